@@ -1,3 +1,8 @@
 #!/bin/bash
 glslc -c --target-env=vulkan vertex.vert -o vertex.spv
-glslc -c --target-env=vulkan fragment.frag -o fragment.spv
\ No newline at end of file
+glslc -c --target-env=vulkan fragment.frag -o fragment.spv
+glslc -c --target-env=vulkan1.2 material.frag -o material.spv
+glslc -c --target-env=vulkan cull.comp -o cull.spv
+glslc -c --target-env=vulkan1.3 meshlet.task -o meshlet.task.spv
+glslc -c --target-env=vulkan1.3 meshlet.mesh -o meshlet.mesh.spv
+glslc -c --target-env=vulkan meshletcull.comp -o meshletcull.spv
\ No newline at end of file
@@ -0,0 +1,35 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+// The CVulkanBindlessHeap set, every texture and material indexed by handle.
+struct Material {
+    vec4 baseColor;
+    uint baseColorTexture;
+    float roughness;
+    float metallic;
+    uint padding;
+};
+
+layout(set = 1, binding = 0) uniform texture2D textures[];
+layout(std430, set = 1, binding = 1) readonly buffer Materials { Material materials[]; };
+layout(set = 1, binding = 2) uniform sampler textureSampler;
+
+const uint NO_TEXTURE = 0xFFFFFFFFu;
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragUV;
+layout(location = 2) flat in uint fragMaterial;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    Material material = materials[fragMaterial];
+    vec4 color = vec4(fragColor, 1.0) * material.baseColor;
+    // Neighbouring fragments may belong to different draws, so the index is not uniform.
+    if(material.baseColorTexture != NO_TEXTURE) {
+        color *= texture(sampler2D(textures[nonuniformEXT(material.baseColorTexture)], textureSampler), fragUV);
+    }
+    outColor = color;
+}
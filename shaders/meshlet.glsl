@@ -0,0 +1,54 @@
+// Shared by shaders/meshlet.task, shaders/meshlet.mesh and shaders/meshletcull.comp. Every entry of meshletDraws is one
+// meshlet of one object, the objects' meshlets one after another.
+
+struct Meshlet {
+    vec4 boundingSphere;
+    vec4 cone;
+    uint firstVertex;
+    uint firstTriangle;
+    uint vertexCount;
+    uint triangleCount;
+};
+
+layout(std430, binding = 0) readonly buffer Transforms { mat4 transforms[]; };
+layout(std430, binding = 1) readonly buffer MeshletDraws { uvec2 meshletDraws[]; }; // Object and meshlet.
+layout(std430, binding = 2) readonly buffer Meshlets { Meshlet meshlets[]; };
+layout(std430, binding = 3) readonly buffer MeshletVertices { uint meshletVertices[]; };
+layout(std430, binding = 4) readonly buffer MeshletTriangles { uint meshletTriangles[]; };
+layout(std430, binding = 5) readonly buffer Vertices { uint vertexData[]; }; // Encoded with CVulkanVertexLayout::Compact().
+
+layout(push_constant) uniform MeshletConstants {
+    vec4 frustumPlanes[6];
+    vec4 camera; // Position with w = 1, or the view direction of an orthographic projection with w = 0.
+    uint drawCount;
+};
+
+// Flattens dispatches split into rows of at most 65535 workgroups.
+uint GetWorkGroupIndex() {
+    return gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+}
+
+bool IsMeshletVisible(uint draw) {
+    uvec2 objectMeshlet = meshletDraws[draw];
+    Meshlet meshlet = meshlets[objectMeshlet.y];
+    mat4 transform = transforms[objectMeshlet.x];
+    vec3 center = (transform * vec4(meshlet.boundingSphere.xyz, 1.0)).xyz;
+    float scale = sqrt(max(max(dot(transform[0].xyz, transform[0].xyz), dot(transform[1].xyz, transform[1].xyz)), dot(transform[2].xyz, transform[2].xyz)));
+    float radius = meshlet.boundingSphere.w * scale;
+    for(int i = 0; i < 6; i++) {
+        if(dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w < -radius) {
+            return false;
+        }
+    }
+
+    // Every triangle faces away when the view direction is within the cone around its axis.
+    if(meshlet.cone.w < 1.0) {
+        vec3 axis = normalize(mat3(transform) * meshlet.cone.xyz);
+        if(camera.w == 0.0) {
+            return dot(camera.xyz, axis) < meshlet.cone.w;
+        }
+        vec3 view = center - camera.xyz;
+        return dot(view, axis) < meshlet.cone.w * length(view) + radius;
+    }
+    return true;
+}
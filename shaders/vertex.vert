@@ -2,12 +2,24 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
-layout(location = 0) in vec2 inPosition;
+layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
+layout(location = 2) in uint inObject; // Index into transforms, see CVulkanInstance.
+layout(location = 3) in uint inMaterial; // Index into the materials of shaders/material.frag.
+layout(location = 7) in vec2 inUV;
+
+layout(set = 0, binding = 0) uniform Camera {
+    mat4 viewProjection;
+};
+layout(std430, set = 0, binding = 1) readonly buffer Transforms { mat4 transforms[]; };
 
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragUV;
+layout(location = 2) flat out uint fragMaterial;
 
 void main() {
-    gl_Position = vec4(inPosition, 0.0, 1.0);
+    gl_Position = viewProjection * transforms[inObject] * vec4(inPosition, 1.0);
     fragColor = inColor;
+    fragUV = inUV;
+    fragMaterial = inMaterial;
 }
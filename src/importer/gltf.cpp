@@ -1,10 +1,144 @@
 #include "gltf.hpp"
 
+#include <cstdio>
+#include "tinygltf/tiny_gltf.h"
+
 #include "vulkan/buffer.hpp"
 #include "vulkan/mesh.hpp"
 #include "vulkan/types.hpp"
 
+// Start of the accessor's elements and the distance between them. Returns nullptr for sparse only accessors without a
+// buffer view and for elements that do not fit in their buffer.
+static const uint8_t* GetAccessorData(const tinygltf::Model& model, const tinygltf::Accessor& accessor, size_t& stride)
+{
+    if(accessor.bufferView < 0 || accessor.bufferView >= static_cast<int>(model.bufferViews.size())) {
+        return nullptr;
+    }
+    const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+    if(bufferView.buffer < 0 || bufferView.buffer >= static_cast<int>(model.buffers.size())) {
+        return nullptr;
+    }
+    const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+    int byteStride = accessor.ByteStride(bufferView);
+    int componentSize = tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(accessor.componentType));
+    int componentCount = tinygltf::GetNumComponentsInType(static_cast<uint32_t>(accessor.type));
+    if(byteStride <= 0 || componentSize <= 0 || componentCount <= 0) {
+        return nullptr;
+    }
+    stride = static_cast<size_t>(byteStride);
+    size_t elementSize = static_cast<size_t>(componentSize * componentCount);
+    size_t start = bufferView.byteOffset + accessor.byteOffset;
+    if(accessor.count > 0 && start + (accessor.count - 1) * stride + elementSize > buffer.data.size()) {
+        return nullptr;
+    }
+    return buffer.data.data() + start;
+}
+
+// Positions and normals are read as three floats.
+static bool IsFloatVec3(const tinygltf::Accessor& accessor)
+{
+    return accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT && accessor.type == TINYGLTF_TYPE_VEC3;
+}
+
+CGltfImporter::CGltfImporter(std::string path, CVulkanMeshLoader* meshLoader)
+    : path(path), meshLoader(meshLoader) {}
+
 CVulkanMesh CGltfImporter::Load()
 {
-    return CVulkanMesh();
+    tinygltf::Model model;
+    tinygltf::TinyGLTF loader;
+    std::string error;
+    std::string warning;
+    bool binary = path.size() >= 4 && path.compare(path.size() - 4, 4, ".glb") == 0;
+    bool loaded = binary ? loader.LoadBinaryFromFile(&model, &error, &warning, path) : loader.LoadASCIIFromFile(&model, &error, &warning, path);
+    if(!loaded || model.meshes.empty() || model.meshes.front().primitives.empty()) {
+        printf("CGltfImporter::Load: Failed to load %s %s\n", path.c_str(), error.c_str());
+        return CVulkanMesh();
+    }
+
+    const tinygltf::Primitive& primitive = model.meshes.front().primitives.front();
+    auto position = primitive.attributes.find("POSITION");
+    if(position == primitive.attributes.end()) {
+        printf("CGltfImporter::Load: %s has no positions\n", path.c_str());
+        return CVulkanMesh();
+    }
+    const tinygltf::Accessor& positionAccessor = model.accessors[position->second];
+    size_t positionStride = 0;
+    const uint8_t* positionData = IsFloatVec3(positionAccessor) ? GetAccessorData(model, positionAccessor, positionStride) : nullptr;
+    if(positionData == nullptr) {
+        printf("CGltfImporter::Load: %s has positions that are not float vec3 inside a buffer\n", path.c_str());
+        return CVulkanMesh();
+    }
+
+    size_t normalStride = 0;
+    const uint8_t* normalData = nullptr;
+    auto normal = primitive.attributes.find("NORMAL");
+    if(normal != primitive.attributes.end() && IsFloatVec3(model.accessors[normal->second]) && model.accessors[normal->second].count >= positionAccessor.count) {
+        normalData = GetAccessorData(model, model.accessors[normal->second], normalStride);
+    }
+
+    // Only float UVs, normalized integer ones are rare outside of quantized files.
+    size_t uvStride = 0;
+    const uint8_t* uvData = nullptr;
+    auto uv = primitive.attributes.find("TEXCOORD_0");
+    if(uv != primitive.attributes.end() && model.accessors[uv->second].componentType == TINYGLTF_COMPONENT_TYPE_FLOAT &&
+        model.accessors[uv->second].type == TINYGLTF_TYPE_VEC2 && model.accessors[uv->second].count >= positionAccessor.count) {
+        uvData = GetAccessorData(model, model.accessors[uv->second], uvStride);
+    }
+
+    std::vector<CVulkanVertex> vertices(positionAccessor.count);
+    for(size_t i = 0; i < positionAccessor.count; i++) {
+        const float* p = reinterpret_cast<const float*>(positionData + i * positionStride);
+        vertices[i].position = glm::vec3(p[0], p[1], p[2]);
+        vertices[i].color = glm::vec3(1.0f);
+        if(normalData != nullptr) {
+            const float* n = reinterpret_cast<const float*>(normalData + i * normalStride);
+            vertices[i].normal = glm::vec3(n[0], n[1], n[2]);
+            vertices[i].color = vertices[i].normal * 0.5f + 0.5f;
+        }
+        if(uvData != nullptr) {
+            const float* t = reinterpret_cast<const float*>(uvData + i * uvStride);
+            vertices[i].uv = glm::vec2(t[0], t[1]);
+        }
+    }
+
+    // The loader narrows indices to 16 bits again when the mesh is small enough.
+    std::vector<uint32_t> indices;
+    if(primitive.indices >= 0) {
+        const tinygltf::Accessor& indexAccessor = model.accessors[primitive.indices];
+        size_t indexStride = 0;
+        const uint8_t* indexData = GetAccessorData(model, indexAccessor, indexStride);
+        // Triangle lists only, a partial last triangle means the accessor is cut short.
+        bool triangles = indexAccessor.count % 3 == 0 && indexAccessor.type == TINYGLTF_TYPE_SCALAR && (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE ||
+            indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT || indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT);
+        if(indexData == nullptr || !triangles) {
+            printf("CGltfImporter::Load: %s has indices that are not whole triangles of unsigned integers inside a buffer\n", path.c_str());
+            return CVulkanMesh();
+        }
+        indices.resize(indexAccessor.count);
+        for(size_t i = 0; i < indexAccessor.count; i++) {
+            const uint8_t* index = indexData + i * indexStride;
+            switch(indexAccessor.componentType) {
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                indices[i] = *index;
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+                indices[i] = *reinterpret_cast<const uint16_t*>(index);
+                break;
+            default:
+                indices[i] = *reinterpret_cast<const uint32_t*>(index);
+                break;
+            }
+            if(indices[i] >= vertices.size()) {
+                printf("CGltfImporter::Load: %s has an index past its %zu vertices\n", path.c_str(), vertices.size());
+                return CVulkanMesh();
+            }
+        }
+    }
+    // Exporters rarely order triangles and vertices for the GPU.
+    CVulkanMeshLoadOptions options;
+    options.optimize = true;
+    options.lodCount = CVulkanMeshLoader::MAX_LODS;
+    options.meshlets = true;
+    return meshLoader->Load(vertices, indices, options);
 }
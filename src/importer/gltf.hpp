@@ -1,8 +1,17 @@
 #pragma once
 
+#include <string>
 #include "importer.hpp"
 
+class CVulkanMeshLoader;
+
+// Loads the first primitive of the first mesh in a .gltf or .glb file. Normals are also written to the vertex colors
+// as the file has no vertex colors of its own.
 class CGltfImporter : IModelImporter {
+	std::string path;
+	CVulkanMeshLoader* meshLoader;
 public:
+	CGltfImporter(std::string path, CVulkanMeshLoader* meshLoader);
+	// Returns a mesh without vertices if the file cannot be read.
 	CVulkanMesh Load();
 };
\ No newline at end of file
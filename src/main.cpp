@@ -1,10 +1,75 @@
 #define SDL_MAIN_HANDLED
+#include <cstdlib>
+#include <cstring>
 #include "system/window.hpp"
+#include "system/culling.hpp"
+#include "system/threadpool.hpp"
+#include "vulkan/drawqueue.hpp"
+#include "vulkan/image.hpp"
+#include "vulkan/memory.hpp"
+#include "vulkan/vertexformat.hpp"
+#include "vulkan/optimize.hpp"
+#include "vulkan/meshlet.hpp"
+#include "vulkan/graph.hpp"
 #include "vulkan/renderer.hpp"
 
-auto main() -> int {
+auto main(int argc, char* argv[]) -> int {
+    CVulkanRendererOptions options;
+    bool blitTest = false;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--cull-benchmark") == 0) {
+            // Runs without a window, checks the SIMD culling kernels against the scalar one.
+            return CFrustumCuller::RunBenchmark(1000000) ? 0 : 1;
+        } else if(strcmp(argv[i], "--sort-benchmark") == 0) {
+            // Runs without a window, checks the radix sort of draw packets against std::stable_sort.
+            return CVulkanDrawQueue::RunBenchmark(1000000) ? 0 : 1;
+        } else if(strcmp(argv[i], "--recording-benchmark") == 0) {
+            // Runs without a window, splits recording of stand-in draws across 1 to all hardware threads and prints the speedup.
+            return CThreadPool::RunBenchmark(1000000) ? 0 : 1;
+        } else if(strcmp(argv[i], "--memory-benchmark") == 0) {
+            // Runs without a window, checks the TLSF free lists, splits and coalescing of a block after every allocation and free.
+            return CVulkanMemoryBlock::RunBenchmark(100000) ? 0 : 1;
+        } else if(strcmp(argv[i], "--downsample-test") == 0) {
+            // Runs without a window, checks the CPU box filtered mip levels of odd and even sizes against a reference.
+            return CVulkanImageLoader::RunDownsampleTest() ? 0 : 1;
+        } else if(strcmp(argv[i], "--blit-test") == 0) {
+            // Opens a window for the device, checks mip levels blitted on the GPU against the CPU box filter and exits.
+            blitTest = true;
+        } else if(strcmp(argv[i], "--vertex-format-test") == 0) {
+            // Runs without a window, checks the error of every compact vertex encoding against its bound.
+            return CVulkanVertexLayout::RunErrorTest(1000000) ? 0 : 1;
+        } else if(strcmp(argv[i], "--mesh-optimizer-benchmark") == 0) {
+            // Runs without a window, optimizes meshes of 1k to 10M triangles and prints the cache statistics.
+            return CVulkanMeshOptimizer::RunBenchmark() ? 0 : 1;
+        } else if(strcmp(argv[i], "--lod-benchmark") == 0) {
+            // Runs without a window, simplifies spheres into LODs and checks their triangles and enclosed volume.
+            return CVulkanMeshOptimizer::RunLodBenchmark() ? 0 : 1;
+        } else if(strcmp(argv[i], "--graph-test") == 0) {
+            // Runs without a window, compiles a deferred shading graph and checks its pass order and transient memory aliasing.
+            return CVulkanRenderGraph::RunAliasingTest() ? 0 : 1;
+        } else if(strcmp(argv[i], "--benchmark") == 0) {
+            options.benchmarkScene = true;
+        } else if(strcmp(argv[i], "--gpu-driven") == 0) {
+            options.gpuDriven = true;
+        } else if(strcmp(argv[i], "--mesh-shading") == 0) {
+            options.meshShading = true;
+        } else if(strcmp(argv[i], "--meshlet-benchmark") == 0) {
+            // Runs without a window, checks the meshlets and their bounds built from grids and spheres of 1k to 1M triangles.
+            return CVulkanMeshletBuilder::RunBenchmark() ? 0 : 1;
+        } else if(strcmp(argv[i], "--recording-threads") == 0 && i + 1 < argc) {
+            // With --benchmark, compare the recording time the frame timer prints at 1 thread and at every core.
+            options.recordingThreads = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if(strcmp(argv[i], "--no-lods") == 0) {
+            // Compare the triangles per frame the frame timer prints with and without.
+            options.lods = false;
+        }
+    }
+
     CSDLWindow window(1024, 768);
-    CVulkanRenderer renderer(&window);
+    CVulkanRenderer renderer(&window, options);
+    if(blitTest) {
+        return renderer.RunBlitTest() ? 0 : 1;
+    }
 
     while(window.IsRunning()) {
         window.PollEvents();
@@ -0,0 +1,305 @@
+#include "culling.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CULLING_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CULLING_TARGET_AVX2
+#else
+#include <cpuid.h>
+// GCC and Clang only emit AVX2 in functions that ask for it, MSVC emits whatever intrinsics are used.
+#define CULLING_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+CFrustum CFrustum::FromViewProjection(glm::mat4 viewProjection) {
+    glm::vec4 rows[4];
+    for(int row = 0; row < 4; row++) {
+        rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+    }
+    CFrustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];
+    frustum.planes[1] = rows[3] - rows[0];
+    frustum.planes[2] = rows[3] + rows[1];
+    frustum.planes[3] = rows[3] - rows[1];
+    frustum.planes[4] = rows[2];
+    frustum.planes[5] = rows[3] - rows[2];
+    for(auto& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+CBoundingSphereArray::CBoundingSphereArray() : count(0) {}
+
+void CBoundingSphereArray::Resize(size_t count) {
+    this->count = count;
+    size_t paddedCount = GetPaddedCount();
+    x.resize(paddedCount, 0.0f);
+    y.resize(paddedCount, 0.0f);
+    z.resize(paddedCount, 0.0f);
+    radius.resize(paddedCount, 0.0f);
+    // Padding never passes the plane test, whatever the frustum.
+    std::fill(radius.begin() + count, radius.end(), -FLT_MAX);
+}
+
+void CBoundingSphereArray::Set(size_t index, glm::vec4 sphere) {
+    x[index] = sphere.x;
+    y[index] = sphere.y;
+    z[index] = sphere.z;
+    radius[index] = sphere.w;
+}
+
+void CBoundingSphereArray::SetTransformed(size_t index, glm::vec4 sphere, const glm::mat4& transform) {
+    glm::vec4 center = transform * glm::vec4(sphere.x, sphere.y, sphere.z, 1.0f);
+    float scale = std::sqrt(std::max({ glm::dot(glm::vec3(transform[0]), glm::vec3(transform[0])),
+        glm::dot(glm::vec3(transform[1]), glm::vec3(transform[1])), glm::dot(glm::vec3(transform[2]), glm::vec3(transform[2])) }));
+    Set(index, glm::vec4(center.x, center.y, center.z, sphere.w * scale));
+}
+
+glm::vec4 CBoundingSphereArray::Get(size_t index) const {
+    return glm::vec4(x[index], y[index], z[index], radius[index]);
+}
+
+size_t CBoundingSphereArray::GetCount() const {
+    return count;
+}
+
+size_t CBoundingSphereArray::GetPaddedCount() const {
+    return (count + PADDING - 1) / PADDING * PADDING;
+}
+
+const float* CBoundingSphereArray::GetX() const {
+    return x.data();
+}
+
+const float* CBoundingSphereArray::GetY() const {
+    return y.data();
+}
+
+const float* CBoundingSphereArray::GetZ() const {
+    return z.data();
+}
+
+const float* CBoundingSphereArray::GetRadius() const {
+    return radius.data();
+}
+
+static size_t CullScalar(const CFrustum& frustum, const CBoundingSphereArray& spheres, uint32_t* visibleIndices) {
+    const float* x = spheres.GetX();
+    const float* y = spheres.GetY();
+    const float* z = spheres.GetZ();
+    const float* radius = spheres.GetRadius();
+    size_t visibleCount = 0;
+    for(size_t i = 0; i < spheres.GetCount(); i++) {
+        bool visible = true;
+        for(auto& plane : frustum.planes) {
+            float distance = ((plane.x * x[i] + plane.y * y[i]) + plane.z * z[i]) + plane.w;
+            visible = visible && distance >= -radius[i];
+        }
+        if(visible) {
+            visibleIndices[visibleCount++] = static_cast<uint32_t>(i);
+        }
+    }
+    return visibleCount;
+}
+
+#ifdef CULLING_X86
+static uint32_t CountTrailingZeros(uint32_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// Appends the lanes set in mask, dropping the ones at or past count.
+static size_t AppendVisible(uint32_t mask, size_t first, size_t lanes, size_t count, uint32_t* visibleIndices, size_t visibleCount) {
+    if(first + lanes > count) {
+        mask &= (1u << (count - first)) - 1;
+    }
+    while(mask != 0) {
+        visibleIndices[visibleCount++] = static_cast<uint32_t>(first + CountTrailingZeros(mask));
+        mask &= mask - 1;
+    }
+    return visibleCount;
+}
+
+static size_t CullSSE(const CFrustum& frustum, const CBoundingSphereArray& spheres, uint32_t* visibleIndices) {
+    __m128 planes[6][4];
+    for(int i = 0; i < 6; i++) {
+        for(int component = 0; component < 4; component++) {
+            planes[i][component] = _mm_set1_ps(frustum.planes[i][component]);
+        }
+    }
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    size_t count = spheres.GetCount();
+    size_t visibleCount = 0;
+    for(size_t i = 0; i < count; i += 4) {
+        __m128 x = _mm_loadu_ps(spheres.GetX() + i);
+        __m128 y = _mm_loadu_ps(spheres.GetY() + i);
+        __m128 z = _mm_loadu_ps(spheres.GetZ() + i);
+        __m128 negativeRadius = _mm_xor_ps(_mm_loadu_ps(spheres.GetRadius() + i), signMask);
+        __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(int plane = 0; plane < 6; plane++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(planes[plane][0], x), _mm_mul_ps(planes[plane][1], y)),
+                _mm_mul_ps(planes[plane][2], z)), planes[plane][3]);
+            visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, negativeRadius));
+        }
+        visibleCount = AppendVisible(static_cast<uint32_t>(_mm_movemask_ps(visible)), i, 4, count, visibleIndices, visibleCount);
+    }
+    return visibleCount;
+}
+
+CULLING_TARGET_AVX2 static size_t CullAVX2(const CFrustum& frustum, const CBoundingSphereArray& spheres, uint32_t* visibleIndices) {
+    __m256 planes[6][4];
+    for(int i = 0; i < 6; i++) {
+        for(int component = 0; component < 4; component++) {
+            planes[i][component] = _mm256_set1_ps(frustum.planes[i][component]);
+        }
+    }
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    size_t count = spheres.GetCount();
+    size_t visibleCount = 0;
+    for(size_t i = 0; i < count; i += 8) {
+        __m256 x = _mm256_loadu_ps(spheres.GetX() + i);
+        __m256 y = _mm256_loadu_ps(spheres.GetY() + i);
+        __m256 z = _mm256_loadu_ps(spheres.GetZ() + i);
+        __m256 negativeRadius = _mm256_xor_ps(_mm256_loadu_ps(spheres.GetRadius() + i), signMask);
+        __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(int plane = 0; plane < 6; plane++) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planes[plane][0], x), _mm256_mul_ps(planes[plane][1], y)),
+                _mm256_mul_ps(planes[plane][2], z)), planes[plane][3]);
+            visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+        }
+        visibleCount = AppendVisible(static_cast<uint32_t>(_mm256_movemask_ps(visible)), i, 8, count, visibleIndices, visibleCount);
+    }
+    return visibleCount;
+}
+
+static void Cpuid(uint32_t leaf, uint32_t registers[4]) {
+#if defined(_MSC_VER)
+    int values[4];
+    __cpuidex(values, static_cast<int>(leaf), 0);
+    for(int i = 0; i < 4; i++) {
+        registers[i] = static_cast<uint32_t>(values[i]);
+    }
+#else
+    __cpuid_count(leaf, 0, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// XCR0, which says whether the OS saves the YMM registers on context switches.
+static uint64_t ReadExtendedControlRegister() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax;
+    uint32_t edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+CFrustumCuller::CFrustumCuller() : kernel(CULL_KERNEL_SCALAR) {
+    if(IsKernelSupported(CULL_KERNEL_AVX2)) {
+        kernel = CULL_KERNEL_AVX2;
+    } else if(IsKernelSupported(CULL_KERNEL_SSE)) {
+        kernel = CULL_KERNEL_SSE;
+    }
+}
+
+CFrustumCuller::CFrustumCuller(CCullKernel kernel) : kernel(kernel) {}
+
+bool CFrustumCuller::IsKernelSupported(CCullKernel kernel) {
+    if(kernel == CULL_KERNEL_SCALAR) {
+        return true;
+    }
+#ifdef CULLING_X86
+    uint32_t registers[4];
+    Cpuid(0, registers);
+    uint32_t maxLeaf = registers[0];
+    Cpuid(1, registers);
+    if(kernel == CULL_KERNEL_SSE) {
+        return (registers[3] & (1u << 26)) != 0; // SSE2, for the integer casts.
+    }
+    bool osSavesYmm = (registers[2] & (1u << 27)) != 0 && (ReadExtendedControlRegister() & 0x6) == 0x6;
+    if(!osSavesYmm || (registers[2] & (1u << 28)) == 0 || maxLeaf < 7) {
+        return false;
+    }
+    Cpuid(7, registers);
+    return (registers[1] & (1u << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+CCullKernel CFrustumCuller::GetKernel() {
+    return kernel;
+}
+
+size_t CFrustumCuller::Cull(const CFrustum& frustum, const CBoundingSphereArray& spheres, uint32_t* visibleIndices) {
+    switch(kernel) {
+#ifdef CULLING_X86
+    case CULL_KERNEL_SSE:
+        return CullSSE(frustum, spheres, visibleIndices);
+    case CULL_KERNEL_AVX2:
+        return CullAVX2(frustum, spheres, visibleIndices);
+#endif
+    default:
+        return CullScalar(frustum, spheres, visibleIndices);
+    }
+}
+
+bool CFrustumCuller::RunBenchmark(size_t count) {
+    // Spheres scattered around a perspective frustum, so that every plane rejects some of them.
+    CFrustum frustum = CFrustum::FromViewProjection(glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f));
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> horizontal(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> depth(-120.0f, 10.0f);
+    std::uniform_real_distribution<float> radius(0.0f, 2.0f);
+    CBoundingSphereArray spheres;
+    spheres.Resize(count);
+    for(size_t i = 0; i < count; i++) {
+        spheres.Set(i, glm::vec4(horizontal(random), horizontal(random), depth(random), radius(random)));
+    }
+
+    const char* names[] = { "scalar", "SSE", "AVX2" };
+    const int runs = 10;
+    std::vector<uint32_t> expected(count);
+    size_t expectedCount = CullScalar(frustum, spheres, expected.data());
+    std::vector<uint32_t> visibleIndices(count);
+    bool matches = true;
+    for(CCullKernel kernel : { CULL_KERNEL_SCALAR, CULL_KERNEL_SSE, CULL_KERNEL_AVX2 }) {
+        if(!IsKernelSupported(kernel)) {
+            printf("CFrustumCuller::RunBenchmark: %s is not supported\n", names[kernel]);
+            continue;
+        }
+        CFrustumCuller culler(kernel);
+        double bestMs = DBL_MAX;
+        size_t visibleCount = 0;
+        for(int run = 0; run < runs; run++) {
+            auto start = std::chrono::steady_clock::now();
+            visibleCount = culler.Cull(frustum, spheres, visibleIndices.data());
+            auto end = std::chrono::steady_clock::now();
+            bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        bool kernelMatches = visibleCount == expectedCount && std::equal(expected.begin(), expected.begin() + expectedCount, visibleIndices.begin());
+        matches = matches && kernelMatches;
+        printf("CFrustumCuller::RunBenchmark: %s culled %zu spheres in %.3f ms, %zu visible, %s the scalar kernel\n", names[kernel], count, bestMs,
+            visibleCount, kernelMatches ? "matches" : "DIFFERS FROM");
+    }
+    return matches;
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Planes bounding a view frustum. Normals point inside and are normalized, so plane distances compare with radii.
+struct CFrustum {
+    glm::vec4 planes[6];
+
+    // Planes of the clip space volume of viewProjection, with Vulkan's depth range of [0, w].
+    static CFrustum FromViewProjection(glm::mat4 viewProjection);
+};
+
+enum CCullKernel {
+    CULL_KERNEL_SCALAR,
+    CULL_KERNEL_SSE, // 4 spheres per instruction.
+    CULL_KERNEL_AVX2 // 8 spheres per instruction.
+};
+
+// Bounding spheres stored as one array per component, so the SIMD kernels load 4 or 8 of a component with one
+// instruction. The arrays are padded to a multiple of 8 with spheres that are never visible.
+class CBoundingSphereArray {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> radius;
+    size_t count;
+public:
+    static constexpr size_t PADDING = 8;
+
+    CBoundingSphereArray();
+    void Resize(size_t count);
+    // Center in xyz, radius in w.
+    void Set(size_t index, glm::vec4 sphere);
+    // Sets the bounds of sphere after transform, the radius grows with the largest scale of transform.
+    void SetTransformed(size_t index, glm::vec4 sphere, const glm::mat4& transform);
+    glm::vec4 Get(size_t index) const;
+    size_t GetCount() const;
+    size_t GetPaddedCount() const;
+    const float* GetX() const;
+    const float* GetY() const;
+    const float* GetZ() const;
+    const float* GetRadius() const;
+};
+
+// Frustum culling of bounding spheres. Every kernel evaluates the plane distances in the same order, so they agree
+// bit for bit with the scalar one.
+class CFrustumCuller {
+    CCullKernel kernel;
+public:
+    // Picks the widest kernel the CPU and OS support.
+    CFrustumCuller();
+    CFrustumCuller(CCullKernel kernel);
+    static bool IsKernelSupported(CCullKernel kernel);
+    CCullKernel GetKernel();
+    // Writes the indices of the spheres at least partially inside frustum to visibleIndices in ascending order and returns
+    // how many there are. visibleIndices must hold spheres.GetCount() entries.
+    size_t Cull(const CFrustum& frustum, const CBoundingSphereArray& spheres, uint32_t* visibleIndices);
+    // Culls count random spheres with every supported kernel, checks them against the scalar kernel and prints the timings.
+    // Returns false if a kernel disagrees.
+    static bool RunBenchmark(size_t count);
+};
\ No newline at end of file
@@ -0,0 +1,269 @@
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <tuple>
+
+static thread_local uint32_t currentWorkerIndex = CThreadPool::NOT_A_WORKER;
+
+CThreadPool::CThreadPool(uint32_t threadCount) : queuedCount(0), nextWorker(0), stopping(false) {
+    if(threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    for(uint32_t i = 0; i < threadCount; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for(uint32_t i = 0; i < threadCount; i++) {
+        threads.emplace_back(&CThreadPool::WorkerLoop, this, i);
+    }
+}
+
+CThreadPool::~CThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for(auto& thread : threads) {
+        thread.join();
+    }
+}
+
+std::future<void> CThreadPool::Submit(std::function<void()> task) {
+    auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+    std::future<void> future = packaged->get_future();
+    // Tasks submitted from a worker stay on it, they likely touch the same data as the task that made them.
+    uint32_t workerIndex = currentWorkerIndex != NOT_A_WORKER ? currentWorkerIndex : nextWorker++ % GetThreadCount();
+    Push(workerIndex, [packaged]() { (*packaged)(); });
+    return future;
+}
+
+void CThreadPool::ParallelFor(size_t count, std::function<void(size_t)> body) {
+    if(count == 0) {
+        return;
+    }
+
+    std::mutex doneMutex;
+    std::condition_variable done;
+    size_t remaining = count;
+    std::exception_ptr exception;
+
+    // Contiguous runs of indices per worker, stealing evens things out when some indices take longer than others.
+    uint32_t threadCount = GetThreadCount();
+    for(size_t i = 0; i < count; i++) {
+        uint32_t workerIndex = static_cast<uint32_t>(i * threadCount / count);
+        Push(workerIndex, [&, i]() {
+            std::exception_ptr taskException;
+            try {
+                body(i);
+            } catch(...) {
+                taskException = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if(taskException && !exception) {
+                exception = taskException;
+            }
+            if(--remaining == 0) {
+                done.notify_one();
+            }
+        });
+    }
+
+    // A worker calling in runs queued tasks while it waits, otherwise a ParallelFor from inside a task deadlocks once every
+    // worker waits on indices queued behind it. Other threads only wait, bodies may index per worker resources.
+    uint32_t callerIndex = currentWorkerIndex;
+    if(callerIndex != NOT_A_WORKER) {
+        std::function<void()> task;
+        while(true) {
+            {
+                std::lock_guard<std::mutex> lock(doneMutex);
+                if(remaining == 0) {
+                    break;
+                }
+            }
+            if(!TryPop(callerIndex, task)) {
+                break;
+            }
+            task();
+        }
+    }
+
+    // Indices still running are on threads that will finish them, helping the same way if they wait themselves.
+    std::unique_lock<std::mutex> lock(doneMutex);
+    done.wait(lock, [&]() { return remaining == 0; });
+    if(exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+bool CThreadPool::RunBenchmark(size_t drawCount) {
+    // Stand-in for a draw: pipeline and mesh binds are only written when they change, as CVulkanCommandBuffer::Draw()
+    // skips redundant binds, followed by the transformed bounds of the batch and the draw itself.
+    struct Draw {
+        uint32_t pipeline;
+        uint32_t mesh;
+        uint32_t indexCount;
+        uint32_t instanceCount;
+        float transform[16];
+    };
+    auto record = [](const std::vector<Draw>& draws, size_t first, size_t last, std::vector<uint32_t>& stream) {
+        stream.clear();
+        uint32_t pipeline = ~0u;
+        uint32_t mesh = ~0u;
+        for(size_t i = first; i < last; i++) {
+            const Draw& draw = draws[i];
+            if(draw.pipeline != pipeline) {
+                pipeline = draw.pipeline;
+                stream.insert(stream.end(), { 1u, pipeline });
+            }
+            if(draw.mesh != mesh) {
+                mesh = draw.mesh;
+                stream.insert(stream.end(), { 2u, mesh });
+            }
+            for(int row = 0; row < 4; row++) {
+                float sum = 0.0f;
+                for(int column = 0; column < 4; column++) {
+                    sum += draw.transform[row * 4 + column] * draw.transform[column * 4 + row];
+                }
+                uint32_t bits;
+                memcpy(&bits, &sum, sizeof(bits));
+                stream.push_back(bits);
+            }
+            stream.insert(stream.end(), { 3u, draw.indexCount, draw.instanceCount });
+        }
+    };
+
+    // Sorted by pipeline and mesh like the draw queue hands them out.
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<uint32_t> pipeline(0, 7);
+    std::uniform_int_distribution<uint32_t> mesh(0, 4095);
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    std::vector<Draw> draws(drawCount);
+    for(auto& draw : draws) {
+        draw.pipeline = pipeline(random);
+        draw.mesh = mesh(random);
+        draw.indexCount = 36 + mesh(random);
+        draw.instanceCount = 1 + pipeline(random);
+        for(auto& element : draw.transform) {
+            element = value(random);
+        }
+    }
+    std::sort(draws.begin(), draws.end(), [](const Draw& a, const Draw& b) { return std::tie(a.pipeline, a.mesh) < std::tie(b.pipeline, b.mesh); });
+
+    // Split into ranges the way CVulkanMeshRenderer::Draw() splits its secondary command buffers.
+    const size_t minDrawsPerRecording = 256;
+    const size_t recordingsPerThread = 4;
+    bool passed = true;
+    double singleThreadMs = 0.0;
+    uint32_t maxThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    for(uint32_t threadCount = 1; ; threadCount = std::min(threadCount * 2, maxThreadCount)) {
+        CThreadPool pool(threadCount);
+        size_t recordingCount = std::clamp<size_t>((drawCount + minDrawsPerRecording - 1) / minDrawsPerRecording, 1, threadCount * recordingsPerThread);
+        std::vector<std::vector<uint32_t>> streams(recordingCount);
+        double bestMs = 0.0;
+        for(int run = 0; run < 5; run++) {
+            auto start = std::chrono::steady_clock::now();
+            pool.ParallelFor(recordingCount, [&](size_t recording) {
+                record(draws, drawCount * recording / recordingCount, drawCount * (recording + 1) / recordingCount, streams[recording]);
+            });
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            bestMs = run == 0 ? ms : std::min(bestMs, ms);
+        }
+        if(threadCount == 1) {
+            singleThreadMs = bestMs;
+        }
+
+        bool matches = true;
+        std::vector<uint32_t> expected;
+        for(size_t recording = 0; recording < recordingCount; recording++) {
+            record(draws, drawCount * recording / recordingCount, drawCount * (recording + 1) / recordingCount, expected);
+            matches = matches && expected == streams[recording];
+        }
+        passed = passed && matches;
+        printf("CThreadPool::RunBenchmark: %u threads recorded %zu draws in %zu ranges in %.3f ms, %.2fx of one thread, %s\n", threadCount, drawCount,
+            recordingCount, bestMs, singleThreadMs / bestMs, matches ? "streams match" : "STREAMS DIFFER");
+        if(threadCount == maxThreadCount) {
+            break;
+        }
+    }
+
+    // Every worker blocks in an inner ParallelFor whose indices are queued behind it, which only finishes if they help.
+    CThreadPool pool(maxThreadCount);
+    std::atomic<size_t> innerCount(0);
+    size_t outerCount = maxThreadCount * 2;
+    size_t innerPerOuter = 64;
+    pool.ParallelFor(outerCount, [&](size_t) {
+        pool.ParallelFor(innerPerOuter, [&](size_t) {
+            innerCount++;
+        });
+    });
+    bool nested = innerCount == outerCount * innerPerOuter;
+    passed = passed && nested;
+    printf("CThreadPool::RunBenchmark: ParallelFor nested in %zu tasks on %u threads ran %zu of %zu bodies, %s\n", outerCount, maxThreadCount,
+        innerCount.load(), outerCount * innerPerOuter, nested ? "passed" : "FAILED");
+    return passed;
+}
+
+uint32_t CThreadPool::GetThreadCount() {
+    // workers is complete before the first thread starts, threads is still growing while they run.
+    return static_cast<uint32_t>(workers.size());
+}
+
+uint32_t CThreadPool::GetCurrentWorkerIndex() {
+    return currentWorkerIndex;
+}
+
+void CThreadPool::Push(uint32_t workerIndex, std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(workers[workerIndex]->mutex);
+        workers[workerIndex]->tasks.push_back(std::move(task));
+    }
+    {
+        // Taken so a worker cannot check queuedCount and go to sleep between the increment and the notify.
+        std::lock_guard<std::mutex> lock(mutex);
+        queuedCount++;
+    }
+    condition.notify_one();
+}
+
+bool CThreadPool::TryPop(uint32_t workerIndex, std::function<void()>& task) {
+    uint32_t threadCount = GetThreadCount();
+    for(uint32_t i = 0; i < threadCount; i++) {
+        Worker& worker = *workers[(workerIndex + i) % threadCount];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if(worker.tasks.empty()) {
+            continue;
+        }
+        if(i == 0) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+        } else {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+        queuedCount--;
+        return true;
+    }
+    return false;
+}
+
+void CThreadPool::WorkerLoop(uint32_t workerIndex) {
+    currentWorkerIndex = workerIndex;
+    while(true) {
+        std::function<void()> task;
+        if(TryPop(workerIndex, task)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this]() { return stopping || queuedCount > 0; });
+        if(stopping && queuedCount == 0) {
+            return;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker threads with a task deque each. Workers pop their own newest task first and steal the oldest task of
+// another worker when they run out, so uneven tasks still keep every thread busy.
+class CThreadPool {
+    struct Worker {
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::mutex mutex; // Guards sleeping and waking, not the deques.
+    std::condition_variable condition;
+    std::atomic<uint64_t> queuedCount;
+    std::atomic<uint32_t> nextWorker;
+    bool stopping;
+public:
+    static constexpr uint32_t NOT_A_WORKER = ~0u;
+
+    // A threadCount of 0 uses one thread per hardware thread.
+    CThreadPool(uint32_t threadCount = 0);
+    ~CThreadPool();
+    std::future<void> Submit(std::function<void()> task);
+    // Runs body(i) for every i in [0, count) across the pool and blocks until all are done, rethrowing the first exception.
+    // Called from a task, the worker runs queued tasks until its indices are taken instead of only waiting on them.
+    void ParallelFor(size_t count, std::function<void(size_t)> body);
+    uint32_t GetThreadCount();
+    // Records drawCount stand-in draws into command streams split like the secondary command buffers of the mesh renderer,
+    // with 1, 2, 4 and up to one thread per hardware thread, and prints the time and speedup of each. Returns false if
+    // a stream differs from one recorded on the calling thread or a ParallelFor nested in every worker does not finish.
+    static bool RunBenchmark(size_t drawCount);
+    // Index of the worker running the calling thread in [0, GetThreadCount()), or NOT_A_WORKER. Lets tasks use per thread resources.
+    static uint32_t GetCurrentWorkerIndex();
+private:
+    void Push(uint32_t workerIndex, std::function<void()> task);
+    bool TryPop(uint32_t workerIndex, std::function<void()>& task);
+    void WorkerLoop(uint32_t workerIndex);
+};
\ No newline at end of file
@@ -0,0 +1,289 @@
+#include "barrier.hpp"
+
+#include <algorithm>
+#include "cmd.hpp"
+
+// Accesses that make memory unavailable to other stages until a barrier makes them visible.
+static const vk::AccessFlags2 WRITE_ACCESS = vk::AccessFlagBits2::eShaderWrite | vk::AccessFlagBits2::eShaderStorageWrite |
+    vk::AccessFlagBits2::eColorAttachmentWrite | vk::AccessFlagBits2::eDepthStencilAttachmentWrite | vk::AccessFlagBits2::eTransferWrite |
+    vk::AccessFlagBits2::eHostWrite | vk::AccessFlagBits2::eMemoryWrite;
+
+CVulkanBarrierTracker::CVulkanBarrierTracker() : memoryBarrierPending(false) {}
+
+void CVulkanBarrierTracker::UseImage(vk::Image image, vk::ImageLayout layout, vk::PipelineStageFlags2 stage, vk::AccessFlags2 access, vk::ImageSubresourceRange range) {
+    ImageState& imageState = GetImageState(image, range);
+    for(uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + range.layerCount; layer++) {
+        for(uint32_t level = range.baseMipLevel; level < range.baseMipLevel + range.levelCount; level++) {
+            CVulkanResourceState& state = imageState.subresources[layer * imageState.levelCount + level];
+            vk::ImageLayout oldLayout = state.layout;
+            vk::PipelineStageFlags2 srcStages;
+            vk::AccessFlags2 srcAccess;
+            if(!Transition(state, layout, stage, access, srcStages, srcAccess)) {
+                statistics.skippedCount++;
+                continue;
+            }
+
+            SubresourceKey key = { image, layer, level };
+            auto pending = pendingImageBarriers.find(key);
+            if(pending != pendingImageBarriers.end()) {
+                // Nothing ran since the pending barrier, so it can go straight to the new layout and wait for both uses.
+                pending->second.dstStageMask |= stage;
+                pending->second.dstAccessMask |= access;
+                pending->second.newLayout = layout;
+                statistics.skippedCount++;
+                continue;
+            }
+            vk::ImageMemoryBarrier2 barrier(srcStages, srcAccess, stage, access, oldLayout, layout,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image, vk::ImageSubresourceRange(imageState.aspectMask, level, 1, layer, 1));
+            pendingImageBarriers.emplace(key, barrier);
+        }
+    }
+}
+
+void CVulkanBarrierTracker::UseBuffer(vk::Buffer buffer, vk::PipelineStageFlags2 stage, vk::AccessFlags2 access) {
+    CVulkanResourceState& state = buffers[buffer];
+    vk::PipelineStageFlags2 srcStages;
+    vk::AccessFlags2 srcAccess;
+    if(!Transition(state, state.layout, stage, access, srcStages, srcAccess)) {
+        statistics.skippedCount++;
+        return;
+    }
+    if(memoryBarrierPending) {
+        statistics.skippedCount++;
+    }
+    pendingMemoryBarrier.srcStageMask |= srcStages;
+    pendingMemoryBarrier.srcAccessMask |= srcAccess;
+    pendingMemoryBarrier.dstStageMask |= stage;
+    pendingMemoryBarrier.dstAccessMask |= access;
+    memoryBarrierPending = true;
+}
+
+void CVulkanBarrierTracker::SetImageState(vk::Image image, CVulkanResourceState state, vk::ImageSubresourceRange range) {
+    ImageState& imageState = GetImageState(image, range);
+    for(uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + range.layerCount; layer++) {
+        for(uint32_t level = range.baseMipLevel; level < range.baseMipLevel + range.levelCount; level++) {
+            imageState.subresources[layer * imageState.levelCount + level] = state;
+        }
+    }
+}
+
+void CVulkanBarrierTracker::SetBufferState(vk::Buffer buffer, CVulkanResourceState state) {
+    buffers[buffer] = state;
+}
+
+void CVulkanBarrierTracker::ReleaseImage(vk::Image image, vk::ImageLayout layout, uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex,
+    vk::ImageSubresourceRange range) {
+    if(srcQueueFamilyIndex == dstQueueFamilyIndex) {
+        srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    }
+    ImageState& imageState = GetImageState(image, range);
+    for(uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + range.layerCount; layer++) {
+        for(uint32_t level = range.baseMipLevel; level < range.baseMipLevel + range.levelCount; level++) {
+            CVulkanResourceState& state = imageState.subresources[layer * imageState.levelCount + level];
+            if(srcQueueFamilyIndex == VK_QUEUE_FAMILY_IGNORED && state.layout == layout) {
+                // Nothing to transfer or transition, the semaphore the other queue waits on makes earlier writes visible.
+                statistics.skippedCount++;
+            } else {
+                // The release has no destination scope, the acquire on the other queue provides it.
+                vk::ImageMemoryBarrier2 barrier(state.writeStages | state.readStages, state.writeAccess, vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone,
+                    state.layout, layout, srcQueueFamilyIndex, dstQueueFamilyIndex, image, vk::ImageSubresourceRange(imageState.aspectMask, level, 1, layer, 1));
+                pendingImageBarriers.insert_or_assign(SubresourceKey { image, layer, level }, barrier);
+            }
+            state = CVulkanResourceState();
+        }
+    }
+    if(range.baseMipLevel == 0 && range.levelCount == imageState.levelCount && range.baseArrayLayer == 0 && range.layerCount == imageState.layerCount) {
+        images.erase(image);
+    }
+}
+
+void CVulkanBarrierTracker::AcquireImage(vk::Image image, vk::ImageLayout oldLayout, vk::ImageLayout layout, uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex,
+    vk::PipelineStageFlags2 stage, vk::AccessFlags2 access, vk::ImageSubresourceRange range) {
+    ImageState& imageState = GetImageState(image, range);
+    for(uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + range.layerCount; layer++) {
+        for(uint32_t level = range.baseMipLevel; level < range.baseMipLevel + range.levelCount; level++) {
+            // Like a transition into layout, already visible to the stage and access it was made for.
+            CVulkanResourceState& state = imageState.subresources[layer * imageState.levelCount + level];
+            state = CVulkanResourceState();
+            state.layout = layout;
+            state.writeStages = stage;
+            state.readStages = stage;
+            state.readAccess = access;
+            if(srcQueueFamilyIndex == dstQueueFamilyIndex) {
+                statistics.skippedCount++; // The release already transitioned it.
+                continue;
+            }
+            vk::ImageMemoryBarrier2 barrier(vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, stage, access, oldLayout, layout,
+                srcQueueFamilyIndex, dstQueueFamilyIndex, image, vk::ImageSubresourceRange(imageState.aspectMask, level, 1, layer, 1));
+            pendingImageBarriers.insert_or_assign(SubresourceKey { image, layer, level }, barrier);
+        }
+    }
+}
+
+void CVulkanBarrierTracker::ReleaseBuffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size, uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex) {
+    auto state = buffers.find(buffer);
+    if(srcQueueFamilyIndex == dstQueueFamilyIndex) {
+        statistics.skippedCount++;
+    } else {
+        vk::PipelineStageFlags2 srcStages = state != buffers.end() ? state->second.writeStages | state->second.readStages : vk::PipelineStageFlagBits2::eAllCommands;
+        vk::AccessFlags2 srcAccess = state != buffers.end() ? state->second.writeAccess : vk::AccessFlagBits2::eMemoryWrite;
+        pendingBufferBarriers.push_back(vk::BufferMemoryBarrier2(srcStages, srcAccess, vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone,
+            srcQueueFamilyIndex, dstQueueFamilyIndex, buffer, offset, size));
+    }
+    if(state != buffers.end()) {
+        buffers.erase(state);
+    }
+}
+
+void CVulkanBarrierTracker::AcquireBuffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size, uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex,
+    vk::PipelineStageFlags2 stage, vk::AccessFlags2 access) {
+    CVulkanResourceState& state = buffers[buffer];
+    state = CVulkanResourceState();
+    state.writeStages = stage;
+    state.readStages = stage;
+    state.readAccess = access;
+    if(srcQueueFamilyIndex == dstQueueFamilyIndex) {
+        statistics.skippedCount++;
+        return;
+    }
+    pendingBufferBarriers.push_back(vk::BufferMemoryBarrier2(vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, stage, access,
+        srcQueueFamilyIndex, dstQueueFamilyIndex, buffer, offset, size));
+}
+
+void CVulkanBarrierTracker::DiscardImage(vk::Image image) {
+    auto imageState = images.find(image);
+    if(imageState == images.end()) {
+        return;
+    }
+    // Stages are kept, the next transition still has to wait for the last uses of the old contents.
+    for(auto& state : imageState->second.subresources) {
+        state.layout = vk::ImageLayout::eUndefined;
+    }
+}
+
+void CVulkanBarrierTracker::RemoveImage(vk::Image image) {
+    images.erase(image);
+}
+
+void CVulkanBarrierTracker::RemoveBuffer(vk::Buffer buffer) {
+    buffers.erase(buffer);
+}
+
+void CVulkanBarrierTracker::Flush(CVulkanCommandBuffer* commandBuffer) {
+    std::vector<vk::ImageMemoryBarrier2> imageBarriers;
+    imageBarriers.reserve(pendingImageBarriers.size());
+    for(auto& [key, barrier] : pendingImageBarriers) {
+        // Pending barriers are sorted by image, layer and level, so a barrier can only extend the one before it.
+        if(!imageBarriers.empty()) {
+            vk::ImageMemoryBarrier2& previous = imageBarriers.back();
+            vk::ImageSubresourceRange& previousRange = previous.subresourceRange;
+            if(previous.image == barrier.image && previousRange.baseArrayLayer == barrier.subresourceRange.baseArrayLayer &&
+                previousRange.baseMipLevel + previousRange.levelCount == barrier.subresourceRange.baseMipLevel &&
+                previous.srcStageMask == barrier.srcStageMask && previous.srcAccessMask == barrier.srcAccessMask &&
+                previous.dstStageMask == barrier.dstStageMask && previous.dstAccessMask == barrier.dstAccessMask &&
+                previous.oldLayout == barrier.oldLayout && previous.newLayout == barrier.newLayout &&
+                previous.srcQueueFamilyIndex == barrier.srcQueueFamilyIndex && previous.dstQueueFamilyIndex == barrier.dstQueueFamilyIndex) {
+                previousRange.levelCount++;
+                continue;
+            }
+        }
+        imageBarriers.push_back(barrier);
+    }
+
+    // Layers covering the same levels in the same way merge into one range as well.
+    std::vector<vk::ImageMemoryBarrier2> mergedBarriers;
+    mergedBarriers.reserve(imageBarriers.size());
+    for(auto& barrier : imageBarriers) {
+        if(!mergedBarriers.empty()) {
+            vk::ImageMemoryBarrier2& previous = mergedBarriers.back();
+            vk::ImageSubresourceRange& previousRange = previous.subresourceRange;
+            if(previous.image == barrier.image && previousRange.baseMipLevel == barrier.subresourceRange.baseMipLevel &&
+                previousRange.levelCount == barrier.subresourceRange.levelCount &&
+                previousRange.baseArrayLayer + previousRange.layerCount == barrier.subresourceRange.baseArrayLayer &&
+                previous.srcStageMask == barrier.srcStageMask && previous.srcAccessMask == barrier.srcAccessMask &&
+                previous.dstStageMask == barrier.dstStageMask && previous.dstAccessMask == barrier.dstAccessMask &&
+                previous.oldLayout == barrier.oldLayout && previous.newLayout == barrier.newLayout &&
+                previous.srcQueueFamilyIndex == barrier.srcQueueFamilyIndex && previous.dstQueueFamilyIndex == barrier.dstQueueFamilyIndex) {
+                previousRange.layerCount++;
+                continue;
+            }
+        }
+        mergedBarriers.push_back(barrier);
+    }
+
+    std::vector<vk::MemoryBarrier2> memoryBarriers;
+    if(memoryBarrierPending) {
+        memoryBarriers.push_back(pendingMemoryBarrier);
+    }
+    if(!memoryBarriers.empty() || !pendingBufferBarriers.empty() || !mergedBarriers.empty()) {
+        commandBuffer->PipelineBarrier2(memoryBarriers, pendingBufferBarriers, mergedBarriers);
+        statistics.barrierCount += static_cast<uint32_t>(memoryBarriers.size() + pendingBufferBarriers.size() + mergedBarriers.size());
+        statistics.batchCount++;
+    }
+
+    pendingImageBarriers.clear();
+    pendingBufferBarriers.clear();
+    pendingMemoryBarrier = vk::MemoryBarrier2();
+    memoryBarrierPending = false;
+}
+
+CVulkanBarrierStatistics CVulkanBarrierTracker::TakeStatistics() {
+    CVulkanBarrierStatistics taken = statistics;
+    statistics = {};
+    return taken;
+}
+
+CVulkanBarrierTracker::ImageState& CVulkanBarrierTracker::GetImageState(vk::Image image, vk::ImageSubresourceRange& range) {
+    ImageState& imageState = images[image];
+    if(imageState.subresources.empty()) {
+        imageState.aspectMask = range.aspectMask;
+    }
+    if(range.levelCount == VK_REMAINING_MIP_LEVELS) {
+        range.levelCount = std::max(imageState.levelCount, range.baseMipLevel + 1) - range.baseMipLevel;
+    }
+    if(range.layerCount == VK_REMAINING_ARRAY_LAYERS) {
+        range.layerCount = std::max(imageState.layerCount, range.baseArrayLayer + 1) - range.baseArrayLayer;
+    }
+
+    // Grow the subresource grid when a range reaches past what has been seen so far.
+    uint32_t levelCount = std::max(imageState.levelCount, range.baseMipLevel + range.levelCount);
+    uint32_t layerCount = std::max(imageState.layerCount, range.baseArrayLayer + range.layerCount);
+    if(levelCount != imageState.levelCount || layerCount != imageState.layerCount) {
+        std::vector<CVulkanResourceState> subresources(levelCount * layerCount);
+        for(uint32_t layer = 0; layer < imageState.layerCount; layer++) {
+            for(uint32_t level = 0; level < imageState.levelCount; level++) {
+                subresources[layer * levelCount + level] = imageState.subresources[layer * imageState.levelCount + level];
+            }
+        }
+        imageState.subresources = std::move(subresources);
+        imageState.levelCount = levelCount;
+        imageState.layerCount = layerCount;
+    }
+    return imageState;
+}
+
+bool CVulkanBarrierTracker::Transition(CVulkanResourceState& state, vk::ImageLayout layout, vk::PipelineStageFlags2 stage, vk::AccessFlags2 access,
+    vk::PipelineStageFlags2& srcStages, vk::AccessFlags2& srcAccess) {
+    vk::AccessFlags2 writeAccess = access & WRITE_ACCESS;
+    if(layout == state.layout && !writeAccess) {
+        // Reads only wait on the last write, and only once per stage and access.
+        bool visible = !state.writeStages || ((state.readStages & stage) == stage && (state.readAccess & access) == access);
+        srcStages = state.writeStages;
+        srcAccess = state.writeAccess;
+        state.readStages |= stage;
+        state.readAccess |= access;
+        return !visible;
+    }
+
+    // Writes and layout transitions wait on the last write and every read since, reads only need an execution dependency.
+    srcStages = state.writeStages | state.readStages;
+    srcAccess = state.writeAccess;
+    state.layout = layout;
+    state.writeStages = stage;
+    state.writeAccess = writeAccess;
+    // A transition into a read-only layout is already visible to the stages it was made for.
+    state.readStages = writeAccess ? vk::PipelineStageFlags2() : stage;
+    state.readAccess = writeAccess ? vk::AccessFlags2() : access;
+    return true;
+}
\ No newline at end of file
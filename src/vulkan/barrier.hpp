@@ -0,0 +1,91 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+class CVulkanCommandBuffer;
+
+// Last synchronized use of an image subresource or buffer.
+struct CVulkanResourceState {
+    vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+    vk::PipelineStageFlags2 writeStages; // Stages of the last write or layout transition.
+    vk::AccessFlags2 writeAccess;
+    vk::PipelineStageFlags2 readStages; // Stages that have waited on that write since.
+    vk::AccessFlags2 readAccess;
+};
+
+// Counts since the last TakeStatistics().
+struct CVulkanBarrierStatistics {
+    uint32_t barrierCount = 0; // Barrier structures recorded.
+    uint32_t batchCount = 0; // vkCmdPipelineBarrier2 calls.
+    uint32_t skippedCount = 0; // Requested uses that needed no barrier of their own.
+};
+
+// Tracks the layout, stages and access of every image subresource and buffer it is told about and turns requested uses
+// into synchronization2 barriers. Uses that are already visible are dropped, barriers requested between two Flush()
+// calls are merged and recorded with a single vkCmdPipelineBarrier2. Assumes command buffers execute in the order they
+// are recorded in, so one tracker serves one queue. Queue family ownership transfers are recorded as a release on the tracker
+// of the queue giving a resource up and an acquire on the tracker of the queue taking it over.
+class CVulkanBarrierTracker {
+    struct ImageState {
+        vk::ImageAspectFlags aspectMask;
+        uint32_t levelCount = 0;
+        uint32_t layerCount = 0;
+        std::vector<CVulkanResourceState> subresources; // Indexed by layer * levelCount + level.
+    };
+    // Key orders pending barriers so that neighbouring levels of one image end up next to each other.
+    struct SubresourceKey {
+        vk::Image image;
+        uint32_t layer;
+        uint32_t level;
+        bool operator<(const SubresourceKey& other) const {
+            return std::tie(image, layer, level) < std::tie(other.image, other.layer, other.level);
+        }
+    };
+
+    std::unordered_map<vk::Image, ImageState> images;
+    std::unordered_map<vk::Buffer, CVulkanResourceState> buffers;
+    std::map<SubresourceKey, vk::ImageMemoryBarrier2> pendingImageBarriers;
+    vk::MemoryBarrier2 pendingMemoryBarrier; // Buffers need no layouts, all of their barriers merge into one.
+    std::vector<vk::BufferMemoryBarrier2> pendingBufferBarriers; // Except ownership transfers, which name their buffer.
+    bool memoryBarrierPending;
+    CVulkanBarrierStatistics statistics;
+public:
+    CVulkanBarrierTracker();
+    // Puts the range of image in layout before stage accesses it with access, waiting on earlier writes and reads.
+    // VK_REMAINING_MIP_LEVELS and VK_REMAINING_ARRAY_LAYERS resolve against the largest range seen for image so far.
+    void UseImage(vk::Image image, vk::ImageLayout layout, vk::PipelineStageFlags2 stage, vk::AccessFlags2 access,
+        vk::ImageSubresourceRange range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+    void UseBuffer(vk::Buffer buffer, vk::PipelineStageFlags2 stage, vk::AccessFlags2 access);
+    // Records the state a range was left in by commands the tracker did not see, e.g. copies or GenerateMipmaps().
+    void SetImageState(vk::Image image, CVulkanResourceState state,
+        vk::ImageSubresourceRange range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+    void SetBufferState(vk::Buffer buffer, CVulkanResourceState state);
+    // Gives the range up to dstQueueFamilyIndex after its last use on this queue, moving it to layout, and forgets it.
+    // The receiving queue records the matching AcquireImage() with the same families and layouts. When both families are
+    // the same only the layout transition is recorded. Neither may share a Flush() with other uses of the range.
+    void ReleaseImage(vk::Image image, vk::ImageLayout layout, uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex,
+        vk::ImageSubresourceRange range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+    // Takes over a range released by srcQueueFamilyIndex, after which it is in layout and visible to stage with access.
+    void AcquireImage(vk::Image image, vk::ImageLayout oldLayout, vk::ImageLayout layout, uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex,
+        vk::PipelineStageFlags2 stage, vk::AccessFlags2 access, vk::ImageSubresourceRange range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+    void ReleaseBuffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size, uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex);
+    void AcquireBuffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size, uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex,
+        vk::PipelineStageFlags2 stage, vk::AccessFlags2 access);
+    // The contents of image are no longer needed, its next use transitions from eUndefined. For swapchain images and
+    // attachments that are cleared before they are read.
+    void DiscardImage(vk::Image image);
+    // Forgets image, call before it is destroyed so a new image reusing its handle starts fresh.
+    void RemoveImage(vk::Image image);
+    void RemoveBuffer(vk::Buffer buffer);
+    // Records every pending barrier into commandBuffer. Must be called before the commands the requested uses are for.
+    void Flush(CVulkanCommandBuffer* commandBuffer);
+    CVulkanBarrierStatistics TakeStatistics();
+private:
+    ImageState& GetImageState(vk::Image image, vk::ImageSubresourceRange& range);
+    // Updates state for a use and returns whether a barrier is needed, filling in its source scope.
+    bool Transition(CVulkanResourceState& state, vk::ImageLayout layout, vk::PipelineStageFlags2 stage, vk::AccessFlags2 access,
+        vk::PipelineStageFlags2& srcStages, vk::AccessFlags2& srcAccess);
+};
\ No newline at end of file
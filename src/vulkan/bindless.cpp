@@ -0,0 +1,158 @@
+#include "bindless.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include "device.hpp"
+#include "buffer.hpp"
+#include "image.hpp"
+#include "cmd.hpp"
+#include "barrier.hpp"
+
+CVulkanBindlessHeap::CVulkanBindlessHeap(CVulkanDevice* device, CVulkanBarrierTracker* barrierTracker)
+    : device(device), barrierTracker(barrierTracker), textureCapacity(std::min(MAX_TEXTURES, device->GetMaxBindlessSampledImages())) {
+    auto vkDevice = device->GetVkDevice();
+    vk::SamplerCreateInfo samplerInfo;
+    samplerInfo.setMagFilter(vk::Filter::eLinear);
+    samplerInfo.setMinFilter(vk::Filter::eLinear);
+    samplerInfo.setMipmapMode(vk::SamplerMipmapMode::eLinear);
+    samplerInfo.setAddressModeU(vk::SamplerAddressMode::eRepeat);
+    samplerInfo.setAddressModeV(vk::SamplerAddressMode::eRepeat);
+    samplerInfo.setAddressModeW(vk::SamplerAddressMode::eRepeat);
+    samplerInfo.setAnisotropyEnable(true);
+    samplerInfo.setMaxAnisotropy(std::min(16.0f, device->GetVkPhysicalDeviceProperties().limits.maxSamplerAnisotropy));
+    samplerInfo.setMaxLod(VK_LOD_CLAMP_NONE);
+    sampler = std::make_unique<vk::raii::Sampler>(*vkDevice, samplerInfo);
+
+    // Textures, materials and the sampler in the order of shaders/material.frag. Only the texture array is written after
+    // bind, the rest is written once here.
+    vk::Sampler immutableSampler = **sampler;
+    std::vector<vk::DescriptorSetLayoutBinding> bindings = {
+        vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eSampledImage, textureCapacity, vk::ShaderStageFlagBits::eFragment),
+        vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment),
+        vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eSampler, 1, vk::ShaderStageFlagBits::eFragment, &immutableSampler),
+    };
+    std::vector<vk::DescriptorBindingFlags> bindingFlags = {
+        vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending,
+        {},
+        {},
+    };
+    vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo(bindingFlags);
+    vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutInfo(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool, bindings, &bindingFlagsInfo);
+    descriptorSetLayout = std::make_unique<vk::raii::DescriptorSetLayout>(*vkDevice, descriptorSetLayoutInfo);
+
+    std::vector<vk::DescriptorPoolSize> descriptorPoolSizes = {
+        { vk::DescriptorType::eSampledImage, textureCapacity },
+        { vk::DescriptorType::eStorageBuffer, 1 },
+        { vk::DescriptorType::eSampler, 1 },
+    };
+    vk::DescriptorPoolCreateInfo descriptorPoolInfo;
+    descriptorPoolInfo.setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet | vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind);
+    descriptorPoolInfo.setMaxSets(1);
+    descriptorPoolInfo.setPoolSizes(descriptorPoolSizes);
+    descriptorPool = std::make_unique<vk::raii::DescriptorPool>(vkDevice->createDescriptorPool(descriptorPoolInfo));
+
+    vk::DescriptorSetLayout setLayout = **descriptorSetLayout;
+    vk::DescriptorSetAllocateInfo descriptorSetInfo(**descriptorPool, setLayout);
+    vk::raii::DescriptorSets descriptorSets(*vkDevice, descriptorSetInfo);
+    descriptorSet = std::make_unique<vk::raii::DescriptorSet>(std::move(descriptorSets[0]));
+
+    materialBuffer = std::make_unique<CVulkanBuffer>(device->CreateBuffer(vk::MemoryPropertyFlagBits::eDeviceLocal,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, nullptr, sizeof(CVulkanMaterialData) * MAX_MATERIALS));
+    vk::DescriptorBufferInfo materialBufferInfo(materialBuffer->GetVkBuffer(), 0, VK_WHOLE_SIZE);
+    vkDevice->updateDescriptorSets(vk::WriteDescriptorSet(**descriptorSet, 1, 0, vk::DescriptorType::eStorageBuffer, nullptr, materialBufferInfo), nullptr);
+
+    CVulkanMaterial defaultMaterial = {};
+    defaultMaterial.roughness = 1.0f;
+    defaultMaterial.metallic = 0.0f;
+    AddMaterial(&defaultMaterial);
+}
+
+CVulkanBindlessHeap::~CVulkanBindlessHeap() {
+    barrierTracker->RemoveBuffer(materialBuffer->GetVkBuffer());
+}
+
+vk::DescriptorSetLayout CVulkanBindlessHeap::GetVkDescriptorSetLayout() {
+    return **descriptorSetLayout;
+}
+
+vk::DescriptorSet CVulkanBindlessHeap::GetVkDescriptorSet() {
+    return **descriptorSet;
+}
+
+uint32_t CVulkanBindlessHeap::AddTexture(CVulkanImage* image) {
+    if(imageViews.size() >= textureCapacity) {
+        printf("CVulkanBindlessHeap::AddTexture: All %u textures are in use\n", textureCapacity);
+        return NO_HANDLE;
+    }
+    vk::ImageViewCreateInfo imageViewInfo({}, image->GetVkImage(), vk::ImageViewType::e2D, image->GetFormat(), {},
+        vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, image->GetMipLevels(), 0, 1));
+    imageViews.push_back(vk::raii::ImageView(*device->GetVkDevice(), imageViewInfo));
+
+    // The slot was never used by a submitted frame, so it may be written while they are pending.
+    uint32_t handle = static_cast<uint32_t>(imageViews.size()) - 1;
+    vk::DescriptorImageInfo imageInfo(nullptr, *imageViews.back(), vk::ImageLayout::eShaderReadOnlyOptimal);
+    device->GetVkDevice()->updateDescriptorSets(vk::WriteDescriptorSet(**descriptorSet, 0, handle, vk::DescriptorType::eSampledImage, imageInfo), nullptr);
+    return handle;
+}
+
+uint32_t CVulkanBindlessHeap::GetTextureCount() {
+    return static_cast<uint32_t>(imageViews.size());
+}
+
+uint32_t CVulkanBindlessHeap::AddMaterial(CVulkanMaterial* material) {
+    if(materials.size() >= MAX_MATERIALS) {
+        printf("CVulkanBindlessHeap::AddMaterial: All %u materials are in use\n", MAX_MATERIALS);
+        return NO_HANDLE;
+    }
+    material->handle = static_cast<uint32_t>(materials.size());
+    materials.push_back(GetMaterialData(*material));
+    dirtyMaterials.push_back(material->handle);
+    return material->handle;
+}
+
+void CVulkanBindlessHeap::UpdateMaterial(const CVulkanMaterial& material) {
+    materials[material.handle] = GetMaterialData(material);
+    dirtyMaterials.push_back(material.handle);
+}
+
+uint32_t CVulkanBindlessHeap::GetMaterialCount() {
+    return static_cast<uint32_t>(materials.size());
+}
+
+void CVulkanBindlessHeap::Upload(CVulkanCommandBuffer* commandBuffer) {
+    if(dirtyMaterials.empty()) {
+        return;
+    }
+    vk::Buffer buffer = materialBuffer->GetVkBuffer();
+    barrierTracker->UseBuffer(buffer, vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite);
+    barrierTracker->Flush(commandBuffer);
+
+    // Runs of consecutive materials are written together, up to the 65536 bytes vkCmdUpdateBuffer takes at once.
+    constexpr uint32_t maxRunLength = 65536 / sizeof(CVulkanMaterialData);
+    std::sort(dirtyMaterials.begin(), dirtyMaterials.end());
+    dirtyMaterials.erase(std::unique(dirtyMaterials.begin(), dirtyMaterials.end()), dirtyMaterials.end());
+    size_t runStart = 0;
+    for(size_t i = 1; i <= dirtyMaterials.size(); i++) {
+        uint32_t first = dirtyMaterials[runStart];
+        if(i < dirtyMaterials.size() && dirtyMaterials[i] == first + (i - runStart) && i - runStart < maxRunLength) {
+            continue;
+        }
+        uint32_t count = static_cast<uint32_t>(i - runStart);
+        commandBuffer->UpdateBuffer(buffer, sizeof(CVulkanMaterialData) * first, sizeof(CVulkanMaterialData) * count, &materials[first]);
+        runStart = i;
+    }
+    dirtyMaterials.clear();
+
+    // Flushed here since draws are recorded inside rendering scopes, where barriers cannot go.
+    barrierTracker->UseBuffer(buffer, vk::PipelineStageFlagBits2::eFragmentShader, vk::AccessFlagBits2::eShaderStorageRead);
+    barrierTracker->Flush(commandBuffer);
+}
+
+CVulkanMaterialData CVulkanBindlessHeap::GetMaterialData(const CVulkanMaterial& material) {
+    CVulkanMaterialData data = {};
+    data.baseColor = material.baseColor;
+    data.baseColorTexture = material.baseColorTexture;
+    data.roughness = material.roughness;
+    data.metallic = material.metallic;
+    return data;
+}
\ No newline at end of file
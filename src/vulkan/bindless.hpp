@@ -0,0 +1,56 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include <memory>
+#include <vector>
+#include "types.hpp"
+
+class CVulkanDevice;
+class CVulkanBuffer;
+class CVulkanImage;
+class CVulkanCommandBuffer;
+class CVulkanBarrierTracker;
+
+// One descriptor set holding every sampled image and the material buffer, bound as set 1 by the pipelines drawing with
+// shaders/material.frag. Shaders select textures and materials by index, so neither ever rebinds a descriptor set.
+// Textures are written after bind into slots no frame has used yet, which partially bound arrays allow, and keep their
+// slot for the lifetime of the heap. Needs CVulkanDevice::IsBindlessEnabled().
+class CVulkanBindlessHeap {
+    CVulkanDevice* device;
+    CVulkanBarrierTracker* barrierTracker;
+    std::unique_ptr<vk::raii::Sampler> sampler; // Declared before the layout it is immutable in.
+    std::unique_ptr<vk::raii::DescriptorSetLayout> descriptorSetLayout;
+    std::unique_ptr<vk::raii::DescriptorPool> descriptorPool;
+    std::unique_ptr<vk::raii::DescriptorSet> descriptorSet;
+    std::vector<vk::raii::ImageView> imageViews; // By texture handle.
+    std::unique_ptr<CVulkanBuffer> materialBuffer; // Device local, written in order with the frames reading it.
+    std::vector<CVulkanMaterialData> materials;
+    std::vector<uint32_t> dirtyMaterials; // Changed since the last Upload().
+    uint32_t textureCapacity;
+public:
+    // Lowered to CVulkanDevice::GetMaxBindlessSampledImages() on devices with a smaller limit.
+    static constexpr uint32_t MAX_TEXTURES = 16384;
+    static constexpr uint32_t MAX_MATERIALS = 65536;
+    static constexpr uint32_t NO_HANDLE = ~0u;
+    static constexpr uint32_t DEFAULT_MATERIAL = 0; // White and untextured, for instances without a material.
+
+    // Material writes are synchronized through barrierTracker.
+    CVulkanBindlessHeap(CVulkanDevice* device, CVulkanBarrierTracker* barrierTracker);
+    ~CVulkanBindlessHeap();
+    vk::DescriptorSetLayout GetVkDescriptorSetLayout();
+    vk::DescriptorSet GetVkDescriptorSet();
+    // Returns the handle shaders index image with, or NO_HANDLE once the heap is full. image must be in eShaderReadOnlyOptimal
+    // by the time it is drawn and outlive the heap.
+    uint32_t AddTexture(CVulkanImage* image);
+    uint32_t GetTextureCount();
+    // Places material in the material buffer and sets its handle, returns NO_HANDLE once the buffer is full.
+    uint32_t AddMaterial(CVulkanMaterial* material);
+    // Writes material again, it must have been added before.
+    void UpdateMaterial(const CVulkanMaterial& material);
+    uint32_t GetMaterialCount();
+    // Records the writes of the materials changed since the last call, outside of a rendering scope. Writes are recorded
+    // into the frame's command buffer so that they land after the earlier frames reading the buffer.
+    void Upload(CVulkanCommandBuffer* commandBuffer);
+private:
+    static CVulkanMaterialData GetMaterialData(const CVulkanMaterial& material);
+};
\ No newline at end of file
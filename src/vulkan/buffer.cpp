@@ -1,28 +1,34 @@
 #include "buffer.hpp"
 
-#include "util.hpp"
+#include "memory.hpp"
 
-CVulkanBuffer::CVulkanBuffer(std::shared_ptr<vk::raii::Device> device, vk::PhysicalDeviceMemoryProperties memoryProperties, vk::MemoryPropertyFlags desiredPropertyFlags, 
-    vk::BufferUsageFlags usage, void* data, vk::DeviceSize dataSize) {
+CVulkanBuffer::CVulkanBuffer(std::shared_ptr<vk::raii::Device> device, CVulkanMemoryAllocator* allocator, vk::MemoryPropertyFlags desiredPropertyFlags, 
+    vk::BufferUsageFlags usage, void* data, vk::DeviceSize dataSize) : size(dataSize) {
     auto bufferInfo = vk::BufferCreateInfo({}, dataSize, usage);
     buffer = std::make_unique<vk::raii::Buffer>(*device, bufferInfo);
 
     vk::MemoryRequirements memoryRequirements = buffer->getMemoryRequirements();
-    auto memoryTypeIndex = GetMemoryTypeIndex(memoryProperties, memoryRequirements.memoryTypeBits, desiredPropertyFlags);
-    if (memoryTypeIndex == -1) {
+    memory = allocator->Allocate(memoryRequirements, desiredPropertyFlags, MEMORY_RESOURCE_LINEAR);
+    if (memory == nullptr) {
         throw CVulkanBufferCreationException(CVulkanBufferCreationError::BUFFER_INVALID_MEMORY_TYPE);
     }
-    vk::MemoryAllocateInfo allocateInfo(memoryRequirements.size, memoryTypeIndex);
-    memory = std::make_unique<vk::raii::DeviceMemory>(*device, allocateInfo);
-    buffer->bindMemory(**memory, 0);
+    buffer->bindMemory(memory->GetVkDeviceMemory(), memory->GetOffset());
 
     if (data != nullptr) {
-        void* handle = memory->mapMemory(0, dataSize);
-        memcpy(handle, data, static_cast<size_t>(dataSize));
-        memory->unmapMemory();
+        // Device local only memory has to be filled through CVulkanStagingRing::CopyToBuffer() instead.
+        if (memory->GetMappedData() == nullptr) {
+            throw CVulkanBufferCreationException(CVulkanBufferCreationError::BUFFER_NOT_HOST_VISIBLE);
+        }
+        memcpy(memory->GetMappedData(), data, static_cast<size_t>(dataSize));
     }
 }
 
+CVulkanBuffer::CVulkanBuffer(CVulkanBuffer&&) noexcept = default;
+
+CVulkanBuffer& CVulkanBuffer::operator=(CVulkanBuffer&&) noexcept = default;
+
+CVulkanBuffer::~CVulkanBuffer() = default;
+
 vk::Buffer CVulkanBuffer::GetVkBuffer() {
     return **buffer;
 }
@@ -30,3 +36,7 @@ vk::Buffer CVulkanBuffer::GetVkBuffer() {
 vk::DeviceSize CVulkanBuffer::GetVkDeviceSize() {
     return size;
 }
+
+void* CVulkanBuffer::GetMappedData() {
+    return memory->GetMappedData();
+}
\ No newline at end of file
@@ -2,8 +2,12 @@
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_raii.hpp>
 
+class CVulkanMemoryAllocator;
+class CVulkanMemoryAllocation;
+
 enum CVulkanBufferCreationError {
-    BUFFER_INVALID_MEMORY_TYPE
+    BUFFER_INVALID_MEMORY_TYPE,
+    BUFFER_NOT_HOST_VISIBLE
 };
 
 class CVulkanBufferCreationException : public std::exception {
@@ -21,11 +25,17 @@ public:
 };
 
 class CVulkanBuffer {
+    std::unique_ptr<CVulkanMemoryAllocation> memory; // Declared first so the buffer is destroyed before its memory is returned.
     std::unique_ptr<vk::raii::Buffer> buffer;
-    std::unique_ptr<vk::raii::DeviceMemory> memory;
     vk::DeviceSize size;
 public:
-    CVulkanBuffer(std::shared_ptr<vk::raii::Device> device, vk::PhysicalDeviceMemoryProperties memoryProperties, vk::MemoryPropertyFlags desiredPropertyFlags, vk::BufferUsageFlags usage, void* data, vk::DeviceSize dataSize);
+    // data is copied in through the mapping, so it must be nullptr unless the memory ends up host visible.
+    CVulkanBuffer(std::shared_ptr<vk::raii::Device> device, CVulkanMemoryAllocator* allocator, vk::MemoryPropertyFlags desiredPropertyFlags, vk::BufferUsageFlags usage, void* data, vk::DeviceSize dataSize);
+    CVulkanBuffer(CVulkanBuffer&&) noexcept;
+    CVulkanBuffer& operator=(CVulkanBuffer&&) noexcept;
+    ~CVulkanBuffer();
     vk::Buffer GetVkBuffer();
     vk::DeviceSize GetVkDeviceSize();
+    // Pointer to the buffer contents if it lives in host visible memory, otherwise nullptr.
+    void* GetMappedData();
 };
\ No newline at end of file
@@ -4,33 +4,83 @@
 #include "types.hpp"
 #include "buffer.hpp"
 #include "image.hpp"
+#include "barrier.hpp"
 
 CVulkanCommandBuffer::CVulkanCommandBuffer(std::shared_ptr<vk::raii::Device> device, std::shared_ptr<vk::raii::CommandPool> commandPool, vk::CommandBufferLevel level) {
     auto commandBufferInfo = vk::CommandBufferAllocateInfo(**commandPool, level, 1);
     commandBuffer = std::make_unique<vk::raii::CommandBuffer>(std::move(vk::raii::CommandBuffers(*device, commandBufferInfo).front()));
 }
 
-void CVulkanCommandBuffer::TransitionImageLayout(vk::Image image, vk::AccessFlags srcAccessFlags, vk::AccessFlags dstAccessFlags, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::PipelineStageFlags srcStage, vk::PipelineStageFlags dstStage) {
-    // Transition image for drawing.
-    vk::ImageMemoryBarrier pipelineBarrier;
-    pipelineBarrier.setImage(image);
-    pipelineBarrier.setSrcAccessMask(srcAccessFlags);
-    pipelineBarrier.setDstAccessMask(dstAccessFlags);
-    pipelineBarrier.setOldLayout(oldLayout);
-    pipelineBarrier.setNewLayout(newLayout);
-    pipelineBarrier.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+void CVulkanCommandBuffer::PipelineBarrier(vk::PipelineStageFlags srcStage, vk::PipelineStageFlags dstStage,
+    const std::vector<vk::BufferMemoryBarrier>& bufferBarriers, const std::vector<vk::ImageMemoryBarrier>& imageBarriers) {
+    commandBuffer->pipelineBarrier(srcStage, dstStage, {}, nullptr, bufferBarriers, imageBarriers);
+}
 
-    commandBuffer->pipelineBarrier(srcStage, dstStage, {}, nullptr, nullptr, pipelineBarrier);
+void CVulkanCommandBuffer::PipelineBarrier2(const std::vector<vk::MemoryBarrier2>& memoryBarriers, const std::vector<vk::BufferMemoryBarrier2>& bufferBarriers,
+    const std::vector<vk::ImageMemoryBarrier2>& imageBarriers) {
+    vk::DependencyInfo dependencyInfo;
+    dependencyInfo.setMemoryBarriers(memoryBarriers);
+    dependencyInfo.setBufferMemoryBarriers(bufferBarriers);
+    dependencyInfo.setImageMemoryBarriers(imageBarriers);
+    commandBuffer->pipelineBarrier2(dependencyInfo);
 }
 
-void CVulkanCommandBuffer::BeginPass(CVulkanFrame* frame, CVulkanRender* render) {
-    Begin();
-    TransitionImageLayout(frame->image, {}, vk::AccessFlagBits::eColorAttachmentWrite,
-        vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal,
-        vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eColorAttachmentOutput);
+void CVulkanCommandBuffer::GenerateMipmaps(CVulkanBarrierTracker* barrierTracker, vk::Image image, vk::Extent3D extent, uint32_t mipLevels,
+    vk::PipelineStageFlags2 readStages) {
+    // Every level arrives in eTransferDstOptimal, made visible to transfers by the ownership acquire or the upload wait.
+    CVulkanResourceState uploaded;
+    uploaded.layout = vk::ImageLayout::eTransferDstOptimal;
+    uploaded.writeStages = vk::PipelineStageFlagBits2::eTransfer;
+    uploaded.writeAccess = vk::AccessFlagBits2::eTransferWrite;
+    barrierTracker->SetImageState(image, uploaded, vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 1));
+
+    int32_t width = static_cast<int32_t>(extent.width);
+    int32_t height = static_cast<int32_t>(extent.height);
+    for(uint32_t level = 1; level < mipLevels; level++) {
+        // Previous level becomes the blit source.
+        barrierTracker->UseImage(image, vk::ImageLayout::eTransferSrcOptimal, vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferRead,
+            vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, level - 1, 1, 0, 1));
+        barrierTracker->UseImage(image, vk::ImageLayout::eTransferDstOptimal, vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite,
+            vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, level, 1, 0, 1));
+        barrierTracker->Flush(this);
 
+        int32_t mipWidth = std::max(width / 2, 1);
+        int32_t mipHeight = std::max(height / 2, 1);
+        vk::ImageBlit blit;
+        blit.setSrcSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level - 1, 0, 1));
+        blit.setSrcOffsets({ vk::Offset3D(0, 0, 0), vk::Offset3D(width, height, 1) });
+        blit.setDstSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level, 0, 1));
+        blit.setDstOffsets({ vk::Offset3D(0, 0, 0), vk::Offset3D(mipWidth, mipHeight, 1) });
+        commandBuffer->blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal, blit, vk::Filter::eLinear);
+
+        width = mipWidth;
+        height = mipHeight;
+    }
+
+    // All levels at once, neighbouring levels left in the same state merge into one barrier.
+    barrierTracker->UseImage(image, vk::ImageLayout::eShaderReadOnlyOptimal, readStages, vk::AccessFlagBits2::eShaderSampledRead,
+        vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 1));
+    barrierTracker->Flush(this);
+}
+
+void CVulkanCommandBuffer::BeginPass(CVulkanBarrierTracker* barrierTracker, CVulkanFrame* frame, CVulkanRender* render, vk::RenderingFlags flags) {
+    barrierTracker->UseImage(frame->image, vk::ImageLayout::eColorAttachmentOptimal,
+        vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2::eColorAttachmentWrite);
+    barrierTracker->Flush(this);
+    BeginRendering(frame, render, flags);
+}
+
+void CVulkanCommandBuffer::EndPass(CVulkanBarrierTracker* barrierTracker, CVulkanFrame* frame) {
+    EndRendering();
+    // Presentation is ordered by the submit semaphore, the barrier only changes the layout.
+    barrierTracker->UseImage(frame->image, vk::ImageLayout::ePresentSrcKHR, vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone);
+    barrierTracker->Flush(this);
+}
+
+void CVulkanCommandBuffer::BeginRendering(CVulkanFrame* frame, CVulkanRender* render, vk::RenderingFlags flags) {
     vk::Rect2D renderArea({}, frame->extent);
     vk::RenderingInfo renderingInfo;
+    renderingInfo.setFlags(flags);
     renderingInfo.setRenderArea(renderArea);
     renderingInfo.setLayerCount(1);
     renderingInfo.setColorAttachments(render->colorAttachments);
@@ -39,54 +89,153 @@ void CVulkanCommandBuffer::BeginPass(CVulkanFrame* frame, CVulkanRender* render)
 
     commandBuffer->beginRendering(renderingInfo);
 
-    vk::Viewport viewport(0.0f, 0.0f, static_cast<float>(frame->extent.width), static_cast<float>(frame->extent.height), 0.0f, 1.0f);
-    commandBuffer->setViewport(0, viewport);
-    commandBuffer->setScissor(0, renderArea);
+    // Secondary command buffers set their own.
+    if(!(flags & vk::RenderingFlagBits::eContentsSecondaryCommandBuffers)) {
+        SetViewport(frame->extent);
+    }
 }
 
-void CVulkanCommandBuffer::EndPass(CVulkanFrame* frame) {
+void CVulkanCommandBuffer::EndRendering() {
     commandBuffer->endRendering();
-    TransitionImageLayout(frame->image, vk::AccessFlagBits::eColorAttachmentWrite, {},
-        vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::ePresentSrcKHR,
-        vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eBottomOfPipe);
-    End();
+}
+
+void CVulkanCommandBuffer::SetViewport(vk::Extent2D extent) {
+    vk::Viewport viewport(0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f);
+    commandBuffer->setViewport(0, viewport);
+    commandBuffer->setScissor(0, vk::Rect2D({}, extent));
 }
 
 void CVulkanCommandBuffer::Draw(CVulkanDraw* draw) {
-    commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, draw->pipeline);
-    commandBuffer->bindVertexBuffers(0, draw->vertexBuffers, draw->vertexBufferOffsets);
-    if(draw->indicesCount > 0) {
-        commandBuffer->bindIndexBuffer(draw->indexBuffer, draw->indexBufferOffset, vk::IndexType::eUint16);
-        commandBuffer->drawIndexed(draw->indicesCount, 1, 0, 0, 0);
+    if(boundState.pipeline != draw->pipeline) {
+        commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, draw->pipeline);
+        boundState.pipeline = draw->pipeline;
+        drawStatistics.bindCount++;
+    } else {
+        drawStatistics.skippedBindCount++;
+    }
+
+    // Sets and push constants are only kept across pipelines with the same layout.
+    bool layoutChanged = boundState.pipelineLayout != draw->pipelineLayout;
+    boundState.pipelineLayout = draw->pipelineLayout;
+    if(!draw->descriptorSets.empty()) {
+        if(layoutChanged || boundState.descriptorSets != draw->descriptorSets) {
+            commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, draw->pipelineLayout, 0, draw->descriptorSets, nullptr);
+            boundState.descriptorSets = draw->descriptorSets;
+            drawStatistics.bindCount++;
+        } else {
+            drawStatistics.skippedBindCount++;
+        }
+    }
+    if(!draw->pushConstants.empty()) {
+        if(layoutChanged || boundState.pushConstantStages != draw->pushConstantStages || boundState.pushConstants != draw->pushConstants) {
+            commandBuffer->pushConstants<uint8_t>(draw->pipelineLayout, draw->pushConstantStages, 0, draw->pushConstants);
+            boundState.pushConstantStages = draw->pushConstantStages;
+            boundState.pushConstants = draw->pushConstants;
+            drawStatistics.bindCount++;
+        } else {
+            drawStatistics.skippedBindCount++;
+        }
+    }
+
+    if(draw->taskGroupCountX > 0) {
+        drawStatistics.drawCount++;
+        commandBuffer->drawMeshTasksEXT(draw->taskGroupCountX, draw->taskGroupCountY, 1);
+        return;
+    }
+
+    if(boundState.vertexBuffers != draw->vertexBuffers || boundState.vertexBufferOffsets != draw->vertexBufferOffsets) {
+        commandBuffer->bindVertexBuffers(0, draw->vertexBuffers, draw->vertexBufferOffsets);
+        boundState.vertexBuffers = draw->vertexBuffers;
+        boundState.vertexBufferOffsets = draw->vertexBufferOffsets;
+        drawStatistics.bindCount++;
     } else {
-        commandBuffer->draw(draw->verticesCount, 1, 0, 0);
+        drawStatistics.skippedBindCount++;
     }
+
+    drawStatistics.drawCount++;
+    if(draw->indirectBuffer || draw->indicesCount > 0) {
+        if(boundState.indexBuffer != draw->indexBuffer || boundState.indexBufferOffset != draw->indexBufferOffset || boundState.indexType != draw->indexType) {
+            commandBuffer->bindIndexBuffer(draw->indexBuffer, draw->indexBufferOffset, draw->indexType);
+            boundState.indexBuffer = draw->indexBuffer;
+            boundState.indexBufferOffset = draw->indexBufferOffset;
+            boundState.indexType = draw->indexType;
+            drawStatistics.bindCount++;
+        } else {
+            drawStatistics.skippedBindCount++;
+        }
+        if(draw->indirectBuffer) {
+            commandBuffer->drawIndexedIndirectCount(draw->indirectBuffer, draw->indirectBufferOffset, draw->countBuffer, draw->countBufferOffset,
+                draw->maxDrawCount, sizeof(vk::DrawIndexedIndirectCommand));
+        } else {
+            commandBuffer->drawIndexed(draw->indicesCount, draw->instanceCount, draw->firstIndex, 0, draw->firstInstance);
+            drawStatistics.triangleCount += static_cast<uint64_t>(draw->indicesCount / 3) * draw->instanceCount;
+        }
+    } else {
+        commandBuffer->draw(draw->verticesCount, draw->instanceCount, 0, draw->firstInstance);
+        drawStatistics.triangleCount += static_cast<uint64_t>(draw->verticesCount / 3) * draw->instanceCount;
+    }
+}
+
+void CVulkanCommandBuffer::Dispatch(CVulkanDispatch* dispatch) {
+    commandBuffer->bindPipeline(vk::PipelineBindPoint::eCompute, dispatch->pipeline);
+    if(!dispatch->descriptorSets.empty()) {
+        commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eCompute, dispatch->pipelineLayout, 0, dispatch->descriptorSets, nullptr);
+    }
+    if(!dispatch->pushConstants.empty()) {
+        commandBuffer->pushConstants<uint8_t>(dispatch->pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, dispatch->pushConstants);
+        // Push constants are not per bind point, the next draw has to push its own again.
+        boundState.pushConstants.clear();
+    }
+    commandBuffer->dispatch(dispatch->groupCountX, dispatch->groupCountY, dispatch->groupCountZ);
 }
 
 void CVulkanCommandBuffer::Draw(ImDrawData* drawData) {
     ImGui_ImplVulkan_RenderDrawData(drawData, **commandBuffer);
+    InvalidateBoundState();
 }
 
 void CVulkanCommandBuffer::CopyBuffer(CVulkanBuffer* srcBuffer, CVulkanBuffer* dstBuffer, vk::BufferCopy regions) {
-    Begin();
     commandBuffer->copyBuffer(srcBuffer->GetVkBuffer(), dstBuffer->GetVkBuffer(), regions);
-    End();
+}
+
+void CVulkanCommandBuffer::FillBuffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size, uint32_t data) {
+    commandBuffer->fillBuffer(buffer, offset, size, data);
+}
+
+void CVulkanCommandBuffer::UpdateBuffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size, const void* data) {
+    commandBuffer->updateBuffer<uint8_t>(buffer, offset, vk::ArrayProxy<const uint8_t>(static_cast<uint32_t>(size), static_cast<const uint8_t*>(data)));
 }
 
 void CVulkanCommandBuffer::CopyImage(CVulkanImage* srcImage, CVulkanImage* dstImage, vk::ImageCopy regions) {
-    Begin();
     commandBuffer->copyImage(srcImage->GetVkImage(), vk::ImageLayout::eTransferSrcOptimal, dstImage->GetVkImage(), vk::ImageLayout::eTransferDstOptimal, regions);
-    End();
 }
 
 void CVulkanCommandBuffer::CopyBufferToImage(CVulkanBuffer* buffer, CVulkanImage* image, vk::ImageLayout layout, vk::BufferImageCopy regions) {
-    Begin();
     commandBuffer->copyBufferToImage(buffer->GetVkBuffer(), image->GetVkImage(), layout, regions);
-    End();
 }
 
-void CVulkanCommandBuffer::ExecuteCommandBuffers(std::vector<std::shared_ptr<CVulkanCommandBuffer>> commandBuffers) {
+void CVulkanCommandBuffer::CopyImageToBuffer(CVulkanImage* image, vk::ImageLayout layout, CVulkanBuffer* buffer, vk::BufferImageCopy regions) {
+    commandBuffer->copyImageToBuffer(image->GetVkImage(), layout, buffer->GetVkBuffer(), regions);
+}
+
+void CVulkanCommandBuffer::ResetQueryPool(vk::QueryPool queryPool, uint32_t firstQuery, uint32_t queryCount) {
+    commandBuffer->resetQueryPool(queryPool, firstQuery, queryCount);
+}
 
+void CVulkanCommandBuffer::WriteTimestamp(vk::PipelineStageFlagBits stage, vk::QueryPool queryPool, uint32_t query) {
+    commandBuffer->writeTimestamp(stage, queryPool, query);
+}
+
+void CVulkanCommandBuffer::ExecuteCommandBuffers(std::vector<std::shared_ptr<CVulkanCommandBuffer>> commandBuffers) {
+    std::vector<vk::CommandBuffer> vkCommandBuffers;
+    vkCommandBuffers.reserve(commandBuffers.size());
+    for(auto& secondaryCommandBuffer : commandBuffers) {
+        vkCommandBuffers.push_back(secondaryCommandBuffer->GetVkCommandBuffer());
+    }
+    if(!vkCommandBuffers.empty()) {
+        commandBuffer->executeCommands(vkCommandBuffers);
+    }
+    InvalidateBoundState();
 }
 
 void CVulkanCommandBuffer::UploadImguiFonts() {
@@ -103,10 +252,31 @@ vk::CommandBuffer CVulkanCommandBuffer::GetVkCommandBuffer() {
     return **commandBuffer;
 }
 
+CVulkanDrawStatistics CVulkanCommandBuffer::TakeDrawStatistics() {
+    CVulkanDrawStatistics taken = drawStatistics;
+    drawStatistics = {};
+    return taken;
+}
+
+void CVulkanCommandBuffer::InvalidateBoundState() {
+    boundState = {};
+}
+
 void CVulkanCommandBuffer::Begin() {
+    InvalidateBoundState();
+    drawStatistics = {};
     commandBuffer->begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
 }
 
+void CVulkanCommandBuffer::BeginSecondary(const std::vector<vk::Format>& colorFormats, vk::Format depthFormat, vk::SampleCountFlagBits samples) {
+    InvalidateBoundState();
+    drawStatistics = {};
+    vk::CommandBufferInheritanceRenderingInfo inheritanceRenderingInfo({}, 0, colorFormats, depthFormat, vk::Format::eUndefined, samples);
+    vk::CommandBufferInheritanceInfo inheritanceInfo;
+    inheritanceInfo.setPNext(&inheritanceRenderingInfo);
+    commandBuffer->begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue, &inheritanceInfo));
+}
+
 void CVulkanCommandBuffer::End() {
     commandBuffer->end();
 }
@@ -116,7 +286,6 @@ CVulkanCommandPool::CVulkanCommandPool(std::shared_ptr<vk::raii::Device> device,
 }
 
 void CVulkanCommandPool::Reset() {
-    device->waitIdle();
     commandPool->reset();
 }
 
@@ -127,3 +296,30 @@ CVulkanCommandBuffer CVulkanCommandPool::CreateCommandBuffer(vk::CommandBufferLe
 vk::CommandPool CVulkanCommandPool::GetVkCommandPool() {
     return **commandPool;
 }
+
+CVulkanSecondaryCommandPools::CVulkanSecondaryCommandPools(std::shared_ptr<vk::raii::Device> device, uint32_t queueFamilyIndex, uint32_t framesInFlight, uint32_t workerCount)
+    : commandBuffers(framesInFlight, std::vector<std::vector<std::shared_ptr<CVulkanCommandBuffer>>>(workerCount)),
+    usedCounts(framesInFlight, std::vector<size_t>(workerCount, 0)) {
+    commandPools.resize(framesInFlight);
+    for(auto& framePools : commandPools) {
+        for(uint32_t i = 0; i < workerCount; i++) {
+            framePools.push_back(std::make_unique<CVulkanCommandPool>(device, queueFamilyIndex, vk::CommandPoolCreateFlagBits::eTransient));
+        }
+    }
+}
+
+void CVulkanSecondaryCommandPools::Reset(uint32_t frameIndex) {
+    for(auto& commandPool : commandPools[frameIndex]) {
+        commandPool->Reset();
+    }
+    std::fill(usedCounts[frameIndex].begin(), usedCounts[frameIndex].end(), 0);
+}
+
+std::shared_ptr<CVulkanCommandBuffer> CVulkanSecondaryCommandPools::Acquire(uint32_t frameIndex, uint32_t workerIndex) {
+    auto& workerCommandBuffers = commandBuffers[frameIndex][workerIndex];
+    size_t& usedCount = usedCounts[frameIndex][workerIndex];
+    if(usedCount == workerCommandBuffers.size()) {
+        workerCommandBuffers.push_back(std::make_shared<CVulkanCommandBuffer>(commandPools[frameIndex][workerIndex]->CreateCommandBuffer(vk::CommandBufferLevel::eSecondary)));
+    }
+    return workerCommandBuffers[usedCount++];
+}
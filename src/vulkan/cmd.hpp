@@ -1,35 +1,88 @@
 #pragma once
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_raii.hpp>
+#include "types.hpp"
 
 struct ImDrawData;
 class CVulkanBuffer;
 class CVulkanImage;
+class CVulkanBarrierTracker;
 struct CVulkanDraw;
+struct CVulkanDispatch;
 struct CVulkanFrame;
 struct CVulkanRender;
 
 class CVulkanCommandBuffer {
+    // What Draw(CVulkanDraw*) last bound, null handles and empty vectors are unbound.
+    struct BoundState {
+        vk::Pipeline pipeline;
+        vk::PipelineLayout pipelineLayout;
+        std::vector<vk::DescriptorSet> descriptorSets;
+        vk::ShaderStageFlags pushConstantStages;
+        std::vector<uint8_t> pushConstants;
+        std::vector<vk::Buffer> vertexBuffers;
+        std::vector<vk::DeviceSize> vertexBufferOffsets;
+        vk::Buffer indexBuffer;
+        vk::DeviceSize indexBufferOffset = 0;
+        vk::IndexType indexType = vk::IndexType::eUint16;
+    };
+
     std::unique_ptr<vk::raii::CommandBuffer> commandBuffer;
+    BoundState boundState;
+    CVulkanDrawStatistics drawStatistics;
 public:
     CVulkanCommandBuffer(std::shared_ptr<vk::raii::Device> device, std::shared_ptr<vk::raii::CommandPool> commandPool, vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary);
-    void TransitionImageLayout(vk::Image image, vk::AccessFlags srcAccessFlags, vk::AccessFlags dstAccessFlags,
-        vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
-        vk::PipelineStageFlags srcStage, vk::PipelineStageFlags dstStage);
-    void BeginPass(CVulkanFrame* frame, CVulkanRender* render);
-    void EndPass(CVulkanFrame* frame);
+    void Begin();
+    // Begins a secondary command buffer that continues a dynamic rendering scope with the given attachment formats.
+    // Nothing is inherited but the formats, viewport and scissor must be set again.
+    void BeginSecondary(const std::vector<vk::Format>& colorFormats, vk::Format depthFormat = vk::Format::eUndefined,
+        vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1);
+    void End();
+    void PipelineBarrier(vk::PipelineStageFlags srcStage, vk::PipelineStageFlags dstStage,
+        const std::vector<vk::BufferMemoryBarrier>& bufferBarriers, const std::vector<vk::ImageMemoryBarrier>& imageBarriers);
+    // Records all barriers with one vkCmdPipelineBarrier2, usually through CVulkanBarrierTracker::Flush().
+    void PipelineBarrier2(const std::vector<vk::MemoryBarrier2>& memoryBarriers, const std::vector<vk::BufferMemoryBarrier2>& bufferBarriers,
+        const std::vector<vk::ImageMemoryBarrier2>& imageBarriers);
+    // Blits every level of image from the previous one, level 0 and the rest must be in eTransferDstOptimal. Barriers go
+    // through barrierTracker, which leaves all levels in eShaderReadOnlyOptimal for readStages. Only valid on queues with
+    // graphics support.
+    void GenerateMipmaps(CVulkanBarrierTracker* barrierTracker, vk::Image image, vk::Extent3D extent, uint32_t mipLevels, vk::PipelineStageFlags2 readStages);
+    // Must be recorded between Begin() and End(). Pass eContentsSecondaryCommandBuffers when the pass is drawn with
+    // ExecuteCommandBuffers(), nothing else can be recorded in it then. The frame's image is transitioned through barrierTracker,
+    // which must know the state it was acquired in.
+    void BeginPass(CVulkanBarrierTracker* barrierTracker, CVulkanFrame* frame, CVulkanRender* render, vk::RenderingFlags flags = {});
+    void EndPass(CVulkanBarrierTracker* barrierTracker, CVulkanFrame* frame);
+    // Rendering scope without the layout transitions of BeginPass()/EndPass(), to switch between inline and secondary contents mid pass.
+    void BeginRendering(CVulkanFrame* frame, CVulkanRender* render, vk::RenderingFlags flags = {});
+    void EndRendering();
+    // Sets the viewport and scissor to cover extent.
+    void SetViewport(vk::Extent2D extent);
+    // Only binds what differs from the previous draw recorded into this command buffer.
     void Draw(CVulkanDraw* draw);
+    // Must be recorded outside of a rendering scope.
+    void Dispatch(CVulkanDispatch* dispatch);
+    // Binds its own state, the next Draw(CVulkanDraw*) binds everything again.
     void Draw(ImDrawData* drawData);
+    // Copies are only recorded, the caller is responsible for Begin() and End().
     void CopyBuffer(CVulkanBuffer* srcBuffer, CVulkanBuffer* dstBuffer, vk::BufferCopy regions);
+    // Writes the 4 byte word data repeatedly over size bytes of buffer.
+    void FillBuffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size, uint32_t data);
+    // Writes size bytes of data inline, size must be a multiple of 4 and at most 65536 bytes.
+    void UpdateBuffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size, const void* data);
     void CopyImage(CVulkanImage* srcImage, CVulkanImage* dstImage, vk::ImageCopy regions);
     void CopyBufferToImage(CVulkanBuffer* buffer, CVulkanImage* image, vk::ImageLayout layout, vk::BufferImageCopy regions);
+    void CopyImageToBuffer(CVulkanImage* image, vk::ImageLayout layout, CVulkanBuffer* buffer, vk::BufferImageCopy regions);
+    void ResetQueryPool(vk::QueryPool queryPool, uint32_t firstQuery, uint32_t queryCount);
+    void WriteTimestamp(vk::PipelineStageFlagBits stage, vk::QueryPool queryPool, uint32_t query);
+    // Executes secondary command buffers in order. Bound state is undefined afterwards.
     void ExecuteCommandBuffers(std::vector<std::shared_ptr<CVulkanCommandBuffer>> commandBuffers);
     void UploadImguiFonts();
     void Reset();
     vk::CommandBuffer GetVkCommandBuffer();
-private:
-    void Begin();
-    void End();
+    // Counts since Begin() or the last call.
+    CVulkanDrawStatistics TakeDrawStatistics();
+    // Forgets the bound state, call after binding through GetVkCommandBuffer().
+    void InvalidateBoundState();
 };
 
 class CVulkanCommandPool {
@@ -37,7 +90,23 @@ class CVulkanCommandPool {
     std::shared_ptr<vk::raii::CommandPool> commandPool;
 public:
     CVulkanCommandPool(std::shared_ptr<vk::raii::Device> device, uint32_t queueFamilyIndex, vk::CommandPoolCreateFlags flags = {});
+    // Resets every command buffer allocated from this pool. Does not wait, the caller must know that none of them are
+    // still executing, e.g. by waiting on the fence of the last submission that used them.
     void Reset();
     CVulkanCommandBuffer CreateCommandBuffer(vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary);
     vk::CommandPool GetVkCommandPool();
+};
+
+// Command pools for recording secondary command buffers from several threads, one per worker thread and frame in flight
+// since a pool may only be used by one thread at a time. Command buffers are kept and handed out again after a Reset().
+class CVulkanSecondaryCommandPools {
+    std::vector<std::vector<std::unique_ptr<CVulkanCommandPool>>> commandPools; // Indexed by frame, then worker.
+    std::vector<std::vector<std::vector<std::shared_ptr<CVulkanCommandBuffer>>>> commandBuffers;
+    std::vector<std::vector<size_t>> usedCounts;
+public:
+    CVulkanSecondaryCommandPools(std::shared_ptr<vk::raii::Device> device, uint32_t queueFamilyIndex, uint32_t framesInFlight, uint32_t workerCount);
+    // Resets the pools of frameIndex, its fence must have signaled.
+    void Reset(uint32_t frameIndex);
+    // Only the thread owning workerIndex may call this, concurrently with other workers.
+    std::shared_ptr<CVulkanCommandBuffer> Acquire(uint32_t frameIndex, uint32_t workerIndex);
 };
\ No newline at end of file
@@ -0,0 +1,194 @@
+#include "descriptor.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+#include "device.hpp"
+
+CVulkanDescriptorLayout::CVulkanDescriptorLayout(const vk::raii::Device& device, std::vector<vk::DescriptorSetLayoutBinding> bindings)
+    : bindings(std::move(bindings)), layout(device, vk::DescriptorSetLayoutCreateInfo({}, this->bindings)), descriptorCount(0) {
+    // Every binding reads its descriptors from consecutive infos, immutable samplers have nothing to write.
+    std::vector<vk::DescriptorUpdateTemplateEntry> entries;
+    for(auto& binding : this->bindings) {
+        if(binding.descriptorType == vk::DescriptorType::eSampler && binding.pImmutableSamplers) {
+            continue;
+        }
+        entries.push_back(vk::DescriptorUpdateTemplateEntry(binding.binding, 0, binding.descriptorCount, binding.descriptorType,
+            sizeof(CVulkanDescriptorInfo) * descriptorCount, sizeof(CVulkanDescriptorInfo)));
+        descriptorCount += binding.descriptorCount;
+    }
+    if(!entries.empty()) {
+        vk::DescriptorUpdateTemplateCreateInfo updateTemplateInfo({}, entries, vk::DescriptorUpdateTemplateType::eDescriptorSet, *layout);
+        updateTemplate = std::make_unique<vk::raii::DescriptorUpdateTemplate>(device, updateTemplateInfo);
+    }
+}
+
+vk::DescriptorSetLayout CVulkanDescriptorLayout::GetVkDescriptorSetLayout() {
+    return *layout;
+}
+
+vk::DescriptorUpdateTemplate CVulkanDescriptorLayout::GetVkDescriptorUpdateTemplate() {
+    return updateTemplate ? **updateTemplate : vk::DescriptorUpdateTemplate();
+}
+
+const std::vector<vk::DescriptorSetLayoutBinding>& CVulkanDescriptorLayout::GetBindings() {
+    return bindings;
+}
+
+uint32_t CVulkanDescriptorLayout::GetDescriptorCount() {
+    return descriptorCount;
+}
+
+CVulkanDescriptorLayoutCache::CVulkanDescriptorLayoutCache(std::shared_ptr<vk::raii::Device> device) : device(device) {}
+
+CVulkanDescriptorLayout* CVulkanDescriptorLayoutCache::Get(std::vector<vk::DescriptorSetLayoutBinding> bindings) {
+    std::sort(bindings.begin(), bindings.end(), [](const vk::DescriptorSetLayoutBinding& a, const vk::DescriptorSetLayoutBinding& b) {
+        return a.binding < b.binding;
+    });
+    std::lock_guard<std::mutex> lock(mutex);
+    // Hashes of different bindings may collide, so the bucket is searched for an exact match.
+    auto& bucket = layouts[Hash(bindings)];
+    for(auto& layout : bucket) {
+        if(layout->GetBindings() == bindings) {
+            return layout.get();
+        }
+    }
+    bucket.push_back(std::make_unique<CVulkanDescriptorLayout>(*device, std::move(bindings)));
+    return bucket.back().get();
+}
+
+size_t CVulkanDescriptorLayoutCache::Hash(const std::vector<vk::DescriptorSetLayoutBinding>& bindings) {
+    size_t hash = bindings.size();
+    auto combine = [&hash](size_t value) {
+        hash ^= value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+    };
+    for(auto& binding : bindings) {
+        combine(binding.binding);
+        combine(static_cast<size_t>(binding.descriptorType));
+        combine(binding.descriptorCount);
+        combine(static_cast<size_t>(static_cast<VkShaderStageFlags>(binding.stageFlags)));
+        combine(std::hash<const void*>()(binding.pImmutableSamplers));
+    }
+    return hash;
+}
+
+CVulkanDescriptorAllocator::CVulkanDescriptorAllocator(CVulkanDevice* device, uint32_t framesInFlight) : device(device), frames(framesInFlight) {}
+
+CVulkanDescriptorAllocator::~CVulkanDescriptorAllocator() {}
+
+void CVulkanDescriptorAllocator::BeginFrame(uint32_t frameIndex) {
+    PoolChain& chain = frames[frameIndex];
+    for(size_t i = 0; i < std::min(chain.current + 1, chain.pools.size()); i++) {
+        chain.pools[i].reset();
+    }
+    chain.current = 0;
+}
+
+vk::DescriptorSet CVulkanDescriptorAllocator::Allocate(uint32_t frameIndex, CVulkanDescriptorLayout* layout) {
+    return Allocate(frames[frameIndex], layout);
+}
+
+vk::DescriptorSet CVulkanDescriptorAllocator::AllocatePersistent(CVulkanDescriptorLayout* layout) {
+    return Allocate(persistent, layout);
+}
+
+void CVulkanDescriptorAllocator::Write(vk::DescriptorSet set, CVulkanDescriptorLayout* layout, const std::vector<CVulkanDescriptorInfo>& infos) {
+    if(infos.size() < layout->GetDescriptorCount()) {
+        printf("CVulkanDescriptorAllocator::Write: %zu infos for %u descriptors\n", infos.size(), layout->GetDescriptorCount());
+        return;
+    }
+    if(layout->GetDescriptorCount() == 0) {
+        return;
+    }
+    auto vkDevice = device->GetVkDevice();
+    vkDevice->getDispatcher()->vkUpdateDescriptorSetWithTemplate(static_cast<VkDevice>(**vkDevice), static_cast<VkDescriptorSet>(set),
+        static_cast<VkDescriptorUpdateTemplate>(layout->GetVkDescriptorUpdateTemplate()), infos.data());
+}
+
+vk::DescriptorPool CVulkanDescriptorAllocator::GetVkLibraryPool() {
+    if(!libraryPool) {
+        std::vector<vk::DescriptorPoolSize> descriptorPoolSizes = {
+            { vk::DescriptorType::eCombinedImageSampler, LIBRARY_POOL_SETS },
+        };
+        vk::DescriptorPoolCreateInfo descriptorPoolInfo;
+        descriptorPoolInfo.setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet);
+        descriptorPoolInfo.setMaxSets(LIBRARY_POOL_SETS);
+        descriptorPoolInfo.setPoolSizes(descriptorPoolSizes);
+        libraryPool = std::make_unique<vk::raii::DescriptorPool>(device->GetVkDevice()->createDescriptorPool(descriptorPoolInfo));
+    }
+    return **libraryPool;
+}
+
+vk::DescriptorSet CVulkanDescriptorAllocator::Allocate(PoolChain& chain, CVulkanDescriptorLayout* layout) {
+    // Sets of the smallest pool that fits a set of layout while empty. A type the pools lack or more descriptors than the
+    // largest pool holds would otherwise have pools created forever.
+    uint32_t poolSets = 1;
+    std::vector<vk::DescriptorPoolSize> setPoolSizes = GetPoolSizes(1);
+    for(auto& binding : layout->GetBindings()) {
+        auto poolSize = std::find_if(setPoolSizes.begin(), setPoolSizes.end(), [&binding](const vk::DescriptorPoolSize& poolSize) {
+            return poolSize.type == binding.descriptorType;
+        });
+        if(poolSize == setPoolSizes.end()) {
+            printf("CVulkanDescriptorAllocator::Allocate: Pools hold no %s descriptors\n", vk::to_string(binding.descriptorType).c_str());
+            throw std::runtime_error("Descriptor set layout uses a type the descriptor pools lack");
+        }
+    }
+    for(auto& poolSize : setPoolSizes) {
+        uint64_t descriptorCount = 0;
+        for(auto& binding : layout->GetBindings()) {
+            if(binding.descriptorType == poolSize.type) {
+                descriptorCount += binding.descriptorCount;
+            }
+        }
+        uint64_t sets = (descriptorCount + poolSize.descriptorCount - 1) / poolSize.descriptorCount;
+        if(sets > MAX_POOL_SETS) {
+            printf("CVulkanDescriptorAllocator::Allocate: %llu %s descriptors exceed the largest pool\n", static_cast<unsigned long long>(descriptorCount),
+                vk::to_string(poolSize.type).c_str());
+            throw std::runtime_error("Descriptor set layout needs more descriptors than the largest descriptor pool holds");
+        }
+        poolSets = std::max(poolSets, static_cast<uint32_t>(sets));
+    }
+
+    vk::DescriptorSetLayout setLayout = layout->GetVkDescriptorSetLayout();
+    while(true) {
+        bool created = chain.current == chain.pools.size();
+        if(created) {
+            chain.pools.push_back(CreatePool(std::max(MIN_POOL_SETS << std::min<size_t>(chain.pools.size(), 16), poolSets)));
+        }
+        // A pool runs out of sets or of one descriptor type, the next one is tried then. Sets are released from RAII, the
+        // pools are reset or destroyed as a whole.
+        try {
+            vk::DescriptorSetAllocateInfo descriptorSetInfo(*chain.pools[chain.current], setLayout);
+            vk::raii::DescriptorSets descriptorSets(*device->GetVkDevice(), descriptorSetInfo);
+            return vk::DescriptorSet(descriptorSets.front().release());
+        } catch(vk::OutOfPoolMemoryError&) {
+        } catch(vk::FragmentedPoolError&) {
+        }
+        if(created) {
+            // The empty pool was sized to fit, so the next one would fail just the same.
+            throw std::runtime_error("Descriptor set does not fit an empty descriptor pool");
+        }
+        chain.current++;
+    }
+}
+
+std::vector<vk::DescriptorPoolSize> CVulkanDescriptorAllocator::GetPoolSizes(uint32_t maxSets) {
+    // Sized for the sets of the renderers, which are mostly storage buffers.
+    return {
+        { vk::DescriptorType::eUniformBuffer, maxSets },
+        { vk::DescriptorType::eStorageBuffer, maxSets * 4 },
+        { vk::DescriptorType::eCombinedImageSampler, maxSets },
+        { vk::DescriptorType::eSampledImage, maxSets },
+        { vk::DescriptorType::eSampler, maxSets },
+        { vk::DescriptorType::eStorageImage, maxSets },
+    };
+}
+
+vk::raii::DescriptorPool CVulkanDescriptorAllocator::CreatePool(uint32_t maxSets) {
+    std::vector<vk::DescriptorPoolSize> descriptorPoolSizes = GetPoolSizes(maxSets);
+    vk::DescriptorPoolCreateInfo descriptorPoolInfo;
+    descriptorPoolInfo.setMaxSets(maxSets);
+    descriptorPoolInfo.setPoolSizes(descriptorPoolSizes);
+    return device->GetVkDevice()->createDescriptorPool(descriptorPoolInfo);
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class CVulkanDevice;
+
+// One descriptor written through an update template, the member read depends on the descriptor type of its binding.
+union CVulkanDescriptorInfo {
+    vk::DescriptorBufferInfo buffer;
+    vk::DescriptorImageInfo image;
+
+    CVulkanDescriptorInfo(vk::DescriptorBufferInfo buffer) : buffer(buffer) {}
+    CVulkanDescriptorInfo(vk::DescriptorImageInfo image) : image(image) {}
+};
+
+// A descriptor set layout with the update template writing every descriptor of a set of it in one call.
+class CVulkanDescriptorLayout {
+    std::vector<vk::DescriptorSetLayoutBinding> bindings; // Sorted by binding.
+    vk::raii::DescriptorSetLayout layout;
+    std::unique_ptr<vk::raii::DescriptorUpdateTemplate> updateTemplate; // Null when every binding is an immutable sampler.
+    uint32_t descriptorCount; // Written by the template.
+public:
+    // bindings must be sorted by binding.
+    CVulkanDescriptorLayout(const vk::raii::Device& device, std::vector<vk::DescriptorSetLayoutBinding> bindings);
+    vk::DescriptorSetLayout GetVkDescriptorSetLayout();
+    vk::DescriptorUpdateTemplate GetVkDescriptorUpdateTemplate();
+    const std::vector<vk::DescriptorSetLayoutBinding>& GetBindings();
+    // Infos an update takes, one per descriptor of every binding but immutable samplers.
+    uint32_t GetDescriptorCount();
+};
+
+// Descriptor set layouts by their bindings, so pipelines and the sets bound to them share one layout per distinct set of
+// bindings. Owned by CVulkanDevice, layouts live as long as it.
+class CVulkanDescriptorLayoutCache {
+    std::shared_ptr<vk::raii::Device> device;
+    std::unordered_map<size_t, std::vector<std::unique_ptr<CVulkanDescriptorLayout>>> layouts; // By hash of the bindings.
+    std::mutex mutex; // Pipelines may be created on several threads.
+public:
+    CVulkanDescriptorLayoutCache(std::shared_ptr<vk::raii::Device> device);
+    // Returns the layout of bindings, created on first use. The order of bindings does not matter.
+    CVulkanDescriptorLayout* Get(std::vector<vk::DescriptorSetLayoutBinding> bindings);
+private:
+    static size_t Hash(const std::vector<vk::DescriptorSetLayoutBinding>& bindings);
+};
+
+// Descriptor sets from pools that are reset in bulk, never freed set by set. Sets of a frame in flight come from its own
+// pools, which BeginFrame() resets once the frame's fence signaled, so sets are allocated and written again every frame
+// instead of being kept in sync with the buffers they refer to. Persistent sets come from pools living as long as the
+// allocator. A full pool is followed by one twice its size, allocating is a single vkAllocateDescriptorSets once the
+// pools of a frame have grown to fit it. Not thread safe, sets are allocated before recording is split across threads.
+class CVulkanDescriptorAllocator {
+    // Pools in the order they were created, the ones before current are full.
+    struct PoolChain {
+        std::vector<vk::raii::DescriptorPool> pools;
+        size_t current = 0;
+    };
+
+    CVulkanDevice* device;
+    std::vector<PoolChain> frames;
+    PoolChain persistent;
+    std::unique_ptr<vk::raii::DescriptorPool> libraryPool; // Created on first use.
+public:
+    static constexpr uint32_t MIN_POOL_SETS = 64;
+    static constexpr uint32_t MAX_POOL_SETS = MIN_POOL_SETS << 16;
+    static constexpr uint32_t LIBRARY_POOL_SETS = 64;
+
+    CVulkanDescriptorAllocator(CVulkanDevice* device, uint32_t framesInFlight);
+    ~CVulkanDescriptorAllocator();
+    // Resets the pools of frameIndex, whose fence must have signaled. Its sets from before are invalid afterwards.
+    void BeginFrame(uint32_t frameIndex);
+    // A set valid until the next BeginFrame() of frameIndex. Throws if layout uses a descriptor type the pools lack or
+    // more descriptors than a pool of MAX_POOL_SETS holds.
+    vk::DescriptorSet Allocate(uint32_t frameIndex, CVulkanDescriptorLayout* layout);
+    // A set valid for the lifetime of the allocator, throws like Allocate().
+    vk::DescriptorSet AllocatePersistent(CVulkanDescriptorLayout* layout);
+    // Writes every descriptor of set with the update template of its layout, infos are in binding order.
+    void Write(vk::DescriptorSet set, CVulkanDescriptorLayout* layout, const std::vector<CVulkanDescriptorInfo>& infos);
+    // A pool with individually freeable combined image samplers, for libraries that allocate and free their own sets.
+    vk::DescriptorPool GetVkLibraryPool();
+private:
+    vk::DescriptorSet Allocate(PoolChain& chain, CVulkanDescriptorLayout* layout);
+    // Descriptors of each type in a pool of maxSets.
+    static std::vector<vk::DescriptorPoolSize> GetPoolSizes(uint32_t maxSets);
+    vk::raii::DescriptorPool CreatePool(uint32_t maxSets);
+};
\ No newline at end of file
@@ -1,11 +1,14 @@
 #include "device.hpp"
 
+#include <cstring>
 #include "queue.hpp"
 #include "buffer.hpp"
 #include "pipeline.hpp"
 #include "image.hpp"
+#include "memory.hpp"
+#include "descriptor.hpp"
 
-CVulkanDevice::CVulkanDevice(vk::raii::PhysicalDevice physicalDevice) : physicalDevice(physicalDevice) {
+CVulkanDevice::CVulkanDevice(vk::raii::PhysicalDevice physicalDevice, vk::SurfaceKHR surface) : physicalDevice(physicalDevice) {
     availableLayers = physicalDevice.enumerateDeviceLayerProperties();
     availableExtensions = physicalDevice.enumerateDeviceExtensionProperties();
     for(auto& layer : availableLayers) {
@@ -18,42 +21,97 @@ CVulkanDevice::CVulkanDevice(vk::raii::PhysicalDevice physicalDevice) : physical
     properties = physicalDevice.getProperties();
     limits = properties.limits;
     features = physicalDevice.getFeatures();
-    memoryProperties = physicalDevice.getMemoryProperties();
-    auto queueFamilies = physicalDevice.getQueueFamilyProperties();
-
-    graphicsQueueIndex = 0;
-    computeQueueIndex = 0;
-    transferQueueIndex = 0;
-    for(auto i = 0; auto & queueFamily : queueFamilies) {
-        if(queueFamily.queueFlags & vk::QueueFlagBits::eGraphics) {
-            graphicsQueueIndex = i;
-        }
-        if(queueFamily.queueFlags & vk::QueueFlagBits::eCompute) {
-            computeQueueIndex = i;
-        }
-        if(queueFamily.queueFlags & vk::QueueFlagBits::eTransfer) {
-            transferQueueIndex = i;
+    auto supportedFeatures = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+    const vk::PhysicalDeviceVulkan12Features& supportedVulkan12Features = supportedFeatures.get<vk::PhysicalDeviceVulkan12Features>();
+    gpuDrivenRenderingSupported = features.multiDrawIndirect && supportedVulkan12Features.drawIndirectCount;
+    // Descriptor indexing is core since Vulkan 1.2, the features of VK_EXT_descriptor_indexing are part of the 1.2 ones.
+    bindlessSupported = supportedVulkan12Features.runtimeDescriptorArray && supportedVulkan12Features.shaderSampledImageArrayNonUniformIndexing &&
+        supportedVulkan12Features.descriptorBindingPartiallyBound && supportedVulkan12Features.descriptorBindingUpdateUnusedWhilePending &&
+        supportedVulkan12Features.descriptorBindingSampledImageUpdateAfterBind;
+    auto supportedProperties = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceVulkan12Properties>();
+    const vk::PhysicalDeviceVulkan12Properties& vulkan12Properties = supportedProperties.get<vk::PhysicalDeviceVulkan12Properties>();
+    maxBindlessSampledImages = std::min(vulkan12Properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+        vulkan12Properties.maxDescriptorSetUpdateAfterBindSampledImages);
+    // The features of an extension may only be queried when the device has it.
+    meshShadingSupported = false;
+    for(auto& extension : availableExtensions) {
+        if(strcmp(extension.extensionName.data(), VK_EXT_MESH_SHADER_EXTENSION_NAME) == 0) {
+            auto meshShaderFeatures = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceMeshShaderFeaturesEXT>();
+            meshShadingSupported = meshShaderFeatures.get<vk::PhysicalDeviceMeshShaderFeaturesEXT>().taskShader &&
+                meshShaderFeatures.get<vk::PhysicalDeviceMeshShaderFeaturesEXT>().meshShader;
+            break;
         }
-        i++;
     }
+    memoryProperties = physicalDevice.getMemoryProperties();
+    queueFamilies = physicalDevice.getQueueFamilyProperties();
+
+    // Async compute prefers a family without graphics, transfers prefer the DMA only family.
+    // Graphics queues implicitly support transfers even if they do not report it.
+    // The swapchain presents on the graphics queue, so that family must also be able to present.
+    graphicsQueueFamily = SelectQueueFamily(vk::QueueFlagBits::eGraphics, {}, surface);
+    if(surface && !physicalDevice.getSurfaceSupportKHR(graphicsQueueFamily, surface)) {
+        printf("CVulkanDevice::CVulkanDevice: No graphics queue family can present to the surface.\n");
+    }
+    computeQueueFamily = SelectQueueFamily(vk::QueueFlagBits::eCompute, vk::QueueFlagBits::eGraphics);
+    transferQueueFamily = SelectQueueFamily(vk::QueueFlagBits::eTransfer, vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute);
 
-    std::vector<float> priorities = { 1.0f };
-    vk::DeviceQueueCreateInfo graphicsInfo({}, graphicsQueueIndex, priorities);
-    vk::DeviceQueueCreateInfo computeInfo({}, computeQueueIndex, priorities);
-    vk::DeviceQueueCreateInfo transferInfo({}, transferQueueIndex, priorities);
+    // When roles share a family, give each its own queue if the family has enough, otherwise they share the last one.
+    std::vector<uint32_t> queuesUsed(queueFamilies.size(), 0);
+    auto takeQueue = [&](uint32_t family) {
+        uint32_t index = std::min(queuesUsed[family], queueFamilies[family].queueCount - 1);
+        queuesUsed[family] = std::max(queuesUsed[family], index + 1);
+        return index;
+    };
+    graphicsQueueIndex = takeQueue(graphicsQueueFamily);
+    computeQueueIndex = takeQueue(computeQueueFamily);
+    transferQueueIndex = takeQueue(transferQueueFamily);
+
+    std::vector<float> priorities = { 1.0f, 1.0f, 1.0f };
+    std::vector<vk::DeviceQueueCreateInfo> queueInfos;
+    for(uint32_t family = 0; family < queuesUsed.size(); family++) {
+        if(queuesUsed[family] > 0) {
+            queueInfos.push_back(vk::DeviceQueueCreateInfo({}, family, queuesUsed[family], priorities.data()));
+        }
+    }
 
     vk::PhysicalDeviceFeatures defaultPhysicalDeviceFeatures;
     defaultPhysicalDeviceFeatures.setFillModeNonSolid(true);
     defaultPhysicalDeviceFeatures.setSamplerAnisotropy(true);
+    defaultPhysicalDeviceFeatures.setTextureCompressionBC(features.textureCompressionBC); // Optional, KTX2/DDS textures are transcoded without it.
+    defaultPhysicalDeviceFeatures.setMultiDrawIndirect(gpuDrivenRenderingSupported);
+
+    // Timeline semaphores back the tickets returned by CVulkanQueue::Submit.
+    vk::PhysicalDeviceVulkan12Features vulkan12Features;
+    vulkan12Features.setTimelineSemaphore(true);
+    vulkan12Features.setDrawIndirectCount(gpuDrivenRenderingSupported); // Optional, culled draws are counted on the GPU with it.
+    // Optional, materials and textures are selected by index from CVulkanBindlessHeap with it and drawn untextured without.
+    vulkan12Features.setRuntimeDescriptorArray(bindlessSupported);
+    vulkan12Features.setShaderSampledImageArrayNonUniformIndexing(bindlessSupported);
+    vulkan12Features.setDescriptorBindingPartiallyBound(bindlessSupported);
+    vulkan12Features.setDescriptorBindingUpdateUnusedWhilePending(bindlessSupported);
+    vulkan12Features.setDescriptorBindingSampledImageUpdateAfterBind(bindlessSupported);
+
+    // Barriers are recorded with vkCmdPipelineBarrier2 by CVulkanBarrierTracker.
+    vk::PhysicalDeviceSynchronization2Features synchronization2Features(true, &vulkan12Features);
 
     // Enable Dynamic Rendering features.
-    vk::PhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures(true);
+    vk::PhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures(true, &synchronization2Features);
     vk::PhysicalDeviceFeatures2 deviceFeatures(defaultPhysicalDeviceFeatures, &dynamicRenderingFeatures);
 
-    std::vector<vk::DeviceQueueCreateInfo> queueInfos = { graphicsInfo, computeInfo, transferInfo };
     enabledExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME };
+
+    // Optional, CVulkanMeshletRenderer culls meshlets with compute and draws them indirectly without it.
+    vk::PhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures;
+    meshShaderFeatures.setTaskShader(true);
+    meshShaderFeatures.setMeshShader(true);
+    if(meshShadingSupported) {
+        vulkan12Features.setPNext(&meshShaderFeatures);
+        enabledExtensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+    }
     vk::DeviceCreateInfo deviceInfo({}, queueInfos, nullptr, enabledExtensions, nullptr, &deviceFeatures);
     device = std::make_shared<vk::raii::Device>(physicalDevice.createDevice(deviceInfo));
+    allocator = std::make_unique<CVulkanMemoryAllocator>(device, memoryProperties);
+    descriptorLayoutCache = std::make_unique<CVulkanDescriptorLayoutCache>(device);
 }
 
 CVulkanDevice::~CVulkanDevice() {
@@ -80,6 +138,10 @@ vk::PhysicalDeviceMemoryProperties CVulkanDevice::GetVkPhysicalDeviceMemoryPrope
     return memoryProperties;
 }
 
+vk::QueueFamilyProperties CVulkanDevice::GetVkQueueFamilyProperties(uint32_t familyIndex) {
+    return queueFamilies[familyIndex];
+}
+
 std::vector<vk::LayerProperties> CVulkanDevice::GetAvailableVkLayerProperties() {
     return availableLayers;
 }
@@ -96,26 +158,99 @@ std::vector<const char*> CVulkanDevice::GetEnabledExtensionProperties() {
     return enabledExtensions;
 }
 
+bool CVulkanDevice::IsFormatFeatureSupported(vk::Format format, vk::FormatFeatureFlags features) {
+    return (physicalDevice.getFormatProperties(format).optimalTilingFeatures & features) == features;
+}
+
+bool CVulkanDevice::IsTextureCompressionBCEnabled() {
+    return features.textureCompressionBC;
+}
+
+bool CVulkanDevice::IsGpuDrivenRenderingEnabled() {
+    return gpuDrivenRenderingSupported;
+}
+
+bool CVulkanDevice::IsMeshShadingEnabled() {
+    return meshShadingSupported;
+}
+
+bool CVulkanDevice::IsBindlessEnabled() {
+    return bindlessSupported;
+}
+
+uint32_t CVulkanDevice::GetMaxBindlessSampledImages() {
+    return maxBindlessSampledImages;
+}
+
 std::unique_ptr<CVulkanQueue> CVulkanDevice::GetGraphicsQueue() {
-    return std::make_unique<CVulkanQueue>(device, graphicsQueueIndex);
+    return std::make_unique<CVulkanQueue>(device, graphicsQueueFamily, graphicsQueueIndex);
 }
 
 std::unique_ptr<CVulkanQueue> CVulkanDevice::GetComputeQueue() {
-    return std::make_unique<CVulkanQueue>(device, computeQueueIndex);
+    return std::make_unique<CVulkanQueue>(device, computeQueueFamily, computeQueueIndex);
 }
 
 std::unique_ptr<CVulkanQueue> CVulkanDevice::GetTransferQueue() {
-    return std::make_unique<CVulkanQueue>(device, transferQueueIndex);
+    return std::make_unique<CVulkanQueue>(device, transferQueueFamily, transferQueueIndex);
+}
+
+CVulkanMemoryAllocator* CVulkanDevice::GetMemoryAllocator() {
+    return allocator.get();
+}
+
+CVulkanDescriptorLayoutCache* CVulkanDevice::GetDescriptorLayoutCache() {
+    return descriptorLayoutCache.get();
 }
 
 CVulkanBuffer CVulkanDevice::CreateBuffer(vk::MemoryPropertyFlags desiredPropertyFlags, vk::BufferUsageFlags usage, void* data, vk::DeviceSize dataSize) {
-    return CVulkanBuffer(device, memoryProperties, desiredPropertyFlags, usage, data, dataSize);
+    return CVulkanBuffer(device, allocator.get(), desiredPropertyFlags, usage, data, dataSize);
+}
+
+CVulkanGraphicsPipeline CVulkanDevice::CreateGraphicsPipeline(std::string vertexShaderFile, std::string fragmentShaderFile, vk::Format colorFormat, const CVulkanVertexLayout& vertexLayout,
+    const std::vector<vk::DescriptorSetLayoutBinding>& descriptorSetLayoutBindings, vk::CullModeFlags cullMode, vk::DescriptorSetLayout bindlessSetLayout) {
+    return CVulkanGraphicsPipeline(device, descriptorLayoutCache.get(), vertexShaderFile, fragmentShaderFile, colorFormat, vertexLayout, descriptorSetLayoutBindings, cullMode, bindlessSetLayout);
 }
 
-CVulkanGraphicsPipeline CVulkanDevice::CreateGraphicsPipeline(std::string vertexShaderFile, std::string fragmentShaderFile, vk::Format colorFormat) {
-    return CVulkanGraphicsPipeline(device, vertexShaderFile, fragmentShaderFile, colorFormat);
+CVulkanMeshShadingPipeline CVulkanDevice::CreateMeshShadingPipeline(std::string taskShaderFile, std::string meshShaderFile, std::string fragmentShaderFile, vk::Format colorFormat,
+    const std::vector<vk::DescriptorSetLayoutBinding>& descriptorSetLayoutBindings, uint32_t pushConstantsSize, vk::CullModeFlags cullMode) {
+    return CVulkanMeshShadingPipeline(device, descriptorLayoutCache.get(), taskShaderFile, meshShaderFile, fragmentShaderFile, colorFormat, descriptorSetLayoutBindings, pushConstantsSize, cullMode);
+}
+
+CVulkanComputePipeline CVulkanDevice::CreateComputePipeline(std::string computeShaderFile, const std::vector<vk::DescriptorSetLayoutBinding>& descriptorSetLayoutBindings, uint32_t pushConstantsSize) {
+    return CVulkanComputePipeline(device, descriptorLayoutCache.get(), computeShaderFile, descriptorSetLayoutBindings, pushConstantsSize);
 }
 
 CVulkanImage CVulkanDevice::CreateImage(vk::Extent3D extent, vk::Format format, uint8_t mipLevels, vk::SampleCountFlagBits samples) {
-    return CVulkanImage(device, memoryProperties, extent, format, mipLevels, samples);
+    return CVulkanImage(device, allocator.get(), extent, format, mipLevels, samples);
 }
+
+
+uint32_t CVulkanDevice::SelectQueueFamily(vk::QueueFlags requiredFlags, vk::QueueFlags undesiredFlags, vk::SurfaceKHR presentSurface) {
+    uint32_t selected = 0;
+    int bestScore = std::numeric_limits<int>::min();
+    for(uint32_t i = 0; i < queueFamilies.size(); i++) {
+        vk::QueueFlags flags = queueFamilies[i].queueFlags;
+        if(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)) {
+            flags |= vk::QueueFlagBits::eTransfer;
+        }
+        if((flags & requiredFlags) != requiredFlags) {
+            continue;
+        }
+
+        int score = 0;
+        for(auto flag : { vk::QueueFlagBits::eGraphics, vk::QueueFlagBits::eCompute, vk::QueueFlagBits::eTransfer }) {
+            if((flags & flag) && (undesiredFlags & flag)) {
+                score -= 16;
+            }
+        }
+        if(presentSurface && !physicalDevice.getSurfaceSupportKHR(i, presentSurface)) {
+            score -= 256; // Outweighs every other term.
+        }
+        score += static_cast<int>(std::min(queueFamilies[i].queueCount, 8u)); // More queues breaks ties.
+        if(score > bestScore) {
+            bestScore = score;
+            selected = i;
+        }
+    }
+    return selected;
+}
\ No newline at end of file
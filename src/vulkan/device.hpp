@@ -5,38 +5,79 @@
 class CVulkanBuffer;
 class CVulkanImage;
 class CVulkanGraphicsPipeline;
+class CVulkanComputePipeline;
+class CVulkanMeshShadingPipeline;
+class CVulkanVertexLayout;
 class CVulkanQueue;
+class CVulkanMemoryAllocator;
+class CVulkanDescriptorLayoutCache;
 
 class CVulkanDevice {
     std::shared_ptr<vk::raii::Device> device;
     vk::raii::PhysicalDevice physicalDevice;
     vk::PhysicalDeviceProperties properties;
     vk::PhysicalDeviceFeatures features;
+    bool gpuDrivenRenderingSupported; // multiDrawIndirect and drawIndirectCount.
+    bool meshShadingSupported; // VK_EXT_mesh_shader with task and mesh shaders.
+    bool bindlessSupported; // Descriptor indexing with partially bound sampled image arrays updated after bind.
+    uint32_t maxBindlessSampledImages; // Per stage and per set limit on update after bind sampled images.
     vk::PhysicalDeviceLimits limits;
     vk::PhysicalDeviceMemoryProperties memoryProperties;
     std::vector<vk::LayerProperties> availableLayers;
     std::vector<const char*> enabledLayers;
     std::vector<vk::ExtensionProperties> availableExtensions;
     std::vector<const char*> enabledExtensions;
+    std::vector<vk::QueueFamilyProperties> queueFamilies;
+    uint32_t graphicsQueueFamily;
+    uint32_t computeQueueFamily;
+    uint32_t transferQueueFamily;
     uint32_t graphicsQueueIndex;
     uint32_t computeQueueIndex;
     uint32_t transferQueueIndex;
+    std::unique_ptr<CVulkanMemoryAllocator> allocator;
+    std::unique_ptr<CVulkanDescriptorLayoutCache> descriptorLayoutCache;
 public:
-    CVulkanDevice(vk::raii::PhysicalDevice physicalDevice);
+    // The graphics family is chosen among those that can present to the surface, when one is given.
+    CVulkanDevice(vk::raii::PhysicalDevice physicalDevice, vk::SurfaceKHR surface = nullptr);
     ~CVulkanDevice();
     vk::SampleCountFlags GetMaximumSupportedMultisamping();
     std::shared_ptr<vk::raii::Device> GetVkDevice();
     vk::PhysicalDevice GetVkPhysicalDevice();
     vk::PhysicalDeviceProperties GetVkPhysicalDeviceProperties();
     vk::PhysicalDeviceMemoryProperties GetVkPhysicalDeviceMemoryProperties();
+    vk::QueueFamilyProperties GetVkQueueFamilyProperties(uint32_t familyIndex);
     std::vector<vk::LayerProperties> GetAvailableVkLayerProperties();
     std::vector<const char*> GetEnabledLayerProperties();
     std::vector<vk::ExtensionProperties> GetAvailableVkExtensionProperties();
     std::vector<const char*> GetEnabledExtensionProperties();
+    // Checks the optimal tiling features of format.
+    bool IsFormatFeatureSupported(vk::Format format, vk::FormatFeatureFlags features);
+    // BC formats may only be used when this is true, even if they report format features.
+    bool IsTextureCompressionBCEnabled();
+    // vkCmdDrawIndexedIndirectCount may only be used with more than one draw when this is true.
+    bool IsGpuDrivenRenderingEnabled();
+    // Task and mesh shaders and vkCmdDrawMeshTasksEXT may only be used when this is true.
+    bool IsMeshShadingEnabled();
+    // Runtime sized, non uniformly indexed descriptor arrays updated after bind may only be used when this is true.
+    bool IsBindlessEnabled();
+    uint32_t GetMaxBindlessSampledImages();
     std::unique_ptr<CVulkanQueue> GetGraphicsQueue();
     std::unique_ptr<CVulkanQueue> GetComputeQueue();
     std::unique_ptr<CVulkanQueue> GetTransferQueue();
+    CVulkanMemoryAllocator* GetMemoryAllocator();
+    // Layouts of the pipelines created here, shared by pipelines and sets with the same bindings.
+    CVulkanDescriptorLayoutCache* GetDescriptorLayoutCache();
     CVulkanBuffer CreateBuffer(vk::MemoryPropertyFlags desiredPropertyFlags, vk::BufferUsageFlags usage, void* data, vk::DeviceSize dataSize);
-    CVulkanGraphicsPipeline CreateGraphicsPipeline(std::string vertexShaderFile, std::string fragmentShaderFile, vk::Format colorFormat);
+    CVulkanGraphicsPipeline CreateGraphicsPipeline(std::string vertexShaderFile, std::string fragmentShaderFile, vk::Format colorFormat, const CVulkanVertexLayout& vertexLayout,
+        const std::vector<vk::DescriptorSetLayoutBinding>& descriptorSetLayoutBindings, vk::CullModeFlags cullMode = vk::CullModeFlagBits::eNone,
+        vk::DescriptorSetLayout bindlessSetLayout = nullptr);
+    CVulkanMeshShadingPipeline CreateMeshShadingPipeline(std::string taskShaderFile, std::string meshShaderFile, std::string fragmentShaderFile, vk::Format colorFormat,
+        const std::vector<vk::DescriptorSetLayoutBinding>& descriptorSetLayoutBindings, uint32_t pushConstantsSize = 0, vk::CullModeFlags cullMode = vk::CullModeFlagBits::eNone);
+    CVulkanComputePipeline CreateComputePipeline(std::string computeShaderFile, const std::vector<vk::DescriptorSetLayoutBinding>& descriptorSetLayoutBindings,
+        uint32_t pushConstantsSize = 0);
     CVulkanImage CreateImage(vk::Extent3D extent, vk::Format format, uint8_t mipLevels = 1, vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1);
+private:
+    // Picks the family with the required flags that has the fewest of the undesired ones, so dedicated families win.
+    // Given a surface, families that cannot present to it only win when no family with the required flags can.
+    uint32_t SelectQueueFamily(vk::QueueFlags requiredFlags, vk::QueueFlags undesiredFlags, vk::SurfaceKHR presentSurface = nullptr);
 };
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "drawqueue.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+static constexpr uint32_t PASS_SHIFT = 62;
+
+uint64_t CVulkanDrawQueue::MakeKey(CVulkanDrawPass pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth) {
+    uint64_t depthBucket = QuantizeDepth(depth);
+    uint64_t state = (static_cast<uint64_t>(pipeline & ((1u << PIPELINE_BITS) - 1)) << (MATERIAL_BITS + MESH_BITS)) |
+        (static_cast<uint64_t>(material & ((1u << MATERIAL_BITS) - 1)) << MESH_BITS) | (mesh & ((1u << MESH_BITS) - 1));
+    uint64_t key = static_cast<uint64_t>(pass) << PASS_SHIFT;
+    if(pass == DRAW_PASS_TRANSPARENT) {
+        // The farthest comes first, state only breaks ties.
+        uint64_t invertedDepth = ((1u << DEPTH_BITS) - 1) - depthBucket;
+        return key | (invertedDepth << (PIPELINE_BITS + MATERIAL_BITS + MESH_BITS)) | state;
+    }
+    return key | (state << DEPTH_BITS) | depthBucket;
+}
+
+uint64_t CVulkanDrawQueue::GetStateKey(uint64_t key) {
+    if((key >> PASS_SHIFT) == DRAW_PASS_TRANSPARENT) {
+        return key & ~(static_cast<uint64_t>((1u << DEPTH_BITS) - 1) << (PIPELINE_BITS + MATERIAL_BITS + MESH_BITS));
+    }
+    return key & ~static_cast<uint64_t>((1u << DEPTH_BITS) - 1);
+}
+
+void CVulkanDrawQueue::Clear() {
+    packets.clear();
+}
+
+void CVulkanDrawQueue::Push(uint64_t key, uint32_t instance) {
+    packets.push_back({ key, instance });
+}
+
+void CVulkanDrawQueue::Sort() {
+    // One pass over the keys counts all eight digits.
+    size_t counts[8][256] = {};
+    for(auto& packet : packets) {
+        for(int digit = 0; digit < 8; digit++) {
+            counts[digit][(packet.key >> (digit * 8)) & 0xFF]++;
+        }
+    }
+
+    scratch.resize(packets.size());
+    for(int digit = 0; digit < 8; digit++) {
+        // A digit every key shares would not move anything, e.g. the unused pipeline and pass bits.
+        size_t* digitCounts = counts[digit];
+        if(std::any_of(digitCounts, digitCounts + 256, [&](size_t count) { return count == packets.size(); })) {
+            continue;
+        }
+        size_t offsets[256];
+        size_t offset = 0;
+        for(int bucket = 0; bucket < 256; bucket++) {
+            offsets[bucket] = offset;
+            offset += digitCounts[bucket];
+        }
+        for(auto& packet : packets) {
+            scratch[offsets[(packet.key >> (digit * 8)) & 0xFF]++] = packet;
+        }
+        packets.swap(scratch);
+    }
+}
+
+const std::vector<CVulkanDrawPacket>& CVulkanDrawQueue::GetPackets() {
+    return packets;
+}
+
+bool CVulkanDrawQueue::RunBenchmark(size_t count) {
+    // Few pipelines and materials and many meshes, as in a real scene, a tenth of them transparent.
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<uint32_t> pipeline(0, 7);
+    std::uniform_int_distribution<uint32_t> material(0, 255);
+    std::uniform_int_distribution<uint32_t> mesh(0, 4095);
+    std::uniform_real_distribution<float> depth(0.0f, 1000.0f);
+    std::uniform_int_distribution<uint32_t> transparent(0, 9);
+    CVulkanDrawQueue queue;
+    queue.packets.reserve(count);
+    for(size_t i = 0; i < count; i++) {
+        CVulkanDrawPass pass = transparent(random) == 0 ? DRAW_PASS_TRANSPARENT : DRAW_PASS_OPAQUE;
+        queue.Push(MakeKey(pass, pipeline(random), material(random), mesh(random), depth(random)), static_cast<uint32_t>(i));
+    }
+    std::vector<CVulkanDrawPacket> expected = queue.packets;
+
+    auto start = std::chrono::steady_clock::now();
+    queue.Sort();
+    auto sorted = std::chrono::steady_clock::now();
+    std::stable_sort(expected.begin(), expected.end(), [](const CVulkanDrawPacket& a, const CVulkanDrawPacket& b) { return a.key < b.key; });
+    auto end = std::chrono::steady_clock::now();
+
+    bool matches = std::equal(expected.begin(), expected.end(), queue.packets.begin(), [](const CVulkanDrawPacket& a, const CVulkanDrawPacket& b) {
+        return a.key == b.key && a.instance == b.instance;
+    });
+    printf("CVulkanDrawQueue::RunBenchmark: Radix sorted %zu packets in %.3f ms, std::stable_sort took %.3f ms, %s\n", count,
+        std::chrono::duration<double, std::milli>(sorted - start).count(), std::chrono::duration<double, std::milli>(end - sorted).count(),
+        matches ? "results match" : "RESULTS DIFFER");
+    return matches;
+}
+
+uint32_t CVulkanDrawQueue::QuantizeDepth(float depth) {
+    depth = std::max(depth, 0.0f);
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    // The sign bit is always clear, the next 20 bits order non-negative floats like their values.
+    return (bits >> (31 - DEPTH_BITS)) & ((1u << DEPTH_BITS) - 1);
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Passes in the order they are drawn in, the top bits of every sort key.
+enum CVulkanDrawPass {
+    DRAW_PASS_OPAQUE,
+    DRAW_PASS_TRANSPARENT
+};
+
+struct CVulkanDrawPacket {
+    uint64_t key;
+    uint32_t instance; // Index of whatever the packet draws, carried along by the sort.
+};
+
+// Draw packets sorted by a 64 bit key with an LSD radix sort, so draws sharing state end up next to each other.
+// Opaque keys are pass | pipeline | material | mesh | depth, drawing front to back within the same state.
+// Transparent keys are pass | inverted depth | pipeline | material | mesh, drawing back to front across all states.
+class CVulkanDrawQueue {
+    std::vector<CVulkanDrawPacket> packets;
+    std::vector<CVulkanDrawPacket> scratch; // Ping pong buffer of the sort.
+public:
+    static constexpr uint32_t PIPELINE_BITS = 10;
+    static constexpr uint32_t MATERIAL_BITS = 16;
+    static constexpr uint32_t MESH_BITS = 16;
+    static constexpr uint32_t DEPTH_BITS = 20;
+
+    // Ids are truncated to their bits, so different ids may share a key. depth is the view distance, negative is clamped to 0.
+    static uint64_t MakeKey(CVulkanDrawPass pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+    // key without its depth, packets with equal state keys can be drawn together.
+    static uint64_t GetStateKey(uint64_t key);
+    void Clear();
+    void Push(uint64_t key, uint32_t instance);
+    // Sorts by key, packets with equal keys keep the order they were pushed in.
+    void Sort();
+    const std::vector<CVulkanDrawPacket>& GetPackets();
+    // Sorts count random packets with Sort() and std::stable_sort, checks they agree and prints the timings.
+    static bool RunBenchmark(size_t count);
+private:
+    // Monotonic 20 bit bucket of a non-negative float, taken from the top of its bit pattern.
+    static uint32_t QuantizeDepth(float depth);
+};
\ No newline at end of file
@@ -0,0 +1,701 @@
+#include "graph.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include "device.hpp"
+#include "memory.hpp"
+#include "image.hpp"
+#include "cmd.hpp"
+#include "types.hpp"
+
+struct CVulkanRenderGraphAccessState {
+    vk::ImageLayout layout;
+    vk::PipelineStageFlags2 stages;
+    vk::AccessFlags2 access;
+    vk::ImageUsageFlags usage;
+};
+
+static CVulkanRenderGraphAccessState GetAccessState(CVulkanRenderGraphAccess access) {
+    switch(access) {
+    case RENDER_GRAPH_COLOR_ATTACHMENT:
+        return { vk::ImageLayout::eColorAttachmentOptimal, vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+            vk::AccessFlagBits2::eColorAttachmentRead | vk::AccessFlagBits2::eColorAttachmentWrite, vk::ImageUsageFlagBits::eColorAttachment };
+    case RENDER_GRAPH_DEPTH_ATTACHMENT:
+        return { vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests,
+            vk::AccessFlagBits2::eDepthStencilAttachmentRead | vk::AccessFlagBits2::eDepthStencilAttachmentWrite, vk::ImageUsageFlagBits::eDepthStencilAttachment };
+    case RENDER_GRAPH_DEPTH_READ:
+        return { vk::ImageLayout::eDepthStencilReadOnlyOptimal, vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests,
+            vk::AccessFlagBits2::eDepthStencilAttachmentRead, vk::ImageUsageFlagBits::eDepthStencilAttachment };
+    case RENDER_GRAPH_SAMPLED:
+        return { vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader,
+            vk::AccessFlagBits2::eShaderSampledRead, vk::ImageUsageFlagBits::eSampled };
+    case RENDER_GRAPH_STORAGE_READ:
+        return { vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader,
+            vk::AccessFlagBits2::eShaderStorageRead, vk::ImageUsageFlagBits::eStorage };
+    case RENDER_GRAPH_STORAGE_WRITE:
+        return { vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader,
+            vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite, vk::ImageUsageFlagBits::eStorage };
+    case RENDER_GRAPH_TRANSFER_SRC:
+        return { vk::ImageLayout::eTransferSrcOptimal, vk::PipelineStageFlagBits2::eTransfer,
+            vk::AccessFlagBits2::eTransferRead, vk::ImageUsageFlagBits::eTransferSrc };
+    case RENDER_GRAPH_TRANSFER_DST:
+    default:
+        return { vk::ImageLayout::eTransferDstOptimal, vk::PipelineStageFlagBits2::eTransfer,
+            vk::AccessFlagBits2::eTransferWrite, vk::ImageUsageFlagBits::eTransferDst };
+    }
+}
+
+static vk::ImageAspectFlags GetAspectMask(vk::Format format) {
+    switch(format) {
+    case vk::Format::eD16Unorm:
+    case vk::Format::eD32Sfloat:
+    case vk::Format::eX8D24UnormPack32:
+        return vk::ImageAspectFlagBits::eDepth;
+    case vk::Format::eD16UnormS8Uint:
+    case vk::Format::eD24UnormS8Uint:
+    case vk::Format::eD32SfloatS8Uint:
+        return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+    default:
+        return vk::ImageAspectFlagBits::eColor;
+    }
+}
+
+static vk::DeviceSize AlignUp(vk::DeviceSize value, vk::DeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Close enough to what a driver asks for to weigh images against each other before any of them exist.
+static vk::DeviceSize GetEstimatedSize(const CVulkanRenderGraphImageDesc& desc) {
+    vk::DeviceSize texelSize;
+    switch(desc.format) {
+    case vk::Format::eR8Unorm:
+        texelSize = 1;
+        break;
+    case vk::Format::eR8G8Unorm:
+    case vk::Format::eR16Sfloat:
+    case vk::Format::eD16Unorm:
+        texelSize = 2;
+        break;
+    case vk::Format::eR16G16B16A16Sfloat:
+    case vk::Format::eR32G32Sfloat:
+    case vk::Format::eD32SfloatS8Uint:
+        texelSize = 8;
+        break;
+    case vk::Format::eR32G32B32A32Sfloat:
+        texelSize = 16;
+        break;
+    default:
+        texelSize = 4;
+        break;
+    }
+    return static_cast<vk::DeviceSize>(desc.extent.width) * desc.extent.height * static_cast<uint32_t>(desc.samples) * texelSize;
+}
+
+// Every resource a pass uses once, a pass may e.g. sample the depth attachment it tests against.
+static std::vector<uint32_t> GetUsedResources(const std::vector<uint32_t>& resources) {
+    std::vector<uint32_t> used = resources;
+    std::sort(used.begin(), used.end());
+    used.erase(std::unique(used.begin(), used.end()), used.end());
+    return used;
+}
+
+CVulkanRenderGraph::CVulkanRenderGraph(CVulkanDevice* device, CVulkanBarrierTracker* barrierTracker)
+    : device(device), barrierTracker(barrierTracker) {}
+
+CVulkanRenderGraph::~CVulkanRenderGraph() {
+    for(auto& transientImage : transientImages) {
+        barrierTracker->RemoveImage(**transientImage.image);
+    }
+}
+
+void CVulkanRenderGraph::Reset() {
+    passes.clear();
+    resources.clear();
+    executionOrder.clear();
+}
+
+uint32_t CVulkanRenderGraph::ImportImage(std::string name, vk::Image image, vk::ImageView imageView, vk::Extent2D extent, vk::Format format,
+    CVulkanResourceState initialState, vk::ImageLayout finalLayout, vk::PipelineStageFlags2 finalStages, vk::AccessFlags2 finalAccess) {
+    Resource resource;
+    resource.name = name;
+    resource.desc.extent = extent;
+    resource.desc.format = format;
+    resource.aspectMask = GetAspectMask(format);
+    resource.imported = true;
+    resource.image = image;
+    resource.imageView = imageView;
+    resource.initialState = initialState;
+    resource.finalLayout = finalLayout;
+    resource.finalStages = finalStages;
+    resource.finalAccess = finalAccess;
+    resources.push_back(resource);
+    return static_cast<uint32_t>(resources.size() - 1);
+}
+
+uint32_t CVulkanRenderGraph::CreateImage(std::string name, CVulkanRenderGraphImageDesc desc) {
+    Resource resource;
+    resource.name = name;
+    resource.desc = desc;
+    resource.aspectMask = GetAspectMask(desc.format);
+    resource.imported = false;
+    resources.push_back(resource);
+    return static_cast<uint32_t>(resources.size() - 1);
+}
+
+uint32_t CVulkanRenderGraph::AddPass(std::string name, CVulkanRenderGraphExecute execute, vk::RenderingFlags renderingFlags) {
+    Pass pass;
+    pass.name = name;
+    pass.execute = execute;
+    pass.renderingFlags = renderingFlags;
+    passes.push_back(pass);
+    return static_cast<uint32_t>(passes.size() - 1);
+}
+
+void CVulkanRenderGraph::AddColorAttachment(uint32_t pass, uint32_t resource, vk::AttachmentLoadOp loadOp, vk::ClearColorValue clearColor) {
+    vk::RenderingAttachmentInfo attachment;
+    attachment.setImageLayout(vk::ImageLayout::eColorAttachmentOptimal);
+    attachment.setLoadOp(loadOp);
+    attachment.setStoreOp(vk::AttachmentStoreOp::eStore);
+    attachment.setClearValue(clearColor);
+    passes[pass].colorResources.push_back(resource);
+    passes[pass].colorAttachments.push_back(attachment);
+    passes[pass].uses.push_back({ resource, RENDER_GRAPH_COLOR_ATTACHMENT, loadOp == vk::AttachmentLoadOp::eLoad, true });
+}
+
+void CVulkanRenderGraph::SetDepthAttachment(uint32_t pass, uint32_t resource, vk::AttachmentLoadOp loadOp, float clearDepth, bool depthWrite) {
+    vk::RenderingAttachmentInfo attachment;
+    attachment.setImageLayout(depthWrite ? vk::ImageLayout::eDepthStencilAttachmentOptimal : vk::ImageLayout::eDepthStencilReadOnlyOptimal);
+    attachment.setLoadOp(loadOp);
+    attachment.setStoreOp(depthWrite ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eNone);
+    attachment.setClearValue(vk::ClearDepthStencilValue(clearDepth, 0));
+    passes[pass].depthResource = resource;
+    passes[pass].depthAttachment = attachment;
+    passes[pass].uses.push_back({ resource, depthWrite ? RENDER_GRAPH_DEPTH_ATTACHMENT : RENDER_GRAPH_DEPTH_READ,
+        !depthWrite || loadOp == vk::AttachmentLoadOp::eLoad, depthWrite });
+}
+
+void CVulkanRenderGraph::AddRead(uint32_t pass, uint32_t resource, CVulkanRenderGraphAccess access) {
+    passes[pass].uses.push_back({ resource, access, true, false });
+}
+
+void CVulkanRenderGraph::AddWrite(uint32_t pass, uint32_t resource, CVulkanRenderGraphAccess access) {
+    passes[pass].uses.push_back({ resource, access, true, true });
+}
+
+void CVulkanRenderGraph::SetSideEffects(uint32_t pass) {
+    passes[pass].sideEffects = true;
+}
+
+void CVulkanRenderGraph::Compile() {
+    std::vector<TransientImage> plannedImages = Plan();
+
+    bool changed = plannedImages.size() != transientImages.size();
+    for(size_t i = 0; !changed && i < plannedImages.size(); i++) {
+        TransientImage& planned = plannedImages[i];
+        TransientImage& current = transientImages[i];
+        changed = planned.desc.extent != current.desc.extent || planned.desc.format != current.desc.format ||
+            planned.desc.usage != current.desc.usage || planned.desc.samples != current.desc.samples ||
+            planned.firstPass != current.firstPass || planned.lastPass != current.lastPass;
+    }
+    statistics.passCount = static_cast<uint32_t>(executionOrder.size());
+    statistics.culledPassCount = static_cast<uint32_t>(passes.size() - executionOrder.size());
+    if(changed) {
+        CreateTransientImages(plannedImages);
+        PrintStatistics();
+    }
+
+    for(auto& resource : resources) {
+        if(resource.transientIndex != NO_RESOURCE) {
+            resource.image = **transientImages[resource.transientIndex].image;
+            resource.imageView = **transientImages[resource.transientIndex].imageView;
+        }
+    }
+}
+
+std::vector<CVulkanRenderGraph::TransientImage> CVulkanRenderGraph::Plan() {
+    // Walk backwards from the imported images, a pass lives if a later live pass or the outside reads what it writes.
+    // A write that does not read the earlier contents makes them dead for the passes before it.
+    std::vector<bool> needed(resources.size(), false);
+    for(size_t i = 0; i < resources.size(); i++) {
+        needed[i] = resources[i].imported;
+    }
+    for(size_t i = passes.size(); i-- > 0;) {
+        Pass& pass = passes[i];
+        pass.live = pass.sideEffects;
+        for(auto& use : pass.uses) {
+            pass.live = pass.live || (use.write && needed[use.resource]);
+        }
+        if(!pass.live) {
+            continue;
+        }
+        for(auto& use : pass.uses) {
+            if(use.write && !use.read) {
+                needed[use.resource] = false;
+            }
+        }
+        for(auto& use : pass.uses) {
+            if(use.read) {
+                needed[use.resource] = true;
+            }
+        }
+    }
+
+    OrderPasses();
+
+    // Lifetimes in execution order, and the usage every transient image needs.
+    std::vector<vk::ImageUsageFlags> usages(resources.size());
+    for(uint32_t position = 0; position < executionOrder.size(); position++) {
+        for(auto& use : passes[executionOrder[position]].uses) {
+            Resource& resource = resources[use.resource];
+            if(resource.firstPass == NO_PASS) {
+                resource.firstPass = position;
+            }
+            resource.lastPass = position;
+            usages[use.resource] |= GetAccessState(use.access).usage;
+        }
+    }
+
+    std::vector<TransientImage> plannedImages;
+    for(uint32_t i = 0; i < resources.size(); i++) {
+        Resource& resource = resources[i];
+        if(resource.imported || resource.firstPass == NO_PASS) {
+            continue;
+        }
+        TransientImage transientImage;
+        transientImage.desc = resource.desc;
+        transientImage.desc.usage |= usages[i];
+        transientImage.aspectMask = resource.aspectMask;
+        transientImage.firstPass = resource.firstPass;
+        transientImage.lastPass = resource.lastPass;
+        resource.transientIndex = static_cast<uint32_t>(plannedImages.size());
+        plannedImages.push_back(std::move(transientImage));
+    }
+    return plannedImages;
+}
+
+void CVulkanRenderGraph::OrderPasses() {
+    // Dependencies from the uses in declaration order: a read waits for the last write, a write for the last write and
+    // every read since. Passes with side effects keep their place, what they touch is outside the graph.
+    std::vector<std::vector<uint32_t>> dependents(passes.size());
+    std::vector<uint32_t> dependencyCounts(passes.size(), 0);
+    auto addDependency = [&](uint32_t before, uint32_t after) {
+        if(before != NO_PASS && before != after) {
+            dependents[before].push_back(after);
+            dependencyCounts[after]++;
+        }
+    };
+    std::vector<uint32_t> lastWriters(resources.size(), NO_PASS);
+    std::vector<std::vector<uint32_t>> readersSinceWrite(resources.size());
+    std::vector<uint32_t> livePasses;
+    uint32_t lastSideEffectPass = NO_PASS;
+    for(uint32_t i = 0; i < passes.size(); i++) {
+        if(!passes[i].live) {
+            continue;
+        }
+        if(passes[i].sideEffects) {
+            for(auto earlier : livePasses) {
+                addDependency(earlier, i);
+            }
+            lastSideEffectPass = i;
+        } else {
+            addDependency(lastSideEffectPass, i);
+        }
+        for(auto& use : passes[i].uses) {
+            addDependency(lastWriters[use.resource], i);
+            if(use.write) {
+                for(auto reader : readersSinceWrite[use.resource]) {
+                    addDependency(reader, i);
+                }
+                readersSinceWrite[use.resource].clear();
+                lastWriters[use.resource] = i;
+            } else {
+                readersSinceWrite[use.resource].push_back(i);
+            }
+        }
+        livePasses.push_back(i);
+    }
+
+    // A transient image takes memory from its first use until after its last one.
+    std::vector<std::vector<uint32_t>> passResources(passes.size());
+    std::vector<vk::DeviceSize> sizes(resources.size(), 0);
+    std::vector<uint32_t> remainingUses(resources.size(), 0);
+    std::vector<bool> allocated(resources.size(), false);
+    for(uint32_t i = 0; i < resources.size(); i++) {
+        sizes[i] = resources[i].imported ? 0 : GetEstimatedSize(resources[i].desc);
+    }
+    std::vector<uint32_t> ready;
+    for(auto pass : livePasses) {
+        std::vector<uint32_t> used;
+        for(auto& use : passes[pass].uses) {
+            used.push_back(use.resource);
+        }
+        passResources[pass] = GetUsedResources(used);
+        for(auto resource : passResources[pass]) {
+            remainingUses[resource]++;
+        }
+        if(dependencyCounts[pass] == 0) {
+            ready.push_back(pass);
+        }
+    }
+
+    executionOrder.clear();
+    while(!ready.empty()) {
+        size_t best = 0;
+        int64_t bestGrowth = std::numeric_limits<int64_t>::max();
+        for(size_t i = 0; i < ready.size(); i++) {
+            int64_t growth = 0;
+            for(auto resource : passResources[ready[i]]) {
+                if(!allocated[resource]) {
+                    growth += static_cast<int64_t>(sizes[resource]);
+                }
+                if(remainingUses[resource] == 1) {
+                    growth -= static_cast<int64_t>(sizes[resource]);
+                }
+            }
+            if(growth < bestGrowth) {
+                best = i;
+                bestGrowth = growth;
+            }
+        }
+        uint32_t pass = ready[best];
+        ready.erase(ready.begin() + best);
+        executionOrder.push_back(pass);
+        for(auto resource : passResources[pass]) {
+            allocated[resource] = true;
+            remainingUses[resource]--;
+        }
+        for(auto dependent : dependents[pass]) {
+            if(--dependencyCounts[dependent] == 0) {
+                ready.insert(std::upper_bound(ready.begin(), ready.end(), dependent), dependent);
+            }
+        }
+    }
+}
+
+void CVulkanRenderGraph::Execute(CVulkanCommandBuffer* commandBuffer, CVulkanFrame* frame) {
+    for(auto& resource : resources) {
+        if(resource.imported && resource.firstPass != NO_PASS) {
+            barrierTracker->SetImageState(resource.image, resource.initialState, vk::ImageSubresourceRange(resource.aspectMask, 0, 1, 0, 1));
+        }
+    }
+
+    for(uint32_t position = 0; position < executionOrder.size(); position++) {
+        Pass& pass = passes[executionOrder[position]];
+        for(auto& use : pass.uses) {
+            Resource& resource = resources[use.resource];
+            vk::ImageSubresourceRange range(resource.aspectMask, 0, 1, 0, 1);
+            CVulkanRenderGraphAccessState state = GetAccessState(use.access);
+            if(!resource.imported) {
+                TransientImage& transientImage = transientImages[resource.transientIndex];
+                if(resource.firstPass == position) {
+                    // The memory held another image, or this one last frame. Its contents are discarded but the first use
+                    // still has to wait for the last uses of whatever was there.
+                    CVulkanResourceState aliasedState;
+                    aliasedState.writeStages = transientImage.usedStages;
+                    aliasedState.writeAccess = transientImage.usedAccess;
+                    for(auto alias : transientImage.aliases) {
+                        aliasedState.writeStages |= transientImages[alias].usedStages;
+                        aliasedState.writeAccess |= transientImages[alias].usedAccess;
+                    }
+                    barrierTracker->SetImageState(resource.image, aliasedState, range);
+                    transientImage.usedStages = {};
+                    transientImage.usedAccess = {};
+                }
+                transientImage.usedStages |= state.stages;
+                transientImage.usedAccess |= state.access;
+            }
+            barrierTracker->UseImage(resource.image, state.layout, state.stages, state.access, range);
+        }
+        barrierTracker->Flush(commandBuffer);
+
+        if(pass.colorAttachments.empty() && pass.depthResource == NO_RESOURCE) {
+            pass.execute(commandBuffer, frame);
+            continue;
+        }
+
+        CVulkanRender render;
+        CVulkanFrame passFrame = *frame;
+        for(size_t i = 0; i < pass.colorAttachments.size(); i++) {
+            Resource& resource = resources[pass.colorResources[i]];
+            pass.colorAttachments[i].setImageView(resource.imageView);
+            render.colorAttachments.push_back(pass.colorAttachments[i]);
+            passFrame.extent = resource.desc.extent;
+        }
+        if(pass.depthResource != NO_RESOURCE) {
+            Resource& resource = resources[pass.depthResource];
+            pass.depthAttachment.setImageView(resource.imageView);
+            render.depthAttachments.push_back(pass.depthAttachment);
+            passFrame.extent = resource.desc.extent;
+        }
+        commandBuffer->BeginRendering(&passFrame, &render, pass.renderingFlags);
+        pass.execute(commandBuffer, &passFrame);
+        commandBuffer->EndRendering();
+    }
+
+    for(auto& resource : resources) {
+        if(resource.imported && resource.firstPass != NO_PASS) {
+            barrierTracker->UseImage(resource.image, resource.finalLayout, resource.finalStages, resource.finalAccess,
+                vk::ImageSubresourceRange(resource.aspectMask, 0, 1, 0, 1));
+        }
+    }
+    barrierTracker->Flush(commandBuffer);
+}
+
+vk::Image CVulkanRenderGraph::GetVkImage(uint32_t resource) {
+    return resources[resource].image;
+}
+
+vk::ImageView CVulkanRenderGraph::GetVkImageView(uint32_t resource) {
+    return resources[resource].imageView;
+}
+
+std::vector<std::string> CVulkanRenderGraph::GetCulledPassNames() {
+    std::vector<std::string> names;
+    for(auto& pass : passes) {
+        if(!pass.live) {
+            names.push_back(pass.name);
+        }
+    }
+    return names;
+}
+
+CVulkanRenderGraphStatistics CVulkanRenderGraph::GetStatistics() {
+    return statistics;
+}
+
+void CVulkanRenderGraph::PrintStatistics() {
+    printf("CVulkanRenderGraph: %u passes, %u culled, %u transient images, %.2f MiB transient memory, %.2f MiB without aliasing\n",
+        statistics.passCount, statistics.culledPassCount, statistics.transientImageCount,
+        statistics.transientBytes / (1024.0 * 1024.0), statistics.unaliasedTransientBytes / (1024.0 * 1024.0));
+}
+
+bool CVulkanRenderGraph::RunAliasingTest() {
+    CVulkanRenderGraph graph(nullptr, nullptr);
+    vk::Extent2D extent(1920, 1080);
+    uint32_t backbuffer = graph.ImportImage("backbuffer", vk::Image(), vk::ImageView(), extent, vk::Format::eB8G8R8A8Srgb,
+        CVulkanResourceState(), vk::ImageLayout::ePresentSrcKHR);
+    uint32_t shadowMap = graph.CreateImage("shadow map", { vk::Extent2D(2048, 2048), vk::Format::eD32Sfloat, {} });
+    uint32_t depth = graph.CreateImage("depth", { extent, vk::Format::eD32Sfloat, {} });
+    uint32_t normals = graph.CreateImage("normals", { extent, vk::Format::eR16G16B16A16Sfloat, {} });
+    uint32_t occlusion = graph.CreateImage("occlusion", { extent, vk::Format::eR8Unorm, {} });
+    uint32_t hdr = graph.CreateImage("hdr", { extent, vk::Format::eR16G16B16A16Sfloat, {} });
+    uint32_t bloom = graph.CreateImage("bloom", { vk::Extent2D(extent.width / 2, extent.height / 2), vk::Format::eR16G16B16A16Sfloat, {} });
+    uint32_t debugView = graph.CreateImage("debug view", { extent, vk::Format::eR8G8B8A8Unorm, {} });
+
+    // Declared the way passes are usually written down, the shadow map first although only lighting reads it.
+    auto record = [](CVulkanCommandBuffer*, CVulkanFrame*) {};
+    uint32_t pass = graph.AddPass("shadows", record);
+    graph.SetDepthAttachment(pass, shadowMap, vk::AttachmentLoadOp::eClear);
+    pass = graph.AddPass("depth prepass", record);
+    graph.SetDepthAttachment(pass, depth, vk::AttachmentLoadOp::eClear);
+    pass = graph.AddPass("gbuffer", record);
+    graph.SetDepthAttachment(pass, depth, vk::AttachmentLoadOp::eLoad, 1.0f, false);
+    graph.AddColorAttachment(pass, normals, vk::AttachmentLoadOp::eClear);
+    pass = graph.AddPass("ambient occlusion", record);
+    graph.AddRead(pass, depth, RENDER_GRAPH_SAMPLED);
+    graph.AddRead(pass, normals, RENDER_GRAPH_SAMPLED);
+    graph.AddColorAttachment(pass, occlusion, vk::AttachmentLoadOp::eClear);
+    pass = graph.AddPass("lighting", record);
+    graph.AddRead(pass, shadowMap, RENDER_GRAPH_SAMPLED);
+    graph.AddRead(pass, normals, RENDER_GRAPH_SAMPLED);
+    graph.AddRead(pass, occlusion, RENDER_GRAPH_SAMPLED);
+    graph.AddColorAttachment(pass, hdr, vk::AttachmentLoadOp::eClear);
+    pass = graph.AddPass("debug view", record);
+    graph.AddRead(pass, normals, RENDER_GRAPH_SAMPLED);
+    graph.AddColorAttachment(pass, debugView, vk::AttachmentLoadOp::eClear);
+    pass = graph.AddPass("bloom", record);
+    graph.AddRead(pass, hdr, RENDER_GRAPH_SAMPLED);
+    graph.AddColorAttachment(pass, bloom, vk::AttachmentLoadOp::eClear);
+    pass = graph.AddPass("tonemap", record);
+    graph.AddRead(pass, hdr, RENDER_GRAPH_SAMPLED);
+    graph.AddRead(pass, bloom, RENDER_GRAPH_SAMPLED);
+    graph.AddColorAttachment(pass, backbuffer, vk::AttachmentLoadOp::eClear);
+
+    // Estimated requirements stand in for the ones of the images the device would create.
+    graph.transientImages = graph.Plan();
+    for(auto& transientImage : graph.transientImages) {
+        transientImage.memoryRequirements = vk::MemoryRequirements(AlignUp(GetEstimatedSize(transientImage.desc), 65536), 65536, ~0u);
+    }
+    graph.PlaceTransientImages();
+    graph.statistics.passCount = static_cast<uint32_t>(graph.executionOrder.size());
+    graph.statistics.culledPassCount = static_cast<uint32_t>(graph.passes.size() - graph.executionOrder.size());
+
+    const char* failure = nullptr;
+    std::vector<std::string> culledPassNames = graph.GetCulledPassNames();
+    if(culledPassNames.size() != 1 || culledPassNames[0] != "debug view") {
+        failure = "culled other passes than the unused debug view";
+    }
+
+    // Live passes touching the same resource, at least one of them writing it, have to keep their declaration order.
+    std::vector<uint32_t> positions(graph.passes.size(), NO_PASS);
+    for(uint32_t position = 0; position < graph.executionOrder.size(); position++) {
+        positions[graph.executionOrder[position]] = position;
+    }
+    for(uint32_t a = 0; a < graph.passes.size(); a++) {
+        for(uint32_t b = a + 1; b < graph.passes.size(); b++) {
+            if(!graph.passes[a].live || !graph.passes[b].live) {
+                continue;
+            }
+            for(auto& useA : graph.passes[a].uses) {
+                for(auto& useB : graph.passes[b].uses) {
+                    if(useA.resource == useB.resource && (useA.write || useB.write) && positions[b] < positions[a]) {
+                        failure = "execution order breaks a dependency";
+                    }
+                }
+            }
+        }
+    }
+
+    for(uint32_t i = 0; i < graph.transientImages.size(); i++) {
+        TransientImage& a = graph.transientImages[i];
+        if(a.offset % a.memoryRequirements.alignment != 0 || a.offset + a.memoryRequirements.size > graph.statistics.transientBytes) {
+            failure = "transient image is misaligned or outside the memory";
+        }
+        for(uint32_t j = i + 1; j < graph.transientImages.size(); j++) {
+            TransientImage& b = graph.transientImages[j];
+            bool alive = a.firstPass <= b.lastPass && b.firstPass <= a.lastPass;
+            bool shared = a.offset < b.offset + b.memoryRequirements.size && b.offset < a.offset + a.memoryRequirements.size;
+            if(alive && shared) {
+                failure = "transient images alive at the same time share memory";
+            }
+        }
+    }
+    // Only possible once the shadows run after the last read of the depth buffer.
+    std::vector<uint32_t>& shadowMapAliases = graph.transientImages[graph.resources[shadowMap].transientIndex].aliases;
+    if(std::find(shadowMapAliases.begin(), shadowMapAliases.end(), graph.resources[depth].transientIndex) == shadowMapAliases.end()) {
+        failure = "shadow map does not share memory with the depth buffer";
+    }
+    if(graph.statistics.transientBytes >= graph.statistics.unaliasedTransientBytes) {
+        failure = "aliasing saved no memory";
+    }
+
+    printf("CVulkanRenderGraph::RunAliasingTest: execution order");
+    for(auto index : graph.executionOrder) {
+        printf("%s %s", index == graph.executionOrder[0] ? "" : ",", graph.passes[index].name.c_str());
+    }
+    printf("\n");
+    for(auto& resource : graph.resources) {
+        if(resource.transientIndex != NO_RESOURCE) {
+            TransientImage& transientImage = graph.transientImages[resource.transientIndex];
+            printf("CVulkanRenderGraph::RunAliasingTest: %-10s passes %u-%u, %6.2f MiB at %6.2f MiB\n", resource.name.c_str(),
+                transientImage.firstPass, transientImage.lastPass, transientImage.memoryRequirements.size / (1024.0 * 1024.0),
+                transientImage.offset / (1024.0 * 1024.0));
+        }
+    }
+    graph.PrintStatistics();
+    printf("CVulkanRenderGraph::RunAliasingTest: aliasing saves %.1f%%, %s%s\n",
+        100.0 * (1.0 - static_cast<double>(graph.statistics.transientBytes) / graph.statistics.unaliasedTransientBytes),
+        failure == nullptr ? "passed" : "FAILED: ", failure == nullptr ? "" : failure);
+
+    // Nothing was created, there is nothing for the barrier tracker to forget.
+    graph.transientImages.clear();
+    return failure == nullptr;
+}
+
+void CVulkanRenderGraph::CreateTransientImages(std::vector<TransientImage>& plannedImages) {
+    // Frames still in flight may use the old images.
+    device->GetVkDevice()->waitIdle();
+    for(auto& transientImage : transientImages) {
+        barrierTracker->RemoveImage(**transientImage.image);
+    }
+    transientImages.clear();
+    transientMemory.reset();
+    transientImages = std::move(plannedImages);
+
+    auto vkDevice = device->GetVkDevice();
+    for(auto& transientImage : transientImages) {
+        auto imageInfo = vk::ImageCreateInfo({}, vk::ImageType::e2D, transientImage.desc.format,
+            vk::Extent3D(transientImage.desc.extent, 1), 1, 1, transientImage.desc.samples, vk::ImageTiling::eOptimal,
+            transientImage.desc.usage, vk::SharingMode::eExclusive);
+        transientImage.image = std::make_unique<vk::raii::Image>(*vkDevice, imageInfo);
+        transientImage.memoryRequirements = transientImage.image->getMemoryRequirements();
+    }
+
+    vk::MemoryRequirements heapRequirements = PlaceTransientImages();
+    if(transientImages.empty()) {
+        return;
+    }
+    if(heapRequirements.memoryTypeBits != 0) {
+        transientMemory = device->GetMemoryAllocator()->Allocate(heapRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal, MEMORY_RESOURCE_OPTIMAL);
+    }
+    if(transientMemory == nullptr) {
+        throw CVulkanImageCreationException(CVulkanImageCreationError::IMAGE_INVALID_MEMORY_TYPE);
+    }
+
+    for(auto& transientImage : transientImages) {
+        transientImage.image->bindMemory(transientMemory->GetVkDeviceMemory(), transientMemory->GetOffset() + transientImage.offset);
+
+        vk::ImageViewCreateInfo imageViewInfo;
+        imageViewInfo.setImage(**transientImage.image);
+        imageViewInfo.setViewType(vk::ImageViewType::e2D);
+        imageViewInfo.setFormat(transientImage.desc.format);
+        imageViewInfo.setSubresourceRange(vk::ImageSubresourceRange(transientImage.aspectMask, 0, 1, 0, 1));
+        transientImage.imageView = std::make_unique<vk::raii::ImageView>(*vkDevice, imageViewInfo);
+    }
+}
+
+vk::MemoryRequirements CVulkanRenderGraph::PlaceTransientImages() {
+    vk::MemoryRequirements heapRequirements;
+    heapRequirements.setMemoryTypeBits(~0u);
+    statistics.transientImageCount = static_cast<uint32_t>(transientImages.size());
+    statistics.unaliasedTransientBytes = 0;
+    for(auto& transientImage : transientImages) {
+        heapRequirements.memoryTypeBits &= transientImage.memoryRequirements.memoryTypeBits;
+        heapRequirements.alignment = std::max(heapRequirements.alignment, transientImage.memoryRequirements.alignment);
+        statistics.unaliasedTransientBytes = AlignUp(statistics.unaliasedTransientBytes, transientImage.memoryRequirements.alignment) +
+            transientImage.memoryRequirements.size;
+    }
+
+    std::vector<uint32_t> order(transientImages.size());
+    for(uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return transientImages[a].memoryRequirements.size > transientImages[b].memoryRequirements.size;
+    });
+
+    std::vector<uint32_t> placed;
+    for(auto index : order) {
+        TransientImage& transientImage = transientImages[index];
+        vk::DeviceSize size = transientImage.memoryRequirements.size;
+        vk::DeviceSize alignment = transientImage.memoryRequirements.alignment;
+
+        // Only images alive at the same time are in the way, candidate offsets are right after each of them.
+        std::vector<uint32_t> conflicts;
+        std::vector<vk::DeviceSize> candidates = { 0 };
+        for(auto other : placed) {
+            TransientImage& otherImage = transientImages[other];
+            if(otherImage.firstPass <= transientImage.lastPass && transientImage.firstPass <= otherImage.lastPass) {
+                conflicts.push_back(other);
+                candidates.push_back(AlignUp(otherImage.offset + otherImage.memoryRequirements.size, alignment));
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+        for(auto candidate : candidates) {
+            bool fits = true;
+            for(auto other : conflicts) {
+                TransientImage& otherImage = transientImages[other];
+                fits = fits && (candidate + size <= otherImage.offset || otherImage.offset + otherImage.memoryRequirements.size <= candidate);
+            }
+            if(fits) {
+                transientImage.offset = candidate;
+                break;
+            }
+        }
+        heapRequirements.size = std::max(heapRequirements.size, transientImage.offset + size);
+        placed.push_back(index);
+    }
+
+    for(uint32_t i = 0; i < transientImages.size(); i++) {
+        for(uint32_t j = 0; j < transientImages.size(); j++) {
+            TransientImage& a = transientImages[i];
+            TransientImage& b = transientImages[j];
+            if(i != j && a.offset < b.offset + b.memoryRequirements.size && b.offset < a.offset + a.memoryRequirements.size) {
+                a.aliases.push_back(j);
+            }
+        }
+    }
+    statistics.transientBytes = heapRequirements.size;
+    return heapRequirements;
+}
\ No newline at end of file
@@ -0,0 +1,157 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+#include "barrier.hpp"
+
+class CVulkanDevice;
+class CVulkanMemoryAllocation;
+class CVulkanCommandBuffer;
+struct CVulkanFrame;
+
+// How a pass uses an image, decides the layout, stages and access it is transitioned to.
+enum CVulkanRenderGraphAccess {
+    RENDER_GRAPH_COLOR_ATTACHMENT,
+    RENDER_GRAPH_DEPTH_ATTACHMENT,
+    RENDER_GRAPH_DEPTH_READ, // Depth test without writes.
+    RENDER_GRAPH_SAMPLED,
+    RENDER_GRAPH_STORAGE_READ,
+    RENDER_GRAPH_STORAGE_WRITE,
+    RENDER_GRAPH_TRANSFER_SRC,
+    RENDER_GRAPH_TRANSFER_DST
+};
+
+// Image the graph creates itself. Its memory may be shared with transient images that are not alive at the same time.
+struct CVulkanRenderGraphImageDesc {
+    vk::Extent2D extent;
+    vk::Format format = vk::Format::eUndefined;
+    vk::ImageUsageFlags usage; // Added to the usage derived from the passes.
+    vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+};
+
+// Of the last Compile() that changed the transient images.
+struct CVulkanRenderGraphStatistics {
+    uint32_t passCount = 0;
+    uint32_t culledPassCount = 0;
+    uint32_t transientImageCount = 0;
+    vk::DeviceSize transientBytes = 0; // Memory backing all transient images with aliasing.
+    vk::DeviceSize unaliasedTransientBytes = 0; // What they would need with memory of their own.
+};
+
+// Records a pass. Passes with attachments are called inside a rendering scope covering them.
+using CVulkanRenderGraphExecute = std::function<void(CVulkanCommandBuffer* commandBuffer, CVulkanFrame* frame)>;
+
+// Frame graph on top of CVulkanCommandBuffer and the barrier tracker. Passes and resources are declared every frame,
+// Compile() culls passes whose results are never used, orders the live passes by their dependencies so transient
+// images stay alive for as few passes as possible, derives the lifetime of every transient image and places transient
+// images with disjoint lifetimes in the same memory. Execute() records the passes in that order with the barriers each
+// pass needs batched in front of it. Transient images are kept between frames while their descriptions stay the same.
+class CVulkanRenderGraph {
+    struct ResourceUse {
+        uint32_t resource;
+        CVulkanRenderGraphAccess access;
+        bool read; // Depends on the earlier contents.
+        bool write;
+    };
+    struct Pass {
+        std::string name;
+        CVulkanRenderGraphExecute execute;
+        vk::RenderingFlags renderingFlags;
+        std::vector<ResourceUse> uses;
+        std::vector<uint32_t> colorResources;
+        std::vector<vk::RenderingAttachmentInfo> colorAttachments; // Image views are filled in by Execute().
+        uint32_t depthResource = NO_RESOURCE;
+        vk::RenderingAttachmentInfo depthAttachment;
+        bool sideEffects = false;
+        bool live = false;
+    };
+    struct Resource {
+        std::string name;
+        CVulkanRenderGraphImageDesc desc;
+        vk::ImageAspectFlags aspectMask;
+        bool imported;
+        vk::Image image;
+        vk::ImageView imageView;
+        CVulkanResourceState initialState;
+        vk::ImageLayout finalLayout;
+        vk::PipelineStageFlags2 finalStages;
+        vk::AccessFlags2 finalAccess;
+        uint32_t firstPass = NO_PASS; // Positions in the execution order.
+        uint32_t lastPass = NO_PASS;
+        uint32_t transientIndex = NO_RESOURCE;
+    };
+    struct TransientImage {
+        CVulkanRenderGraphImageDesc desc;
+        vk::ImageAspectFlags aspectMask;
+        uint32_t firstPass;
+        uint32_t lastPass;
+        std::unique_ptr<vk::raii::Image> image;
+        std::unique_ptr<vk::raii::ImageView> imageView;
+        vk::MemoryRequirements memoryRequirements;
+        vk::DeviceSize offset = 0;
+        std::vector<uint32_t> aliases; // Transient images sharing some of its memory.
+        vk::PipelineStageFlags2 usedStages; // Since its last first use, the next image in its memory waits on them.
+        vk::AccessFlags2 usedAccess;
+    };
+
+    CVulkanDevice* device;
+    CVulkanBarrierTracker* barrierTracker;
+    std::vector<Pass> passes;
+    std::vector<Resource> resources;
+    std::vector<uint32_t> executionOrder;
+    std::unique_ptr<CVulkanMemoryAllocation> transientMemory; // Declared before the images so they are destroyed first.
+    std::vector<TransientImage> transientImages;
+    CVulkanRenderGraphStatistics statistics;
+public:
+    static constexpr uint32_t NO_RESOURCE = ~0u;
+    static constexpr uint32_t NO_PASS = ~0u;
+
+    // Every barrier is recorded through barrierTracker, which must be the one of the queue the graph is executed on.
+    CVulkanRenderGraph(CVulkanDevice* device, CVulkanBarrierTracker* barrierTracker);
+    ~CVulkanRenderGraph();
+    // Clears the passes and resources of the last frame, transient images stay alive for the next Compile().
+    void Reset();
+    // An image the graph does not own, e.g. the swapchain image. It starts in initialState and is left in finalLayout
+    // for finalStages, the passes writing it are never culled. Returns its resource index.
+    uint32_t ImportImage(std::string name, vk::Image image, vk::ImageView imageView, vk::Extent2D extent, vk::Format format,
+        CVulkanResourceState initialState, vk::ImageLayout finalLayout,
+        vk::PipelineStageFlags2 finalStages = vk::PipelineStageFlagBits2::eNone, vk::AccessFlags2 finalAccess = vk::AccessFlagBits2::eNone);
+    // A single level, single layer image created and aliased by the graph. Its contents do not survive between frames.
+    uint32_t CreateImage(std::string name, CVulkanRenderGraphImageDesc desc);
+    // Returns the pass index. renderingFlags are passed to the rendering scope of passes with attachments.
+    uint32_t AddPass(std::string name, CVulkanRenderGraphExecute execute, vk::RenderingFlags renderingFlags = {});
+    // eLoad keeps the earlier contents and makes the pass depend on the passes that wrote them.
+    void AddColorAttachment(uint32_t pass, uint32_t resource, vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eLoad,
+        vk::ClearColorValue clearColor = vk::ClearColorValue(0.0f, 0.0f, 0.0f, 1.0f));
+    void SetDepthAttachment(uint32_t pass, uint32_t resource, vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eLoad,
+        float clearDepth = 1.0f, bool depthWrite = true);
+    void AddRead(uint32_t pass, uint32_t resource, CVulkanRenderGraphAccess access);
+    // Writes that are not attachments are assumed to be partial, they keep the passes before them alive.
+    void AddWrite(uint32_t pass, uint32_t resource, CVulkanRenderGraphAccess access);
+    // The pass is never culled, for passes with results outside of the graph.
+    void SetSideEffects(uint32_t pass);
+    // Culls and orders passes, computes lifetimes and (re)creates the transient images if they changed since the last frame.
+    // Recreating them waits for the device to go idle, which only happens when the graph or the extent changes.
+    void Compile();
+    void Execute(CVulkanCommandBuffer* commandBuffer, CVulkanFrame* frame);
+    vk::Image GetVkImage(uint32_t resource);
+    vk::ImageView GetVkImageView(uint32_t resource);
+    std::vector<std::string> GetCulledPassNames();
+    CVulkanRenderGraphStatistics GetStatistics();
+    void PrintStatistics();
+    // Runs without a device, compiles a deferred shading graph declared in a naive order with estimated memory
+    // requirements and checks culling, the dependencies of the execution order and the transient image placement.
+    static bool RunAliasingTest();
+private:
+    // Culling, ordering and lifetimes, returns the transient images the graph needs without creating them.
+    std::vector<TransientImage> Plan();
+    // List scheduling over the dependencies between live passes. Of the passes whose dependencies ran, the one growing
+    // the estimated transient memory alive the least runs next, ties keep declaration order.
+    void OrderPasses();
+    void CreateTransientImages(std::vector<TransientImage>& plannedImages);
+    // Greedily places the largest images first at the lowest offset that does not overlap an image alive at the same time.
+    // Fills in the statistics and returns what the memory shared by all transient images needs.
+    vk::MemoryRequirements PlaceTransientImages();
+};
\ No newline at end of file
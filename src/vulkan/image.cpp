@@ -3,52 +3,177 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include "system/threadpool.hpp"
 #include "device.hpp"
+#include "buffer.hpp"
 #include "queue.hpp"
+#include "barrier.hpp"
 #include "cmd.hpp"
-#include "buffer.hpp"
-#include "util.hpp"
+#include "memory.hpp"
+#include "staging.hpp"
+#include "bindless.hpp"
+#include "texture.hpp"
+
+static bool IsSrgbFormat(vk::Format format) {
+    return format == vk::Format::eR8G8B8A8Srgb || format == vk::Format::eB8G8R8A8Srgb;
+}
+
+// Halves an RGBA8 level with a 2x2 box filter. The last row/column of an odd level is folded into the last texel, which
+// then averages 3 texels across, so that no texel is dropped. Color is averaged in linear space for sRGB formats.
+static std::vector<uint8_t> DownsampleBoxFilter(const uint8_t* pixels, uint32_t width, uint32_t height, bool srgb) {
+    // Built once by whichever thread gets here first, batch loads filter on several threads at once.
+    static const std::array<float, 256> srgbToLinear = []() {
+        std::array<float, 256> table;
+        for(int i = 0; i < 256; i++) {
+            float c = i / 255.0f;
+            table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return table;
+    }();
+
+    uint32_t mipWidth = std::max(width / 2, 1u);
+    uint32_t mipHeight = std::max(height / 2, 1u);
+    std::vector<uint8_t> mip(static_cast<size_t>(mipWidth) * mipHeight * 4);
+    for(uint32_t y = 0; y < mipHeight; y++) {
+        uint32_t y0 = std::min(y * 2, height - 1);
+        uint32_t y1 = y + 1 == mipHeight ? height - 1 : y * 2 + 1;
+        for(uint32_t x = 0; x < mipWidth; x++) {
+            uint32_t x0 = std::min(x * 2, width - 1);
+            uint32_t x1 = x + 1 == mipWidth ? width - 1 : x * 2 + 1;
+            uint32_t count = (y1 - y0 + 1) * (x1 - x0 + 1);
+            uint8_t* out = mip.data() + (static_cast<size_t>(y) * mipWidth + x) * 4;
+            for(int channel = 0; channel < 4; channel++) {
+                bool linearize = srgb && channel < 3;
+                uint32_t sum = 0;
+                float linearSum = 0.0f;
+                for(uint32_t sourceY = y0; sourceY <= y1; sourceY++) {
+                    for(uint32_t sourceX = x0; sourceX <= x1; sourceX++) {
+                        uint8_t texel = pixels[(static_cast<size_t>(sourceY) * width + sourceX) * 4 + channel];
+                        if(linearize) {
+                            linearSum += srgbToLinear[texel];
+                        } else {
+                            sum += texel;
+                        }
+                    }
+                }
+                if(linearize) {
+                    float linear = linearSum / count;
+                    float encoded = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+                    out[channel] = static_cast<uint8_t>(std::clamp(encoded * 255.0f + 0.5f, 0.0f, 255.0f));
+                } else {
+                    out[channel] = static_cast<uint8_t>((sum + count / 2) / count);
+                }
+            }
+        }
+    }
+    return mip;
+}
+
+static uint32_t GetLevelCount(uint32_t width, uint32_t height, uint8_t mipLevels) {
+    uint32_t fullChainLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+    return mipLevels == 0 ? fullChainLevels : std::min<uint32_t>(mipLevels, fullChainLevels);
+}
+
+static vk::DeviceSize GetRgbaLevelSize(uint32_t width, uint32_t height, uint32_t level) {
+    return static_cast<vk::DeviceSize>(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * 4;
+}
+
+// Offsets of levels packed one after another in a staging range, totalSize receives the size of the whole range.
+static std::vector<vk::DeviceSize> GetPackedLevelOffsets(std::vector<vk::DeviceSize> levelSizes, vk::DeviceSize& totalSize) {
+    std::vector<vk::DeviceSize> offsets(levelSizes.size());
+    totalSize = 0;
+    for(size_t i = 0; i < levelSizes.size(); i++) {
+        totalSize = (totalSize + CVulkanStagingRing::ALIGNMENT - 1) / CVulkanStagingRing::ALIGNMENT * CVulkanStagingRing::ALIGNMENT;
+        offsets[i] = totalSize;
+        totalSize += levelSizes[i];
+    }
+    return offsets;
+}
+
+static double GetMilliseconds(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
 
-CVulkanImage::CVulkanImage(std::shared_ptr<vk::raii::Device> device, vk::PhysicalDeviceMemoryProperties memoryProperties, vk::Extent3D extent, vk::Format format, uint8_t mipLevels, vk::SampleCountFlagBits samples) {
+CVulkanImage::CVulkanImage(std::shared_ptr<vk::raii::Device> device, CVulkanMemoryAllocator* allocator, vk::Extent3D extent, vk::Format format, uint8_t mipLevels, vk::SampleCountFlagBits samples)
+    : extent(extent), format(format), mipLevels(mipLevels) {
+    // Mip levels are blitted from the previous level, which needs it to be a transfer source.
+    vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+    if(mipLevels > 1) {
+        usage |= vk::ImageUsageFlagBits::eTransferSrc;
+    }
     auto imageInfo = vk::ImageCreateInfo({}, vk::ImageType::e2D, format,
         extent, mipLevels, 1, samples, vk::ImageTiling::eOptimal,
-        vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
-        vk::SharingMode::eExclusive);
+        usage, vk::SharingMode::eExclusive);
     image = std::make_unique<vk::raii::Image>(*device, imageInfo);
 
     vk::MemoryRequirements memoryRequirements = image->getMemoryRequirements();
-    auto memoryTypeIndex = GetMemoryTypeIndex(memoryProperties, memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
-    if(memoryTypeIndex == -1) {
+    memory = allocator->Allocate(memoryRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal, MEMORY_RESOURCE_OPTIMAL);
+    if(memory == nullptr) {
         throw CVulkanImageCreationException(CVulkanImageCreationError::IMAGE_INVALID_MEMORY_TYPE);
     }
-    vk::MemoryAllocateInfo allocateInfo(memoryRequirements.size, memoryTypeIndex);
-    memory = std::make_unique<vk::raii::DeviceMemory>(*device, allocateInfo);
-    image->bindMemory(**memory, 0);
+    image->bindMemory(memory->GetVkDeviceMemory(), memory->GetOffset());
 }
 
+CVulkanImage::CVulkanImage(CVulkanImage&&) noexcept = default;
+
+CVulkanImage& CVulkanImage::operator=(CVulkanImage&&) noexcept = default;
+
+CVulkanImage::~CVulkanImage() = default;
+
 vk::Image CVulkanImage::GetVkImage() {
     return **image;
 }
 
-CVulkanImageLoader::CVulkanImageLoader(CVulkanDevice* device, CVulkanQueue* transferQueue, std::shared_ptr<CVulkanCommandBuffer> transferCommandBuffer)
-    : device(device), transferQueue(transferQueue), transferCommandBuffer(transferCommandBuffer) {}
+vk::Extent3D CVulkanImage::GetExtent() {
+    return extent;
+}
 
-CVulkanImage CVulkanImageLoader::Load(std::string path, vk::Format format, uint8_t mipLevels, vk::SampleCountFlagBits samples) {
-    auto vkDevice = device->GetVkDevice();
+vk::Format CVulkanImage::GetFormat() {
+    return format;
+}
+
+uint32_t CVulkanImage::GetMipLevels() {
+    return mipLevels;
+}
 
+uint32_t CVulkanImage::GetBindlessHandle() {
+    return bindlessHandle;
+}
+
+void CVulkanImage::SetBindlessHandle(uint32_t handle) {
+    bindlessHandle = handle;
+}
+
+CVulkanImageLoader::CVulkanImageLoader(CVulkanDevice* device, CVulkanStagingRing* stagingRing, CVulkanBindlessHeap* bindlessHeap)
+    : device(device), stagingRing(stagingRing), bindlessHeap(bindlessHeap) {}
+
+CVulkanImage CVulkanImageLoader::Load(std::string path, vk::Format format, uint8_t mipLevels, vk::SampleCountFlagBits samples, CVulkanImageLoadTiming* timing) {
+    if(CVulkanCompressedTexture::IsContainerPath(path)) {
+        return LoadCompressed(path, samples, timing);
+    }
+
+    auto start = std::chrono::steady_clock::now();
     int width, height, channels;
     stbi_uc* bitmap = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
     if(!bitmap) {
         throw CVulkanImageCreationException(CVulkanImageCreationError::IMAGE_LOAD_FAILED);
     }
+    auto decoded = std::chrono::steady_clock::now();
 
-    vk::DeviceSize size = width * height * 4;
-    auto stagingBuffer = device->CreateBuffer(vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, vk::BufferUsageFlagBits::eTransferSrc, bitmap, size);
-    stbi_image_free(bitmap);
-
+    vk::DeviceSize size = static_cast<vk::DeviceSize>(width) * height * 4;
+    vk::DeviceSize stagedBytes = size;
     vk::Extent3D extent = vk::Extent3D(width, height, 1);
-    CVulkanImage image = device->CreateImage(extent, format, mipLevels, samples);
-    
+    uint32_t levels = GetLevelCount(width, height, mipLevels);
+    CVulkanImage image = device->CreateImage(extent, format, static_cast<uint8_t>(levels), samples);
+    RecordTransitionToTransferDst(&image, levels);
+
     vk::BufferImageCopy region;
     region.bufferOffset = 0;
     region.bufferImageHeight = 0;
@@ -56,9 +181,440 @@ CVulkanImage CVulkanImageLoader::Load(std::string path, vk::Format format, uint8
     region.imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
     region.imageOffset = vk::Offset3D { 0, 0, 0 };
     region.imageExtent = extent;
+    stagingRing->CopyToImage(bitmap, size, &image, region);
+
+    auto linearBlitFeatures = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    if(levels == 1) {
+        stagingRing->ReleaseImage(&image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+    } else if(device->IsFormatFeatureSupported(format, linearBlitFeatures)) {
+        stagingRing->ReleaseImageForMipmapping(&image);
+    } else {
+        std::vector<uint8_t> level(bitmap, bitmap + size);
+        uint32_t levelWidth = width;
+        uint32_t levelHeight = height;
+        for(uint32_t i = 1; i < levels; i++) {
+            level = DownsampleBoxFilter(level.data(), levelWidth, levelHeight, IsSrgbFormat(format));
+            levelWidth = std::max(levelWidth / 2, 1u);
+            levelHeight = std::max(levelHeight / 2, 1u);
+            region.imageSubresource.mipLevel = i;
+            region.imageExtent = vk::Extent3D(levelWidth, levelHeight, 1);
+            stagingRing->CopyToImage(level.data(), level.size(), &image, region);
+            stagedBytes += level.size();
+        }
+        stagingRing->ReleaseImage(&image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+    }
+    stagingRing->Flush(); // Deferred until EndBatch() when the caller batches several loads.
+    stbi_image_free(bitmap);
 
-    transferCommandBuffer->CopyBufferToImage(&stagingBuffer, &image, vk::ImageLayout::eTransferDstOptimal, region);
-    transferQueue->Submit(transferCommandBuffer);
-    transferCommandBuffer->Reset();
+    if(timing) {
+        timing->path = path;
+        timing->stagedBytes = stagedBytes;
+        timing->decodeMilliseconds = GetMilliseconds(start, decoded);
+        timing->uploadMilliseconds = GetMilliseconds(decoded, std::chrono::steady_clock::now());
+    }
+    AddToBindlessHeap(&image);
     return image;
 }
+
+std::vector<CVulkanImage> CVulkanImageLoader::LoadBatch(std::vector<std::string> paths, vk::Format format, uint8_t mipLevels, vk::SampleCountFlagBits samples, CThreadPool* threadPool) {
+    // A file whose pixels still have to be written into its reserved staging range.
+    struct PendingDecode {
+        size_t index;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levels;
+        bool filterOnCpu;
+        bool transcode;
+        vk::DeviceSize offset;
+        std::vector<vk::DeviceSize> levelOffsets;
+    };
+
+    // Headers are enough to size every image and its staging range before anything is decoded.
+    std::vector<int> widths(paths.size()), heights(paths.size()), headersValid(paths.size());
+    std::vector<std::unique_ptr<CVulkanCompressedTexture>> compressedTextures(paths.size());
+    threadPool->ParallelFor(paths.size(), [&](size_t i) {
+        if(CVulkanCompressedTexture::IsContainerPath(paths[i])) {
+            compressedTextures[i] = std::make_unique<CVulkanCompressedTexture>(paths[i]);
+            headersValid[i] = 1;
+            return;
+        }
+        int channels;
+        headersValid[i] = stbi_info(paths[i].c_str(), &widths[i], &heights[i], &channels);
+    });
+    if(std::find(headersValid.begin(), headersValid.end(), 0) != headersValid.end()) {
+        throw CVulkanImageCreationException(CVulkanImageCreationError::IMAGE_LOAD_FAILED);
+    }
+
+    timings.assign(paths.size(), {});
+    bool srgb = IsSrgbFormat(format);
+    auto linearBlitFeatures = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    bool blitSupported = device->IsFormatFeatureSupported(format, linearBlitFeatures);
+
+    // Block compressed levels are read from the file straight into the ring, or transcoded first if the device cannot sample them.
+    auto writeCompressed = [&](PendingDecode& decode, char* staging, CVulkanImageLoadTiming& timing) {
+        CVulkanCompressedTexture* texture = compressedTextures[decode.index].get();
+        for(uint32_t level = 0; level < decode.levels; level++) {
+            auto start = std::chrono::steady_clock::now();
+            if(!decode.transcode) {
+                texture->ReadLevel(level, staging + decode.levelOffsets[level]);
+                timing.uploadMilliseconds += GetMilliseconds(start, std::chrono::steady_clock::now());
+                timing.stagedBytes += texture->GetLevelSize(level);
+                continue;
+            }
+            std::vector<uint8_t> pixels = texture->DecodeLevel(level);
+            auto decoded = std::chrono::steady_clock::now();
+            memcpy(staging + decode.levelOffsets[level], pixels.data(), pixels.size());
+            timing.decodeMilliseconds += GetMilliseconds(start, decoded);
+            timing.uploadMilliseconds += GetMilliseconds(decoded, std::chrono::steady_clock::now());
+            timing.stagedBytes += pixels.size();
+        }
+    };
+
+    auto writeDecoded = [&](PendingDecode& decode, char* staging, CVulkanImageLoadTiming& timing) {
+        auto start = std::chrono::steady_clock::now();
+        int width, height, channels;
+        stbi_uc* bitmap = stbi_load(paths[decode.index].c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        if(!bitmap || static_cast<uint32_t>(width) != decode.width || static_cast<uint32_t>(height) != decode.height) {
+            stbi_image_free(bitmap);
+            throw CVulkanImageCreationException(CVulkanImageCreationError::IMAGE_LOAD_FAILED);
+        }
+        auto decoded = std::chrono::steady_clock::now();
+
+        vk::DeviceSize size = static_cast<vk::DeviceSize>(width) * height * 4;
+        memcpy(staging, bitmap, static_cast<size_t>(size));
+        timing.stagedBytes = size;
+        if(decode.filterOnCpu) {
+            // Filter from the decoded copy, reading back the write combined staging memory would be slow.
+            const uint8_t* source = bitmap;
+            std::vector<uint8_t> level;
+            uint32_t levelWidth = decode.width;
+            uint32_t levelHeight = decode.height;
+            for(uint32_t j = 1; j < decode.levels; j++) {
+                level = DownsampleBoxFilter(source, levelWidth, levelHeight, srgb);
+                source = level.data();
+                levelWidth = std::max(levelWidth / 2, 1u);
+                levelHeight = std::max(levelHeight / 2, 1u);
+                memcpy(staging + decode.levelOffsets[j], level.data(), level.size());
+                timing.stagedBytes += level.size();
+            }
+        }
+        stbi_image_free(bitmap);
+        timing.decodeMilliseconds = GetMilliseconds(start, decoded);
+        timing.uploadMilliseconds = GetMilliseconds(decoded, std::chrono::steady_clock::now());
+    };
+
+    std::vector<PendingDecode> pending;
+    // Ranges have to be written before the ring submits the copies reading them, so this runs whenever it is about to.
+    auto decodePending = [&]() {
+        threadPool->ParallelFor(pending.size(), [&](size_t i) {
+            PendingDecode& decode = pending[i];
+            CVulkanImageLoadTiming& timing = timings[decode.index];
+            char* staging = static_cast<char*>(stagingRing->GetMappedData(decode.offset));
+            if(compressedTextures[decode.index]) {
+                writeCompressed(decode, staging, timing);
+            } else {
+                writeDecoded(decode, staging, timing);
+            }
+            timing.path = paths[decode.index];
+        });
+        pending.clear();
+    };
+
+    std::vector<CVulkanImage> images;
+    images.reserve(paths.size());
+    stagingRing->BeginBatch();
+    for(size_t i = 0; i < paths.size(); i++) {
+        CVulkanCompressedTexture* texture = compressedTextures[i].get();
+        vk::Format imageFormat = format;
+        uint32_t width, height, levels;
+        bool filterOnCpu = false;
+        bool transcode = false;
+        std::vector<vk::DeviceSize> levelSizes;
+        if(texture) {
+            transcode = !IsCompressedFormatSupported(texture->GetFormat());
+            imageFormat = transcode ? texture->GetDecodedFormat() : texture->GetFormat();
+            width = texture->GetExtent().width;
+            height = texture->GetExtent().height;
+            levels = texture->GetLevelCount();
+            for(uint32_t level = 0; level < levels; level++) {
+                levelSizes.push_back(transcode ? GetRgbaLevelSize(width, height, level) : texture->GetLevelSize(level));
+            }
+        } else {
+            width = static_cast<uint32_t>(widths[i]);
+            height = static_cast<uint32_t>(heights[i]);
+            levels = GetLevelCount(width, height, mipLevels);
+            filterOnCpu = levels > 1 && !blitSupported;
+            for(uint32_t level = 0; level < (filterOnCpu ? levels : 1); level++) {
+                levelSizes.push_back(GetRgbaLevelSize(width, height, level));
+            }
+        }
+        vk::DeviceSize stagingSize;
+        std::vector<vk::DeviceSize> levelOffsets = GetPackedLevelOffsets(levelSizes, stagingSize);
+
+        // Too large to stage in one range, Load() copies it in bands instead.
+        if(stagingSize > stagingRing->GetCapacity() / 2) {
+            decodePending();
+            images.push_back(Load(paths[i], format, mipLevels, samples, &timings[i]));
+            continue;
+        }
+
+        vk::DeviceSize offset;
+        if(!stagingRing->TryReserve(stagingSize, CVulkanStagingRing::ALIGNMENT, offset)) {
+            decodePending();
+            offset = stagingRing->Reserve(stagingSize, CVulkanStagingRing::ALIGNMENT);
+        }
+
+        CVulkanImage image = device->CreateImage(vk::Extent3D(width, height, 1), imageFormat, static_cast<uint8_t>(levels), samples);
+        RecordTransitionToTransferDst(&image, levels);
+        for(uint32_t level = 0; level < levelOffsets.size(); level++) {
+            vk::BufferImageCopy region;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level, 0, 1);
+            region.imageOffset = vk::Offset3D { 0, 0, 0 };
+            region.imageExtent = vk::Extent3D(std::max(width >> level, 1u), std::max(height >> level, 1u), 1);
+            stagingRing->CopyReservedToImage(offset + levelOffsets[level], &image, region);
+        }
+        if(levels > levelOffsets.size()) {
+            stagingRing->ReleaseImageForMipmapping(&image);
+        } else {
+            stagingRing->ReleaseImage(&image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+        }
+
+        pending.push_back(PendingDecode { i, width, height, levels, filterOnCpu, transcode, offset, std::move(levelOffsets) });
+        images.push_back(std::move(image));
+    }
+    decodePending();
+    stagingRing->EndBatch();
+    // Images that fell back to Load() were added there.
+    for(auto& image : images) {
+        if(image.GetBindlessHandle() == CVulkanImage::NO_BINDLESS_HANDLE) {
+            AddToBindlessHeap(&image);
+        }
+    }
+    return images;
+}
+
+CVulkanImage CVulkanImageLoader::LoadCompressed(std::string path, vk::SampleCountFlagBits samples, CVulkanImageLoadTiming* timing) {
+    auto start = std::chrono::steady_clock::now();
+    CVulkanCompressedTexture texture(path);
+    bool transcode = !IsCompressedFormatSupported(texture.GetFormat());
+    vk::Format format = transcode ? texture.GetDecodedFormat() : texture.GetFormat();
+    uint32_t levels = texture.GetLevelCount();
+    CVulkanImage image = device->CreateImage(texture.GetExtent(), format, static_cast<uint8_t>(levels), samples);
+    RecordTransitionToTransferDst(&image, levels);
+
+    double decodeMilliseconds = 0.0;
+    vk::DeviceSize stagedBytes = 0;
+    for(uint32_t level = 0; level < levels; level++) {
+        auto levelStart = std::chrono::steady_clock::now();
+        std::vector<uint8_t> data;
+        if(transcode) {
+            data = texture.DecodeLevel(level);
+        } else {
+            data.resize(static_cast<size_t>(texture.GetLevelSize(level)));
+            texture.ReadLevel(level, data.data());
+        }
+        decodeMilliseconds += GetMilliseconds(levelStart, std::chrono::steady_clock::now());
+
+        vk::BufferImageCopy region;
+        region.bufferOffset = 0;
+        region.bufferImageHeight = 0;
+        region.bufferRowLength = 0;
+        region.imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level, 0, 1);
+        region.imageOffset = vk::Offset3D { 0, 0, 0 };
+        region.imageExtent = texture.GetLevelExtent(level);
+        if(transcode) {
+            stagingRing->CopyToImage(data.data(), data.size(), &image, region);
+        } else {
+            stagingRing->CopyToImage(data.data(), data.size(), &image, region, texture.GetBlockSize(), 4);
+        }
+        stagedBytes += data.size();
+    }
+    stagingRing->ReleaseImage(&image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+    stagingRing->Flush(); // Deferred until EndBatch() when the caller batches several loads.
+
+    if(timing) {
+        timing->path = path;
+        timing->stagedBytes = stagedBytes;
+        timing->decodeMilliseconds = decodeMilliseconds;
+        timing->uploadMilliseconds = GetMilliseconds(start, std::chrono::steady_clock::now()) - decodeMilliseconds;
+    }
+    AddToBindlessHeap(&image);
+    return image;
+}
+
+bool CVulkanImageLoader::IsCompressedFormatSupported(vk::Format format) {
+    auto features = vk::FormatFeatureFlagBits::eSampledImage | vk::FormatFeatureFlagBits::eSampledImageFilterLinear | vk::FormatFeatureFlagBits::eTransferDst;
+    return device->IsTextureCompressionBCEnabled() && device->IsFormatFeatureSupported(format, features);
+}
+
+std::vector<CVulkanImageLoadTiming> CVulkanImageLoader::GetTimings() {
+    return timings;
+}
+
+bool CVulkanImageLoader::RunDownsampleTest() {
+    // The reference adds every texel to the one at half its coordinates, clamped to the last, so a row or column that is
+    // dropped or counted twice moves the average of its texel.
+    const uint32_t sizes[] = { 1, 2, 3, 5, 8, 17, 64, 255 };
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<uint32_t> value(0, 255);
+    auto toLinear = [](double c) { return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4); };
+    auto toSrgb = [](double c) { return c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055; };
+    int maxError = 0;
+    size_t levelCount = 0;
+    for(bool srgb : { false, true }) {
+        for(uint32_t width : sizes) {
+            for(uint32_t height : sizes) {
+                std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+                for(auto& channel : pixels) {
+                    channel = static_cast<uint8_t>(value(random));
+                }
+                std::vector<uint8_t> mip = DownsampleBoxFilter(pixels.data(), width, height, srgb);
+
+                uint32_t mipWidth = std::max(width / 2, 1u);
+                uint32_t mipHeight = std::max(height / 2, 1u);
+                std::vector<double> sums(mip.size(), 0.0);
+                std::vector<uint32_t> counts(static_cast<size_t>(mipWidth) * mipHeight, 0);
+                for(uint32_t y = 0; y < height; y++) {
+                    for(uint32_t x = 0; x < width; x++) {
+                        size_t texel = static_cast<size_t>(std::min(y / 2, mipHeight - 1)) * mipWidth + std::min(x / 2, mipWidth - 1);
+                        counts[texel]++;
+                        for(int channel = 0; channel < 4; channel++) {
+                            double c = pixels[(static_cast<size_t>(y) * width + x) * 4 + channel];
+                            sums[texel * 4 + channel] += srgb && channel < 3 ? toLinear(c / 255.0) : c;
+                        }
+                    }
+                }
+                for(size_t i = 0; i < mip.size(); i++) {
+                    double average = sums[i] / counts[i / 4];
+                    double expected = srgb && i % 4 < 3 ? toSrgb(average) * 255.0 : average;
+                    maxError = std::max(maxError, std::abs(static_cast<int>(mip[i]) - static_cast<int>(std::floor(expected + 0.5))));
+                }
+                levelCount++;
+            }
+        }
+    }
+    bool passed = maxError <= 1;
+    printf("CVulkanImageLoader::RunDownsampleTest: %zu levels of odd and even sizes, largest error %d, %s\n", levelCount, maxError, passed ? "passed" : "FAILED");
+    return passed;
+}
+
+bool CVulkanImageLoader::RunBlitTest(CVulkanDevice* device, CVulkanQueue* queue) {
+    struct BlitCase {
+        uint32_t width;
+        uint32_t height;
+        vk::Format format;
+    };
+    const BlitCase cases[] = {
+        { 64, 64, vk::Format::eR8G8B8A8Unorm }, { 256, 16, vk::Format::eR8G8B8A8Unorm }, { 255, 17, vk::Format::eR8G8B8A8Unorm },
+        { 64, 64, vk::Format::eR8G8B8A8Srgb }, { 256, 16, vk::Format::eR8G8B8A8Srgb }, { 255, 17, vk::Format::eR8G8B8A8Srgb }
+    };
+    auto linearBlitFeatures = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    vk::MemoryPropertyFlags hostVisible = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    CVulkanCommandPool commandPool = queue->CreateCommandPool(vk::CommandPoolCreateFlagBits::eTransient);
+    CVulkanBarrierTracker barrierTracker;
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<uint32_t> value(0, 255);
+    int maxError = 0;
+    int maxOddError = 0;
+    size_t levelCount = 0;
+    for(auto& blitCase : cases) {
+        if(!device->IsFormatFeatureSupported(blitCase.format, linearBlitFeatures)) {
+            printf("CVulkanImageLoader::RunBlitTest: Format %d lacks linear blits, its levels are filtered on the CPU\n", static_cast<int>(blitCase.format));
+            continue;
+        }
+        uint32_t levels = GetLevelCount(blitCase.width, blitCase.height, 0);
+        std::vector<vk::DeviceSize> levelSizes;
+        for(uint32_t level = 0; level < levels; level++) {
+            levelSizes.push_back(GetRgbaLevelSize(blitCase.width, blitCase.height, level));
+        }
+        vk::DeviceSize readbackSize;
+        std::vector<vk::DeviceSize> levelOffsets = GetPackedLevelOffsets(levelSizes, readbackSize);
+
+        std::vector<uint8_t> pixels(static_cast<size_t>(levelSizes[0]));
+        for(auto& channel : pixels) {
+            channel = static_cast<uint8_t>(value(random));
+        }
+        CVulkanBuffer upload = device->CreateBuffer(hostVisible, vk::BufferUsageFlagBits::eTransferSrc, pixels.data(), levelSizes[0]);
+        CVulkanBuffer readback = device->CreateBuffer(hostVisible, vk::BufferUsageFlagBits::eTransferDst, nullptr, readbackSize);
+        vk::Extent3D extent(blitCase.width, blitCase.height, 1);
+        CVulkanImage image = device->CreateImage(extent, blitCase.format, static_cast<uint8_t>(levels));
+        vk::ImageSubresourceRange allLevels(vk::ImageAspectFlagBits::eColor, 0, levels, 0, 1);
+
+        auto commandBuffer = std::make_shared<CVulkanCommandBuffer>(commandPool.CreateCommandBuffer());
+        commandBuffer->Begin();
+        barrierTracker.UseImage(image.GetVkImage(), vk::ImageLayout::eTransferDstOptimal, vk::PipelineStageFlagBits2::eTransfer,
+            vk::AccessFlagBits2::eTransferWrite, allLevels);
+        barrierTracker.Flush(commandBuffer.get());
+        vk::BufferImageCopy region;
+        region.imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+        region.imageExtent = extent;
+        commandBuffer->CopyBufferToImage(&upload, &image, vk::ImageLayout::eTransferDstOptimal, region);
+        commandBuffer->GenerateMipmaps(&barrierTracker, image.GetVkImage(), extent, levels, vk::PipelineStageFlagBits2::eTransfer);
+        barrierTracker.UseImage(image.GetVkImage(), vk::ImageLayout::eTransferSrcOptimal, vk::PipelineStageFlagBits2::eTransfer,
+            vk::AccessFlagBits2::eTransferRead, allLevels);
+        barrierTracker.Flush(commandBuffer.get());
+        for(uint32_t level = 0; level < levels; level++) {
+            region.bufferOffset = levelOffsets[level];
+            region.imageSubresource.mipLevel = level;
+            region.imageExtent = vk::Extent3D(std::max(blitCase.width >> level, 1u), std::max(blitCase.height >> level, 1u), 1);
+            commandBuffer->CopyImageToBuffer(&image, vk::ImageLayout::eTransferSrcOptimal, &readback, region);
+        }
+        // Waiting on the queue does not make the copies visible to the host by itself.
+        commandBuffer->PipelineBarrier2({ vk::MemoryBarrier2(vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite,
+            vk::PipelineStageFlagBits2::eHost, vk::AccessFlagBits2::eHostRead) }, {}, {});
+        commandBuffer->End();
+        queue->Wait(queue->Submit(commandBuffer));
+        barrierTracker.RemoveImage(image.GetVkImage());
+
+        const uint8_t* levelData = static_cast<const uint8_t*>(readback.GetMappedData());
+        bool powerOfTwo = (blitCase.width & (blitCase.width - 1)) == 0 && (blitCase.height & (blitCase.height - 1)) == 0;
+        for(size_t i = 0; i < pixels.size(); i++) {
+            maxError = std::max(maxError, std::abs(static_cast<int>(levelData[i]) - static_cast<int>(pixels[i])));
+        }
+        for(uint32_t level = 1; level < levels; level++) {
+            std::vector<uint8_t> expected = DownsampleBoxFilter(levelData + levelOffsets[level - 1], std::max(blitCase.width >> (level - 1), 1u),
+                std::max(blitCase.height >> (level - 1), 1u), IsSrgbFormat(blitCase.format));
+            const uint8_t* blitted = levelData + levelOffsets[level];
+            int& error = powerOfTwo ? maxError : maxOddError;
+            for(size_t i = 0; i < expected.size(); i++) {
+                error = std::max(error, std::abs(static_cast<int>(blitted[i]) - static_cast<int>(expected[i])));
+            }
+            levelCount++;
+        }
+    }
+    bool passed = maxError <= 2;
+    printf("CVulkanImageLoader::RunBlitTest: %zu blitted levels, largest error %d, %d on odd levels, %s\n", levelCount, maxError, maxOddError,
+        passed ? "passed" : "FAILED");
+    return passed;
+}
+
+void CVulkanImageLoader::PrintTimings() {
+    double decodeTotal = 0.0;
+    double uploadTotal = 0.0;
+    vk::DeviceSize stagedTotal = 0;
+    for(auto& timing : timings) {
+        printf("%s: decode %.2f ms, upload %.2f ms, %llu bytes\n", timing.path.c_str(), timing.decodeMilliseconds, timing.uploadMilliseconds,
+            static_cast<unsigned long long>(timing.stagedBytes));
+        decodeTotal += timing.decodeMilliseconds;
+        uploadTotal += timing.uploadMilliseconds;
+        stagedTotal += timing.stagedBytes;
+    }
+    printf("%zu images: decode %.2f ms, upload %.2f ms, %llu bytes (summed across threads)\n", timings.size(), decodeTotal, uploadTotal,
+        static_cast<unsigned long long>(stagedTotal));
+}
+
+void CVulkanImageLoader::RecordTransitionToTransferDst(CVulkanImage* image, uint32_t levels) {
+    // New images start in eUndefined, the ring's tracker forgets released images so a reused handle starts there too.
+    CVulkanBarrierTracker* barrierTracker = stagingRing->GetBarrierTracker();
+    barrierTracker->UseImage(image->GetVkImage(), vk::ImageLayout::eTransferDstOptimal, vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite,
+        vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, levels, 0, 1));
+    barrierTracker->Flush(stagingRing->GetCommandBuffer().get());
+}
+
+void CVulkanImageLoader::AddToBindlessHeap(CVulkanImage* image) {
+    if(bindlessHeap) {
+        image->SetBindlessHandle(bindlessHeap->AddTexture(image));
+    }
+}
\ No newline at end of file
@@ -2,10 +2,13 @@
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_raii.hpp>
 #include <exception>
+#include <string>
+#include <vector>
 
 enum CVulkanImageCreationError {
     IMAGE_LOAD_FAILED,
-    IMAGE_INVALID_MEMORY_TYPE
+    IMAGE_INVALID_MEMORY_TYPE,
+    IMAGE_UNSUPPORTED_FORMAT
 };
 
 class CVulkanImageCreationException : public std::exception {
@@ -24,26 +27,78 @@ public:
 
 class CVulkanBuffer;
 class CVulkanDevice;
+class CVulkanMemoryAllocator;
+class CVulkanMemoryAllocation;
 class CVulkanQueue;
 class CVulkanCommandPool;
 class CVulkanCommandBuffer;
+class CVulkanStagingRing;
+class CVulkanBindlessHeap;
+class CThreadPool;
+
+// Where the load time of a single file went.
+struct CVulkanImageLoadTiming {
+    std::string path;
+    vk::DeviceSize stagedBytes = 0; // Includes levels filtered on the CPU.
+    double decodeMilliseconds = 0.0;
+    double uploadMilliseconds = 0.0; // Writing into the staging ring, including CPU mip generation.
+};
 
 class CVulkanImage {
+    std::unique_ptr<CVulkanMemoryAllocation> memory; // Declared first so the image is destroyed before its memory is returned.
     std::shared_ptr<vk::raii::Image> image;
-    std::unique_ptr<vk::raii::DeviceMemory> memory;
+    vk::Extent3D extent;
+    vk::Format format;
+    uint32_t mipLevels;
+    uint32_t bindlessHandle = NO_BINDLESS_HANDLE;
 public:
+    static constexpr uint32_t NO_BINDLESS_HANDLE = ~0u;
+
     // Creates an image from bits.
-    CVulkanImage(std::shared_ptr<vk::raii::Device> device, vk::PhysicalDeviceMemoryProperties memoryProperties, vk::Extent3D extent, vk::Format format, uint8_t mipLevels = 1,
+    CVulkanImage(std::shared_ptr<vk::raii::Device> device, CVulkanMemoryAllocator* allocator, vk::Extent3D extent, vk::Format format, uint8_t mipLevels = 1,
         vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1);
+    CVulkanImage(CVulkanImage&&) noexcept;
+    CVulkanImage& operator=(CVulkanImage&&) noexcept;
+    ~CVulkanImage();
     vk::Image GetVkImage();
+    vk::Extent3D GetExtent();
+    vk::Format GetFormat();
+    uint32_t GetMipLevels();
+    // Index of the image in the texture array of a CVulkanBindlessHeap, NO_BINDLESS_HANDLE when it is not in one.
+    uint32_t GetBindlessHandle();
+    void SetBindlessHandle(uint32_t handle);
 private:
 };
 
 class CVulkanImageLoader {
     CVulkanDevice* device;
-    CVulkanQueue* transferQueue;
-    std::shared_ptr<CVulkanCommandBuffer> transferCommandBuffer;
+    CVulkanStagingRing* stagingRing;
+    CVulkanBindlessHeap* bindlessHeap;
+    std::vector<CVulkanImageLoadTiming> timings;
 public:
-    CVulkanImageLoader(CVulkanDevice* device, CVulkanQueue* transferQueue, std::shared_ptr<CVulkanCommandBuffer> transferCommandBuffer);
-    CVulkanImage Load(std::string path, vk::Format format, uint8_t mipLevels, vk::SampleCountFlagBits samples);
+    // Loaded images are added to bindlessHeap when given, their handle is then stable for the lifetime of the heap.
+    CVulkanImageLoader(CVulkanDevice* device, CVulkanStagingRing* stagingRing, CVulkanBindlessHeap* bindlessHeap = nullptr);
+    // Loads level 0 from path and fills the remaining levels, a mipLevels of 0 requests the full chain.
+    // Levels are blitted on the owner queue when the format supports linear blits, otherwise box filtered on the CPU.
+    // KTX2 and DDS files keep their own BC format and mip chain, format and mipLevels are ignored for them. They are
+    // uploaded unmodified, or transcoded to RGBA8 when the device cannot sample the format.
+    CVulkanImage Load(std::string path, vk::Format format, uint8_t mipLevels, vk::SampleCountFlagBits samples, CVulkanImageLoadTiming* timing = nullptr);
+    // Loads every file in paths the same way as Load(), decoding them on threadPool. Copies are recorded on the calling thread
+    // into staging ranges reserved from the image headers, the workers then write the pixels and CPU filtered levels into them.
+    std::vector<CVulkanImage> LoadBatch(std::vector<std::string> paths, vk::Format format, uint8_t mipLevels, vk::SampleCountFlagBits samples, CThreadPool* threadPool);
+    // Per file timings of the last LoadBatch(), in the order of its paths.
+    std::vector<CVulkanImageLoadTiming> GetTimings();
+    void PrintTimings();
+    // Halves random RGBA8 and sRGB levels of odd and even sizes with the CPU box filter and checks every texel against a
+    // reference. Returns false if one is off by more than 1. Blitted levels are compared by RunBlitTest().
+    static bool RunDownsampleTest();
+    // Generates the mip chains of random RGBA8 and sRGB images with CVulkanCommandBuffer::GenerateMipmaps() on queue, reads
+    // every level back and compares it with the CPU box filter of the level read back before it. Returns false if a level
+    // of a power of two image is off by more than 2, odd levels are only reported since a blit does not fold in their edges.
+    static bool RunBlitTest(CVulkanDevice* device, CVulkanQueue* queue);
+private:
+    CVulkanImage LoadCompressed(std::string path, vk::SampleCountFlagBits samples, CVulkanImageLoadTiming* timing);
+    bool IsCompressedFormatSupported(vk::Format format);
+    void RecordTransitionToTransferDst(CVulkanImage* image, uint32_t levels);
+    void AddToBindlessHeap(CVulkanImage* image);
 };
\ No newline at end of file
@@ -0,0 +1,248 @@
+#include "indirect.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "device.hpp"
+#include "buffer.hpp"
+#include "pipeline.hpp"
+#include "cmd.hpp"
+#include "staging.hpp"
+#include "barrier.hpp"
+#include "mesh.hpp"
+#include "transform.hpp"
+#include "descriptor.hpp"
+#include "system/culling.hpp"
+
+CVulkanIndirectRenderer::CVulkanIndirectRenderer(CVulkanDevice* device, CVulkanGraphicsPipeline* pipeline, CVulkanBarrierTracker* barrierTracker,
+    CVulkanDescriptorAllocator* descriptorAllocator, uint32_t framesInFlight, vk::DescriptorSet bindlessSet)
+    : device(device), pipeline(pipeline), bindlessSet(bindlessSet), barrierTracker(barrierTracker), descriptorAllocator(descriptorAllocator), frames(framesInFlight) {
+    transformBuffer = std::make_unique<CVulkanTransformBuffer>(device, descriptorAllocator, framesInFlight);
+
+    // Transforms, object meshes, meshes, draw commands and the draw count, in the order of shaders/cull.comp.
+    std::vector<vk::DescriptorSetLayoutBinding> bindings;
+    for(uint32_t binding = 0; binding < 5; binding++) {
+        bindings.push_back(vk::DescriptorSetLayoutBinding(binding, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute));
+    }
+    cullPipeline = std::make_unique<CVulkanComputePipeline>(device->CreateComputePipeline("shaders/cull.spv", bindings, sizeof(CVulkanCullConstants)));
+}
+
+CVulkanIndirectRenderer::~CVulkanIndirectRenderer() {}
+
+void CVulkanIndirectRenderer::SetMeshes(const std::vector<std::shared_ptr<CVulkanMesh>>& meshes, CVulkanStagingRing* stagingRing) {
+    this->meshes = meshes;
+    meshIndices.clear();
+    transformBuffer->Clear();
+    objectMeshes.clear();
+    objectMaterials.clear();
+
+    // Every mesh keeps its own position dequantization, which is folded into the transforms of its objects.
+    const CVulkanVertexLayout& vertexLayout = pipeline->GetVertexLayout();
+    std::vector<uint8_t> vertexData;
+    size_t verticesCount = 0;
+    std::vector<uint32_t> indices;
+    std::vector<CVulkanIndirectMesh> indirectMeshes;
+    for(auto& mesh : meshes) {
+        CVulkanIndirectMesh indirectMesh = {};
+        indirectMesh.firstIndex = static_cast<uint32_t>(indices.size());
+        indirectMesh.vertexOffset = static_cast<int32_t>(verticesCount);
+        // Objects are drawn at full detail, LODs are only selected by CVulkanMeshRenderer.
+        const CVulkanMeshLod& lod = mesh->lods.front();
+        if(mesh->indices.empty()) {
+            // Every draw is indexed, meshes without indices get sequential ones.
+            for(size_t i = 0; i < mesh->vertices.size(); i++) {
+                indices.push_back(static_cast<uint32_t>(i));
+            }
+        } else {
+            indices.insert(indices.end(), mesh->indices.begin() + lod.firstIndex, mesh->indices.begin() + lod.firstIndex + lod.indexCount);
+        }
+        indirectMesh.indexCount = static_cast<uint32_t>(indices.size()) - indirectMesh.firstIndex;
+        glm::vec4 dequantization = mesh->positionDequantization;
+        indirectMesh.boundingSphere = glm::vec4((glm::vec3(mesh->boundingSphere) - glm::vec3(dequantization)) / dequantization.w, mesh->boundingSphere.w / dequantization.w);
+        meshIndices[mesh.get()] = static_cast<uint32_t>(indirectMeshes.size());
+        indirectMeshes.push_back(indirectMesh);
+        vertexLayout.Encode(mesh->vertices, dequantization, vertexData);
+        verticesCount += mesh->vertices.size();
+    }
+
+    // The mesh buffer is bound to every descriptor set, which are written again along with new object buffers.
+    for(auto& frame : frames) {
+        frame.capacity = 0;
+        frame.writtenObjects = 0;
+    }
+    vertexBuffer.reset();
+    indexBuffer.reset();
+    meshBuffer.reset();
+    if(verticesCount == 0) {
+        return;
+    }
+
+    vk::DeviceSize vertexBufferSize = vertexData.size();
+    vertexBuffer = std::make_unique<CVulkanBuffer>(device->CreateBuffer(vk::MemoryPropertyFlagBits::eDeviceLocal, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, nullptr, vertexBufferSize));
+    stagingRing->CopyToBuffer(vertexData.data(), vertexBufferSize, vertexBuffer.get());
+
+    indexType = vk::IndexType::eUint16;
+    for(auto& mesh : meshes) {
+        if(CVulkanMeshLoader::GetIndexType(mesh->vertices.size()) == vk::IndexType::eUint32) {
+            indexType = vk::IndexType::eUint32;
+        }
+    }
+    std::vector<uint8_t> indexData;
+    CVulkanMeshLoader::AppendIndices(indices, indexType, indexData);
+    vk::DeviceSize indexBufferSize = indexData.size();
+    indexBuffer = std::make_unique<CVulkanBuffer>(device->CreateBuffer(vk::MemoryPropertyFlagBits::eDeviceLocal, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer, nullptr, indexBufferSize));
+    stagingRing->CopyToBuffer(indexData.data(), indexBufferSize, indexBuffer.get());
+
+    vk::DeviceSize meshBufferSize = sizeof(CVulkanIndirectMesh) * indirectMeshes.size();
+    meshBuffer = std::make_unique<CVulkanBuffer>(device->CreateBuffer(vk::MemoryPropertyFlagBits::eDeviceLocal, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, nullptr, meshBufferSize));
+    stagingRing->CopyToBuffer(indirectMeshes.data(), meshBufferSize, meshBuffer.get());
+    stagingRing->Flush(); // Deferred until EndBatch() when the caller batches several loads.
+}
+
+uint32_t CVulkanIndirectRenderer::AddObject(std::shared_ptr<CVulkanMesh> mesh, glm::mat4 worldTransform, uint32_t material) {
+    auto meshIndex = meshIndices.find(mesh.get());
+    if(meshIndex == meshIndices.end()) {
+        printf("CVulkanIndirectRenderer::AddObject: Mesh was not passed to SetMeshes\n");
+        return NO_OBJECT;
+    }
+    objectMeshes.push_back(meshIndex->second);
+    objectMaterials.push_back(material);
+    return transformBuffer->Add(worldTransform * mesh->GetDequantizationTransform());
+}
+
+void CVulkanIndirectRenderer::SetWorldTransform(uint32_t object, glm::mat4 worldTransform) {
+    transformBuffer->Set(object, worldTransform * meshes[objectMeshes[object]]->GetDequantizationTransform());
+}
+
+uint32_t CVulkanIndirectRenderer::GetObjectCount() {
+    return transformBuffer->GetCount();
+}
+
+void CVulkanIndirectRenderer::Cull(CVulkanCommandBuffer* commandBuffer, CVulkanFrame* frame, glm::mat4 viewProjection) {
+    uint32_t objectCount = GetObjectCount();
+    if(objectCount == 0) {
+        return;
+    }
+    FrameBuffers& frameBuffers = frames[frame->currentFrame];
+    // Sets are allocated from the frame's pools every frame, so buffers recreated here are written along with the rest.
+    transformBuffer->Upload(frame->currentFrame, viewProjection);
+    ReserveObjects(frameBuffers);
+    WriteDescriptorSet(frameBuffers, frame->currentFrame);
+
+    // The frame's fence has signaled, so the GPU is done with its copy of the objects.
+    uint32_t* mappedObjectMeshes = static_cast<uint32_t*>(frameBuffers.objectMeshes->GetMappedData());
+    memcpy(mappedObjectMeshes + frameBuffers.writtenObjects, objectMeshes.data() + frameBuffers.writtenObjects,
+        sizeof(uint32_t) * (objectCount - frameBuffers.writtenObjects));
+    CVulkanInstance* mappedInstances = static_cast<CVulkanInstance*>(frameBuffers.instances->GetMappedData());
+    for(uint32_t object = frameBuffers.writtenObjects; object < objectCount; object++) {
+        mappedInstances[object].material = objectMaterials[object];
+    }
+    frameBuffers.writtenObjects = objectCount;
+
+    // Host writes are made visible by the submission, only the GPU's own accesses need barriers.
+    vk::Buffer drawCommands = frameBuffers.drawCommands->GetVkBuffer();
+    vk::Buffer drawCount = frameBuffers.drawCount->GetVkBuffer();
+    barrierTracker->UseBuffer(drawCount, vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite);
+    barrierTracker->Flush(commandBuffer);
+    commandBuffer->FillBuffer(drawCount, 0, sizeof(uint32_t), 0);
+
+    barrierTracker->UseBuffer(drawCount, vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+    barrierTracker->UseBuffer(drawCommands, vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite);
+    barrierTracker->Flush(commandBuffer);
+
+    CVulkanCullConstants constants = {};
+    CFrustum frustum = CFrustum::FromViewProjection(viewProjection);
+    std::copy(std::begin(frustum.planes), std::end(frustum.planes), constants.frustumPlanes);
+    constants.objectCount = objectCount;
+    CVulkanDispatch dispatch;
+    dispatch.pipeline = cullPipeline->GetVkPipeline();
+    dispatch.pipelineLayout = cullPipeline->GetVkPipelineLayout();
+    dispatch.descriptorSets = { frameBuffers.descriptorSet };
+    dispatch.pushConstants.assign(reinterpret_cast<uint8_t*>(&constants), reinterpret_cast<uint8_t*>(&constants) + sizeof(constants));
+    dispatch.groupCountX = (objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE;
+    commandBuffer->Dispatch(&dispatch);
+
+    // Flushed here since the draw is recorded inside a rendering scope, where barriers cannot go.
+    barrierTracker->UseBuffer(drawCount, vk::PipelineStageFlagBits2::eDrawIndirect, vk::AccessFlagBits2::eIndirectCommandRead);
+    barrierTracker->UseBuffer(drawCommands, vk::PipelineStageFlagBits2::eDrawIndirect, vk::AccessFlagBits2::eIndirectCommandRead);
+    barrierTracker->Flush(commandBuffer);
+}
+
+void CVulkanIndirectRenderer::Draw(CVulkanCommandBuffer* commandBuffer, CVulkanFrame* frame) {
+    drawStatistics = {};
+    uint32_t objectCount = GetObjectCount();
+    if(objectCount == 0) {
+        return;
+    }
+    FrameBuffers& frameBuffers = frames[frame->currentFrame];
+
+    CVulkanDraw draw;
+    draw.pipeline = pipeline->GetVkPipeline();
+    draw.pipelineLayout = pipeline->GetVkPipelineLayout();
+    draw.descriptorSets = { transformBuffer->GetVkDescriptorSet(frame->currentFrame) };
+    if(bindlessSet) {
+        draw.descriptorSets.push_back(bindlessSet);
+    }
+    draw.verticesCount = 0;
+    draw.vertexBuffers = { vertexBuffer->GetVkBuffer(), frameBuffers.instances->GetVkBuffer() };
+    draw.vertexBufferOffsets = { 0, 0 };
+    draw.indicesCount = 0;
+    draw.indexBuffer = indexBuffer->GetVkBuffer();
+    draw.indexBufferOffset = 0;
+    draw.indexType = indexType;
+    draw.indirectBuffer = frameBuffers.drawCommands->GetVkBuffer();
+    draw.countBuffer = frameBuffers.drawCount->GetVkBuffer();
+    draw.maxDrawCount = objectCount;
+    commandBuffer->TakeDrawStatistics();
+    commandBuffer->Draw(&draw);
+    drawStatistics = commandBuffer->TakeDrawStatistics();
+}
+
+CVulkanDrawStatistics CVulkanIndirectRenderer::GetDrawStatistics() {
+    return drawStatistics;
+}
+
+void CVulkanIndirectRenderer::ReserveObjects(FrameBuffers& frame) {
+    uint32_t objectCount = GetObjectCount();
+    if(frame.capacity >= objectCount) {
+        return;
+    }
+    uint32_t capacity = MIN_OBJECT_CAPACITY;
+    while(capacity < objectCount) {
+        capacity *= 2;
+    }
+
+    if(frame.drawCommands) {
+        barrierTracker->RemoveBuffer(frame.drawCommands->GetVkBuffer());
+        barrierTracker->RemoveBuffer(frame.drawCount->GetVkBuffer());
+    }
+    vk::MemoryPropertyFlags hostVisible = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    // Draws set firstInstance to their object, so every instance holds its own index.
+    std::vector<CVulkanInstance> instances(capacity);
+    for(uint32_t object = 0; object < capacity; object++) {
+        instances[object].object = object;
+    }
+    frame.instances = std::make_unique<CVulkanBuffer>(device->CreateBuffer(hostVisible,
+        vk::BufferUsageFlagBits::eVertexBuffer, instances.data(), sizeof(CVulkanInstance) * capacity));
+    frame.objectMeshes = std::make_unique<CVulkanBuffer>(device->CreateBuffer(hostVisible,
+        vk::BufferUsageFlagBits::eStorageBuffer, nullptr, sizeof(uint32_t) * capacity));
+    frame.drawCommands = std::make_unique<CVulkanBuffer>(device->CreateBuffer(vk::MemoryPropertyFlagBits::eDeviceLocal,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, nullptr, sizeof(vk::DrawIndexedIndirectCommand) * capacity));
+    frame.drawCount = std::make_unique<CVulkanBuffer>(device->CreateBuffer(vk::MemoryPropertyFlagBits::eDeviceLocal,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst, nullptr, sizeof(uint32_t)));
+    frame.capacity = capacity;
+    frame.writtenObjects = 0;
+    return true;
+}
+
+void CVulkanIndirectRenderer::WriteDescriptorSet(FrameBuffers& frame, uint32_t frameIndex) {
+    CVulkanDescriptorLayout* descriptorLayout = cullPipeline->GetDescriptorLayout();
+    frame.descriptorSet = descriptorAllocator->Allocate(frameIndex, descriptorLayout);
+    descriptorAllocator->Write(frame.descriptorSet, descriptorLayout, {
+        vk::DescriptorBufferInfo(transformBuffer->GetVkBuffer(frameIndex), 0, VK_WHOLE_SIZE),
+        vk::DescriptorBufferInfo(frame.objectMeshes->GetVkBuffer(), 0, VK_WHOLE_SIZE),
+        vk::DescriptorBufferInfo(meshBuffer->GetVkBuffer(), 0, VK_WHOLE_SIZE),
+        vk::DescriptorBufferInfo(frame.drawCommands->GetVkBuffer(), 0, VK_WHOLE_SIZE),
+        vk::DescriptorBufferInfo(frame.drawCount->GetVkBuffer(), 0, VK_WHOLE_SIZE),
+    });
+}
\ No newline at end of file
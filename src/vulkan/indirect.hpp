@@ -0,0 +1,101 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include <glm/glm.hpp>
+#include <map>
+#include <memory>
+#include <vector>
+#include "types.hpp"
+
+class CVulkanDevice;
+class CVulkanBuffer;
+class CVulkanGraphicsPipeline;
+class CVulkanComputePipeline;
+class CVulkanCommandBuffer;
+class CVulkanStagingRing;
+class CVulkanBarrierTracker;
+class CVulkanDescriptorAllocator;
+class CVulkanTransformBuffer;
+struct CVulkanMesh;
+struct CVulkanFrame;
+
+// Where a mesh lives in the shared geometry buffers, laid out as shaders/cull.comp reads it.
+struct CVulkanIndirectMesh {
+    glm::vec4 boundingSphere; // Center in xyz, radius in w, in the space of the encoded positions.
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t padding;
+};
+
+// Push constants of shaders/cull.comp.
+struct CVulkanCullConstants {
+    glm::vec4 frustumPlanes[6]; // Normals point inside, w is the distance from the origin.
+    uint32_t objectCount;
+};
+
+// GPU driven mesh rendering. Meshes share one vertex and index buffer and objects stay in buffers between frames, only
+// the ones that changed are written again. Every frame a compute pass frustum culls all objects and appends a
+// VkDrawIndexedIndirectCommand per visible object, which are drawn with a single vkCmdDrawIndexedIndirectCount.
+// The CPU cost of a frame depends on the number of changed objects, not on the number of objects.
+class CVulkanIndirectRenderer {
+    // Objects are host visible and written by the CPU, so every frame in flight has its own copy.
+    struct FrameBuffers {
+        std::unique_ptr<CVulkanBuffer> instances; // CVulkanInstance per object holding its own index and material, the instance vertex buffer.
+        std::unique_ptr<CVulkanBuffer> objectMeshes; // Index into the mesh buffer per object.
+        std::unique_ptr<CVulkanBuffer> drawCommands;
+        std::unique_ptr<CVulkanBuffer> drawCount;
+        vk::DescriptorSet descriptorSet; // Allocated again by every Cull().
+        uint32_t capacity = 0; // Objects the buffers hold, 0 until they are created.
+        uint32_t writtenObjects = 0; // Object meshes and materials are only ever appended.
+    };
+
+    CVulkanDevice* device;
+    CVulkanGraphicsPipeline* pipeline;
+    vk::DescriptorSet bindlessSet;
+    CVulkanBarrierTracker* barrierTracker;
+    CVulkanDescriptorAllocator* descriptorAllocator;
+    std::unique_ptr<CVulkanComputePipeline> cullPipeline;
+    std::unique_ptr<CVulkanBuffer> vertexBuffer;
+    std::unique_ptr<CVulkanBuffer> indexBuffer;
+    vk::IndexType indexType = vk::IndexType::eUint16; // 32 bit as soon as one mesh needs it, indices are relative to each mesh's vertexOffset.
+    std::unique_ptr<CVulkanBuffer> meshBuffer;
+    std::vector<std::shared_ptr<CVulkanMesh>> meshes;
+    std::map<CVulkanMesh*, uint32_t> meshIndices;
+    std::unique_ptr<CVulkanTransformBuffer> transformBuffer; // World transforms with the position dequantization of the mesh folded in.
+    std::vector<uint32_t> objectMeshes;
+    std::vector<uint32_t> objectMaterials;
+    std::vector<FrameBuffers> frames;
+    CVulkanDrawStatistics drawStatistics;
+public:
+    static constexpr uint32_t NO_OBJECT = ~0u;
+    static constexpr uint32_t MIN_OBJECT_CAPACITY = 1024;
+    static constexpr uint32_t CULL_GROUP_SIZE = 64; // local_size_x of shaders/cull.comp.
+
+    // Draws with pipeline, which must take CVulkanInstance on binding 1 and CVulkanTransformBuffer::GetDescriptorSetLayoutBindings()
+    // as set 0, and the layout of a CVulkanBindlessHeap as set 1 when its bindlessSet is given. Every buffer is synchronized
+    // through barrierTracker, descriptor sets come from the frame's pools of descriptorAllocator. Needs
+    // CVulkanDevice::IsGpuDrivenRenderingEnabled().
+    CVulkanIndirectRenderer(CVulkanDevice* device, CVulkanGraphicsPipeline* pipeline, CVulkanBarrierTracker* barrierTracker,
+        CVulkanDescriptorAllocator* descriptorAllocator, uint32_t framesInFlight, vk::DescriptorSet bindlessSet = nullptr);
+    ~CVulkanIndirectRenderer();
+    // Copies the geometry of meshes into the shared buffers through stagingRing, replacing the meshes and objects from before.
+    // Must not be called while earlier frames are still executing.
+    void SetMeshes(const std::vector<std::shared_ptr<CVulkanMesh>>& meshes, CVulkanStagingRing* stagingRing);
+    // Returns the object index, or NO_OBJECT if mesh was not passed to SetMeshes(). material is a CVulkanMaterial::handle.
+    uint32_t AddObject(std::shared_ptr<CVulkanMesh> mesh, glm::mat4 worldTransform, uint32_t material = 0);
+    void SetWorldTransform(uint32_t object, glm::mat4 worldTransform);
+    uint32_t GetObjectCount();
+    // Writes the changed objects and the camera and records the cull pass, outside of a rendering scope. Objects outside of
+    // the frustum of viewProjection are not drawn.
+    void Cull(CVulkanCommandBuffer* commandBuffer, CVulkanFrame* frame, glm::mat4 viewProjection);
+    // Records the draw of the objects Cull() found visible, inside a rendering scope with inline contents.
+    void Draw(CVulkanCommandBuffer* commandBuffer, CVulkanFrame* frame);
+    // Binds issued and skipped by the last Draw().
+    CVulkanDrawStatistics GetDrawStatistics();
+private:
+    // Recreates the buffers of frame when the objects no longer fit, the frame's fence must have signaled.
+    void ReserveObjects(FrameBuffers& frame);
+    // Allocates the set of frame from its pools and writes the buffers of this frame into it.
+    void WriteDescriptorSet(FrameBuffers& frame, uint32_t frameIndex);
+};
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
+#include <stdexcept>
 #include "device.hpp"
 
 #ifdef _DEBUG
@@ -64,6 +65,12 @@ CVulkanInstance::CVulkanInstance(SDL_Window* window) {
     debugUtilsInfo.pfnUserCallback = debugUtilsCallback;
     debugUtilsMessenger = std::make_unique<vk::raii::DebugUtilsMessengerEXT>(instance->createDebugUtilsMessengerEXT(debugUtilsInfo));
 #endif
+    VkSurfaceKHR tmpSurface;
+    if(!SDL_Vulkan_CreateSurface(window, **instance, &tmpSurface)) {
+        printf("CVulkanInstance::CVulkanInstance: Could not create the window surface: %s\n", SDL_GetError());
+        throw std::runtime_error("CVulkanInstance: surface creation failed");
+    }
+    surface = std::make_unique<vk::raii::SurfaceKHR>(*instance, tmpSurface);
     physicalDevices = instance->enumeratePhysicalDevices();
 }
 
@@ -71,6 +78,10 @@ std::shared_ptr<vk::raii::Instance> CVulkanInstance::GetVkInstance() {
     return instance;
 }
 
+vk::SurfaceKHR CVulkanInstance::GetVkSurface() {
+    return **surface;
+}
+
 std::vector<vk::raii::PhysicalDevice> CVulkanInstance::GetVkPhysicalDevices() {
     return physicalDevices;
 }
@@ -92,15 +103,31 @@ std::vector<const char*> CVulkanInstance::GetEnabledExtensionProperties() {
 }
 
 std::unique_ptr<CVulkanDevice> CVulkanInstance::CreateDevice() {
-    return std::make_unique<CVulkanDevice>(SelectPrimaryPhysicalDevice(physicalDevices));
+    return std::make_unique<CVulkanDevice>(SelectPrimaryPhysicalDevice(physicalDevices), **surface);
 }
 
 vk::raii::PhysicalDevice CVulkanInstance::SelectPrimaryPhysicalDevice(std::vector<vk::raii::PhysicalDevice> physicalDevices) {
     for(auto& physicalDevice : physicalDevices) {
         vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
-        if(properties.deviceType == vk::PhysicalDeviceType::eDiscreteGpu) {
+        if(properties.deviceType == vk::PhysicalDeviceType::eDiscreteGpu && CanPresent(physicalDevice)) {
             return physicalDevice;
         }
     }
+    for(auto& physicalDevice : physicalDevices) {
+        if(CanPresent(physicalDevice)) {
+            return physicalDevice;
+        }
+    }
+    printf("CVulkanInstance::SelectPrimaryPhysicalDevice: No device can present to the window surface, using the first one.\n");
     return physicalDevices.front();
 }
+
+bool CVulkanInstance::CanPresent(const vk::raii::PhysicalDevice& physicalDevice) {
+    auto queueFamilies = physicalDevice.getQueueFamilyProperties();
+    for(uint32_t i = 0; i < queueFamilies.size(); i++) {
+        if((queueFamilies[i].queueFlags & vk::QueueFlagBits::eGraphics) && physicalDevice.getSurfaceSupportKHR(i, **surface)) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -12,13 +12,16 @@ class CVulkanInstance {
 #ifdef _DEBUG
     std::unique_ptr<vk::raii::DebugUtilsMessengerEXT> debugUtilsMessenger;
 #endif
+    std::unique_ptr<vk::raii::SurfaceKHR> surface; // Created before the device so queue selection can check present support.
     std::vector<vk::LayerProperties> availableLayers;
     std::vector<const char*> enabledLayers;
     std::vector<vk::ExtensionProperties> availableExtensions;
     std::vector<const char*> enabledExtensions;
 public:
+    // On failure to create the window surface throws a std::runtime_error.
     CVulkanInstance(SDL_Window* window);
     std::shared_ptr<vk::raii::Instance> GetVkInstance();
+    vk::SurfaceKHR GetVkSurface();
     std::vector<vk::raii::PhysicalDevice> GetVkPhysicalDevices();
     std::vector<vk::LayerProperties> GetAvailableVkLayerProperties();
     std::vector<const char*> GetEnabledLayerProperties();
@@ -26,5 +29,7 @@ public:
     std::vector<const char*> GetEnabledExtensionProperties();
     std::unique_ptr<CVulkanDevice> CreateDevice();
 private:
+    // Prefers a discrete GPU, skipping devices without a graphics family that can present to the surface.
     vk::raii::PhysicalDevice SelectPrimaryPhysicalDevice(std::vector<vk::raii::PhysicalDevice> physicalDevices);
+    bool CanPresent(const vk::raii::PhysicalDevice& physicalDevice);
 };
\ No newline at end of file
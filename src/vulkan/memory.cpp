@@ -0,0 +1,524 @@
+#include "memory.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "util.hpp"
+
+struct CVulkanMemoryNode {
+    vk::DeviceSize offset;
+    vk::DeviceSize size;
+    bool free;
+    CVulkanMemoryNode* prevPhysical;
+    CVulkanMemoryNode* nextPhysical;
+    CVulkanMemoryNode* prevFree;
+    CVulkanMemoryNode* nextFree;
+};
+
+// Remainders smaller than this stay attached to the allocation instead of becoming a free node.
+static constexpr vk::DeviceSize MINIMUM_SPLIT_SIZE = 64;
+
+CVulkanMemoryAllocation::CVulkanMemoryAllocation(CVulkanMemoryAllocator* allocator, CVulkanMemoryBlock* block, CVulkanMemoryNode* node, CVulkanMemoryResourceType resourceType,
+    vk::DeviceSize offset, vk::DeviceSize size, uint32_t memoryTypeIndex)
+    : allocator(allocator), block(block), node(node), resourceType(resourceType), memory(block->GetVkDeviceMemory()), offset(offset), size(size), memoryTypeIndex(memoryTypeIndex) {
+    mapped = block->GetMappedData() != nullptr ? static_cast<char*>(block->GetMappedData()) + offset : nullptr;
+}
+
+CVulkanMemoryAllocation::CVulkanMemoryAllocation(CVulkanMemoryAllocator* allocator, std::unique_ptr<vk::raii::DeviceMemory> dedicatedMemory,
+    vk::DeviceSize size, uint32_t memoryTypeIndex, void* mapped)
+    : allocator(allocator), block(nullptr), node(nullptr), resourceType(MEMORY_RESOURCE_LINEAR), dedicatedMemory(std::move(dedicatedMemory)),
+    offset(0), size(size), memoryTypeIndex(memoryTypeIndex), mapped(mapped) {
+    memory = **this->dedicatedMemory;
+}
+
+CVulkanMemoryAllocation::~CVulkanMemoryAllocation() {
+    allocator->Free(this);
+}
+
+vk::DeviceMemory CVulkanMemoryAllocation::GetVkDeviceMemory() {
+    return memory;
+}
+
+vk::DeviceSize CVulkanMemoryAllocation::GetOffset() {
+    return offset;
+}
+
+vk::DeviceSize CVulkanMemoryAllocation::GetSize() {
+    return size;
+}
+
+uint32_t CVulkanMemoryAllocation::GetMemoryTypeIndex() {
+    return memoryTypeIndex;
+}
+
+void* CVulkanMemoryAllocation::GetMappedData() {
+    return mapped;
+}
+
+bool CVulkanMemoryAllocation::IsDedicated() {
+    return dedicatedMemory != nullptr;
+}
+
+CVulkanMemoryBlock::CVulkanMemoryBlock(std::shared_ptr<vk::raii::Device> device, uint32_t memoryTypeIndex, vk::DeviceSize size, bool hostVisible)
+    : CVulkanMemoryBlock(size) {
+    memory = std::make_unique<vk::raii::DeviceMemory>(*device, vk::MemoryAllocateInfo(size, memoryTypeIndex));
+    if(hostVisible) { // Host visible blocks stay mapped for their whole lifetime, mapping the same memory twice is invalid.
+        mapped = memory->mapMemory(0, VK_WHOLE_SIZE);
+    }
+}
+
+CVulkanMemoryBlock::CVulkanMemoryBlock(vk::DeviceSize size)
+    : size(size), mapped(nullptr), allocationCount(0), firstLevelBitmap(0) {
+    secondLevelBitmaps.fill(0);
+    for(auto& freeList : freeLists) {
+        freeList.fill(nullptr);
+    }
+
+    firstNode = new CVulkanMemoryNode { 0, size, true, nullptr, nullptr, nullptr, nullptr };
+    InsertFreeNode(firstNode);
+}
+
+CVulkanMemoryBlock::~CVulkanMemoryBlock() {
+    CVulkanMemoryNode* node = firstNode;
+    while(node != nullptr) {
+        CVulkanMemoryNode* next = node->nextPhysical;
+        delete node;
+        node = next;
+    }
+}
+
+CVulkanMemoryNode* CVulkanMemoryBlock::Allocate(vk::DeviceSize allocationSize, vk::DeviceSize alignment, vk::DeviceSize& allocationOffset) {
+    alignment = std::max<vk::DeviceSize>(alignment, 1);
+    CVulkanMemoryNode* node = FindFreeNode(allocationSize + alignment - 1);
+    if(node == nullptr) {
+        return nullptr;
+    }
+    RemoveFreeNode(node);
+
+    // Give the bytes skipped by alignment back as their own free node.
+    vk::DeviceSize alignedOffset = (node->offset + alignment - 1) / alignment * alignment;
+    vk::DeviceSize padding = alignedOffset - node->offset;
+    if(padding > 0) {
+        auto front = new CVulkanMemoryNode { node->offset, padding, true, node->prevPhysical, node, nullptr, nullptr };
+        if(node->prevPhysical != nullptr) {
+            node->prevPhysical->nextPhysical = front;
+        } else {
+            firstNode = front;
+        }
+        node->prevPhysical = front;
+        node->offset = alignedOffset;
+        node->size -= padding;
+        InsertFreeNode(front);
+    }
+
+    vk::DeviceSize remaining = node->size - allocationSize;
+    if(remaining >= MINIMUM_SPLIT_SIZE) {
+        auto back = new CVulkanMemoryNode { node->offset + allocationSize, remaining, true, node, node->nextPhysical, nullptr, nullptr };
+        if(node->nextPhysical != nullptr) {
+            node->nextPhysical->prevPhysical = back;
+        }
+        node->nextPhysical = back;
+        node->size = allocationSize;
+        InsertFreeNode(back);
+    }
+
+    node->free = false;
+    allocationCount++;
+    allocationOffset = node->offset;
+    return node;
+}
+
+void CVulkanMemoryBlock::Free(CVulkanMemoryNode* node) {
+    node->free = true;
+    allocationCount--;
+
+    // Coalesce with free physical neighbours, adjacent free nodes never exist outside of this function.
+    CVulkanMemoryNode* prev = node->prevPhysical;
+    if(prev != nullptr && prev->free) {
+        RemoveFreeNode(prev);
+        prev->size += node->size;
+        prev->nextPhysical = node->nextPhysical;
+        if(node->nextPhysical != nullptr) {
+            node->nextPhysical->prevPhysical = prev;
+        }
+        delete node;
+        node = prev;
+    }
+
+    CVulkanMemoryNode* next = node->nextPhysical;
+    if(next != nullptr && next->free) {
+        RemoveFreeNode(next);
+        node->size += next->size;
+        node->nextPhysical = next->nextPhysical;
+        if(next->nextPhysical != nullptr) {
+            next->nextPhysical->prevPhysical = node;
+        }
+        delete next;
+    }
+    InsertFreeNode(node);
+}
+
+bool CVulkanMemoryBlock::IsEmpty() {
+    return allocationCount == 0;
+}
+
+vk::DeviceMemory CVulkanMemoryBlock::GetVkDeviceMemory() {
+    return **memory;
+}
+
+vk::DeviceSize CVulkanMemoryBlock::GetSize() {
+    return size;
+}
+
+void* CVulkanMemoryBlock::GetMappedData() {
+    return mapped;
+}
+
+bool CVulkanMemoryBlock::RunBenchmark(size_t count) {
+    struct Range {
+        CVulkanMemoryNode* node;
+        vk::DeviceSize offset;
+        vk::DeviceSize size;
+        vk::DeviceSize alignment;
+    };
+
+    // Returns what is broken, or nullptr if the nodes tile the block, free neighbours were coalesced, the free lists and
+    // bitmaps hold exactly the free nodes and every range still owns its aligned node.
+    auto validate = [](CVulkanMemoryBlock& block, const std::vector<Range>& ranges) -> const char* {
+        size_t freeCount = 0;
+        size_t allocatedCount = 0;
+        vk::DeviceSize end = 0;
+        for(CVulkanMemoryNode* node = block.firstNode; node != nullptr; node = node->nextPhysical) {
+            if(node->offset != end || node->size == 0 || (node->nextPhysical != nullptr && node->nextPhysical->prevPhysical != node)) {
+                return "nodes do not tile the block";
+            }
+            if(node->free && node->nextPhysical != nullptr && node->nextPhysical->free) {
+                return "adjacent free nodes were not coalesced";
+            }
+            end += node->size;
+            node->free ? freeCount++ : allocatedCount++;
+        }
+        if(end != block.size || block.firstNode->prevPhysical != nullptr) {
+            return "nodes do not tile the block";
+        }
+        if(allocatedCount != block.allocationCount || allocatedCount != ranges.size()) {
+            return "allocated nodes and ranges differ";
+        }
+
+        size_t listedCount = 0;
+        for(uint32_t firstLevel = 0; firstLevel < FIRST_LEVEL_COUNT; firstLevel++) {
+            if(((block.firstLevelBitmap >> firstLevel) & 1) != (block.secondLevelBitmaps[firstLevel] != 0 ? 1u : 0u)) {
+                return "first level bitmap differs from the second level bitmaps";
+            }
+            for(uint32_t secondLevel = 0; secondLevel < SECOND_LEVEL_COUNT; secondLevel++) {
+                CVulkanMemoryNode* head = block.freeLists[firstLevel][secondLevel];
+                if(((block.secondLevelBitmaps[firstLevel] >> secondLevel) & 1) != (head != nullptr ? 1u : 0u)) {
+                    return "second level bitmap differs from the free lists";
+                }
+                for(CVulkanMemoryNode* node = head; node != nullptr; node = node->nextFree) {
+                    uint32_t nodeFirstLevel, nodeSecondLevel;
+                    block.MapSize(node->size, nodeFirstLevel, nodeSecondLevel);
+                    if(!node->free || nodeFirstLevel != firstLevel || nodeSecondLevel != secondLevel || (node != head) != (node->prevFree != nullptr)) {
+                        return "free list holds a node of another size class";
+                    }
+                    listedCount++;
+                }
+            }
+        }
+        if(listedCount != freeCount) {
+            return "free nodes are missing from the free lists";
+        }
+
+        for(auto& range : ranges) {
+            if(range.node->free || range.node->offset != range.offset || range.node->size < range.size || range.offset % range.alignment != 0) {
+                return "range lost its node or alignment";
+            }
+        }
+        return nullptr;
+    };
+
+    // Mostly small buffers and some large images at the alignments resources ask for, enough to fill the block so that
+    // allocations fail and ranges are freed between live neighbours.
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<uint32_t> action(0, 2);
+    std::uniform_int_distribution<uint32_t> large(0, 15);
+    std::uniform_int_distribution<vk::DeviceSize> smallSize(1, 64 * 1024);
+    std::uniform_int_distribution<vk::DeviceSize> largeSize(64 * 1024, 4 * 1024 * 1024);
+    std::uniform_int_distribution<uint32_t> alignmentLog2(0, 16);
+    std::vector<Range> ranges;
+    // Offsets only, no device memory backs the block.
+    CVulkanMemoryBlock block(64ull * 1024 * 1024);
+    const char* failure = nullptr;
+
+    // A small range out of the empty block is split off, freeing it coalesces the block back into one node.
+    vk::DeviceSize offset;
+    CVulkanMemoryNode* node = block.Allocate(256, 1, offset);
+    if(node == nullptr || offset != 0 || node->nextPhysical == nullptr || node->nextPhysical->size != block.size - 256) {
+        failure = "empty block was not split";
+    } else {
+        block.Free(node);
+        if(block.firstNode->nextPhysical != nullptr || block.firstNode->size != block.size) {
+            failure = "empty block was not coalesced";
+        }
+    }
+
+    size_t failedCount = 0;
+    std::chrono::steady_clock::duration elapsed {};
+    for(size_t i = 0; i < count && failure == nullptr; i++) {
+        auto start = std::chrono::steady_clock::now();
+        if(ranges.empty() || action(random) != 0) {
+            Range range;
+            range.size = large(random) == 0 ? largeSize(random) : smallSize(random);
+            range.alignment = 1ull << alignmentLog2(random);
+            range.node = block.Allocate(range.size, range.alignment, range.offset);
+            elapsed += std::chrono::steady_clock::now() - start;
+            if(range.node != nullptr) {
+                ranges.push_back(range);
+            } else {
+                // Good fit only searches size classes whose every node fits, one class above the request at most.
+                failedCount++;
+                vk::DeviceSize request = range.size + range.alignment - 1;
+                for(CVulkanMemoryNode* free = block.firstNode; free != nullptr; free = free->nextPhysical) {
+                    if(free->free && free->size >= request + request / SECOND_LEVEL_COUNT + SECOND_LEVEL_COUNT) {
+                        failure = "allocation failed with a large enough free node";
+                    }
+                }
+            }
+        } else {
+            size_t index = std::uniform_int_distribution<size_t>(0, ranges.size() - 1)(random);
+            block.Free(ranges[index].node);
+            elapsed += std::chrono::steady_clock::now() - start;
+            ranges[index] = ranges.back();
+            ranges.pop_back();
+        }
+        if(failure == nullptr) {
+            failure = validate(block, ranges);
+        }
+    }
+
+    // Freeing everything in random order has to coalesce the block back into a single node.
+    std::shuffle(ranges.begin(), ranges.end(), random);
+    while(failure == nullptr && !ranges.empty()) {
+        block.Free(ranges.back().node);
+        ranges.pop_back();
+        failure = validate(block, ranges);
+    }
+    if(failure == nullptr && (block.firstNode->nextPhysical != nullptr || !block.IsEmpty())) {
+        failure = "emptied block was not coalesced";
+    }
+
+    printf("CVulkanMemoryBlock::RunBenchmark: %zu allocations and frees in %.3f ms, %zu did not fit, %s%s\n", count,
+        std::chrono::duration<double, std::milli>(elapsed).count(), failedCount, failure == nullptr ? "passed" : "FAILED: ", failure == nullptr ? "" : failure);
+    return failure == nullptr;
+}
+
+void CVulkanMemoryBlock::MapSize(vk::DeviceSize nodeSize, uint32_t& firstLevel, uint32_t& secondLevel) {
+    if(nodeSize < (1ull << SMALL_BLOCK_LOG2)) {
+        firstLevel = 0;
+        secondLevel = static_cast<uint32_t>(nodeSize >> (SMALL_BLOCK_LOG2 - SECOND_LEVEL_LOG2));
+    } else {
+        uint32_t mostSignificantBit = 63 - std::countl_zero(nodeSize);
+        firstLevel = mostSignificantBit - SMALL_BLOCK_LOG2 + 1;
+        secondLevel = static_cast<uint32_t>(nodeSize >> (mostSignificantBit - SECOND_LEVEL_LOG2)) ^ SECOND_LEVEL_COUNT;
+    }
+}
+
+CVulkanMemoryNode* CVulkanMemoryBlock::FindFreeNode(vk::DeviceSize nodeSize) {
+    // Round up to the next size class so that any node in the found list is large enough.
+    if(nodeSize >= (1ull << SMALL_BLOCK_LOG2)) {
+        uint32_t mostSignificantBit = 63 - std::countl_zero(nodeSize);
+        nodeSize += (1ull << (mostSignificantBit - SECOND_LEVEL_LOG2)) - 1;
+    } else {
+        nodeSize += (1ull << (SMALL_BLOCK_LOG2 - SECOND_LEVEL_LOG2)) - 1;
+    }
+
+    uint32_t firstLevel, secondLevel;
+    MapSize(nodeSize, firstLevel, secondLevel);
+    if(firstLevel >= FIRST_LEVEL_COUNT) {
+        return nullptr;
+    }
+
+    uint32_t secondLevelMap = secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+    if(secondLevelMap == 0) {
+        uint64_t firstLevelMap = firstLevel + 1 < 64 ? firstLevelBitmap & (~0ull << (firstLevel + 1)) : 0;
+        if(firstLevelMap == 0) {
+            return nullptr;
+        }
+        firstLevel = std::countr_zero(firstLevelMap);
+        secondLevelMap = secondLevelBitmaps[firstLevel];
+    }
+    secondLevel = std::countr_zero(secondLevelMap);
+    return freeLists[firstLevel][secondLevel];
+}
+
+void CVulkanMemoryBlock::InsertFreeNode(CVulkanMemoryNode* node) {
+    uint32_t firstLevel, secondLevel;
+    MapSize(node->size, firstLevel, secondLevel);
+
+    CVulkanMemoryNode* head = freeLists[firstLevel][secondLevel];
+    node->prevFree = nullptr;
+    node->nextFree = head;
+    if(head != nullptr) {
+        head->prevFree = node;
+    }
+    freeLists[firstLevel][secondLevel] = node;
+    firstLevelBitmap |= 1ull << firstLevel;
+    secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+}
+
+void CVulkanMemoryBlock::RemoveFreeNode(CVulkanMemoryNode* node) {
+    uint32_t firstLevel, secondLevel;
+    MapSize(node->size, firstLevel, secondLevel);
+
+    if(node->prevFree != nullptr) {
+        node->prevFree->nextFree = node->nextFree;
+    } else {
+        freeLists[firstLevel][secondLevel] = node->nextFree;
+    }
+    if(node->nextFree != nullptr) {
+        node->nextFree->prevFree = node->prevFree;
+    }
+    node->prevFree = nullptr;
+    node->nextFree = nullptr;
+
+    if(freeLists[firstLevel][secondLevel] == nullptr) {
+        secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+        if(secondLevelBitmaps[firstLevel] == 0) {
+            firstLevelBitmap &= ~(1ull << firstLevel);
+        }
+    }
+}
+
+CVulkanMemoryAllocator::CVulkanMemoryAllocator(std::shared_ptr<vk::raii::Device> device, vk::PhysicalDeviceMemoryProperties memoryProperties)
+    : device(device), memoryProperties(memoryProperties) {
+    // Small heaps (integrated GPUs, host visible device local BAR) get proportionally smaller blocks.
+    for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        vk::DeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size;
+        preferredBlockSizes[i] = heapSize <= 1024ull * 1024 * 1024 ? heapSize / 8 : DEFAULT_BLOCK_SIZE;
+    }
+}
+
+std::unique_ptr<CVulkanMemoryAllocation> CVulkanMemoryAllocator::Allocate(vk::MemoryRequirements memoryRequirements, vk::MemoryPropertyFlags desiredPropertyFlags, CVulkanMemoryResourceType resourceType) {
+    uint32_t memoryTypeIndex = GetMemoryTypeIndex(memoryProperties, memoryRequirements.memoryTypeBits, desiredPropertyFlags);
+    if(memoryTypeIndex == INVALID_MEMORY_TYPE_INDEX) {
+        return nullptr;
+    }
+    bool hostVisible = static_cast<bool>(memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& typeStatistics = statistics[memoryTypeIndex];
+    // Counted only once the memory exists, creating it throws when the device is out of memory.
+    auto countAllocation = [&]() {
+        typeStatistics.allocationCount++;
+        typeStatistics.allocatedBytes += memoryRequirements.size;
+        typeStatistics.peakAllocatedBytes = std::max(typeStatistics.peakAllocatedBytes, typeStatistics.allocatedBytes);
+    };
+
+    // Resources larger than half a block would waste most of it, give them their own memory.
+    if(memoryRequirements.size > preferredBlockSizes[memoryTypeIndex] / 2) {
+        auto dedicatedMemory = std::make_unique<vk::raii::DeviceMemory>(*device, vk::MemoryAllocateInfo(memoryRequirements.size, memoryTypeIndex));
+        void* mapped = hostVisible ? dedicatedMemory->mapMemory(0, VK_WHOLE_SIZE) : nullptr;
+        countAllocation();
+        typeStatistics.dedicatedAllocationCount++;
+        typeStatistics.reservedBytes += memoryRequirements.size;
+        return std::make_unique<CVulkanMemoryAllocation>(this, std::move(dedicatedMemory), memoryRequirements.size, memoryTypeIndex, mapped);
+    }
+
+    vk::DeviceSize offset;
+    auto& pool = blocks[memoryTypeIndex][resourceType];
+    for(auto& block : pool) {
+        CVulkanMemoryNode* node = block->Allocate(memoryRequirements.size, memoryRequirements.alignment, offset);
+        if(node != nullptr) {
+            countAllocation();
+            return std::make_unique<CVulkanMemoryAllocation>(this, block.get(), node, resourceType, offset, memoryRequirements.size, memoryTypeIndex);
+        }
+    }
+
+    pool.push_back(CreateBlock(memoryTypeIndex, memoryRequirements.size, hostVisible));
+    CVulkanMemoryBlock* block = pool.back().get();
+    typeStatistics.blockCount++;
+    typeStatistics.reservedBytes += block->GetSize();
+    CVulkanMemoryNode* node = block->Allocate(memoryRequirements.size, memoryRequirements.alignment, offset);
+    countAllocation();
+    return std::make_unique<CVulkanMemoryAllocation>(this, block, node, resourceType, offset, memoryRequirements.size, memoryTypeIndex);
+}
+
+CVulkanMemoryStatistics CVulkanMemoryAllocator::GetStatistics(uint32_t memoryTypeIndex) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return statistics[memoryTypeIndex];
+}
+
+CVulkanMemoryStatistics CVulkanMemoryAllocator::GetTotalStatistics() {
+    std::lock_guard<std::mutex> lock(mutex);
+    CVulkanMemoryStatistics total;
+    for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        total.blockCount += statistics[i].blockCount;
+        total.dedicatedAllocationCount += statistics[i].dedicatedAllocationCount;
+        total.allocationCount += statistics[i].allocationCount;
+        total.reservedBytes += statistics[i].reservedBytes;
+        total.allocatedBytes += statistics[i].allocatedBytes;
+        total.peakAllocatedBytes += statistics[i].peakAllocatedBytes;
+    }
+    return total;
+}
+
+void CVulkanMemoryAllocator::PrintStatistics() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        auto& typeStatistics = statistics[i];
+        if(typeStatistics.blockCount == 0 && typeStatistics.dedicatedAllocationCount == 0) {
+            continue;
+        }
+        printf("CVulkanMemoryAllocator: type %u: %u blocks, %u dedicated, %u allocations, %llu/%llu bytes used (peak %llu)\n", i,
+            typeStatistics.blockCount, typeStatistics.dedicatedAllocationCount, typeStatistics.allocationCount,
+            static_cast<unsigned long long>(typeStatistics.allocatedBytes), static_cast<unsigned long long>(typeStatistics.reservedBytes),
+            static_cast<unsigned long long>(typeStatistics.peakAllocatedBytes));
+    }
+}
+
+std::unique_ptr<CVulkanMemoryBlock> CVulkanMemoryAllocator::CreateBlock(uint32_t memoryTypeIndex, vk::DeviceSize minimumSize, bool hostVisible) {
+    // Retry with smaller blocks when the driver cannot satisfy a full sized one.
+    vk::DeviceSize blockSize = preferredBlockSizes[memoryTypeIndex];
+    while(true) {
+        try {
+            return std::make_unique<CVulkanMemoryBlock>(device, memoryTypeIndex, blockSize, hostVisible);
+        } catch(vk::SystemError& error) {
+            if(blockSize / 2 < minimumSize * 2) {
+                throw;
+            }
+            blockSize /= 2;
+        }
+    }
+}
+
+void CVulkanMemoryAllocator::Free(CVulkanMemoryAllocation* allocation) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& typeStatistics = statistics[allocation->memoryTypeIndex];
+    typeStatistics.allocationCount--;
+    typeStatistics.allocatedBytes -= allocation->size;
+
+    if(allocation->IsDedicated()) {
+        typeStatistics.dedicatedAllocationCount--;
+        typeStatistics.reservedBytes -= allocation->size;
+        allocation->dedicatedMemory.reset();
+        return;
+    }
+
+    allocation->block->Free(allocation->node);
+    if(!allocation->block->IsEmpty()) {
+        return;
+    }
+
+    // Keep a single empty block around per pool so that load/unload cycles do not thrash vkAllocateMemory.
+    auto& pool = blocks[allocation->memoryTypeIndex][allocation->resourceType];
+    size_t emptyBlocks = std::count_if(pool.begin(), pool.end(), [](auto& block) { return block->IsEmpty(); });
+    if(emptyBlocks > 1) {
+        auto it = std::find_if(pool.begin(), pool.end(), [&](auto& block) { return block.get() == allocation->block; });
+        typeStatistics.blockCount--;
+        typeStatistics.reservedBytes -= (*it)->GetSize();
+        pool.erase(it);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include <array>
+#include <mutex>
+
+class CVulkanMemoryAllocator;
+class CVulkanMemoryBlock;
+struct CVulkanMemoryNode;
+
+// Linear (buffers) and optimal (images) resources are kept in separate blocks so bufferImageGranularity never applies.
+enum CVulkanMemoryResourceType {
+    MEMORY_RESOURCE_LINEAR,
+    MEMORY_RESOURCE_OPTIMAL,
+    MEMORY_RESOURCE_COUNT
+};
+
+struct CVulkanMemoryStatistics {
+    uint32_t blockCount = 0;
+    uint32_t dedicatedAllocationCount = 0;
+    uint32_t allocationCount = 0;
+    vk::DeviceSize reservedBytes = 0; // Device memory held by blocks and dedicated allocations.
+    vk::DeviceSize allocatedBytes = 0;
+    vk::DeviceSize peakAllocatedBytes = 0;
+};
+
+// A range of device memory handed out by the allocator, returned to it on destruction.
+class CVulkanMemoryAllocation {
+    CVulkanMemoryAllocator* allocator;
+    CVulkanMemoryBlock* block;
+    CVulkanMemoryNode* node;
+    CVulkanMemoryResourceType resourceType;
+    std::unique_ptr<vk::raii::DeviceMemory> dedicatedMemory;
+    vk::DeviceMemory memory;
+    vk::DeviceSize offset;
+    vk::DeviceSize size;
+    uint32_t memoryTypeIndex;
+    void* mapped;
+public:
+    CVulkanMemoryAllocation(CVulkanMemoryAllocator* allocator, CVulkanMemoryBlock* block, CVulkanMemoryNode* node, CVulkanMemoryResourceType resourceType,
+        vk::DeviceSize offset, vk::DeviceSize size, uint32_t memoryTypeIndex);
+    CVulkanMemoryAllocation(CVulkanMemoryAllocator* allocator, std::unique_ptr<vk::raii::DeviceMemory> dedicatedMemory,
+        vk::DeviceSize size, uint32_t memoryTypeIndex, void* mapped);
+    CVulkanMemoryAllocation(const CVulkanMemoryAllocation&) = delete;
+    CVulkanMemoryAllocation& operator=(const CVulkanMemoryAllocation&) = delete;
+    ~CVulkanMemoryAllocation();
+    vk::DeviceMemory GetVkDeviceMemory();
+    vk::DeviceSize GetOffset();
+    vk::DeviceSize GetSize();
+    uint32_t GetMemoryTypeIndex();
+    // Pointer to the start of this allocation if the memory is host visible, otherwise nullptr.
+    void* GetMappedData();
+    bool IsDedicated();
+private:
+    friend class CVulkanMemoryAllocator;
+};
+
+// A single vkAllocateMemory call sub-allocated with a two level segregated fit (TLSF) free list.
+class CVulkanMemoryBlock {
+    static constexpr uint32_t SECOND_LEVEL_LOG2 = 4;
+    static constexpr uint32_t SECOND_LEVEL_COUNT = 1 << SECOND_LEVEL_LOG2;
+    static constexpr uint32_t SMALL_BLOCK_LOG2 = 8;
+    static constexpr uint32_t FIRST_LEVEL_COUNT = 64 - SMALL_BLOCK_LOG2 + 1;
+
+    std::unique_ptr<vk::raii::DeviceMemory> memory;
+    vk::DeviceSize size;
+    void* mapped;
+    uint32_t allocationCount;
+    uint64_t firstLevelBitmap;
+    std::array<uint32_t, FIRST_LEVEL_COUNT> secondLevelBitmaps;
+    std::array<std::array<CVulkanMemoryNode*, SECOND_LEVEL_COUNT>, FIRST_LEVEL_COUNT> freeLists;
+    CVulkanMemoryNode* firstNode;
+public:
+    CVulkanMemoryBlock(std::shared_ptr<vk::raii::Device> device, uint32_t memoryTypeIndex, vk::DeviceSize size, bool hostVisible);
+    ~CVulkanMemoryBlock();
+    // Returns nullptr if no free range in this block can hold size bytes at the requested alignment.
+    CVulkanMemoryNode* Allocate(vk::DeviceSize allocationSize, vk::DeviceSize alignment, vk::DeviceSize& allocationOffset);
+    void Free(CVulkanMemoryNode* node);
+    bool IsEmpty();
+    vk::DeviceMemory GetVkDeviceMemory();
+    vk::DeviceSize GetSize();
+    void* GetMappedData();
+    // Allocates and frees count random ranges in a block without device memory, checking after every step that the nodes
+    // tile the block, free neighbours were coalesced and the free lists hold exactly the free nodes. Prints the time spent
+    // in Allocate() and Free() and returns false on the first broken invariant.
+    static bool RunBenchmark(size_t count);
+private:
+    // Offsets only, for RunBenchmark().
+    CVulkanMemoryBlock(vk::DeviceSize size);
+    void MapSize(vk::DeviceSize nodeSize, uint32_t& firstLevel, uint32_t& secondLevel);
+    CVulkanMemoryNode* FindFreeNode(vk::DeviceSize nodeSize);
+    void InsertFreeNode(CVulkanMemoryNode* node);
+    void RemoveFreeNode(CVulkanMemoryNode* node);
+};
+
+// Hands out sub-allocations from large per memory type blocks instead of one vkAllocateMemory per resource.
+class CVulkanMemoryAllocator {
+    std::shared_ptr<vk::raii::Device> device;
+    vk::PhysicalDeviceMemoryProperties memoryProperties;
+    std::array<vk::DeviceSize, VK_MAX_MEMORY_TYPES> preferredBlockSizes;
+    std::array<std::array<std::vector<std::unique_ptr<CVulkanMemoryBlock>>, MEMORY_RESOURCE_COUNT>, VK_MAX_MEMORY_TYPES> blocks;
+    std::array<CVulkanMemoryStatistics, VK_MAX_MEMORY_TYPES> statistics;
+    std::mutex mutex;
+public:
+    static constexpr vk::DeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+    CVulkanMemoryAllocator(std::shared_ptr<vk::raii::Device> device, vk::PhysicalDeviceMemoryProperties memoryProperties);
+    // Returns nullptr when no memory type satisfies both the requirements and the desired property flags.
+    std::unique_ptr<CVulkanMemoryAllocation> Allocate(vk::MemoryRequirements memoryRequirements, vk::MemoryPropertyFlags desiredPropertyFlags, CVulkanMemoryResourceType resourceType);
+    CVulkanMemoryStatistics GetStatistics(uint32_t memoryTypeIndex);
+    CVulkanMemoryStatistics GetTotalStatistics();
+    void PrintStatistics();
+private:
+    friend class CVulkanMemoryAllocation;
+    std::unique_ptr<CVulkanMemoryBlock> CreateBlock(uint32_t memoryTypeIndex, vk::DeviceSize minimumSize, bool hostVisible);
+    void Free(CVulkanMemoryAllocation* allocation);
+};
\ No newline at end of file
@@ -1,56 +1,340 @@
 #include "mesh.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <unordered_map>
 #include "device.hpp"
-#include "queue.hpp"
 #include "buffer.hpp"
 #include "pipeline.hpp"
 #include "cmd.hpp"
+#include "staging.hpp"
+#include "optimize.hpp"
+#include "transform.hpp"
 #include "types.hpp"
+#include "system/threadpool.hpp"
 
-CVulkanMeshLoader::CVulkanMeshLoader(CVulkanDevice* device, CVulkanQueue* transferQueue, std::shared_ptr<CVulkanCommandBuffer> transferCommandBuffer) 
-    : device(device), transferQueue(transferQueue), transferCommandBuffer(transferCommandBuffer) {}
-
-CVulkanMesh CVulkanMeshLoader::Load(std::vector<CVulkanVertex> vertices, std::vector<uint16_t> indices) {
-    auto vkDevice = device->GetVkDevice();
-    auto vkMemoryProperties = device->GetVkPhysicalDeviceMemoryProperties();
+CVulkanMeshLoader::CVulkanMeshLoader(CVulkanDevice* device, CVulkanStagingRing* stagingRing, const CVulkanVertexLayout& vertexLayout)
+    : device(device), stagingRing(stagingRing), vertexLayout(vertexLayout) {}
 
+CVulkanMesh CVulkanMeshLoader::Load(std::vector<CVulkanVertex> vertices, std::vector<uint32_t> indices, CVulkanMeshLoadOptions options) {
+    if(options.optimize) {
+        CVulkanMeshOptimizer::Optimize(vertices, indices);
+    }
     CVulkanMesh mesh;
     mesh.vertices = vertices;
+    mesh.indexType = GetIndexType(vertices.size());
+    if(options.meshlets) {
+        CVulkanMeshletBuilder::Build(vertices, indices, mesh.meshlets, mesh.meshletVertices, mesh.meshletTriangles);
+    }
+
+    // Every LOD is simplified from full detail, so its error is measured against it rather than the LOD before.
+    mesh.lods.push_back({ 0, static_cast<uint32_t>(indices.size()), 0.0f });
+    size_t fullIndexCount = indices.size();
+    for(uint32_t lod = 1; lod < std::min(options.lodCount, MAX_LODS) && !indices.empty(); lod++) {
+        size_t targetIndexCount = (fullIndexCount >> lod) / 3 * 3;
+        if(targetIndexCount < MIN_LOD_TRIANGLES * 3) {
+            break;
+        }
+        float error = 0.0f;
+        std::vector<uint32_t> lodIndices = CVulkanMeshOptimizer::Simplify(vertices, std::vector<uint32_t>(indices.begin(), indices.begin() + fullIndexCount), targetIndexCount, error);
+        if(lodIndices.size() * 10 > mesh.lods.back().indexCount * 9) {
+            break;
+        }
+        CVulkanMeshOptimizer::OptimizeVertexCache(lodIndices, vertices.size());
+        mesh.lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lodIndices.size()), error });
+        indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+    }
     mesh.indices = indices;
 
-    vk::DeviceSize vertexBufferSize = sizeof(CVulkanVertex) * vertices.size();
-    auto stagingVertexBuffer = device->CreateBuffer(vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, vk::BufferUsageFlagBits::eTransferSrc, vertices.data(), vertexBufferSize);
-    mesh.vertexBuffer = std::make_unique<CVulkanBuffer>(device->CreateBuffer(vk::MemoryPropertyFlagBits::eDeviceLocal, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, nullptr, vertexBufferSize));
+    // Bounds are computed once here, instances only transform them.
+    if(!vertices.empty()) {
+        glm::vec3 minimum = vertices.front().position;
+        glm::vec3 maximum = vertices.front().position;
+        for(auto& vertex : vertices) {
+            minimum = glm::min(minimum, vertex.position);
+            maximum = glm::max(maximum, vertex.position);
+        }
+        mesh.boundsMin = minimum;
+        mesh.boundsMax = maximum;
+        glm::vec3 center = (minimum + maximum) * 0.5f;
+        float radius = 0.0f;
+        for(auto& vertex : vertices) {
+            radius = std::max(radius, glm::length(vertex.position - center));
+        }
+        mesh.boundingSphere = glm::vec4(center, radius);
+    }
 
-    transferCommandBuffer->CopyBuffer(&stagingVertexBuffer, mesh.vertexBuffer.get(), vk::BufferCopy(0, 0, vertexBufferSize));
-    transferQueue->Submit(transferCommandBuffer);
-    transferCommandBuffer->Reset();
+    mesh.positionDequantization = vertexLayout.GetPositionDequantization(vertices);
+    std::vector<uint8_t> vertexData;
+    vertexLayout.Encode(vertices, mesh.positionDequantization, vertexData);
+    vk::DeviceSize vertexBufferSize = vertexData.size();
+    mesh.vertexBuffer = std::make_unique<CVulkanBuffer>(device->CreateBuffer(vk::MemoryPropertyFlagBits::eDeviceLocal, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer, nullptr, vertexBufferSize));
+    stagingRing->CopyToBuffer(vertexData.data(), vertexBufferSize, mesh.vertexBuffer.get());
 
     if(indices.size() > 0) {
-        vk::DeviceSize indexBufferSize = sizeof(uint16_t) * indices.size();
-        auto stagingIndexBuffer = device->CreateBuffer(vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, vk::BufferUsageFlagBits::eTransferSrc, indices.data(), indexBufferSize);
+        std::vector<uint8_t> indexData;
+        AppendIndices(indices, mesh.indexType, indexData);
+        vk::DeviceSize indexBufferSize = indexData.size();
         mesh.indexBuffer = std::make_unique<CVulkanBuffer>(device->CreateBuffer(vk::MemoryPropertyFlagBits::eDeviceLocal, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer, nullptr, indexBufferSize));
-
-        transferCommandBuffer->CopyBuffer(&stagingIndexBuffer, mesh.indexBuffer.get(), vk::BufferCopy(0, 0, indexBufferSize));
-        transferQueue->Submit(transferCommandBuffer);
-        transferCommandBuffer->Reset();
+        stagingRing->CopyToBuffer(indexData.data(), indexBufferSize, mesh.indexBuffer.get());
     }
+    stagingRing->Flush(); // Deferred until EndBatch() when the caller batches several loads.
     return mesh;
 }
 
-CVulkanMeshRenderer::CVulkanMeshRenderer(CVulkanGraphicsPipeline* pipeline, std::vector<std::shared_ptr<CVulkanCommandBuffer>> graphicsCommandBuffers)
-    : pipeline(pipeline), graphicsCommandBuffers(graphicsCommandBuffers) {}
+vk::IndexType CVulkanMeshLoader::GetIndexType(size_t verticesCount) {
+    return verticesCount <= UINT16_MAX + 1 ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+}
+
+void CVulkanMeshLoader::AppendIndices(const std::vector<uint32_t>& indices, vk::IndexType indexType, std::vector<uint8_t>& buffer) {
+    size_t offset = buffer.size();
+    if(indexType == vk::IndexType::eUint32) {
+        buffer.resize(offset + sizeof(uint32_t) * indices.size());
+        memcpy(buffer.data() + offset, indices.data(), sizeof(uint32_t) * indices.size());
+        return;
+    }
+    buffer.resize(offset + sizeof(uint16_t) * indices.size());
+    uint16_t* narrowed = reinterpret_cast<uint16_t*>(buffer.data() + offset);
+    for(size_t i = 0; i < indices.size(); i++) {
+        narrowed[i] = static_cast<uint16_t>(indices[i]);
+    }
+}
+
+CVulkanMeshRenderer::CVulkanMeshRenderer(CVulkanDevice* device, CVulkanGraphicsPipeline* pipeline, CVulkanDescriptorAllocator* descriptorAllocator,
+    std::vector<std::shared_ptr<CVulkanCommandBuffer>> graphicsCommandBuffers, vk::DescriptorSet bindlessSet)
+    : device(device), pipeline(pipeline), bindlessSet(bindlessSet), graphicsCommandBuffers(graphicsCommandBuffers), threadPool(nullptr), instanceBuffers(graphicsCommandBuffers.size()) {
+    transformBuffer = std::make_unique<CVulkanTransformBuffer>(device, descriptorAllocator, static_cast<uint32_t>(graphicsCommandBuffers.size()));
+}
+
+CVulkanMeshRenderer::CVulkanMeshRenderer(CVulkanDevice* device, uint32_t queueFamilyIndex, CVulkanGraphicsPipeline* pipeline, CVulkanDescriptorAllocator* descriptorAllocator,
+    std::vector<std::shared_ptr<CVulkanCommandBuffer>> graphicsCommandBuffers, CThreadPool* threadPool, vk::Format colorFormat, vk::DescriptorSet bindlessSet)
+    : device(device), pipeline(pipeline), bindlessSet(bindlessSet), graphicsCommandBuffers(graphicsCommandBuffers), threadPool(threadPool), colorFormats({ colorFormat }),
+    instanceBuffers(graphicsCommandBuffers.size()) {
+    transformBuffer = std::make_unique<CVulkanTransformBuffer>(device, descriptorAllocator, static_cast<uint32_t>(graphicsCommandBuffers.size()));
+    secondaryCommandPools = std::make_unique<CVulkanSecondaryCommandPools>(device->GetVkDevice(), queueFamilyIndex,
+        static_cast<uint32_t>(graphicsCommandBuffers.size()), threadPool->GetThreadCount());
+}
+
+CVulkanMeshRenderer::~CVulkanMeshRenderer() {}
+
+vk::RenderingFlags CVulkanMeshRenderer::GetRenderingFlags() {
+    if(threadPool == nullptr) {
+        return {};
+    }
+    return vk::RenderingFlagBits::eContentsSecondaryCommandBuffers;
+}
+
+void CVulkanMeshRenderer::Draw(CVulkanFrame* frame, const std::vector<CVulkanMeshInstance>& instances, glm::mat4 viewProjection) {
+    auto primaryCommandBuffer = graphicsCommandBuffers[frame->currentFrame];
+    drawStatistics = {};
+    if(threadPool != nullptr) {
+        // The frame's fence has signaled by now, so its secondaries from last time are done.
+        secondaryCommandPools->Reset(frame->currentFrame);
+    }
+    BuildBatches(frame, instances, viewProjection);
+    size_t drawCount = batches.size();
+    if(drawCount == 0) {
+        return;
+    }
+    vk::Buffer instanceBuffer = instanceBuffers[frame->currentFrame]->GetVkBuffer();
+    vk::DescriptorSet descriptorSet = transformBuffer->GetVkDescriptorSet(frame->currentFrame);
+    auto recordingStart = std::chrono::steady_clock::now();
+    if(threadPool == nullptr) {
+        primaryCommandBuffer->TakeDrawStatistics();
+        RecordDraws(primaryCommandBuffer.get(), instanceBuffer, descriptorSet, 0, drawCount);
+        drawStatistics = primaryCommandBuffer->TakeDrawStatistics();
+        drawStatistics.recordingMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recordingStart).count();
+        return;
+    }
+
+    size_t maxRecordings = threadPool->GetThreadCount() * RECORDINGS_PER_THREAD;
+    size_t recordingCount = std::clamp<size_t>((drawCount + MIN_DRAWS_PER_RECORDING - 1) / MIN_DRAWS_PER_RECORDING, 1, maxRecordings);
+
+    // Contiguous ranges keep the submission order of the draws once the secondaries are executed in order.
+    std::vector<std::shared_ptr<CVulkanCommandBuffer>> secondaryCommandBuffers(recordingCount);
+    std::vector<CVulkanDrawStatistics> recordingStatistics(recordingCount);
+    threadPool->ParallelFor(recordingCount, [&](size_t recording) {
+        auto commandBuffer = secondaryCommandPools->Acquire(frame->currentFrame, CThreadPool::GetCurrentWorkerIndex());
+        commandBuffer->BeginSecondary(colorFormats);
+        commandBuffer->SetViewport(frame->extent);
+        RecordDraws(commandBuffer.get(), instanceBuffer, descriptorSet, drawCount * recording / recordingCount, drawCount * (recording + 1) / recordingCount);
+        commandBuffer->End();
+        secondaryCommandBuffers[recording] = commandBuffer;
+        recordingStatistics[recording] = commandBuffer->TakeDrawStatistics();
+    });
+    drawStatistics.recordingMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recordingStart).count();
+    primaryCommandBuffer->ExecuteCommandBuffers(secondaryCommandBuffers);
+    for(auto& statistics : recordingStatistics) {
+        drawStatistics.drawCount += statistics.drawCount;
+        drawStatistics.bindCount += statistics.bindCount;
+        drawStatistics.skippedBindCount += statistics.skippedBindCount;
+        drawStatistics.triangleCount += statistics.triangleCount;
+    }
+}
+
+CVulkanDrawStatistics CVulkanMeshRenderer::GetDrawStatistics() {
+    return drawStatistics;
+}
+
+uint32_t CVulkanMeshRenderer::SelectLod(const CVulkanMesh& mesh, const glm::vec4& worldSphere, const glm::vec4& clipW, float pixelsPerUnit) {
+    float w = glm::dot(clipW, glm::vec4(glm::vec3(worldSphere), 1.0f));
+    if(mesh.lods.size() <= 1 || w <= 0.0f || mesh.boundingSphere.w <= 0.0f) {
+        return 0;
+    }
+    // Instances are scaled uniformly enough for the ratio of their sphere radii to scale the model space error.
+    float errorScale = worldSphere.w / mesh.boundingSphere.w * pixelsPerUnit / w;
+    for(uint32_t lod = static_cast<uint32_t>(mesh.lods.size()) - 1; lod > 0; lod--) {
+        if(mesh.lods[lod].error * errorScale <= LOD_PIXEL_ERROR) {
+            return lod;
+        }
+    }
+    return 0;
+}
+
+void CVulkanMeshRenderer::SetLodsEnabled(bool enabled) {
+    lodsEnabled = enabled;
+}
+
+void CVulkanMeshRenderer::BuildBatches(CVulkanFrame* frame, const std::vector<CVulkanMeshInstance>& instances, const glm::mat4& viewProjection) {
+    batches.clear();
+    if(instances.empty()) {
+        return;
+    }
+
+    // Instances are the objects of the transform buffer by index. Comparing is far cheaper than uploading, so only the
+    // transforms that differ from last frame's are set and written to the GPU.
+    transformBuffer->Resize(static_cast<uint32_t>(instances.size()));
+    changedInstances.resize(instances.size());
+    ForEachChunk(instances.size(), [&](size_t first, size_t last) {
+        for(size_t i = first; i < last; i++) {
+            glm::mat4 transform = instances[i].worldTransform * instances[i].mesh->GetDequantizationTransform();
+            changedInstances[i] = transform != transformBuffer->Get(static_cast<uint32_t>(i)) ? 1 : 0;
+        }
+    });
+    for(size_t i = 0; i < instances.size(); i++) {
+        if(changedInstances[i]) {
+            transformBuffer->Set(static_cast<uint32_t>(i), instances[i].worldTransform * instances[i].mesh->GetDequantizationTransform());
+        }
+    }
+    transformBuffer->Upload(frame->currentFrame, viewProjection);
+
+    // Bounds are culled in world space before batching, so hidden instances take no slots.
+    instanceSpheres.Resize(instances.size());
+    ForEachChunk(instances.size(), [&](size_t first, size_t last) {
+        for(size_t i = first; i < last; i++) {
+            instanceSpheres.SetTransformed(i, instances[i].mesh->boundingSphere, instances[i].worldTransform);
+        }
+    });
+    visibleInstances.resize(instances.size());
+    CFrustum frustum = CFrustum::FromViewProjection(viewProjection);
+    size_t visibleCount = culler.Cull(frustum, instanceSpheres, visibleInstances.data());
+    if(visibleCount == 0) {
+        return;
+    }
+
+    // Meshes get small ids for the sort keys in the order they first appear. Instances of one mesh tend to be next to each
+    // other, so the last pointer is checked before the map. Materials are read by index in the shader and take no part
+    // in the state.
+    std::unordered_map<const void*, uint32_t> ids;
+    auto getId = [&](const void* pointer, const void*& lastPointer, uint32_t& lastId) {
+        if(pointer != lastPointer) {
+            lastId = ids.emplace(pointer, static_cast<uint32_t>(ids.size())).first->second;
+            lastPointer = pointer;
+        }
+        return lastId;
+    };
+    const void* lastMesh = nullptr;
+    uint32_t lastMeshId = 0;
+    const glm::vec4& nearPlane = frustum.planes[4];
+    // A model space error of one unit at clip space w of one covers this many pixels vertically.
+    glm::vec4 clipW(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+    float pixelsPerUnit = glm::length(glm::vec3(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1])) *
+        static_cast<float>(frame->extent.height) * 0.5f;
+    instanceLods.resize(instances.size());
+    drawQueue.Clear();
+    for(size_t i = 0; i < visibleCount; i++) {
+        uint32_t index = visibleInstances[i];
+        const CVulkanMeshInstance& instance = instances[index];
+        CVulkanDrawPass pass = instance.material && instance.material->transparent ? DRAW_PASS_TRANSPARENT : DRAW_PASS_OPAQUE;
+        float depth = glm::dot(glm::vec3(nearPlane), glm::vec3(instanceSpheres.Get(index))) + nearPlane.w;
+        uint32_t lod = lodsEnabled ? SelectLod(*instance.mesh, instanceSpheres.Get(index), clipW, pixelsPerUnit) : 0;
+        instanceLods[index] = static_cast<uint8_t>(lod);
+        uint32_t meshId = getId(instance.mesh.get(), lastMesh, lastMeshId);
+        drawQueue.Push(CVulkanDrawQueue::MakeKey(pass, 0, 0, meshId * CVulkanMeshLoader::MAX_LODS + lod, depth), index);
+    }
+    drawQueue.Sort();
+
+    // Sorted packets are the slots, runs sharing state become one batch. Ids are truncated in the keys, so the pointers
+    // are compared as well.
+    const std::vector<CVulkanDrawPacket>& packets = drawQueue.GetPackets();
+    uint64_t lastState = 0;
+    for(size_t i = 0; i < visibleCount; i++) {
+        const CVulkanMeshInstance& instance = instances[packets[i].instance];
+        uint32_t lod = instanceLods[packets[i].instance];
+        uint64_t state = CVulkanDrawQueue::GetStateKey(packets[i].key);
+        if(batches.empty() || state != lastState || batches.back().mesh != instance.mesh.get() || batches.back().lod != lod) {
+            batches.push_back({ instance.mesh.get(), lod, static_cast<uint32_t>(i), 0 });
+            lastState = state;
+        }
+        batches.back().instanceCount++;
+    }
+
+    // The frame's fence has signaled, so its instance buffer can be rewritten or replaced.
+    auto& instanceBuffer = instanceBuffers[frame->currentFrame];
+    vk::DeviceSize requiredSize = sizeof(CVulkanInstance) * visibleCount;
+    if(!instanceBuffer || instanceBuffer->GetVkDeviceSize() < requiredSize) {
+        size_t capacity = MIN_INSTANCE_CAPACITY;
+        while(capacity < visibleCount) {
+            capacity *= 2;
+        }
+        instanceBuffer = std::make_unique<CVulkanBuffer>(device->CreateBuffer(vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+            vk::BufferUsageFlagBits::eVertexBuffer, nullptr, sizeof(CVulkanInstance) * capacity));
+    }
+
+    CVulkanInstance* mapped = static_cast<CVulkanInstance*>(instanceBuffer->GetMappedData());
+    ForEachChunk(visibleCount, [&](size_t first, size_t last) {
+        for(size_t i = first; i < last; i++) {
+            const CVulkanMaterial* material = instances[packets[i].instance].material.get();
+            mapped[i].object = packets[i].instance;
+            mapped[i].material = material && material->handle != ~0u ? material->handle : 0;
+        }
+    });
+}
+
+void CVulkanMeshRenderer::ForEachChunk(size_t count, const std::function<void(size_t, size_t)>& body) {
+    if(threadPool == nullptr || count < MIN_PARALLEL_INSTANCES) {
+        body(0, count);
+        return;
+    }
+    size_t chunkCount = threadPool->GetThreadCount();
+    threadPool->ParallelFor(chunkCount, [&](size_t chunk) {
+        body(count * chunk / chunkCount, count * (chunk + 1) / chunkCount);
+    });
+}
 
-void CVulkanMeshRenderer::Draw(CVulkanFrame* frame, std::vector<std::shared_ptr<CVulkanMesh>> meshes) {
+void CVulkanMeshRenderer::RecordDraws(CVulkanCommandBuffer* commandBuffer, vk::Buffer instanceBuffer, vk::DescriptorSet descriptorSet, size_t first, size_t last) {
     CVulkanDraw draw;
     draw.pipeline = pipeline->GetVkPipeline();
-    for(auto& mesh : meshes) {
+    draw.pipelineLayout = pipeline->GetVkPipelineLayout();
+    draw.descriptorSets = { descriptorSet };
+    if(bindlessSet) {
+        draw.descriptorSets.push_back(bindlessSet);
+    }
+    draw.vertexBufferOffsets = { 0, 0 };
+    for(size_t i = first; i < last; i++) {
+        CVulkanInstanceBatch& batch = batches[i];
+        CVulkanMesh* mesh = batch.mesh;
         draw.verticesCount = static_cast<uint32_t>(mesh->vertices.size());
-        draw.vertexBuffers = { mesh->vertexBuffer->GetVkBuffer() };
-        draw.vertexBufferOffsets = { 0 };
-        draw.indicesCount = static_cast<uint32_t>(mesh->indices.size());
-        draw.indexBuffer = mesh->indexBuffer->GetVkBuffer();
+        draw.vertexBuffers = { mesh->vertexBuffer->GetVkBuffer(), instanceBuffer };
+        const CVulkanMeshLod& lod = mesh->lods[batch.lod];
+        draw.indicesCount = lod.indexCount;
+        draw.firstIndex = lod.firstIndex;
+        draw.indexBuffer = mesh->indexBuffer ? mesh->indexBuffer->GetVkBuffer() : vk::Buffer();
         draw.indexBufferOffset = 0;
-        graphicsCommandBuffers[frame->currentFrame]->Draw(&draw);
+        draw.indexType = mesh->indexType;
+        draw.instanceCount = batch.instanceCount;
+        draw.firstInstance = batch.firstInstance;
+        commandBuffer->Draw(&draw);
     }
 }
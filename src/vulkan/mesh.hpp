@@ -3,6 +3,12 @@
 #include <vulkan/vulkan_raii.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <functional>
+#include "types.hpp"
+#include "system/culling.hpp"
+#include "drawqueue.hpp"
+#include "vertexformat.hpp"
+#include "meshlet.hpp"
 
 struct CVulkanVertex;
 struct CVulkanMaterial;
@@ -11,16 +17,52 @@ class CVulkanDevice;
 class CVulkanQueue;
 class CVulkanCommandPool;
 class CVulkanCommandBuffer;
+class CVulkanSecondaryCommandPools;
 class CVulkanGraphicsPipeline;
+class CVulkanStagingRing;
+class CVulkanTransformBuffer;
+class CVulkanDescriptorAllocator;
+class CThreadPool;
 struct CVulkanFrame;
 
+// A range of a mesh's indices drawing it at lower detail.
+struct CVulkanMeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount; // 0 for meshes without indices.
+    float error; // Largest deviation from full detail in model space units.
+};
+
+// Geometry shared by every instance drawing it.
 struct CVulkanMesh {
     std::vector<CVulkanVertex> vertices;
-    std::vector<uint16_t> indices;
+    std::vector<uint32_t> indices; // Every LOD one after another.
+    std::vector<CVulkanMeshLod> lods; // From full detail down, filled in by CVulkanMeshLoader.
+    // Full detail split for mesh shaders, empty unless loaded with CVulkanMeshLoadOptions::meshlets. See CVulkanMeshletBuilder.
+    std::vector<CVulkanMeshlet> meshlets;
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint32_t> meshletTriangles;
+    vk::IndexType indexType = vk::IndexType::eUint16; // Width of indexBuffer, indices is always kept at 32 bits.
     std::vector<CVulkanMaterial> material;
     std::unique_ptr<CVulkanBuffer> vertexBuffer;
     std::unique_ptr<CVulkanBuffer> indexBuffer;
-    glm::mat4 worldTransform;
+    // Model space, filled in by CVulkanMeshLoader.
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    glm::vec4 boundingSphere = glm::vec4(0.0f); // Center in xyz, radius in w.
+    glm::vec4 positionDequantization = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f); // Offset in xyz, scale in w, see CVulkanVertexLayout.
+
+    // Takes positions in vertexBuffer to model space, applied before the world transform of instances.
+    glm::mat4 GetDequantizationTransform() const {
+        return glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(positionDequantization)), glm::vec3(positionDequantization.w));
+    }
+};
+
+// A placement of a mesh. Instances of the same mesh are drawn with a single instanced draw, materials are selected per
+// instance from the bindless heap.
+struct CVulkanMeshInstance {
+    std::shared_ptr<CVulkanMesh> mesh;
+    std::shared_ptr<CVulkanMaterial> material;
+    glm::mat4 worldTransform = glm::mat4(1.0f);
 
     void SetLocation(glm::vec3 location) {
         worldTransform = glm::translate(worldTransform, location);
@@ -37,19 +79,97 @@ struct CVulkanMesh {
     }
 };
 
+// Consecutive slots of the instance buffer drawn with one call.
+struct CVulkanInstanceBatch {
+    CVulkanMesh* mesh;
+    uint32_t lod;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+struct CVulkanMeshLoadOptions {
+    bool optimize = false; // Runs CVulkanMeshOptimizer::Optimize() first, which always produces indices.
+    uint32_t lodCount = 1; // Up to CVulkanMeshLoader::MAX_LODS, each with half the triangles of the one before.
+    bool meshlets = false; // For CVulkanMeshletRenderer, built after optimizing.
+};
+
 class CVulkanMeshLoader {
     CVulkanDevice* device;
-    CVulkanQueue* transferQueue;
-    std::shared_ptr<CVulkanCommandBuffer> transferCommandBuffer;
+    CVulkanStagingRing* stagingRing;
+    CVulkanVertexLayout vertexLayout;
 public:
-    CVulkanMeshLoader(CVulkanDevice* device, CVulkanQueue* transferQueue, std::shared_ptr<CVulkanCommandBuffer> transferCommandBuffer);
-    CVulkanMesh Load(std::vector<CVulkanVertex> vertices, std::vector<uint16_t> indices = {});
+    // Vertex buffers are encoded with vertexLayout, the one of the pipeline drawing the meshes.
+    CVulkanMeshLoader(CVulkanDevice* device, CVulkanStagingRing* stagingRing, const CVulkanVertexLayout& vertexLayout);
+    static constexpr uint32_t MAX_LODS = 8;
+    // LODs stop early once simplification removes less than a tenth of the triangles or they would have fewer than this.
+    static constexpr size_t MIN_LOD_TRIANGLES = 16;
+
+    // Index buffers are 16 bit when every vertex can be addressed with them and 32 bit otherwise. LODs share the vertices
+    // and the index buffer of the mesh.
+    CVulkanMesh Load(std::vector<CVulkanVertex> vertices, std::vector<uint32_t> indices = {}, CVulkanMeshLoadOptions options = {});
+    static vk::IndexType GetIndexType(size_t verticesCount);
+    // Narrows indices to 16 bits if indexType is eUint16 and appends them to buffer.
+    static void AppendIndices(const std::vector<uint32_t>& indices, vk::IndexType indexType, std::vector<uint8_t>& buffer);
 };
 
 class CVulkanMeshRenderer {
+    CVulkanDevice* device;
     CVulkanGraphicsPipeline* pipeline;
+    vk::DescriptorSet bindlessSet;
     std::vector<std::shared_ptr<CVulkanCommandBuffer>> graphicsCommandBuffers;
+    CThreadPool* threadPool;
+    std::unique_ptr<CVulkanSecondaryCommandPools> secondaryCommandPools;
+    std::vector<vk::Format> colorFormats;
+    std::vector<std::unique_ptr<CVulkanBuffer>> instanceBuffers; // One per frame in flight, host visible.
+    std::unique_ptr<CVulkanTransformBuffer> transformBuffer; // Object per instance, by index into the instances passed to Draw().
+    std::vector<uint8_t> changedInstances; // Whether the transform of an instance differs from its object's, rebuilt every Draw().
+    std::vector<CVulkanInstanceBatch> batches;
+    CFrustumCuller culler;
+    CBoundingSphereArray instanceSpheres; // World space, rebuilt every Draw().
+    std::vector<uint32_t> visibleInstances;
+    CVulkanDrawQueue drawQueue; // Visible instances by sort key, rebuilt every Draw().
+    std::vector<uint8_t> instanceLods; // Selected LOD per instance, valid for visible ones.
+    bool lodsEnabled = true;
+    CVulkanDrawStatistics drawStatistics;
 public:
-    CVulkanMeshRenderer(CVulkanGraphicsPipeline* pipeline, std::vector<std::shared_ptr<CVulkanCommandBuffer>> graphicsCommandBuffers);
-    void Draw(CVulkanFrame* frame, std::vector<std::shared_ptr<CVulkanMesh>> meshes);
+    // Fewer draws than this are not worth a secondary command buffer of their own.
+    static constexpr size_t MIN_DRAWS_PER_RECORDING = 256;
+    // Recordings per worker thread, more than one so that stealing evens out uneven chunks.
+    static constexpr size_t RECORDINGS_PER_THREAD = 4;
+    static constexpr size_t MIN_INSTANCE_CAPACITY = 1024;
+    // Fewer instances than this are transformed and written on the calling thread.
+    static constexpr size_t MIN_PARALLEL_INSTANCES = 1024;
+    // Largest error in pixels a LOD may show on screen to be picked over a finer one.
+    static constexpr float LOD_PIXEL_ERROR = 1.0f;
+
+    // Records draws inline into the frame's command buffer. pipeline must take CVulkanTransformBuffer::GetDescriptorSetLayoutBindings()
+    // as set 0, and the layout of a CVulkanBindlessHeap as set 1 when its bindlessSet is given. Set 0 is allocated every frame
+    // from descriptorAllocator.
+    CVulkanMeshRenderer(CVulkanDevice* device, CVulkanGraphicsPipeline* pipeline, CVulkanDescriptorAllocator* descriptorAllocator,
+        std::vector<std::shared_ptr<CVulkanCommandBuffer>> graphicsCommandBuffers, vk::DescriptorSet bindlessSet = nullptr);
+    // Records draws into secondary command buffers on threadPool, one pool per worker and frame in flight. The pass they are
+    // drawn in must be begun with GetRenderingFlags(), colorFormat is the format of its color attachment.
+    CVulkanMeshRenderer(CVulkanDevice* device, uint32_t queueFamilyIndex, CVulkanGraphicsPipeline* pipeline, CVulkanDescriptorAllocator* descriptorAllocator,
+        std::vector<std::shared_ptr<CVulkanCommandBuffer>> graphicsCommandBuffers, CThreadPool* threadPool, vk::Format colorFormat,
+        vk::DescriptorSet bindlessSet = nullptr);
+    ~CVulkanMeshRenderer();
+    vk::RenderingFlags GetRenderingFlags();
+    // Culls instances against the frustum of viewProjection, sorts the visible ones by pass, mesh and depth, writes their
+    // object indices and material handles into the frame's instance buffer and records one instanced draw per run of equal
+    // state. Instances without a material or with one not added to the bindless heap use its default material.
+    // Instances keep their transform in the transform buffer between frames, only the ones that changed are uploaded.
+    // Opaque instances are drawn first and front to back, transparent ones after them and back to front. Each instance draws
+    // the coarsest LOD of its mesh whose error projects to at most LOD_PIXEL_ERROR pixels, LODs are part of the state.
+    void Draw(CVulkanFrame* frame, const std::vector<CVulkanMeshInstance>& instances, glm::mat4 viewProjection);
+    // Draws every instance at full detail when disabled, for comparing throughput.
+    void SetLodsEnabled(bool enabled);
+    // Binds issued and skipped by the last Draw(), summed over every command buffer it recorded into.
+    CVulkanDrawStatistics GetDrawStatistics();
+private:
+    void BuildBatches(CVulkanFrame* frame, const std::vector<CVulkanMeshInstance>& instances, const glm::mat4& viewProjection);
+    // clipW is the row of the view projection giving clip space w, worldSphere the instance's bounding sphere.
+    static uint32_t SelectLod(const CVulkanMesh& mesh, const glm::vec4& worldSphere, const glm::vec4& clipW, float pixelsPerUnit);
+    // Runs body over [0, count) in chunks, split across the thread pool when there are enough.
+    void ForEachChunk(size_t count, const std::function<void(size_t, size_t)>& body);
+    void RecordDraws(CVulkanCommandBuffer* commandBuffer, vk::Buffer instanceBuffer, vk::DescriptorSet descriptorSet, size_t first, size_t last);
 };
\ No newline at end of file
@@ -0,0 +1,240 @@
+#include "meshlet.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include "optimize.hpp"
+
+void CVulkanMeshletBuilder::Build(const std::vector<CVulkanVertex>& vertices, const std::vector<uint32_t>& indices, std::vector<CVulkanMeshlet>& meshlets,
+    std::vector<uint32_t>& meshletVertices, std::vector<uint32_t>& meshletTriangles) {
+    size_t indexCount = indices.empty() ? vertices.size() / 3 * 3 : indices.size();
+    auto getIndex = [&](size_t i) { return indices.empty() ? static_cast<uint32_t>(i) : indices[i]; };
+
+    // Meshlet vertex of every mesh vertex in the open meshlet, reset for its vertices when it is closed.
+    std::vector<uint8_t> localVertices(vertices.size(), 0xFF);
+    CVulkanMeshlet meshlet = {};
+    meshlet.firstVertex = static_cast<uint32_t>(meshletVertices.size());
+    meshlet.firstTriangle = static_cast<uint32_t>(meshletTriangles.size());
+    auto closeMeshlet = [&]() {
+        for(uint32_t i = 0; i < meshlet.vertexCount; i++) {
+            localVertices[meshletVertices[meshlet.firstVertex + i]] = 0xFF;
+        }
+        ComputeBounds(vertices, meshletVertices, meshletTriangles, meshlet);
+        meshlets.push_back(meshlet);
+        meshlet = {};
+        meshlet.firstVertex = static_cast<uint32_t>(meshletVertices.size());
+        meshlet.firstTriangle = static_cast<uint32_t>(meshletTriangles.size());
+    };
+
+    for(size_t i = 0; i < indexCount; i += 3) {
+        uint32_t triangle[3] = { getIndex(i), getIndex(i + 1), getIndex(i + 2) };
+        uint32_t newVertices = 0;
+        for(uint32_t corner = 0; corner < 3; corner++) {
+            // Repeated corners of degenerate triangles are only counted once.
+            bool repeated = (corner > 0 && triangle[corner] == triangle[0]) || (corner > 1 && triangle[corner] == triangle[1]);
+            newVertices += localVertices[triangle[corner]] == 0xFF && !repeated ? 1 : 0;
+        }
+        if(meshlet.vertexCount + newVertices > MAX_VERTICES || meshlet.triangleCount == MAX_TRIANGLES) {
+            closeMeshlet();
+        }
+
+        uint32_t packed = 0;
+        for(uint32_t corner = 0; corner < 3; corner++) {
+            uint8_t& local = localVertices[triangle[corner]];
+            if(local == 0xFF) {
+                local = static_cast<uint8_t>(meshlet.vertexCount++);
+                meshletVertices.push_back(triangle[corner]);
+            }
+            packed |= static_cast<uint32_t>(local) << (corner * 8);
+        }
+        meshletTriangles.push_back(packed);
+        meshlet.triangleCount++;
+    }
+    if(meshlet.triangleCount > 0) {
+        closeMeshlet();
+    }
+}
+
+void CVulkanMeshletBuilder::ComputeBounds(const std::vector<CVulkanVertex>& vertices, const std::vector<uint32_t>& meshletVertices,
+    const std::vector<uint32_t>& meshletTriangles, CVulkanMeshlet& meshlet) {
+    // The sphere around the center of the bounding box is not the smallest, but close for the compact shapes meshlets have.
+    glm::vec3 minimum = vertices[meshletVertices[meshlet.firstVertex]].position;
+    glm::vec3 maximum = minimum;
+    for(uint32_t i = 1; i < meshlet.vertexCount; i++) {
+        glm::vec3 position = vertices[meshletVertices[meshlet.firstVertex + i]].position;
+        minimum = glm::min(minimum, position);
+        maximum = glm::max(maximum, position);
+    }
+    glm::vec3 center = (minimum + maximum) * 0.5f;
+    float radius = 0.0f;
+    for(uint32_t i = 0; i < meshlet.vertexCount; i++) {
+        radius = std::max(radius, glm::length(vertices[meshletVertices[meshlet.firstVertex + i]].position - center));
+    }
+    meshlet.boundingSphere = glm::vec4(center, radius);
+
+    // The axis is the average face normal, the cone opens as wide as the normal furthest from it.
+    std::vector<glm::vec3> normals;
+    normals.reserve(meshlet.triangleCount);
+    glm::vec3 axis(0.0f);
+    for(uint32_t i = 0; i < meshlet.triangleCount; i++) {
+        uint32_t packed = meshletTriangles[meshlet.firstTriangle + i];
+        glm::vec3 corners[3];
+        for(uint32_t corner = 0; corner < 3; corner++) {
+            corners[corner] = vertices[meshletVertices[meshlet.firstVertex + ((packed >> (corner * 8)) & 0xFF)]].position;
+        }
+        glm::vec3 normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+        float length = glm::length(normal);
+        if(length > 0.0f) {
+            normals.push_back(normal / length);
+            axis += normals.back();
+        }
+    }
+    float axisLength = glm::length(axis);
+    if(normals.empty() || axisLength <= 0.0f) {
+        meshlet.cone = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+        return;
+    }
+    axis /= axisLength;
+    float minimumDot = 1.0f;
+    for(auto& normal : normals) {
+        minimumDot = std::min(minimumDot, glm::dot(normal, axis));
+    }
+    // Normals at 90 degrees or more from the axis face the viewer from every direction the cone would cull.
+    float sine = minimumDot <= 0.0f ? 1.0f : std::sqrt(std::max(0.0f, 1.0f - minimumDot * minimumDot));
+    meshlet.cone = glm::vec4(axis, sine);
+}
+
+bool CVulkanMeshletBuilder::RunBenchmark() {
+    bool passed = true;
+    std::mt19937 random(1234);
+    for(size_t targetTriangles = 1000; targetTriangles <= 1000000; targetTriangles *= 10) {
+        for(int shape = 0; shape < 2; shape++) {
+            std::vector<CVulkanVertex> vertices;
+            std::vector<size_t> quads;
+            size_t rows;
+            size_t columns;
+            if(shape == 0) {
+                // A grid with its left half wound the other way, so some meshlets face away and the ones on the fold both ways.
+                rows = columns = static_cast<size_t>(std::ceil(std::sqrt(targetTriangles / 2.0)));
+                vertices.resize((rows + 1) * (columns + 1));
+                for(size_t y = 0; y <= rows; y++) {
+                    for(size_t x = 0; x <= columns; x++) {
+                        CVulkanVertex vertex = {};
+                        vertex.position = glm::vec3(static_cast<float>(x) / columns - 0.5f, static_cast<float>(y) / rows - 0.5f, 0.0f);
+                        vertex.color = glm::vec3(1.0f);
+                        vertices[y * (columns + 1) + x] = vertex;
+                    }
+                }
+            } else {
+                // A unit sphere around the z axis, facing out. Its last column repeats the first and its pole rows
+                // collapse into points, so their triangles are degenerate like in exported meshes.
+                rows = static_cast<size_t>(std::ceil(std::sqrt(targetTriangles / 4.0)));
+                columns = rows * 2;
+                vertices.resize((rows + 1) * (columns + 1));
+                for(size_t y = 0; y <= rows; y++) {
+                    for(size_t x = 0; x <= columns; x++) {
+                        float theta = 3.14159265f * y / rows;
+                        float phi = 2.0f * 3.14159265f * (x % columns) / columns;
+                        CVulkanVertex vertex = {};
+                        vertex.position = glm::vec3(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta));
+                        vertex.color = glm::vec3(1.0f);
+                        vertex.normal = vertex.position;
+                        vertices[y * (columns + 1) + x] = vertex;
+                    }
+                }
+            }
+            quads.resize(rows * columns);
+            std::iota(quads.begin(), quads.end(), 0);
+            std::shuffle(quads.begin(), quads.end(), random);
+            std::vector<uint32_t> indices;
+            indices.reserve(quads.size() * 6);
+            for(auto quad : quads) {
+                size_t x = quad % columns;
+                size_t y = quad / columns;
+                uint32_t corners[4] = {
+                    static_cast<uint32_t>(y * (columns + 1) + x), static_cast<uint32_t>(y * (columns + 1) + x + 1),
+                    static_cast<uint32_t>((y + 1) * (columns + 1) + x + 1), static_cast<uint32_t>((y + 1) * (columns + 1) + x)
+                };
+                if(shape == 1 || x >= columns / 2) {
+                    indices.insert(indices.end(), { corners[0], corners[1], corners[2], corners[0], corners[2], corners[3] });
+                } else {
+                    indices.insert(indices.end(), { corners[0], corners[2], corners[1], corners[0], corners[3], corners[2] });
+                }
+            }
+            CVulkanMeshOptimizer::OptimizeVertexCache(indices, vertices.size());
+
+            std::vector<CVulkanMeshlet> meshlets;
+            std::vector<uint32_t> meshletVertices;
+            std::vector<uint32_t> meshletTriangles;
+            auto start = std::chrono::steady_clock::now();
+            Build(vertices, indices, meshlets, meshletVertices, meshletTriangles);
+            auto end = std::chrono::steady_clock::now();
+
+            // Triangles come out in order, each bound has to hold every vertex and face normal of its meshlet.
+            bool valid = meshletTriangles.size() * 3 == indices.size();
+            size_t triangle = 0;
+            size_t cullableMeshlets = 0;
+            for(auto& meshlet : meshlets) {
+                valid = valid && meshlet.vertexCount <= MAX_VERTICES && meshlet.triangleCount <= MAX_TRIANGLES &&
+                    meshlet.firstTriangle == triangle;
+                for(uint32_t i = 0; i < meshlet.vertexCount && valid; i++) {
+                    glm::vec3 offset = vertices[meshletVertices[meshlet.firstVertex + i]].position - glm::vec3(meshlet.boundingSphere);
+                    valid = glm::length(offset) <= meshlet.boundingSphere.w * 1.0001f + 1e-6f;
+                }
+                float cosine = std::sqrt(std::max(0.0f, 1.0f - meshlet.cone.w * meshlet.cone.w));
+                cullableMeshlets += meshlet.cone.w < 1.0f ? 1 : 0;
+                for(uint32_t i = 0; i < meshlet.triangleCount && valid; i++, triangle++) {
+                    uint32_t packed = meshletTriangles[meshlet.firstTriangle + i];
+                    uint32_t corners[3];
+                    for(uint32_t corner = 0; corner < 3; corner++) {
+                        corners[corner] = meshletVertices[meshlet.firstVertex + ((packed >> (corner * 8)) & 0xFF)];
+                        valid = valid && corners[corner] == indices[triangle * 3 + corner];
+                    }
+                    glm::vec3 normal = glm::cross(vertices[corners[1]].position - vertices[corners[0]].position,
+                        vertices[corners[2]].position - vertices[corners[0]].position);
+                    float length = glm::length(normal);
+                    valid = valid && (meshlet.cone.w >= 1.0f || length == 0.0f || glm::dot(normal / length, glm::vec3(meshlet.cone)) >= cosine - 1e-4f);
+                }
+            }
+            valid = valid && triangle * 3 == indices.size();
+
+            // From cameras around the sphere, every meshlet the cone test of shaders/meshlet.glsl culls must only hold
+            // triangles facing away.
+            size_t culledMeshlets = 0;
+            size_t testedMeshlets = 0;
+            if(shape == 1) {
+                glm::vec3 cameras[4] = { glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, -4.0f, 0.5f), glm::vec3(2.0f, 2.0f, -2.0f), glm::vec3(-1.5f, 0.2f, 0.0f) };
+                for(auto& camera : cameras) {
+                    for(auto& meshlet : meshlets) {
+                        testedMeshlets++;
+                        glm::vec3 view = glm::vec3(meshlet.boundingSphere) - camera;
+                        if(meshlet.cone.w >= 1.0f || glm::dot(view, glm::vec3(meshlet.cone)) < meshlet.cone.w * glm::length(view) + meshlet.boundingSphere.w) {
+                            continue;
+                        }
+                        culledMeshlets++;
+                        for(uint32_t i = 0; i < meshlet.triangleCount && valid; i++) {
+                            uint32_t packed = meshletTriangles[meshlet.firstTriangle + i];
+                            glm::vec3 corners[3];
+                            for(uint32_t corner = 0; corner < 3; corner++) {
+                                corners[corner] = vertices[meshletVertices[meshlet.firstVertex + ((packed >> (corner * 8)) & 0xFF)]].position;
+                            }
+                            glm::vec3 normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                            valid = glm::dot(normal, camera - corners[0]) <= 1e-6f;
+                        }
+                    }
+                }
+                // Some of the sphere faces away from every camera, a cone test that culls nothing is broken as well.
+                valid = valid && culledMeshlets > 0;
+            }
+            passed = passed && valid;
+            printf("CVulkanMeshletBuilder::RunBenchmark: %s of %zu triangles, %zu meshlets with %.1f vertices and %.1f triangles on average, "
+                "%zu cone cullable, %zu of %zu culled from the cameras, %.1f ms, %s\n", shape == 0 ? "grid" : "sphere", indices.size() / 3, meshlets.size(),
+                static_cast<double>(meshletVertices.size()) / meshlets.size(), static_cast<double>(meshletTriangles.size()) / meshlets.size(),
+                cullableMeshlets, culledMeshlets, testedMeshlets, std::chrono::duration<double, std::milli>(end - start).count(), valid ? "passed" : "FAILED");
+        }
+    }
+    return passed;
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "types.hpp"
+
+// Up to MAX_VERTICES vertices and MAX_TRIANGLES triangles of a mesh, laid out as shaders/meshlet.glsl reads it.
+struct CVulkanMeshlet {
+    glm::vec4 boundingSphere; // Center in xyz, radius in w, in model space.
+    // Axis in xyz that every triangle normal is within some angle of, w the sine of that angle. From a view direction at
+    // least that close to the axis all triangles face away. w is 1 when the normals spread too far to ever cull.
+    glm::vec4 cone;
+    uint32_t firstVertex; // Into meshletVertices.
+    uint32_t firstTriangle; // Into meshletTriangles.
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+// Splits triangle lists into meshlets for mesh shaders, in the order of the triangles. Run after
+// CVulkanMeshOptimizer::OptimizeVertexCache(), whose order keeps neighbouring triangles together.
+class CVulkanMeshletBuilder {
+public:
+    // Vertex and primitive limits of shaders/meshlet.mesh, 124 triangles leave room for a 128 byte aligned index block.
+    static constexpr uint32_t MAX_VERTICES = 64;
+    static constexpr uint32_t MAX_TRIANGLES = 124;
+
+    // Appends the meshlets of indices to meshlets. meshletVertices receives the mesh vertex of every meshlet vertex,
+    // meshletTriangles 3 meshlet vertices of 8 bits per triangle. indices may be empty for unindexed vertices.
+    static void Build(const std::vector<CVulkanVertex>& vertices, const std::vector<uint32_t>& indices, std::vector<CVulkanMeshlet>& meshlets,
+        std::vector<uint32_t>& meshletVertices, std::vector<uint32_t>& meshletTriangles);
+    // Builds meshlets of shuffled and cache optimized grids and spheres of 1k to 1M triangles, printing the time and how
+    // full the meshlets are. Returns false if a triangle got lost, a bound does not hold its triangles or the cone test
+    // culls a meshlet of the sphere with a triangle facing one of a few cameras around it.
+    static bool RunBenchmark();
+private:
+    static void ComputeBounds(const std::vector<CVulkanVertex>& vertices, const std::vector<uint32_t>& meshletVertices,
+        const std::vector<uint32_t>& meshletTriangles, CVulkanMeshlet& meshlet);
+};
\ No newline at end of file
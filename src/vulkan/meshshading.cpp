@@ -0,0 +1,314 @@
+#include "meshshading.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "device.hpp"
+#include "buffer.hpp"
+#include "pipeline.hpp"
+#include "cmd.hpp"
+#include "staging.hpp"
+#include "barrier.hpp"
+#include "mesh.hpp"
+#include "transform.hpp"
+#include "descriptor.hpp"
+#include "system/culling.hpp"
+
+CVulkanMeshletRenderer::CVulkanMeshletRenderer(CVulkanDevice* device, vk::Format colorFormat, CVulkanBarrierTracker* barrierTracker, CVulkanDescriptorAllocator* descriptorAllocator,
+    uint32_t framesInFlight)
+    : device(device), barrierTracker(barrierTracker), descriptorAllocator(descriptorAllocator), meshShading(device->IsMeshShadingEnabled()), frames(framesInFlight) {
+    transformBuffer = std::make_unique<CVulkanTransformBuffer>(device, descriptorAllocator, framesInFlight);
+
+    // Transforms, meshlet draws, meshlets, meshlet vertices, meshlet triangles and vertices in the order of shaders/meshlet.glsl,
+    // then the camera of shaders/meshlet.mesh or the draw commands and their count of shaders/meshletcull.comp.
+    vk::ShaderStageFlags stages = meshShading ? vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT : vk::ShaderStageFlagBits::eCompute;
+    uint32_t storageBindingCount = meshShading ? 6 : 8;
+    std::vector<vk::DescriptorSetLayoutBinding> bindings;
+    for(uint32_t binding = 0; binding < storageBindingCount; binding++) {
+        bindings.push_back(vk::DescriptorSetLayoutBinding(binding, vk::DescriptorType::eStorageBuffer, 1, stages));
+    }
+    if(meshShading) {
+        bindings.push_back(vk::DescriptorSetLayoutBinding(6, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eMeshEXT));
+    }
+    if(meshShading) {
+        meshShadingPipeline = std::make_unique<CVulkanMeshShadingPipeline>(device->CreateMeshShadingPipeline("shaders/meshlet.task.spv", "shaders/meshlet.mesh.spv",
+            "shaders/fragment.spv", colorFormat, bindings, sizeof(CVulkanMeshletConstants), vk::CullModeFlagBits::eBack));
+    } else {
+        cullPipeline = std::make_unique<CVulkanComputePipeline>(device->CreateComputePipeline("shaders/meshletcull.spv", bindings, sizeof(CVulkanMeshletConstants)));
+        pipeline = std::make_unique<CVulkanGraphicsPipeline>(device->CreateGraphicsPipeline("shaders/vertex.spv", "shaders/fragment.spv", colorFormat,
+            CVulkanVertexLayout::Compact(), CVulkanTransformBuffer::GetDescriptorSetLayoutBindings(device), vk::CullModeFlagBits::eBack));
+    }
+}
+
+CVulkanMeshletRenderer::~CVulkanMeshletRenderer() {}
+
+bool CVulkanMeshletRenderer::IsMeshShading() {
+    return meshShading;
+}
+
+void CVulkanMeshletRenderer::SetMeshes(const std::vector<std::shared_ptr<CVulkanMesh>>& meshes, CVulkanStagingRing* stagingRing) {
+    this->meshes = meshes;
+    meshIndices.clear();
+    meshRanges.clear();
+    transformBuffer->Clear();
+    objectMeshes.clear();
+    meshletDraws.clear();
+
+    // Meshlets of every mesh are offset to the shared buffers, meshlet vertices refer to the shared vertex buffer.
+    // Vertices are encoded with the layout shaders/meshlet.mesh decodes.
+    CVulkanVertexLayout vertexLayout = CVulkanVertexLayout::Compact();
+    std::vector<uint8_t> vertexData;
+    size_t verticesCount = 0;
+    std::vector<CVulkanMeshlet> meshlets;
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint32_t> meshletTriangles;
+    std::vector<uint32_t> indices;
+    for(auto& mesh : meshes) {
+        if(mesh->meshlets.empty() && !mesh->vertices.empty()) {
+            printf("CVulkanMeshletRenderer::SetMeshes: Mesh was loaded without meshlets and is not drawn\n");
+        }
+        glm::vec4 dequantization = mesh->positionDequantization;
+        meshIndices[mesh.get()] = static_cast<uint32_t>(meshRanges.size());
+        meshRanges.push_back({ static_cast<uint32_t>(meshlets.size()), static_cast<uint32_t>(mesh->meshlets.size()) });
+        for(auto meshlet : mesh->meshlets) {
+            meshlet.boundingSphere = glm::vec4((glm::vec3(meshlet.boundingSphere) - glm::vec3(dequantization)) / dequantization.w, meshlet.boundingSphere.w / dequantization.w);
+            meshlet.firstVertex += static_cast<uint32_t>(meshletVertices.size());
+            meshlet.firstTriangle += static_cast<uint32_t>(meshletTriangles.size());
+            meshlets.push_back(meshlet);
+        }
+        for(auto vertex : mesh->meshletVertices) {
+            meshletVertices.push_back(vertex + static_cast<uint32_t>(verticesCount));
+        }
+        meshletTriangles.insert(meshletTriangles.end(), mesh->meshletTriangles.begin(), mesh->meshletTriangles.end());
+        vertexLayout.Encode(mesh->vertices, dequantization, vertexData);
+        verticesCount += mesh->vertices.size();
+    }
+    if(!meshShading) {
+        // Triangles in meshlet order, so the draw of a meshlet starts at 3 times its first triangle.
+        indices.reserve(meshletTriangles.size() * 3);
+        for(auto& meshlet : meshlets) {
+            for(uint32_t i = 0; i < meshlet.triangleCount; i++) {
+                uint32_t packed = meshletTriangles[meshlet.firstTriangle + i];
+                for(uint32_t corner = 0; corner < 3; corner++) {
+                    indices.push_back(meshletVertices[meshlet.firstVertex + ((packed >> (corner * 8)) & 0xFF)]);
+                }
+            }
+        }
+    }
+
+    // The meshlet buffers are bound to every descriptor set, which are written again along with new object buffers.
+    for(auto& frame : frames) {
+        frame.capacity = 0;
+        frame.drawCapacity = 0;
+        frame.writtenDraws = 0;
+    }
+    vertexBuffer.reset();
+    indexBuffer.reset();
+    meshletBuffer.reset();
+    meshletVertexBuffer.reset();
+    meshletTriangleBuffer.reset();
+    if(meshletTriangles.empty()) {
+        return;
+    }
+
+    auto createBuffer = [&](const void* data, vk::DeviceSize size, vk::BufferUsageFlags usage) {
+        auto buffer = std::make_unique<CVulkanBuffer>(device->CreateBuffer(vk::MemoryPropertyFlagBits::eDeviceLocal, vk::BufferUsageFlagBits::eTransferDst | usage, nullptr, size));
+        stagingRing->CopyToBuffer(data, size, buffer.get());
+        return buffer;
+    };
+    vertexBuffer = createBuffer(vertexData.data(), vertexData.size(), vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer);
+    meshletBuffer = createBuffer(meshlets.data(), sizeof(CVulkanMeshlet) * meshlets.size(), vk::BufferUsageFlagBits::eStorageBuffer);
+    meshletVertexBuffer = createBuffer(meshletVertices.data(), sizeof(uint32_t) * meshletVertices.size(), vk::BufferUsageFlagBits::eStorageBuffer);
+    meshletTriangleBuffer = createBuffer(meshletTriangles.data(), sizeof(uint32_t) * meshletTriangles.size(), vk::BufferUsageFlagBits::eStorageBuffer);
+    if(!meshShading) {
+        indexBuffer = createBuffer(indices.data(), sizeof(uint32_t) * indices.size(), vk::BufferUsageFlagBits::eIndexBuffer);
+    }
+    stagingRing->Flush(); // Deferred until EndBatch() when the caller batches several loads.
+}
+
+uint32_t CVulkanMeshletRenderer::AddObject(std::shared_ptr<CVulkanMesh> mesh, glm::mat4 worldTransform) {
+    auto meshIndex = meshIndices.find(mesh.get());
+    if(meshIndex == meshIndices.end()) {
+        printf("CVulkanMeshletRenderer::AddObject: Mesh was not passed to SetMeshes\n");
+        return NO_OBJECT;
+    }
+    uint32_t object = transformBuffer->Add(worldTransform * mesh->GetDequantizationTransform());
+    objectMeshes.push_back(meshIndex->second);
+    const MeshRange& range = meshRanges[meshIndex->second];
+    for(uint32_t i = 0; i < range.meshletCount; i++) {
+        meshletDraws.push_back(glm::uvec2(object, range.firstMeshlet + i));
+    }
+    return object;
+}
+
+void CVulkanMeshletRenderer::SetWorldTransform(uint32_t object, glm::mat4 worldTransform) {
+    transformBuffer->Set(object, worldTransform * meshes[objectMeshes[object]]->GetDequantizationTransform());
+}
+
+uint32_t CVulkanMeshletRenderer::GetObjectCount() {
+    return transformBuffer->GetCount();
+}
+
+void CVulkanMeshletRenderer::Cull(CVulkanCommandBuffer* commandBuffer, CVulkanFrame* frame, glm::mat4 viewProjection) {
+    uint32_t drawCount = static_cast<uint32_t>(meshletDraws.size());
+    if(drawCount == 0) {
+        return;
+    }
+    FrameBuffers& frameBuffers = frames[frame->currentFrame];
+    // Sets are allocated from the frame's pools every frame, so buffers recreated here are written along with the rest.
+    transformBuffer->Upload(frame->currentFrame, viewProjection);
+    ReserveObjects(frameBuffers);
+    WriteDescriptorSet(frameBuffers, frame->currentFrame);
+
+    // The frame's fence has signaled, so the GPU is done with its copy of the meshlet draws.
+    glm::uvec2* mappedMeshletDraws = static_cast<glm::uvec2*>(frameBuffers.meshletDraws->GetMappedData());
+    memcpy(mappedMeshletDraws + frameBuffers.writtenDraws, meshletDraws.data() + frameBuffers.writtenDraws,
+        sizeof(glm::uvec2) * (drawCount - frameBuffers.writtenDraws));
+    frameBuffers.writtenDraws = drawCount;
+
+    // The camera is where clip space w is 0 for every x and y. Orthographic projections put it at infinity, leaving the
+    // direction towards larger depth.
+    CFrustum frustum = CFrustum::FromViewProjection(viewProjection);
+    std::copy(std::begin(frustum.planes), std::end(frustum.planes), constants.frustumPlanes);
+    glm::vec4 camera = glm::inverse(viewProjection) * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+    if(std::abs(camera.w) > 1e-6f * glm::length(glm::vec3(camera))) {
+        constants.camera = glm::vec4(glm::vec3(camera) / camera.w, 1.0f);
+    } else {
+        constants.camera = glm::vec4(glm::normalize(glm::vec3(camera)), 0.0f);
+    }
+    constants.drawCount = drawCount;
+    if(meshShading) {
+        return; // Culled by the task shader in Draw().
+    }
+
+    // Host writes are made visible by the submission, only the GPU's own accesses need barriers.
+    vk::Buffer drawCommands = frameBuffers.drawCommands->GetVkBuffer();
+    vk::Buffer drawCommandCount = frameBuffers.drawCommandCount->GetVkBuffer();
+    barrierTracker->UseBuffer(drawCommandCount, vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite);
+    barrierTracker->Flush(commandBuffer);
+    commandBuffer->FillBuffer(drawCommandCount, 0, sizeof(uint32_t), 0);
+
+    barrierTracker->UseBuffer(drawCommandCount, vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+    barrierTracker->UseBuffer(drawCommands, vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite);
+    barrierTracker->Flush(commandBuffer);
+
+    uint32_t groupCount = (drawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE;
+    CVulkanDispatch dispatch;
+    dispatch.pipeline = cullPipeline->GetVkPipeline();
+    dispatch.pipelineLayout = cullPipeline->GetVkPipelineLayout();
+    dispatch.descriptorSets = { frameBuffers.descriptorSet };
+    dispatch.pushConstants.assign(reinterpret_cast<uint8_t*>(&constants), reinterpret_cast<uint8_t*>(&constants) + sizeof(constants));
+    dispatch.groupCountX = std::min(groupCount, MAX_GROUP_COUNT_X);
+    dispatch.groupCountY = (groupCount + dispatch.groupCountX - 1) / dispatch.groupCountX;
+    commandBuffer->Dispatch(&dispatch);
+
+    // Flushed here since the draw is recorded inside a rendering scope, where barriers cannot go.
+    barrierTracker->UseBuffer(drawCommandCount, vk::PipelineStageFlagBits2::eDrawIndirect, vk::AccessFlagBits2::eIndirectCommandRead);
+    barrierTracker->UseBuffer(drawCommands, vk::PipelineStageFlagBits2::eDrawIndirect, vk::AccessFlagBits2::eIndirectCommandRead);
+    barrierTracker->Flush(commandBuffer);
+}
+
+void CVulkanMeshletRenderer::Draw(CVulkanCommandBuffer* commandBuffer, CVulkanFrame* frame) {
+    drawStatistics = {};
+    uint32_t drawCount = static_cast<uint32_t>(meshletDraws.size());
+    if(drawCount == 0) {
+        return;
+    }
+    FrameBuffers& frameBuffers = frames[frame->currentFrame];
+
+    CVulkanDraw draw;
+    draw.verticesCount = 0;
+    draw.indicesCount = 0;
+    if(meshShading) {
+        uint32_t groupCount = (drawCount + TASK_GROUP_SIZE - 1) / TASK_GROUP_SIZE;
+        draw.pipeline = meshShadingPipeline->GetVkPipeline();
+        draw.pipelineLayout = meshShadingPipeline->GetVkPipelineLayout();
+        draw.descriptorSets = { frameBuffers.descriptorSet };
+        draw.pushConstantStages = vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT;
+        draw.pushConstants.assign(reinterpret_cast<uint8_t*>(&constants), reinterpret_cast<uint8_t*>(&constants) + sizeof(constants));
+        draw.taskGroupCountX = std::min(groupCount, MAX_GROUP_COUNT_X);
+        draw.taskGroupCountY = (groupCount + draw.taskGroupCountX - 1) / draw.taskGroupCountX;
+    } else {
+        draw.pipeline = pipeline->GetVkPipeline();
+        draw.pipelineLayout = pipeline->GetVkPipelineLayout();
+        draw.descriptorSets = { transformBuffer->GetVkDescriptorSet(frame->currentFrame) };
+        draw.vertexBuffers = { vertexBuffer->GetVkBuffer(), frameBuffers.instances->GetVkBuffer() };
+        draw.vertexBufferOffsets = { 0, 0 };
+        draw.indexBuffer = indexBuffer->GetVkBuffer();
+        draw.indexBufferOffset = 0;
+        draw.indexType = vk::IndexType::eUint32;
+        draw.indirectBuffer = frameBuffers.drawCommands->GetVkBuffer();
+        draw.countBuffer = frameBuffers.drawCommandCount->GetVkBuffer();
+        draw.maxDrawCount = drawCount;
+    }
+    commandBuffer->TakeDrawStatistics();
+    commandBuffer->Draw(&draw);
+    drawStatistics = commandBuffer->TakeDrawStatistics();
+}
+
+CVulkanDrawStatistics CVulkanMeshletRenderer::GetDrawStatistics() {
+    return drawStatistics;
+}
+
+void CVulkanMeshletRenderer::ReserveObjects(FrameBuffers& frame) {
+    uint32_t objectCount = GetObjectCount();
+    uint32_t drawCount = static_cast<uint32_t>(meshletDraws.size());
+    if(frame.capacity >= objectCount && frame.drawCapacity >= drawCount) {
+        return;
+    }
+    uint32_t capacity = MIN_OBJECT_CAPACITY;
+    while(capacity < objectCount) {
+        capacity *= 2;
+    }
+    uint32_t drawCapacity = MIN_OBJECT_CAPACITY;
+    while(drawCapacity < drawCount) {
+        drawCapacity *= 2;
+    }
+
+    if(frame.drawCommands) {
+        barrierTracker->RemoveBuffer(frame.drawCommands->GetVkBuffer());
+        barrierTracker->RemoveBuffer(frame.drawCommandCount->GetVkBuffer());
+    }
+    vk::MemoryPropertyFlags hostVisible = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    frame.meshletDraws = std::make_unique<CVulkanBuffer>(device->CreateBuffer(hostVisible,
+        vk::BufferUsageFlagBits::eStorageBuffer, nullptr, sizeof(glm::uvec2) * drawCapacity));
+    if(!meshShading) {
+        // Draws set firstInstance to their object, so every instance holds its own index.
+        std::vector<CVulkanInstance> instances(capacity);
+        for(uint32_t object = 0; object < capacity; object++) {
+            instances[object].object = object;
+        }
+        frame.instances = std::make_unique<CVulkanBuffer>(device->CreateBuffer(hostVisible,
+            vk::BufferUsageFlagBits::eVertexBuffer, instances.data(), sizeof(CVulkanInstance) * capacity));
+        frame.drawCommands = std::make_unique<CVulkanBuffer>(device->CreateBuffer(vk::MemoryPropertyFlagBits::eDeviceLocal,
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, nullptr, sizeof(vk::DrawIndexedIndirectCommand) * drawCapacity));
+        frame.drawCommandCount = std::make_unique<CVulkanBuffer>(device->CreateBuffer(vk::MemoryPropertyFlagBits::eDeviceLocal,
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst, nullptr, sizeof(uint32_t)));
+    }
+    frame.capacity = capacity;
+    frame.drawCapacity = drawCapacity;
+    frame.writtenDraws = 0;
+    return true;
+}
+
+void CVulkanMeshletRenderer::WriteDescriptorSet(FrameBuffers& frame, uint32_t frameIndex) {
+    // Infos in binding order, the camera of the mesh shader comes after the storage buffers.
+    std::vector<CVulkanDescriptorInfo> infos = {
+        vk::DescriptorBufferInfo(transformBuffer->GetVkBuffer(frameIndex), 0, VK_WHOLE_SIZE),
+        vk::DescriptorBufferInfo(frame.meshletDraws->GetVkBuffer(), 0, VK_WHOLE_SIZE),
+        vk::DescriptorBufferInfo(meshletBuffer->GetVkBuffer(), 0, VK_WHOLE_SIZE),
+        vk::DescriptorBufferInfo(meshletVertexBuffer->GetVkBuffer(), 0, VK_WHOLE_SIZE),
+        vk::DescriptorBufferInfo(meshletTriangleBuffer->GetVkBuffer(), 0, VK_WHOLE_SIZE),
+        vk::DescriptorBufferInfo(vertexBuffer->GetVkBuffer(), 0, VK_WHOLE_SIZE),
+    };
+    if(meshShading) {
+        infos.push_back(vk::DescriptorBufferInfo(transformBuffer->GetVkCameraBuffer(frameIndex), 0, VK_WHOLE_SIZE));
+    } else {
+        infos.push_back(vk::DescriptorBufferInfo(frame.drawCommands->GetVkBuffer(), 0, VK_WHOLE_SIZE));
+        infos.push_back(vk::DescriptorBufferInfo(frame.drawCommandCount->GetVkBuffer(), 0, VK_WHOLE_SIZE));
+    }
+    CVulkanDescriptorLayout* descriptorLayout = meshShading ? meshShadingPipeline->GetDescriptorLayout() : cullPipeline->GetDescriptorLayout();
+    frame.descriptorSet = descriptorAllocator->Allocate(frameIndex, descriptorLayout);
+    descriptorAllocator->Write(frame.descriptorSet, descriptorLayout, infos);
+}
\ No newline at end of file
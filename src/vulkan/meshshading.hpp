@@ -0,0 +1,113 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include <glm/glm.hpp>
+#include <map>
+#include <memory>
+#include <vector>
+#include "types.hpp"
+#include "meshlet.hpp"
+
+class CVulkanDevice;
+class CVulkanBuffer;
+class CVulkanGraphicsPipeline;
+class CVulkanMeshShadingPipeline;
+class CVulkanComputePipeline;
+class CVulkanCommandBuffer;
+class CVulkanStagingRing;
+class CVulkanBarrierTracker;
+class CVulkanDescriptorAllocator;
+class CVulkanTransformBuffer;
+struct CVulkanMesh;
+struct CVulkanFrame;
+
+// Push constants of shaders/meshlet.glsl.
+struct CVulkanMeshletConstants {
+    glm::vec4 frustumPlanes[6]; // Normals point inside, w is the distance from the origin.
+    glm::vec4 camera; // Position with w = 1, or the view direction of an orthographic projection with w = 0.
+    uint32_t drawCount; // Meshlet draws, one per meshlet of every object.
+};
+
+// GPU driven rendering of meshes split into meshlets, for dense meshes where a few large draws leave most of the culling
+// to the rasterizer. Every meshlet of every object is frustum and back face cone culled on its own. With mesh shaders a
+// task shader culls and launches one mesh shader workgroup per visible meshlet. Without them a compute pass appends a
+// VkDrawIndexedIndirectCommand per visible meshlet, drawn with one vkCmdDrawIndexedIndirectCount over an index buffer
+// holding the triangles in meshlet order. Objects stay in buffers between frames like with CVulkanIndirectRenderer.
+// Meshes are drawn at full detail and single sided, counter clockwise triangles face the front.
+class CVulkanMeshletRenderer {
+    // Objects are host visible and written by the CPU, so every frame in flight has its own copy.
+    struct FrameBuffers {
+        std::unique_ptr<CVulkanBuffer> instances; // CVulkanInstance per object holding its own index, without mesh shaders only.
+        std::unique_ptr<CVulkanBuffer> meshletDraws; // Object and meshlet per meshlet draw.
+        std::unique_ptr<CVulkanBuffer> drawCommands; // Without mesh shaders only.
+        std::unique_ptr<CVulkanBuffer> drawCommandCount;
+        vk::DescriptorSet descriptorSet; // Allocated again by every Cull().
+        uint32_t capacity = 0; // Objects the buffers hold, 0 until they are created.
+        uint32_t drawCapacity = 0;
+        uint32_t writtenDraws = 0; // Meshlet draws are only ever appended.
+    };
+
+    // Where a mesh lives in the shared meshlet buffers.
+    struct MeshRange {
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
+    };
+
+    CVulkanDevice* device;
+    CVulkanBarrierTracker* barrierTracker;
+    CVulkanDescriptorAllocator* descriptorAllocator;
+    bool meshShading;
+    std::unique_ptr<CVulkanMeshShadingPipeline> meshShadingPipeline;
+    std::unique_ptr<CVulkanComputePipeline> cullPipeline;
+    std::unique_ptr<CVulkanGraphicsPipeline> pipeline; // Draws the culled meshlets without mesh shaders.
+    std::unique_ptr<CVulkanBuffer> vertexBuffer;
+    std::unique_ptr<CVulkanBuffer> indexBuffer; // Without mesh shaders only.
+    std::unique_ptr<CVulkanBuffer> meshletBuffer;
+    std::unique_ptr<CVulkanBuffer> meshletVertexBuffer;
+    std::unique_ptr<CVulkanBuffer> meshletTriangleBuffer;
+    std::vector<std::shared_ptr<CVulkanMesh>> meshes;
+    std::map<CVulkanMesh*, uint32_t> meshIndices;
+    std::vector<MeshRange> meshRanges;
+    std::unique_ptr<CVulkanTransformBuffer> transformBuffer; // World transforms with the position dequantization of the mesh folded in.
+    std::vector<uint32_t> objectMeshes;
+    std::vector<glm::uvec2> meshletDraws;
+    std::vector<FrameBuffers> frames;
+    CVulkanMeshletConstants constants = {};
+    CVulkanDrawStatistics drawStatistics;
+public:
+    static constexpr uint32_t NO_OBJECT = ~0u;
+    static constexpr uint32_t MIN_OBJECT_CAPACITY = 1024;
+    static constexpr uint32_t TASK_GROUP_SIZE = 32; // local_size_x of shaders/meshlet.task.
+    static constexpr uint32_t CULL_GROUP_SIZE = 64; // local_size_x of shaders/meshletcull.comp.
+    // Dispatches and task launches are split into rows of this many workgroups, the smallest limit devices must support.
+    static constexpr uint32_t MAX_GROUP_COUNT_X = 65535;
+
+    // Uses mesh shaders when CVulkanDevice::IsMeshShadingEnabled(), otherwise needs CVulkanDevice::IsGpuDrivenRenderingEnabled().
+    // Draws into a color attachment of colorFormat, every buffer is synchronized through barrierTracker. Descriptor sets
+    // come from the frame's pools of descriptorAllocator.
+    CVulkanMeshletRenderer(CVulkanDevice* device, vk::Format colorFormat, CVulkanBarrierTracker* barrierTracker, CVulkanDescriptorAllocator* descriptorAllocator,
+        uint32_t framesInFlight);
+    ~CVulkanMeshletRenderer();
+    // Whether meshlets are drawn with mesh shaders, the stages reading the geometry buffers are task and mesh shaders then.
+    bool IsMeshShading();
+    // Copies the geometry and meshlets of meshes into the shared buffers through stagingRing, replacing the meshes and objects
+    // from before. Meshes must be loaded with CVulkanMeshLoadOptions::meshlets. Must not be called while earlier frames are
+    // still executing.
+    void SetMeshes(const std::vector<std::shared_ptr<CVulkanMesh>>& meshes, CVulkanStagingRing* stagingRing);
+    // Returns the object index, or NO_OBJECT if mesh was not passed to SetMeshes().
+    uint32_t AddObject(std::shared_ptr<CVulkanMesh> mesh, glm::mat4 worldTransform);
+    void SetWorldTransform(uint32_t object, glm::mat4 worldTransform);
+    uint32_t GetObjectCount();
+    // Writes the changed objects and the camera and, without mesh shaders, records the cull pass, outside of a rendering
+    // scope. Meshlets outside of the frustum of viewProjection or facing away from its camera are not drawn.
+    void Cull(CVulkanCommandBuffer* commandBuffer, CVulkanFrame* frame, glm::mat4 viewProjection);
+    // Records the draw of the meshlets, inside a rendering scope with inline contents.
+    void Draw(CVulkanCommandBuffer* commandBuffer, CVulkanFrame* frame);
+    // Binds issued and skipped by the last Draw().
+    CVulkanDrawStatistics GetDrawStatistics();
+private:
+    // Recreates the buffers of frame when the objects no longer fit, the frame's fence must have signaled.
+    void ReserveObjects(FrameBuffers& frame);
+    // Allocates the set of frame from its pools and writes the buffers of this frame into it.
+    void WriteDescriptorSet(FrameBuffers& frame, uint32_t frameIndex);
+};
\ No newline at end of file
@@ -0,0 +1,644 @@
+#include "optimize.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <random>
+
+static constexpr uint32_t NO_VERTEX = UINT32_MAX;
+static constexpr uint32_t NO_TRIANGLE = UINT32_MAX;
+// Live triangle counts above this score the same.
+static constexpr uint32_t MAX_SCORED_VALENCE = 32;
+
+static uint32_t HashVertex(const CVulkanVertex& vertex) {
+    uint32_t words[sizeof(CVulkanVertex) / sizeof(uint32_t)];
+    memcpy(words, &vertex, sizeof(words));
+    uint32_t hash = 2166136261u;
+    for(auto word : words) {
+        hash = (hash ^ word) * 16777619u;
+        hash ^= hash >> 15;
+    }
+    return hash;
+}
+
+void CVulkanMeshOptimizer::Optimize(std::vector<CVulkanVertex>& vertices, std::vector<uint32_t>& indices) {
+    WeldVertices(vertices, indices);
+    OptimizeVertexCache(indices, vertices.size());
+    OptimizeOverdraw(indices, vertices);
+    OptimizeVertexFetch(vertices, indices);
+}
+
+void CVulkanMeshOptimizer::WeldVertices(std::vector<CVulkanVertex>& vertices, std::vector<uint32_t>& indices) {
+    if(indices.empty()) {
+        indices.resize(vertices.size());
+        std::iota(indices.begin(), indices.end(), 0);
+    }
+
+    // Open addressing into the welded vertices, at most half full.
+    size_t capacity = 1;
+    while(capacity < vertices.size() * 2) {
+        capacity *= 2;
+    }
+    std::vector<uint32_t> table(capacity, NO_VERTEX);
+    std::vector<uint32_t> remap(vertices.size());
+    std::vector<CVulkanVertex> welded;
+    welded.reserve(vertices.size());
+    for(size_t i = 0; i < vertices.size(); i++) {
+        size_t slot = HashVertex(vertices[i]) & (capacity - 1);
+        while(table[slot] != NO_VERTEX && memcmp(&welded[table[slot]], &vertices[i], sizeof(CVulkanVertex)) != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if(table[slot] == NO_VERTEX) {
+            table[slot] = static_cast<uint32_t>(welded.size());
+            welded.push_back(vertices[i]);
+        }
+        remap[i] = table[slot];
+    }
+    for(auto& index : indices) {
+        index = remap[index];
+    }
+    vertices.swap(welded);
+}
+
+void CVulkanMeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, size_t verticesCount) {
+    size_t triangleCount = indices.size() / 3;
+    if(triangleCount == 0) {
+        return;
+    }
+
+    // Vertices score higher the more recently they were used and the fewer triangles they have left, so that lone
+    // triangles are not left behind. The three most recent vertices score lower, to avoid strips.
+    float cacheScores[CACHE_SIZE];
+    for(uint32_t i = 0; i < CACHE_SIZE; i++) {
+        cacheScores[i] = i < 3 ? 0.75f : std::pow(1.0f - static_cast<float>(i - 3) / (CACHE_SIZE - 3), 1.5f);
+    }
+    float valenceScores[MAX_SCORED_VALENCE + 1];
+    valenceScores[0] = 0.0f;
+    for(uint32_t i = 1; i <= MAX_SCORED_VALENCE; i++) {
+        valenceScores[i] = 2.0f / std::sqrt(static_cast<float>(i));
+    }
+    std::vector<uint32_t> liveCounts(verticesCount, 0);
+    std::vector<int32_t> cachePositions(verticesCount, -1);
+    auto getVertexScore = [&](uint32_t vertex) {
+        if(liveCounts[vertex] == 0) {
+            return -1.0f;
+        }
+        float score = cachePositions[vertex] >= 0 ? cacheScores[cachePositions[vertex]] : 0.0f;
+        return score + valenceScores[std::min(liveCounts[vertex], MAX_SCORED_VALENCE)];
+    };
+
+    // Triangles not emitted yet per vertex, the first liveCounts[vertex] entries from adjacencyOffsets[vertex].
+    for(auto index : indices) {
+        liveCounts[index]++;
+    }
+    std::vector<uint32_t> adjacencyOffsets(verticesCount + 1, 0);
+    for(size_t i = 0; i < verticesCount; i++) {
+        adjacencyOffsets[i + 1] = adjacencyOffsets[i] + liveCounts[i];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> adjacencyCursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for(size_t i = 0; i < indices.size(); i++) {
+        adjacency[adjacencyCursors[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<float> vertexScores(verticesCount);
+    for(size_t i = 0; i < verticesCount; i++) {
+        vertexScores[i] = getVertexScore(static_cast<uint32_t>(i));
+    }
+    std::vector<float> triangleScores(triangleCount);
+    uint32_t bestTriangle = 0;
+    for(size_t i = 0; i < triangleCount; i++) {
+        triangleScores[i] = vertexScores[indices[i * 3]] + vertexScores[indices[i * 3 + 1]] + vertexScores[indices[i * 3 + 2]];
+        if(triangleScores[i] > triangleScores[bestTriangle]) {
+            bestTriangle = static_cast<uint32_t>(i);
+        }
+    }
+
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    uint32_t cache[CACHE_SIZE + 3];
+    uint32_t cacheCount = 0;
+    size_t nextTriangle = 0;
+    for(size_t i = 0; i < triangleCount; i++) {
+        if(bestTriangle == NO_TRIANGLE) {
+            // Nothing in the cache has triangles left, continue with the next one in the original order.
+            while(emitted[nextTriangle]) {
+                nextTriangle++;
+            }
+            bestTriangle = static_cast<uint32_t>(nextTriangle);
+        }
+        uint32_t triangle = bestTriangle;
+        emitted[triangle] = 1;
+        const uint32_t* triangleVertices = &indices[static_cast<size_t>(triangle) * 3];
+
+        // The triangle's vertices move to the front of the cache, the rest shift back and the last ones fall out.
+        uint32_t newCache[CACHE_SIZE + 3];
+        uint32_t newCacheCount = 0;
+        for(int k = 0; k < 3; k++) {
+            uint32_t vertex = triangleVertices[k];
+            output.push_back(vertex);
+            uint32_t* live = &adjacency[adjacencyOffsets[vertex]];
+            for(uint32_t j = 0; j < liveCounts[vertex]; j++) {
+                if(live[j] == triangle) {
+                    live[j] = live[liveCounts[vertex] - 1];
+                    break;
+                }
+            }
+            liveCounts[vertex]--;
+            if(std::find(newCache, newCache + newCacheCount, vertex) == newCache + newCacheCount) {
+                newCache[newCacheCount++] = vertex;
+            }
+        }
+        for(uint32_t j = 0; j < cacheCount; j++) {
+            if(std::find(triangleVertices, triangleVertices + 3, cache[j]) == triangleVertices + 3) {
+                newCache[newCacheCount++] = cache[j];
+            }
+        }
+        for(uint32_t j = 0; j < newCacheCount; j++) {
+            cachePositions[newCache[j]] = j < CACHE_SIZE ? static_cast<int32_t>(j) : -1;
+            vertexScores[newCache[j]] = getVertexScore(newCache[j]);
+        }
+
+        // Only triangles of vertices whose score changed need to be scored again, the best of them comes next.
+        bestTriangle = NO_TRIANGLE;
+        float bestScore = -1.0f;
+        for(uint32_t j = 0; j < newCacheCount; j++) {
+            uint32_t vertex = newCache[j];
+            const uint32_t* live = &adjacency[adjacencyOffsets[vertex]];
+            for(uint32_t k = 0; k < liveCounts[vertex]; k++) {
+                uint32_t liveTriangle = live[k];
+                const uint32_t* liveVertices = &indices[static_cast<size_t>(liveTriangle) * 3];
+                float score = vertexScores[liveVertices[0]] + vertexScores[liveVertices[1]] + vertexScores[liveVertices[2]];
+                triangleScores[liveTriangle] = score;
+                if(score > bestScore) {
+                    bestScore = score;
+                    bestTriangle = liveTriangle;
+                }
+            }
+        }
+        cacheCount = std::min(newCacheCount, CACHE_SIZE);
+        std::copy(newCache, newCache + cacheCount, cache);
+    }
+    indices.swap(output);
+}
+
+void CVulkanMeshOptimizer::OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<CVulkanVertex>& vertices) {
+    size_t triangleCount = indices.size() / 3;
+    if(triangleCount < MIN_CLUSTER_TRIANGLES * 2) {
+        return;
+    }
+
+    // A triangle missing all three vertices starts over with a cold cache, moving it costs no more misses.
+    std::vector<uint32_t> timestamps(vertices.size(), 0);
+    uint32_t time = ANALYSIS_CACHE_SIZE + 1;
+    std::vector<size_t> clusterStarts = { 0 };
+    for(size_t i = 0; i < triangleCount; i++) {
+        int misses = 0;
+        for(int k = 0; k < 3; k++) {
+            uint32_t vertex = indices[i * 3 + k];
+            if(time - timestamps[vertex] > ANALYSIS_CACHE_SIZE) {
+                timestamps[vertex] = time++;
+                misses++;
+            }
+        }
+        if(misses == 3 && i - clusterStarts.back() >= MIN_CLUSTER_TRIANGLES) {
+            clusterStarts.push_back(i);
+        }
+    }
+    clusterStarts.push_back(triangleCount);
+    size_t clusterCount = clusterStarts.size() - 1;
+    if(clusterCount < 2) {
+        return;
+    }
+
+    // Clusters far out along their average normal face the viewer whenever they could hide the rest of the mesh.
+    auto getCentroid = [&](size_t triangle) {
+        return (vertices[indices[triangle * 3]].position + vertices[indices[triangle * 3 + 1]].position + vertices[indices[triangle * 3 + 2]].position) / 3.0f;
+    };
+    glm::vec3 meshCentroid(0.0f);
+    for(size_t i = 0; i < triangleCount; i++) {
+        meshCentroid += getCentroid(i);
+    }
+    meshCentroid /= static_cast<float>(triangleCount);
+    std::vector<float> sortKeys(clusterCount);
+    for(size_t cluster = 0; cluster < clusterCount; cluster++) {
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        for(size_t i = clusterStarts[cluster]; i < clusterStarts[cluster + 1]; i++) {
+            centroid += getCentroid(i);
+            normal += vertices[indices[i * 3]].normal + vertices[indices[i * 3 + 1]].normal + vertices[indices[i * 3 + 2]].normal;
+        }
+        centroid /= static_cast<float>(clusterStarts[cluster + 1] - clusterStarts[cluster]);
+        float normalLength = glm::length(normal);
+        sortKeys[cluster] = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+    }
+    std::vector<size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    for(auto cluster : order) {
+        output.insert(output.end(), indices.begin() + clusterStarts[cluster] * 3, indices.begin() + clusterStarts[cluster + 1] * 3);
+    }
+    indices.swap(output);
+}
+
+void CVulkanMeshOptimizer::OptimizeVertexFetch(std::vector<CVulkanVertex>& vertices, std::vector<uint32_t>& indices) {
+    std::vector<uint32_t> remap(vertices.size(), NO_VERTEX);
+    std::vector<CVulkanVertex> fetched;
+    fetched.reserve(vertices.size());
+    for(auto& index : indices) {
+        if(remap[index] == NO_VERTEX) {
+            remap[index] = static_cast<uint32_t>(fetched.size());
+            fetched.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(fetched);
+}
+
+// Symmetric 4x4 matrix summing weighted squared distances to planes, evaluated at (x, y, z, 1).
+struct CQuadric {
+    float xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+    float weight; // Sum of the plane weights, dividing by it gives the mean squared distance.
+
+    static CQuadric FromPlane(glm::vec3 normal, float distance, float weight) {
+        glm::vec3 n = normal * weight;
+        return { n.x * normal.x, n.x * normal.y, n.x * normal.z, n.x * distance, n.y * normal.y, n.y * normal.z, n.y * distance,
+            n.z * normal.z, n.z * distance, weight * distance * distance, weight };
+    }
+
+    void Add(const CQuadric& other) {
+        xx += other.xx; xy += other.xy; xz += other.xz; xw += other.xw; yy += other.yy;
+        yz += other.yz; yw += other.yw; zz += other.zz; zw += other.zw; ww += other.ww;
+        weight += other.weight;
+    }
+
+    float Evaluate(glm::vec3 p) const {
+        float error = xx * p.x * p.x + 2.0f * xy * p.x * p.y + 2.0f * xz * p.x * p.z + 2.0f * xw * p.x + yy * p.y * p.y +
+            2.0f * yz * p.y * p.z + 2.0f * yw * p.y + zz * p.z * p.z + 2.0f * zw * p.z + ww;
+        return std::max(error, 0.0f);
+    }
+};
+
+std::vector<uint32_t> CVulkanMeshOptimizer::Simplify(const std::vector<CVulkanVertex>& vertices, const std::vector<uint32_t>& indices, size_t targetIndexCount, float& error) {
+    error = 0.0f;
+    std::vector<uint32_t> result = indices;
+    size_t verticesCount = vertices.size();
+    if(result.size() <= targetIndexCount || verticesCount == 0) {
+        return result;
+    }
+    auto getPosition = [&](uint32_t vertex) { return vertices[vertex].position; };
+    auto getNormal = [&](uint32_t a, uint32_t b, uint32_t c) { return glm::cross(getPosition(b) - getPosition(a), getPosition(c) - getPosition(a)); };
+
+    // Quadrics of the planes around each vertex, weighted by triangle area.
+    std::vector<CQuadric> quadrics(verticesCount, CQuadric{});
+    glm::vec3 boundsMin = vertices.front().position;
+    glm::vec3 boundsMax = vertices.front().position;
+    for(size_t i = 0; i < result.size(); i += 3) {
+        glm::vec3 normal = getNormal(result[i], result[i + 1], result[i + 2]);
+        float area = glm::length(normal);
+        if(area > 0.0f) {
+            normal /= area;
+            CQuadric quadric = CQuadric::FromPlane(normal, -glm::dot(normal, getPosition(result[i])), area * 0.5f);
+            for(int k = 0; k < 3; k++) {
+                quadrics[result[i + k]].Add(quadric);
+            }
+        }
+        for(int k = 0; k < 3; k++) {
+            boundsMin = glm::min(boundsMin, vertices[result[i + k]].position);
+            boundsMax = glm::max(boundsMax, vertices[result[i + k]].position);
+        }
+    }
+    float radius = glm::length(boundsMax - boundsMin) * 0.5f;
+    float attributeScale = ATTRIBUTE_WEIGHT * radius * radius;
+
+    // Edges of one triangle only are borders. Vertices sharing a position with another one are on an attribute seam,
+    // moving them would tear the seam open.
+    std::vector<uint8_t> locked(verticesCount, 0);
+    std::vector<uint64_t> edges;
+    edges.reserve(result.size());
+    for(size_t i = 0; i < result.size(); i += 3) {
+        for(int k = 0; k < 3; k++) {
+            uint32_t a = result[i + k];
+            uint32_t b = result[i + (k + 1) % 3];
+            edges.push_back(static_cast<uint64_t>(std::min(a, b)) << 32 | std::max(a, b));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    for(size_t i = 0; i < edges.size();) {
+        size_t run = i + 1;
+        while(run < edges.size() && edges[run] == edges[i]) {
+            run++;
+        }
+        if(run - i == 1) {
+            locked[edges[i] >> 32] = 1;
+            locked[edges[i] & UINT32_MAX] = 1;
+        }
+        i = run;
+    }
+    std::vector<uint32_t> positionOrder(verticesCount);
+    std::iota(positionOrder.begin(), positionOrder.end(), 0);
+    auto positionLess = [&](uint32_t a, uint32_t b) {
+        const glm::vec3& p = vertices[a].position;
+        const glm::vec3& q = vertices[b].position;
+        return p.x < q.x || (p.x == q.x && (p.y < q.y || (p.y == q.y && p.z < q.z)));
+    };
+    std::sort(positionOrder.begin(), positionOrder.end(), positionLess);
+    for(size_t i = 1; i < verticesCount; i++) {
+        if(!positionLess(positionOrder[i - 1], positionOrder[i])) {
+            locked[positionOrder[i - 1]] = 1;
+            locked[positionOrder[i]] = 1;
+        }
+    }
+
+    struct Collapse {
+        float cost;
+        float distance; // Root mean square distance to the planes of both vertices, in model space units.
+        uint32_t from;
+        uint32_t to;
+    };
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> adjacencyOffsets(verticesCount + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<uint32_t> collapseTargets(verticesCount);
+    std::vector<uint8_t> touched(verticesCount);
+    while(result.size() > targetIndexCount) {
+        // Triangles around each vertex, rebuilt every pass.
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for(auto index : result) {
+            adjacencyOffsets[index + 1]++;
+        }
+        for(size_t i = 0; i < verticesCount; i++) {
+            adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+        }
+        adjacency.resize(result.size());
+        std::vector<uint32_t> adjacencyCursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for(size_t i = 0; i < result.size(); i++) {
+            adjacency[adjacencyCursors[result[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        // Every edge may collapse either way, onto the vertex that stays.
+        collapses.clear();
+        for(size_t i = 0; i < result.size(); i += 3) {
+            for(int k = 0; k < 3; k++) {
+                uint32_t from = result[i + k];
+                uint32_t to = result[i + (k + 1) % 3];
+                if(locked[from]) {
+                    continue;
+                }
+                CQuadric quadric = quadrics[from];
+                quadric.Add(quadrics[to]);
+                const CVulkanVertex& a = vertices[from];
+                const CVulkanVertex& b = vertices[to];
+                glm::vec3 normalDifference = a.normal - b.normal;
+                glm::vec3 colorDifference = a.color - b.color;
+                glm::vec2 uvDifference = a.uv - b.uv;
+                float attributeDistance = glm::dot(normalDifference, normalDifference) + glm::dot(colorDifference, colorDifference) + glm::dot(uvDifference, uvDifference);
+                float planeError = quadric.Evaluate(getPosition(to));
+                float distance = quadric.weight > 0.0f ? std::sqrt(planeError / quadric.weight) : 0.0f;
+                collapses.push_back({ planeError + attributeScale * attributeDistance, distance, from, to });
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+        // Cheapest first, a vertex whose triangles changed this pass waits for the next one so the flip test stays valid.
+        std::iota(collapseTargets.begin(), collapseTargets.end(), 0);
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t removableTriangles = (result.size() - targetIndexCount + 2) / 3;
+        size_t removedTriangles = 0;
+        for(auto& collapse : collapses) {
+            if(removedTriangles >= removableTriangles) {
+                break;
+            }
+            if(touched[collapse.from] || touched[collapse.to]) {
+                continue;
+            }
+            size_t collapsedTriangles = 0;
+            bool flips = false;
+            for(uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1] && !flips; j++) {
+                const uint32_t* triangle = &result[static_cast<size_t>(adjacency[j]) * 3];
+                if(triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                    collapsedTriangles++;
+                    continue;
+                }
+                uint32_t moved[3] = { triangle[0], triangle[1], triangle[2] };
+                for(auto& vertex : moved) {
+                    vertex = vertex == collapse.from ? collapse.to : vertex;
+                }
+                flips = glm::dot(getNormal(triangle[0], triangle[1], triangle[2]), getNormal(moved[0], moved[1], moved[2])) <= 0.0f;
+            }
+            if(flips) {
+                continue;
+            }
+            collapseTargets[collapse.from] = collapse.to;
+            quadrics[collapse.to].Add(quadrics[collapse.from]);
+            error = std::max(error, collapse.distance);
+            removedTriangles += collapsedTriangles;
+            for(uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; j++) {
+                const uint32_t* triangle = &result[static_cast<size_t>(adjacency[j]) * 3];
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+            }
+        }
+        if(removedTriangles == 0) {
+            break;
+        }
+
+        // Triangles that lost an edge are dropped.
+        size_t kept = 0;
+        for(size_t i = 0; i < result.size(); i += 3) {
+            uint32_t a = collapseTargets[result[i]];
+            uint32_t b = collapseTargets[result[i + 1]];
+            uint32_t c = collapseTargets[result[i + 2]];
+            if(a != b && b != c && a != c) {
+                result[kept++] = a;
+                result[kept++] = b;
+                result[kept++] = c;
+            }
+        }
+        result.resize(kept);
+    }
+    return result;
+}
+
+CVulkanVertexCacheStatistics CVulkanMeshOptimizer::AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t verticesCount) {
+    // A vertex is in the FIFO while fewer than ANALYSIS_CACHE_SIZE misses happened since its own.
+    std::vector<uint32_t> timestamps(verticesCount, 0);
+    std::vector<uint8_t> referenced(verticesCount, 0);
+    uint32_t time = ANALYSIS_CACHE_SIZE + 1;
+    size_t misses = 0;
+    size_t referencedCount = 0;
+    for(auto index : indices) {
+        if(time - timestamps[index] > ANALYSIS_CACHE_SIZE) {
+            timestamps[index] = time++;
+            misses++;
+        }
+        if(!referenced[index]) {
+            referenced[index] = 1;
+            referencedCount++;
+        }
+    }
+    CVulkanVertexCacheStatistics statistics = {};
+    if(indices.size() >= 3) {
+        statistics.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+        statistics.atvr = static_cast<float>(misses) / static_cast<float>(referencedCount);
+    }
+    return statistics;
+}
+
+bool CVulkanMeshOptimizer::RunBenchmark() {
+    bool passed = true;
+    std::mt19937 random(1234);
+    for(size_t targetTriangles = 1000; targetTriangles <= 10000000; targetTriangles *= 10) {
+        // A dome shaped grid, every grid vertex stored twice and referenced through either copy, with vertices and
+        // triangles shuffled like an exporter that does not care.
+        size_t side = static_cast<size_t>(std::ceil(std::sqrt(targetTriangles / 2.0)));
+        size_t gridVertices = (side + 1) * (side + 1);
+        std::vector<CVulkanVertex> vertices(gridVertices * 2);
+        for(size_t y = 0; y <= side; y++) {
+            for(size_t x = 0; x <= side; x++) {
+                CVulkanVertex vertex = {};
+                vertex.position = glm::vec3(static_cast<float>(x) / side - 0.5f, static_cast<float>(y) / side - 0.5f, 0.0f);
+                vertex.color = glm::vec3(1.0f);
+                vertex.normal = glm::normalize(glm::vec3(vertex.position.x, vertex.position.y, 1.0f));
+                vertices[(y * (side + 1) + x) * 2] = vertex;
+                vertices[(y * (side + 1) + x) * 2 + 1] = vertex;
+            }
+        }
+        std::vector<uint32_t> vertexOrder(vertices.size());
+        std::iota(vertexOrder.begin(), vertexOrder.end(), 0);
+        std::shuffle(vertexOrder.begin(), vertexOrder.end(), random);
+        std::vector<CVulkanVertex> shuffledVertices(vertices.size());
+        for(size_t i = 0; i < vertices.size(); i++) {
+            shuffledVertices[vertexOrder[i]] = vertices[i];
+        }
+        vertices.swap(shuffledVertices);
+
+        std::vector<size_t> quads(side * side);
+        std::iota(quads.begin(), quads.end(), 0);
+        std::shuffle(quads.begin(), quads.end(), random);
+        std::vector<uint32_t> indices;
+        indices.reserve(quads.size() * 6);
+        auto getIndex = [&](size_t x, size_t y) { return vertexOrder[(y * (side + 1) + x) * 2 + (random() & 1)]; };
+        for(auto quad : quads) {
+            size_t x = quad % side;
+            size_t y = quad / side;
+            uint32_t corners[4] = { getIndex(x, y), getIndex(x + 1, y), getIndex(x + 1, y + 1), getIndex(x, y + 1) };
+            indices.insert(indices.end(), { corners[0], corners[1], corners[2], corners[0], corners[2], corners[3] });
+        }
+
+        // Order independent over triangles, order dependent within them, so it also checks winding.
+        auto getChecksum = [&]() {
+            uint64_t checksum = 0;
+            for(size_t i = 0; i < indices.size(); i += 3) {
+                uint64_t hash = HashVertex(vertices[indices[i]]);
+                hash = hash * 31 + HashVertex(vertices[indices[i + 1]]);
+                hash = hash * 31 + HashVertex(vertices[indices[i + 2]]);
+                checksum += hash * 0x9E3779B97F4A7C15ull;
+            }
+            return checksum;
+        };
+        uint64_t checksum = getChecksum();
+        size_t inputVertices = vertices.size();
+        CVulkanVertexCacheStatistics before = AnalyzeVertexCache(indices, vertices.size());
+
+        auto start = std::chrono::steady_clock::now();
+        WeldVertices(vertices, indices);
+        auto welded = std::chrono::steady_clock::now();
+        OptimizeVertexCache(indices, vertices.size());
+        auto cacheOptimized = std::chrono::steady_clock::now();
+        OptimizeOverdraw(indices, vertices);
+        auto overdrawOptimized = std::chrono::steady_clock::now();
+        OptimizeVertexFetch(vertices, indices);
+        auto end = std::chrono::steady_clock::now();
+        CVulkanVertexCacheStatistics after = AnalyzeVertexCache(indices, vertices.size());
+
+        bool valid = getChecksum() == checksum && after.acmr <= before.acmr && after.atvr <= before.atvr;
+        passed = passed && valid;
+        auto milliseconds = [](auto from, auto to) { return std::chrono::duration<double, std::milli>(to - from).count(); };
+        printf("CVulkanMeshOptimizer::RunBenchmark: %zu triangles, %zu -> %zu vertices, weld %.1f ms, vertex cache %.1f ms, overdraw %.1f ms, "
+            "vertex fetch %.1f ms, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %s\n", indices.size() / 3, inputVertices, vertices.size(),
+            milliseconds(start, welded), milliseconds(welded, cacheOptimized), milliseconds(cacheOptimized, overdrawOptimized),
+            milliseconds(overdrawOptimized, end), before.acmr, after.acmr, before.atvr, after.atvr, valid ? "passed" : "FAILED");
+    }
+    return passed;
+}
+
+bool CVulkanMeshOptimizer::RunLodBenchmark() {
+    bool passed = true;
+    for(size_t targetTriangles = 1000; targetTriangles <= 100000; targetTriangles *= 10) {
+        // A unit sphere around the z axis, rings above and below the equator share their xy, so a seam test or quadric
+        // that ignores z would lock or flatten them.
+        uint32_t rings = static_cast<uint32_t>(std::ceil(std::sqrt(targetTriangles / 4.0)));
+        uint32_t segments = rings * 2;
+        std::vector<CVulkanVertex> vertices;
+        auto addVertex = [&](glm::vec3 position) {
+            CVulkanVertex vertex = {};
+            vertex.position = position;
+            vertex.color = glm::vec3(1.0f);
+            vertex.normal = position;
+            vertices.push_back(vertex);
+        };
+        addVertex(glm::vec3(0.0f, 0.0f, 1.0f));
+        for(uint32_t ring = 1; ring < rings; ring++) {
+            float theta = 3.14159265f * ring / rings;
+            for(uint32_t segment = 0; segment < segments; segment++) {
+                float phi = 2.0f * 3.14159265f * segment / segments;
+                addVertex(glm::vec3(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta)));
+            }
+        }
+        addVertex(glm::vec3(0.0f, 0.0f, -1.0f));
+        uint32_t southPole = static_cast<uint32_t>(vertices.size() - 1);
+        auto getRingVertex = [&](uint32_t ring, uint32_t segment) { return 1 + (ring - 1) * segments + segment % segments; };
+        std::vector<uint32_t> indices;
+        for(uint32_t segment = 0; segment < segments; segment++) {
+            indices.insert(indices.end(), { 0, getRingVertex(1, segment), getRingVertex(1, segment + 1) });
+            for(uint32_t ring = 1; ring + 1 < rings; ring++) {
+                uint32_t corners[4] = { getRingVertex(ring, segment), getRingVertex(ring + 1, segment), getRingVertex(ring + 1, segment + 1), getRingVertex(ring, segment + 1) };
+                indices.insert(indices.end(), { corners[0], corners[1], corners[2], corners[0], corners[2], corners[3] });
+            }
+            indices.insert(indices.end(), { getRingVertex(rings - 1, segment), southPole, getRingVertex(rings - 1, segment + 1) });
+        }
+
+        // Signed volume by the divergence theorem, and the area the error of a LOD can move.
+        auto getVolume = [&](const std::vector<uint32_t>& triangles) {
+            float volume = 0.0f;
+            for(size_t i = 0; i < triangles.size(); i += 3) {
+                volume += glm::dot(vertices[triangles[i]].position, glm::cross(vertices[triangles[i + 1]].position, vertices[triangles[i + 2]].position)) / 6.0f;
+            }
+            return volume;
+        };
+        float area = 0.0f;
+        for(size_t i = 0; i < indices.size(); i += 3) {
+            area += glm::length(glm::cross(vertices[indices[i + 1]].position - vertices[indices[i]].position,
+                vertices[indices[i + 2]].position - vertices[indices[i]].position)) * 0.5f;
+        }
+        float fullVolume = getVolume(indices);
+        printf("CVulkanMeshOptimizer::RunLodBenchmark: %zu triangles, volume %.4f\n", indices.size() / 3, fullVolume);
+
+        // Every LOD is simplified from full detail, like CVulkanMeshLoader does.
+        for(size_t targetIndexCount = (indices.size() / 2) / 3 * 3; targetIndexCount >= 64 * 3; targetIndexCount = (targetIndexCount / 2) / 3 * 3) {
+            float error = 0.0f;
+            auto start = std::chrono::steady_clock::now();
+            std::vector<uint32_t> lodIndices = Simplify(vertices, indices, targetIndexCount, error);
+            auto end = std::chrono::steady_clock::now();
+
+            bool valid = lodIndices.size() <= targetIndexCount && lodIndices.size() % 3 == 0;
+            for(size_t i = 0; i < lodIndices.size() && valid; i += 3) {
+                valid = lodIndices[i] < vertices.size() && lodIndices[i + 1] < vertices.size() && lodIndices[i + 2] < vertices.size() &&
+                    lodIndices[i] != lodIndices[i + 1] && lodIndices[i + 1] != lodIndices[i + 2] && lodIndices[i] != lodIndices[i + 2];
+            }
+            float volume = getVolume(lodIndices);
+            valid = valid && std::abs(volume - fullVolume) <= area * error;
+            passed = passed && valid;
+            printf("CVulkanMeshOptimizer::RunLodBenchmark: %zu -> %zu triangles, error %.5f, volume %.4f, %.1f ms, %s\n", indices.size() / 3,
+                lodIndices.size() / 3, error, volume, std::chrono::duration<double, std::milli>(end - start).count(), valid ? "passed" : "FAILED");
+        }
+    }
+    return passed;
+}
\ No newline at end of file
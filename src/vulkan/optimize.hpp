@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "types.hpp"
+
+// Post-transform vertex cache behaviour of a triangle list, simulated with a FIFO of ANALYSIS_CACHE_SIZE entries.
+struct CVulkanVertexCacheStatistics {
+    float acmr; // Average cache misses per triangle, 3 at worst and about 0.5 at best for regular meshes.
+    float atvr; // Average transforms per referenced vertex, 1 at best.
+};
+
+// Reorders and simplifies triangle lists and their vertices for the GPU before upload. Every stage but Simplify() keeps
+// the set of triangles, only their order and the order of vertices change.
+class CVulkanMeshOptimizer {
+public:
+    static constexpr uint32_t CACHE_SIZE = 32; // LRU cache scored by OptimizeVertexCache().
+    static constexpr uint32_t ANALYSIS_CACHE_SIZE = 16;
+    // Smallest run of triangles OptimizeOverdraw() moves as a whole.
+    static constexpr size_t MIN_CLUSTER_TRIANGLES = 64;
+    // Weight of the squared attribute distance of a collapse in Simplify(), relative to the squared mesh radius.
+    static constexpr float ATTRIBUTE_WEIGHT = 1.0f;
+
+    // Runs every stage in order. indices may be empty for unindexed vertices and are filled in.
+    static void Optimize(std::vector<CVulkanVertex>& vertices, std::vector<uint32_t>& indices);
+    // Merges bitwise equal vertices, vertices no index refers to any more stay until OptimizeVertexFetch().
+    static void WeldVertices(std::vector<CVulkanVertex>& vertices, std::vector<uint32_t>& indices);
+    // Reorders triangles for the post-transform vertex cache, after Tom Forsyth's linear-speed vertex cache optimisation.
+    static void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t verticesCount);
+    // Splits triangles into clusters where the cache runs cold anyway and draws outward facing clusters first, so near
+    // geometry tends to cover far geometry. Run after OptimizeVertexCache(), whose order is kept within clusters.
+    static void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<CVulkanVertex>& vertices);
+    // Reorders vertices by first use so fetches walk the vertex buffer forwards, dropping unreferenced ones.
+    static void OptimizeVertexFetch(std::vector<CVulkanVertex>& vertices, std::vector<uint32_t>& indices);
+    // Collapses edges by quadric error plus attribute distance until at most targetIndexCount indices are left or no
+    // collapse is possible, returning the new indices into the same vertices. Vertices on borders and attribute seams
+    // never move. error is set to the largest root mean square distance of a collapse to the planes it replaces, in model
+    // space units, the attribute distance only orders collapses.
+    static std::vector<uint32_t> Simplify(const std::vector<CVulkanVertex>& vertices, const std::vector<uint32_t>& indices, size_t targetIndexCount, float& error);
+    static CVulkanVertexCacheStatistics AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t verticesCount);
+    // Optimizes shuffled grids of 1k to 10M triangles with duplicated vertices, printing the time of every stage and the
+    // cache statistics before and after. Returns false if a stage lost triangles or made the cache statistics worse.
+    static bool RunBenchmark();
+    // Simplifies closed spheres of 1k to 100k triangles into halving LODs the way CVulkanMeshLoader does, printing the
+    // triangles, error and enclosed volume of every LOD. Returns false if a LOD misses its target, has invalid triangles
+    // or its volume differs from full detail by more than its error allows.
+    static bool RunLodBenchmark();
+};
\ No newline at end of file
@@ -1,9 +1,27 @@
 #include "pipeline.hpp"
 
 #include <fstream>
+#include "descriptor.hpp"
 #include "types.hpp"
 
-CVulkanGraphicsPipeline::CVulkanGraphicsPipeline(std::shared_ptr<vk::raii::Device> device, std::string vertexShaderFile, std::string fragmentShaderFile, vk::Format colorFormat) {
+static std::vector<char> ReadSPIRVFile(std::string filename) {
+    std::ifstream inputStream(filename, std::ifstream::ate | std::ifstream::binary);
+    if(!inputStream.is_open()) {
+        printf("CVulkanPipeline::ReadFile: Failed to open %s", filename.c_str());
+    }
+
+    size_t fileLength = static_cast<size_t>(inputStream.tellg());
+    std::vector<char> fileContent(fileLength);
+    inputStream.seekg(0);
+    inputStream.read(fileContent.data(), fileLength);
+    inputStream.close();
+    return fileContent;
+}
+
+CVulkanGraphicsPipeline::CVulkanGraphicsPipeline(std::shared_ptr<vk::raii::Device> device, CVulkanDescriptorLayoutCache* descriptorLayoutCache, std::string vertexShaderFile,
+    std::string fragmentShaderFile, vk::Format colorFormat, const CVulkanVertexLayout& vertexLayout, const std::vector<vk::DescriptorSetLayoutBinding>& descriptorSetLayoutBindings,
+    vk::CullModeFlags cullMode, vk::DescriptorSetLayout bindlessSetLayout)
+    : vertexLayout(vertexLayout) {
     std::vector<vk::PipelineShaderStageCreateInfo> shaderStagesInfo;
 
     // Vertex Shader
@@ -20,9 +38,14 @@ CVulkanGraphicsPipeline::CVulkanGraphicsPipeline(std::shared_ptr<vk::raii::Devic
     vertexShaderStageInfo.setPName("main");
     shaderStagesInfo.push_back(vertexShaderStageInfo);
 
-    auto vertexInputAttributeDescriptions = CVulkanVertex::GetVkVertexInputAttributeDescriptions();
-    auto vertexInputBindingDescription = CVulkanVertex::GetVkVertexInputBindingDecription();
-    vk::PipelineVertexInputStateCreateInfo vertexInputStateInfo({}, vertexInputBindingDescription, vertexInputAttributeDescriptions);
+    // Binding 0 is per vertex, binding 1 per instance.
+    auto vertexInputAttributeDescriptions = vertexLayout.GetVkVertexInputAttributeDescriptions(0);
+    auto instanceInputAttributeDescriptions = CVulkanInstance::GetVkVertexInputAttributeDescriptions();
+    vertexInputAttributeDescriptions.insert(vertexInputAttributeDescriptions.end(), instanceInputAttributeDescriptions.begin(), instanceInputAttributeDescriptions.end());
+    std::vector<vk::VertexInputBindingDescription> vertexInputBindingDescriptions = {
+        vertexLayout.GetVkVertexInputBindingDescription(0), CVulkanInstance::GetVkVertexInputBindingDecription()
+    };
+    vk::PipelineVertexInputStateCreateInfo vertexInputStateInfo({}, vertexInputBindingDescriptions, vertexInputAttributeDescriptions);
 
     // Fragment Shader
     std::vector<char> fragmentShaderCode = ReadSPIRVFile(fragmentShaderFile);
@@ -47,7 +70,7 @@ CVulkanGraphicsPipeline::CVulkanGraphicsPipeline(std::shared_ptr<vk::raii::Devic
 
     vk::PipelineRasterizationStateCreateInfo rasterizationStateInfo;
     rasterizationStateInfo.setPolygonMode(vk::PolygonMode::eFill);
-    rasterizationStateInfo.setCullMode(vk::CullModeFlagBits::eNone);
+    rasterizationStateInfo.setCullMode(cullMode);
     rasterizationStateInfo.setFrontFace(vk::FrontFace::eCounterClockwise);
     rasterizationStateInfo.setLineWidth(1.0f);
 
@@ -65,13 +88,14 @@ CVulkanGraphicsPipeline::CVulkanGraphicsPipeline(std::shared_ptr<vk::raii::Devic
     auto dynamicStates = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
     vk::PipelineDynamicStateCreateInfo dynamicStateInfo({}, dynamicStates);
 
-    /*
-    auto descriptorSetLayoutInfo = vk::DescriptorSetLayoutCreateInfo({});
-    descriptorSetLayout = device.createDescriptorSetLayoutUnique(descriptorSetLayoutInfo);
+    // Transforms and the camera come from the descriptor set, nothing is pushed per object or per draw.
+    descriptorLayout = descriptorLayoutCache->Get(descriptorSetLayoutBindings);
 
-    auto pushConstantRange = vk::PushConstantRange(vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::mat4));
-    */
-    auto layoutInfo = vk::PipelineLayoutCreateInfo({});
+    std::vector<vk::DescriptorSetLayout> setLayouts = { descriptorLayout->GetVkDescriptorSetLayout() };
+    if(bindlessSetLayout) {
+        setLayouts.push_back(bindlessSetLayout);
+    }
+    vk::PipelineLayoutCreateInfo layoutInfo({}, setLayouts);
     layout = std::make_unique<vk::raii::PipelineLayout>(*device, layoutInfo);
 
     /*
@@ -104,16 +128,147 @@ vk::Pipeline CVulkanGraphicsPipeline::GetVkPipeline() {
     return **pipeline;
 }
 
-std::vector<char> CVulkanGraphicsPipeline::ReadSPIRVFile(std::string filename) {
-    std::ifstream inputStream(filename, std::ifstream::ate | std::ifstream::binary);
-    if(!inputStream.is_open()) {
-        printf("CVulkanPipeline::ReadFile: Failed to open %s", filename.c_str());
+vk::PipelineLayout CVulkanGraphicsPipeline::GetVkPipelineLayout() {
+    return **layout;
+}
+
+vk::DescriptorSetLayout CVulkanGraphicsPipeline::GetVkDescriptorSetLayout() {
+    return descriptorLayout->GetVkDescriptorSetLayout();
+}
+
+CVulkanDescriptorLayout* CVulkanGraphicsPipeline::GetDescriptorLayout() {
+    return descriptorLayout;
+}
+
+const CVulkanVertexLayout& CVulkanGraphicsPipeline::GetVertexLayout() {
+    return vertexLayout;
+}
+
+static vk::raii::ShaderModule CreateShaderModule(std::shared_ptr<vk::raii::Device> device, std::string shaderFile) {
+    std::vector<char> shaderCode = ReadSPIRVFile(shaderFile);
+    vk::ShaderModuleCreateInfo shaderModuleInfo;
+    shaderModuleInfo.codeSize = shaderCode.size();
+    shaderModuleInfo.pCode = reinterpret_cast<uint32_t*>(shaderCode.data());
+    return vk::raii::ShaderModule(*device, shaderModuleInfo);
+}
+
+CVulkanMeshShadingPipeline::CVulkanMeshShadingPipeline(std::shared_ptr<vk::raii::Device> device, CVulkanDescriptorLayoutCache* descriptorLayoutCache, std::string taskShaderFile,
+    std::string meshShaderFile, std::string fragmentShaderFile, vk::Format colorFormat, const std::vector<vk::DescriptorSetLayoutBinding>& descriptorSetLayoutBindings,
+    uint32_t pushConstantsSize, vk::CullModeFlags cullMode) {
+    vk::raii::ShaderModule taskShaderModule = CreateShaderModule(device, taskShaderFile);
+    vk::raii::ShaderModule meshShaderModule = CreateShaderModule(device, meshShaderFile);
+    vk::raii::ShaderModule fragmentShaderModule = CreateShaderModule(device, fragmentShaderFile);
+    std::vector<vk::PipelineShaderStageCreateInfo> shaderStagesInfo = {
+        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eTaskEXT, *taskShaderModule, "main"),
+        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eMeshEXT, *meshShaderModule, "main"),
+        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, *fragmentShaderModule, "main"),
+    };
+
+    // Vertex input and input assembly are not part of mesh shading pipelines.
+    vk::Viewport viewport;
+    vk::Rect2D scissor;
+    vk::PipelineViewportStateCreateInfo viewportStateInfo({}, viewport, scissor);
+
+    vk::PipelineRasterizationStateCreateInfo rasterizationStateInfo;
+    rasterizationStateInfo.setPolygonMode(vk::PolygonMode::eFill);
+    rasterizationStateInfo.setCullMode(cullMode);
+    rasterizationStateInfo.setFrontFace(vk::FrontFace::eCounterClockwise);
+    rasterizationStateInfo.setLineWidth(1.0f);
+
+    vk::PipelineMultisampleStateCreateInfo multisampleStateInfo;
+    multisampleStateInfo.setRasterizationSamples(vk::SampleCountFlagBits::e1);
+
+    vk::PipelineColorBlendAttachmentState colorBlendAttachmentState;
+    colorBlendAttachmentState.setBlendEnable(false);
+    colorBlendAttachmentState.setColorWriteMask(vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eA);
+
+    vk::PipelineColorBlendStateCreateInfo colorBlendStateInfo;
+    colorBlendStateInfo.setAttachments(colorBlendAttachmentState);
+
+    auto dynamicStates = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+    vk::PipelineDynamicStateCreateInfo dynamicStateInfo({}, dynamicStates);
+
+    descriptorLayout = descriptorLayoutCache->Get(descriptorSetLayoutBindings);
+
+    vk::DescriptorSetLayout setLayout = descriptorLayout->GetVkDescriptorSetLayout();
+    vk::PushConstantRange pushConstantRange(vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT, 0, pushConstantsSize);
+    vk::PipelineLayoutCreateInfo layoutInfo({}, setLayout);
+    if(pushConstantsSize > 0) {
+        layoutInfo.setPushConstantRanges(pushConstantRange);
     }
+    layout = std::make_unique<vk::raii::PipelineLayout>(*device, layoutInfo);
 
-    size_t fileLength = static_cast<size_t>(inputStream.tellg());
-    std::vector<char> fileContent(fileLength);
-    inputStream.seekg(0);
-    inputStream.read(fileContent.data(), fileLength);
-    inputStream.close();
-    return fileContent;
+    vk::PipelineRenderingCreateInfo pipelineRenderingInfo;
+    pipelineRenderingInfo.setColorAttachmentFormats(colorFormat);
+
+    vk::GraphicsPipelineCreateInfo pipelineInfo;
+    pipelineInfo.setStages(shaderStagesInfo);
+    pipelineInfo.setPViewportState(&viewportStateInfo);
+    pipelineInfo.setPRasterizationState(&rasterizationStateInfo);
+    pipelineInfo.setPMultisampleState(&multisampleStateInfo);
+    pipelineInfo.setPColorBlendState(&colorBlendStateInfo);
+    pipelineInfo.setPDynamicState(&dynamicStateInfo);
+    pipelineInfo.setLayout(**layout);
+    pipelineInfo.setPNext(&pipelineRenderingInfo);
+    pipeline = std::make_unique<vk::raii::Pipeline>(*device, nullptr, pipelineInfo);
+}
+
+vk::Pipeline CVulkanMeshShadingPipeline::GetVkPipeline() {
+    return **pipeline;
+}
+
+vk::PipelineLayout CVulkanMeshShadingPipeline::GetVkPipelineLayout() {
+    return **layout;
+}
+
+vk::DescriptorSetLayout CVulkanMeshShadingPipeline::GetVkDescriptorSetLayout() {
+    return descriptorLayout->GetVkDescriptorSetLayout();
+}
+
+CVulkanDescriptorLayout* CVulkanMeshShadingPipeline::GetDescriptorLayout() {
+    return descriptorLayout;
+}
+
+CVulkanComputePipeline::CVulkanComputePipeline(std::shared_ptr<vk::raii::Device> device, CVulkanDescriptorLayoutCache* descriptorLayoutCache, std::string computeShaderFile,
+    const std::vector<vk::DescriptorSetLayoutBinding>& descriptorSetLayoutBindings, uint32_t pushConstantsSize) {
+    std::vector<char> computeShaderCode = ReadSPIRVFile(computeShaderFile);
+    vk::ShaderModuleCreateInfo computeShaderModuleInfo;
+    computeShaderModuleInfo.codeSize = computeShaderCode.size();
+    computeShaderModuleInfo.pCode = reinterpret_cast<uint32_t*>(computeShaderCode.data());
+
+    vk::raii::ShaderModule computeShaderModule = vk::raii::ShaderModule(*device, computeShaderModuleInfo);
+
+    vk::PipelineShaderStageCreateInfo computeShaderStageInfo;
+    computeShaderStageInfo.setStage(vk::ShaderStageFlagBits::eCompute);
+    computeShaderStageInfo.setModule(*computeShaderModule);
+    computeShaderStageInfo.setPName("main");
+
+    descriptorLayout = descriptorLayoutCache->Get(descriptorSetLayoutBindings);
+
+    vk::DescriptorSetLayout setLayout = descriptorLayout->GetVkDescriptorSetLayout();
+    vk::PushConstantRange pushConstantRange(vk::ShaderStageFlagBits::eCompute, 0, pushConstantsSize);
+    vk::PipelineLayoutCreateInfo layoutInfo({}, setLayout);
+    if(pushConstantsSize > 0) {
+        layoutInfo.setPushConstantRanges(pushConstantRange);
+    }
+    layout = std::make_unique<vk::raii::PipelineLayout>(*device, layoutInfo);
+
+    vk::ComputePipelineCreateInfo pipelineInfo({}, computeShaderStageInfo, **layout);
+    pipeline = std::make_unique<vk::raii::Pipeline>(*device, nullptr, pipelineInfo);
+}
+
+vk::Pipeline CVulkanComputePipeline::GetVkPipeline() {
+    return **pipeline;
+}
+
+vk::PipelineLayout CVulkanComputePipeline::GetVkPipelineLayout() {
+    return **layout;
+}
+
+vk::DescriptorSetLayout CVulkanComputePipeline::GetVkDescriptorSetLayout() {
+    return descriptorLayout->GetVkDescriptorSetLayout();
+}
+
+CVulkanDescriptorLayout* CVulkanComputePipeline::GetDescriptorLayout() {
+    return descriptorLayout;
 }
@@ -1,24 +1,60 @@
 #pragma once
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_raii.hpp>
+#include "vertexformat.hpp"
+
+class CVulkanDescriptorLayout;
+class CVulkanDescriptorLayoutCache;
 
 class CVulkanGraphicsPipeline {
+    CVulkanDescriptorLayout* descriptorLayout; // Owned by the CVulkanDescriptorLayoutCache, outlives the pipeline.
+    std::unique_ptr<vk::raii::PipelineLayout> layout;
     std::unique_ptr<vk::raii::Pipeline> pipeline;
+    CVulkanVertexLayout vertexLayout;
+public:
+    // Vertex buffers drawn with the pipeline must be encoded with vertexLayout. Counter clockwise triangles face the front.
+    // Takes a descriptor set of the given bindings, usually CVulkanTransformBuffer::GetDescriptorSetLayoutBindings(), and
+    // bindlessSetLayout as set 1 when given, see CVulkanBindlessHeap.
+    CVulkanGraphicsPipeline(std::shared_ptr<vk::raii::Device> device, CVulkanDescriptorLayoutCache* descriptorLayoutCache, std::string vertexShaderFile,
+        std::string fragmentShaderFile, vk::Format colorFormat, const CVulkanVertexLayout& vertexLayout,
+        const std::vector<vk::DescriptorSetLayoutBinding>& descriptorSetLayoutBindings, vk::CullModeFlags cullMode = vk::CullModeFlagBits::eNone,
+        vk::DescriptorSetLayout bindlessSetLayout = nullptr);
+    vk::Pipeline GetVkPipeline();
+    vk::PipelineLayout GetVkPipelineLayout();
+    vk::DescriptorSetLayout GetVkDescriptorSetLayout();
+    // The layout of set 0, for allocating and writing its sets through CVulkanDescriptorAllocator.
+    CVulkanDescriptorLayout* GetDescriptorLayout();
+    const CVulkanVertexLayout& GetVertexLayout();
+};
+
+// Graphics pipeline generating its geometry with a task and a mesh shader instead of vertex input, with a single descriptor
+// set of the given bindings and push constants for the task and mesh stages. Needs CVulkanDevice::IsMeshShadingEnabled().
+class CVulkanMeshShadingPipeline {
+    CVulkanDescriptorLayout* descriptorLayout; // Owned by the CVulkanDescriptorLayoutCache, outlives the pipeline.
     std::unique_ptr<vk::raii::PipelineLayout> layout;
-    std::unique_ptr<vk::raii::DescriptorSet> descriptorSet;
-    std::unique_ptr<vk::raii::DescriptorSetLayout> descriptorSetLayout;
+    std::unique_ptr<vk::raii::Pipeline> pipeline;
 public:
-    CVulkanGraphicsPipeline(std::shared_ptr<vk::raii::Device> device, std::string vertexShaderFile, std::string fragmentShaderFile, vk::Format colorFormat);
+    CVulkanMeshShadingPipeline(std::shared_ptr<vk::raii::Device> device, CVulkanDescriptorLayoutCache* descriptorLayoutCache, std::string taskShaderFile,
+        std::string meshShaderFile, std::string fragmentShaderFile, vk::Format colorFormat, const std::vector<vk::DescriptorSetLayoutBinding>& descriptorSetLayoutBindings, uint32_t pushConstantsSize = 0,
+        vk::CullModeFlags cullMode = vk::CullModeFlagBits::eNone);
     vk::Pipeline GetVkPipeline();
-private:
-    std::vector<char> ReadSPIRVFile(std::string filename);
+    vk::PipelineLayout GetVkPipelineLayout();
+    vk::DescriptorSetLayout GetVkDescriptorSetLayout();
+    // The layout of set 0, for allocating and writing its sets through CVulkanDescriptorAllocator.
+    CVulkanDescriptorLayout* GetDescriptorLayout();
 };
 
+// Compute pipeline with a single descriptor set of the given bindings and push constants for the compute stage.
 class CVulkanComputePipeline {
-    std::shared_ptr<vk::raii::Pipeline> pipeline;
+    CVulkanDescriptorLayout* descriptorLayout; // Owned by the CVulkanDescriptorLayoutCache, outlives the pipeline.
+    std::unique_ptr<vk::raii::PipelineLayout> layout;
+    std::unique_ptr<vk::raii::Pipeline> pipeline;
 public:
-    CVulkanComputePipeline() = default;
-    CVulkanComputePipeline(std::shared_ptr<vk::raii::Device> device, std::string computeShaderFile) {
-
-    }
+    CVulkanComputePipeline(std::shared_ptr<vk::raii::Device> device, CVulkanDescriptorLayoutCache* descriptorLayoutCache, std::string computeShaderFile,
+        const std::vector<vk::DescriptorSetLayoutBinding>& descriptorSetLayoutBindings, uint32_t pushConstantsSize = 0);
+    vk::Pipeline GetVkPipeline();
+    vk::PipelineLayout GetVkPipelineLayout();
+    vk::DescriptorSetLayout GetVkDescriptorSetLayout();
+    // The layout of set 0, for allocating and writing its sets through CVulkanDescriptorAllocator.
+    CVulkanDescriptorLayout* GetDescriptorLayout();
 };
\ No newline at end of file
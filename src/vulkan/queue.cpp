@@ -2,37 +2,73 @@
 
 #include "cmd.hpp"
 
-CVulkanQueue::CVulkanQueue(std::shared_ptr<vk::raii::Device> device, uint32_t familyIndex) : device(device), familyIndex(familyIndex) {
-    queue = std::make_shared<vk::raii::Queue>(*device, familyIndex, 0);
+CVulkanQueue::CVulkanQueue(std::shared_ptr<vk::raii::Device> device, uint32_t familyIndex, uint32_t queueIndex) 
+    : device(device), timelineValue(0), familyIndex(familyIndex), queueIndex(queueIndex) {
+    queue = std::make_shared<vk::raii::Queue>(*device, familyIndex, queueIndex);
+
+    vk::SemaphoreTypeCreateInfo semaphoreTypeInfo(vk::SemaphoreType::eTimeline, timelineValue);
+    timeline = std::make_unique<vk::raii::Semaphore>(*device, vk::SemaphoreCreateInfo({}, &semaphoreTypeInfo));
 }
 
 CVulkanQueue::~CVulkanQueue() {
     queue->waitIdle();
 }
 
-void CVulkanQueue::Submit(std::shared_ptr<CVulkanCommandBuffer> commandBuffer, vk::Semaphore submitSemaphore,
+CVulkanSubmitTicket CVulkanQueue::Submit(std::shared_ptr<CVulkanCommandBuffer> commandBuffer, vk::Semaphore submitSemaphore,
     vk::Semaphore waitSemaphore, vk::PipelineStageFlags waitSemaphoreFlags,
-    vk::Fence signalFence) {
-    vk::SubmitInfo submitInfo;
-    std::vector<vk::PipelineStageFlags> waitSemaphoreDestinationFlags = {};
-    auto vkCommandBuffer = commandBuffer->GetVkCommandBuffer();
+    vk::Fence signalFence, std::vector<CVulkanSubmitTicket> waitTickets,
+    vk::PipelineStageFlags waitTicketFlags) {
+    // Binary semaphores take a value too when mixed with timeline semaphores, it is ignored.
+    std::vector<vk::Semaphore> waitSemaphores;
+    std::vector<vk::PipelineStageFlags> waitSemaphoreDestinationFlags;
+    std::vector<uint64_t> waitSemaphoreValues;
     if(waitSemaphore) {
+        waitSemaphores.push_back(waitSemaphore);
         waitSemaphoreDestinationFlags.push_back(waitSemaphoreFlags);
-        submitInfo = vk::SubmitInfo(waitSemaphore, waitSemaphoreDestinationFlags, vkCommandBuffer, submitSemaphore);
-    } else {
-        submitInfo = vk::SubmitInfo(nullptr, waitSemaphoreDestinationFlags, vkCommandBuffer);
+        waitSemaphoreValues.push_back(0);
     }
-
-    if(signalFence) {
-        queue->submit(submitInfo, signalFence);
-    } else { // If we do not have a fence already, create one and wait for it to be signalled.
-        auto fence = vk::raii::Fence(*device, vk::FenceCreateInfo());
-        queue->submit(submitInfo, *fence);
-        vk::Result waitForFencesResult = device->waitForFences(*fence, true, std::numeric_limits<uint64_t>::max());
-        if(waitForFencesResult != vk::Result::eSuccess) {
-            printf("CVulkanQueue::Submit: Failed to wait for fence");
+    for(auto& ticket : waitTickets) {
+        if(ticket.semaphore && ticket.value > 0) {
+            waitSemaphores.push_back(ticket.semaphore);
+            waitSemaphoreDestinationFlags.push_back(waitTicketFlags);
+            waitSemaphoreValues.push_back(ticket.value);
         }
     }
+
+    timelineValue++;
+    std::vector<vk::Semaphore> signalSemaphores = { **timeline };
+    std::vector<uint64_t> signalSemaphoreValues = { timelineValue };
+    if(submitSemaphore) {
+        signalSemaphores.push_back(submitSemaphore);
+        signalSemaphoreValues.push_back(0);
+    }
+
+    auto vkCommandBuffer = commandBuffer->GetVkCommandBuffer();
+    vk::TimelineSemaphoreSubmitInfo timelineSubmitInfo(waitSemaphoreValues, signalSemaphoreValues);
+    vk::SubmitInfo submitInfo(waitSemaphores, waitSemaphoreDestinationFlags, vkCommandBuffer, signalSemaphores, &timelineSubmitInfo);
+    queue->submit(submitInfo, signalFence);
+    return CVulkanSubmitTicket { **timeline, timelineValue };
+}
+
+bool CVulkanQueue::IsComplete(CVulkanSubmitTicket ticket) {
+    if(!ticket.semaphore || ticket.value == 0) {
+        return true;
+    }
+    return device->waitSemaphores(vk::SemaphoreWaitInfo({}, ticket.semaphore, ticket.value), 0) == vk::Result::eSuccess;
+}
+
+void CVulkanQueue::Wait(CVulkanSubmitTicket ticket) {
+    if(!ticket.semaphore || ticket.value == 0) {
+        return;
+    }
+    vk::Result waitSemaphoresResult = device->waitSemaphores(vk::SemaphoreWaitInfo({}, ticket.semaphore, ticket.value), std::numeric_limits<uint64_t>::max());
+    if(waitSemaphoresResult != vk::Result::eSuccess) {
+        printf("CVulkanQueue::Wait: Failed to wait for semaphore");
+    }
+}
+
+CVulkanSubmitTicket CVulkanQueue::GetLastTicket() {
+    return CVulkanSubmitTicket { **timeline, timelineValue };
 }
 
 CVulkanCommandPool CVulkanQueue::CreateCommandPool(vk::CommandPoolCreateFlags flags) {
@@ -45,4 +81,4 @@ std::shared_ptr<vk::raii::Queue> CVulkanQueue::GetVkQueue() {
 
 uint32_t CVulkanQueue::GetFamilyIndex() {
     return familyIndex;
-}
+}
\ No newline at end of file
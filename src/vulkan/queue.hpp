@@ -5,16 +5,31 @@
 class CVulkanCommandBuffer;
 class CVulkanCommandPool;
 
+// Identifies a submission by the value its queue's timeline semaphore reaches once the submission completes.
+struct CVulkanSubmitTicket {
+    vk::Semaphore semaphore;
+    uint64_t value = 0;
+};
+
 class CVulkanQueue {
     std::shared_ptr<vk::raii::Device> device;
     std::shared_ptr<vk::raii::Queue> queue;
+    std::unique_ptr<vk::raii::Semaphore> timeline;
+    uint64_t timelineValue;
     uint32_t familyIndex;
+    uint32_t queueIndex;
 public:
-    CVulkanQueue(std::shared_ptr<vk::raii::Device> device, uint32_t familyIndex);
+    CVulkanQueue(std::shared_ptr<vk::raii::Device> device, uint32_t familyIndex, uint32_t queueIndex = 0);
     ~CVulkanQueue();
-    void Submit(std::shared_ptr<CVulkanCommandBuffer> commandBuffer, vk::Semaphore submitSemaphore = nullptr,
+    // Submits without waiting, the returned ticket can be polled, waited on or passed as waitTickets to a submission on another queue.
+    CVulkanSubmitTicket Submit(std::shared_ptr<CVulkanCommandBuffer> commandBuffer, vk::Semaphore submitSemaphore = nullptr,
         vk::Semaphore waitSemaphore = nullptr, vk::PipelineStageFlags waitSemaphoreFlags = {},
-        vk::Fence signalFence = nullptr);
+        vk::Fence signalFence = nullptr, std::vector<CVulkanSubmitTicket> waitTickets = {},
+        vk::PipelineStageFlags waitTicketFlags = vk::PipelineStageFlagBits::eAllCommands);
+    bool IsComplete(CVulkanSubmitTicket ticket);
+    void Wait(CVulkanSubmitTicket ticket);
+    // Ticket of the most recent submission, waiting on it waits for everything submitted to this queue so far.
+    CVulkanSubmitTicket GetLastTicket();
     CVulkanCommandPool CreateCommandPool(vk::CommandPoolCreateFlags flags = {});
     std::shared_ptr<vk::raii::Queue> GetVkQueue();
     uint32_t GetFamilyIndex();
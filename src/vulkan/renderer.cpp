@@ -1,16 +1,22 @@
 #include "renderer.hpp"
 
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include "importer/gltf.hpp"
+#include "image.hpp"
+
 std::vector<CVulkanVertex> vertices = {
-    CVulkanVertex(glm::vec2(0.0f, -0.5f), glm::vec3(1.0, .0f, 0.0f)),
-    CVulkanVertex(glm::vec2(0.5f, 0.5f), glm::vec3(0.0f, 1.0f, 0.0f)),
-    CVulkanVertex(glm::vec2(-0.5f, 0.5f), glm::vec3(0.0f, 0.0f, 1.0f)),
+    CVulkanVertex(glm::vec3(0.0f, -0.5f, 0.0f), glm::vec3(1.0, .0f, 0.0f)),
+    CVulkanVertex(glm::vec3(0.5f, 0.5f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+    CVulkanVertex(glm::vec3(-0.5f, 0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
 };
 
-std::vector<uint16_t> indices = {
+std::vector<uint32_t> indices = {
     0, 1, 2
 };
 
-CVulkanRenderer::CVulkanRenderer(CSDLWindow* window) {
+CVulkanRenderer::CVulkanRenderer(CSDLWindow* window, CVulkanRendererOptions options) {
     window->AddEventCallback(static_cast<void*>(this), SDL_EventFilterCallback); // Add callback when certain events fire.
 
     instance = std::make_unique<CVulkanInstance>(window->GetSDL_Window());
@@ -21,51 +27,219 @@ CVulkanRenderer::CVulkanRenderer(CSDLWindow* window) {
 
     int imageCount = 2;
     swapchain = std::make_unique<CVulkanSwapchain>(instance.get(), device.get(), graphicsQueue.get(), window->GetSDL_Window(), imageCount, true);
+    descriptorAllocator = std::make_unique<CVulkanDescriptorAllocator>(device.get(), imageCount);
 
-    graphicsCommandPool = std::make_unique<CVulkanCommandPool>(graphicsQueue->CreateCommandPool());
     computeCommandPool = std::make_unique<CVulkanCommandPool>(computeQueue->CreateCommandPool());
-    transferCommandPool = std::make_unique<CVulkanCommandPool>(transferQueue->CreateCommandPool(vk::CommandPoolCreateFlagBits::eResetCommandBuffer)); // Reset command buffers instead for transfer operations instead of the whole pool.
+    stagingRing = std::make_unique<CVulkanStagingRing>(device.get(), transferQueue.get(), graphicsQueue->GetFamilyIndex());
 
     for(int i = 0; i < imageCount; i++) {
-        graphicsCommandBuffers.push_back(std::make_shared<CVulkanCommandBuffer>(graphicsCommandPool->CreateCommandBuffer()));
+        graphicsCommandPools.push_back(std::make_unique<CVulkanCommandPool>(graphicsQueue->CreateCommandPool(vk::CommandPoolCreateFlagBits::eTransient)));
+        graphicsCommandBuffers.push_back(std::make_shared<CVulkanCommandBuffer>(graphicsCommandPools[i]->CreateCommandBuffer()));
     }
+    frameTimer = std::make_unique<CVulkanFrameTimer>(device.get(), graphicsQueue.get(), imageCount);
+    barrierTracker = std::make_unique<CVulkanBarrierTracker>();
+    renderGraph = std::make_unique<CVulkanRenderGraph>(device.get(), barrierTracker.get());
 
     computeCommandBuffer = std::make_shared<CVulkanCommandBuffer>(computeCommandPool->CreateCommandBuffer());
-    transferCommandBuffer = std::make_shared<CVulkanCommandBuffer>(transferCommandPool->CreateCommandBuffer());
 
     auto surfaceFormat = swapchain->GetVkSurfaceFormat();
-    pipeline = std::make_unique<CVulkanGraphicsPipeline>(device->CreateGraphicsPipeline("shaders/vertex.spv", "shaders/fragment.spv", surfaceFormat));
+    // Draws select their material and textures by index with descriptor indexing, and are drawn with vertex colors only without it.
+    vk::DescriptorSet bindlessSet;
+    if(device->IsBindlessEnabled()) {
+        bindlessHeap = std::make_unique<CVulkanBindlessHeap>(device.get(), barrierTracker.get());
+        bindlessSet = bindlessHeap->GetVkDescriptorSet();
+        pipeline = std::make_unique<CVulkanGraphicsPipeline>(device->CreateGraphicsPipeline("shaders/vertex.spv", "shaders/material.spv", surfaceFormat,
+            CVulkanVertexLayout::Compact(), CVulkanTransformBuffer::GetDescriptorSetLayoutBindings(device.get()), vk::CullModeFlagBits::eNone,
+            bindlessHeap->GetVkDescriptorSetLayout()));
+    } else {
+        printf("CVulkanRenderer::CVulkanRenderer: Device lacks descriptor indexing, drawing without materials\n");
+        pipeline = std::make_unique<CVulkanGraphicsPipeline>(device->CreateGraphicsPipeline("shaders/vertex.spv", "shaders/fragment.spv", surfaceFormat,
+            CVulkanVertexLayout::Compact(), CVulkanTransformBuffer::GetDescriptorSetLayoutBindings(device.get())));
+    }
+
+    threadPool = std::make_unique<CThreadPool>(options.recordingThreads);
+    meshRenderer = std::make_unique<CVulkanMeshRenderer>(device.get(), graphicsQueue->GetFamilyIndex(), pipeline.get(), descriptorAllocator.get(), graphicsCommandBuffers,
+        threadPool.get(), surfaceFormat, bindlessSet);
+    meshRenderer->SetLodsEnabled(options.lods);
+    meshLoader = std::make_unique<CVulkanMeshLoader>(device.get(), stagingRing.get(), pipeline->GetVertexLayout());
+    stagingRing->BeginBatch();
+    CVulkanMeshLoadOptions loadOptions;
+    loadOptions.meshlets = options.meshShading;
+    meshes.push_back(std::make_shared<CVulkanMesh>(meshLoader->Load(vertices, indices, loadOptions)));
+    if(options.benchmarkScene) {
+        CGltfImporter importer("models/Box.gltf", meshLoader.get());
+        CVulkanMesh box = importer.Load();
+        if(box.vertices.empty()) {
+            // Instancing the triangle instead would benchmark a different scene.
+            printf("CVulkanRenderer::CVulkanRenderer: Benchmark scene needs models/Box.gltf and models/Box0.bin next to the executable\n");
+            throw std::runtime_error("Failed to load the benchmark model models/Box.gltf");
+        }
+        meshes.push_back(std::make_shared<CVulkanMesh>(std::move(box)));
+    }
+    if(options.meshShading) {
+        if(device->IsMeshShadingEnabled() || device->IsGpuDrivenRenderingEnabled()) {
+            meshletRenderer = std::make_unique<CVulkanMeshletRenderer>(device.get(), surfaceFormat, barrierTracker.get(), descriptorAllocator.get(), imageCount);
+            meshletRenderer->SetMeshes(meshes, stagingRing.get());
+            printf("CVulkanRenderer::CVulkanRenderer: Drawing meshlets with %s\n", meshletRenderer->IsMeshShading() ? "mesh shaders" : "compute culled indirect draws");
+        } else {
+            printf("CVulkanRenderer::CVulkanRenderer: Device lacks mesh shaders and drawIndirectCount, drawing from the CPU\n");
+        }
+    } else if(options.gpuDriven) {
+        if(device->IsGpuDrivenRenderingEnabled()) {
+            indirectRenderer = std::make_unique<CVulkanIndirectRenderer>(device.get(), pipeline.get(), barrierTracker.get(), descriptorAllocator.get(), imageCount,
+                bindlessSet);
+            indirectRenderer->SetMeshes(meshes, stagingRing.get());
+        } else {
+            printf("CVulkanRenderer::CVulkanRenderer: Device lacks multiDrawIndirect or drawIndirectCount, drawing from the CPU\n");
+        }
+    }
+    stagingRing->EndBatch();
+
+    if(options.benchmarkScene) {
+        // Square grid covering the screen, one instance per cell.
+        uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(BENCHMARK_INSTANCE_COUNT))));
+        float cellSize = 2.0f / columns;
+        instances.reserve(BENCHMARK_INSTANCE_COUNT);
+        for(uint32_t i = 0; i < BENCHMARK_INSTANCE_COUNT; i++) {
+            CVulkanMeshInstance meshInstance;
+            meshInstance.mesh = meshes.back();
+            meshInstance.SetLocation(glm::vec3(-1.0f + (i % columns + 0.5f) * cellSize, -1.0f + (i / columns + 0.5f) * cellSize, 0.0f));
+            meshInstance.SetScale(glm::vec3(cellSize * 0.8f));
+            instances.push_back(meshInstance);
+        }
+    } else {
+        CVulkanMeshInstance meshInstance;
+        meshInstance.mesh = meshes.front();
+        instances.push_back(meshInstance);
+    }
+    if(bindlessHeap) {
+        for(auto& meshInstance : instances) {
+            if(meshInstance.material && meshInstance.material->handle == ~0u) {
+                bindlessHeap->AddMaterial(meshInstance.material.get());
+            }
+        }
+    }
+    if(indirectRenderer) {
+        for(auto& meshInstance : instances) {
+            indirectRenderer->AddObject(meshInstance.mesh, meshInstance.worldTransform, meshInstance.material && meshInstance.material->handle != ~0u ? meshInstance.material->handle : 0);
+        }
+    }
+    if(meshletRenderer) {
+        for(auto& meshInstance : instances) {
+            meshletRenderer->AddObject(meshInstance.mesh, meshInstance.worldTransform);
+        }
+    }
+    ui = std::make_unique<CVulkanUi>(window->GetSDL_Window(), instance.get(), device.get(), graphicsQueue.get(), graphicsCommandPools.front().get(), graphicsCommandBuffers, 2, surfaceFormat,
+        descriptorAllocator.get());
+}
 
-    meshRenderer = std::make_unique<CVulkanMeshRenderer>(pipeline.get(), graphicsCommandBuffers);
-    meshLoader = std::make_unique<CVulkanMeshLoader>(device.get(), transferQueue.get(), transferCommandBuffer);
-    meshes.push_back(std::make_shared<CVulkanMesh>(meshLoader->Load(vertices, indices)));
-    ui = std::make_unique<CVulkanUi>(window->GetSDL_Window(), instance.get(), device.get(), graphicsQueue.get(), graphicsCommandPool.get(), graphicsCommandBuffers, 2, surfaceFormat);
+CVulkanRenderer::~CVulkanRenderer() {
+    // Frames are no longer waited on every frame, the last ones may still be using the command pools.
+    device->GetVkDevice()->waitIdle();
 }
 
 void CVulkanRenderer::OnResize() {
     swapchain->Recreate();
 }
 
+bool CVulkanRenderer::RunBlitTest() {
+    return CVulkanImageLoader::RunBlitTest(device.get(), graphicsQueue.get());
+}
+
 void CVulkanRenderer::DrawFrame() {
-    CVulkanFrame frame = swapchain->GetNextFrame();
-    graphicsCommandPool->Reset();
-    CVulkanRender render;
-    render.colorAttachments = { vk::RenderingAttachmentInfo(frame.imageView, vk::ImageLayout::eColorAttachmentOptimal,
-                                                vk::ResolveModeFlagBits::eNone, nullptr, vk::ImageLayout::eUndefined,
-                                                vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eStore,
-                                                vk::ClearColorValue(0.0f, 0.0f, 0.0f, 1.0f)) };
+    auto frameStart = std::chrono::steady_clock::now();
+    CVulkanFrame frame = swapchain->GetNextFrame(); // Waits on this frame's fence, the other frames keep running on the GPU.
+    auto frameAcquired = std::chrono::steady_clock::now();
+    graphicsCommandPools[frame.currentFrame]->Reset();
+    descriptorAllocator->BeginFrame(frame.currentFrame);
+    frameTimer->BeginFrame(frame.currentFrame);
 
-    auto currentCommandBuffer = graphicsCommandBuffers[frame.currentFrame];
-    currentCommandBuffer->BeginPass(&frame, &render);
+    // The old contents of the image are discarded, the acquire semaphore is waited on in eColorAttachmentOutput.
+    CVulkanResourceState acquiredState;
+    acquiredState.writeStages = vk::PipelineStageFlagBits2::eColorAttachmentOutput;
+    renderGraph->Reset();
+    uint32_t backbuffer = renderGraph->ImportImage("backbuffer", frame.image, frame.imageView, frame.extent, swapchain->GetVkSurfaceFormat(),
+        acquiredState, vk::ImageLayout::ePresentSrcKHR);
+    vk::AttachmentLoadOp meshLoadOp = vk::AttachmentLoadOp::eClear;
 #ifdef _DEBUG
-    ui->Draw(&frame);
-    meshRenderer->Draw(&frame, meshes);
-#else
-    meshRenderer->Draw(&frame, meshes);
+    // The ui records inline, meshes may need a rendering scope of their own for secondary command buffers.
+    uint32_t uiPass = renderGraph->AddPass("ui", [this](CVulkanCommandBuffer* commandBuffer, CVulkanFrame* passFrame) {
+        ui->Draw(passFrame);
+    });
+    renderGraph->AddColorAttachment(uiPass, backbuffer, vk::AttachmentLoadOp::eClear);
+    meshLoadOp = vk::AttachmentLoadOp::eLoad;
 #endif
-    currentCommandBuffer->EndPass(&frame);
-    graphicsQueue->Submit(currentCommandBuffer, frame.submitSemaphore, frame.acquireSemaphore, vk::PipelineStageFlagBits::eColorAttachmentOutput, frame.acquireFence);
+    // The scene is laid out in clip space, so the camera uploaded to every path is the identity.
+    glm::mat4 viewProjection(1.0f);
+    if(indirectRenderer || meshletRenderer) {
+        uint32_t cullPass = renderGraph->AddPass("cull", [this, viewProjection](CVulkanCommandBuffer* commandBuffer, CVulkanFrame* passFrame) {
+            if(meshletRenderer) {
+                meshletRenderer->Cull(commandBuffer, passFrame, viewProjection);
+            } else {
+                indirectRenderer->Cull(commandBuffer, passFrame, viewProjection);
+            }
+        });
+        renderGraph->SetSideEffects(cullPass);
+    }
+    // The indirect and mesh task draws are recorded inline, there is only one.
+    bool gpuDriven = indirectRenderer || meshletRenderer;
+    uint32_t meshPass = renderGraph->AddPass("meshes", [this, viewProjection](CVulkanCommandBuffer* commandBuffer, CVulkanFrame* passFrame) {
+        if(meshletRenderer) {
+            meshletRenderer->Draw(commandBuffer, passFrame);
+        } else if(indirectRenderer) {
+            indirectRenderer->Draw(commandBuffer, passFrame);
+        } else {
+            meshRenderer->Draw(passFrame, instances, viewProjection);
+        }
+    }, gpuDriven ? vk::RenderingFlags() : meshRenderer->GetRenderingFlags());
+    renderGraph->AddColorAttachment(meshPass, backbuffer, meshLoadOp);
+    renderGraph->Compile();
+
+    // Uploads run on the transfer queue alongside rendering, only the stages reading them wait for them to land.
+    vk::PipelineStageFlags uploadStages = vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eFragmentShader |
+        vk::PipelineStageFlagBits::eTransfer;
+    if(meshletRenderer && meshletRenderer->IsMeshShading()) {
+        uploadStages |= vk::PipelineStageFlagBits::eTaskShaderEXT | vk::PipelineStageFlagBits::eMeshShaderEXT;
+    }
+    CVulkanSubmitTicket uploadTicket = stagingRing->Flush();
+    CVulkanOwnershipAcquire uploadAcquires = stagingRing->TakeOwnershipAcquires();
+
+    auto currentCommandBuffer = graphicsCommandBuffers[frame.currentFrame];
+    currentCommandBuffer->Begin();
+    frameTimer->WriteBeginTimestamp(currentCommandBuffer.get(), frame.currentFrame);
+    if(bindlessHeap) {
+        bindlessHeap->Upload(currentCommandBuffer.get());
+    }
+    // Synchronization2 stage bits keep the values of the original ones.
+    vk::PipelineStageFlags2 uploadStages2(static_cast<VkPipelineStageFlags>(uploadStages));
+    for(auto& acquire : uploadAcquires.bufferBarriers) {
+        barrierTracker->AcquireBuffer(acquire.buffer, acquire.offset, acquire.size, acquire.srcQueueFamilyIndex, acquire.dstQueueFamilyIndex,
+            uploadStages2, acquire.dstAccessMask);
+    }
+    for(auto& acquire : uploadAcquires.imageBarriers) {
+        barrierTracker->AcquireImage(acquire.image, acquire.oldLayout, acquire.newLayout, acquire.srcQueueFamilyIndex, acquire.dstQueueFamilyIndex,
+            uploadStages2, acquire.dstAccessMask, acquire.subresourceRange);
+    }
+    barrierTracker->Flush(currentCommandBuffer.get());
+    for(auto& mipmapRequest : uploadAcquires.mipmapRequests) {
+        currentCommandBuffer->GenerateMipmaps(barrierTracker.get(), mipmapRequest.image, mipmapRequest.extent, mipmapRequest.mipLevels, uploadStages2);
+    }
+    renderGraph->Execute(currentCommandBuffer.get(), &frame);
+    frameTimer->WriteEndTimestamp(currentCommandBuffer.get(), frame.currentFrame);
+    currentCommandBuffer->End();
+    graphicsQueue->Submit(currentCommandBuffer, frame.submitSemaphore, frame.acquireSemaphore, vk::PipelineStageFlagBits::eColorAttachmentOutput, frame.acquireFence,
+        { uploadTicket }, uploadStages);
     swapchain->Present();
+
+    auto frameEnd = std::chrono::steady_clock::now();
+    CVulkanBarrierStatistics barrierStatistics = barrierTracker->TakeStatistics();
+    CVulkanBarrierStatistics uploadBarrierStatistics = stagingRing->TakeBarrierStatistics(); // Transitions and releases on the transfer queue.
+    barrierStatistics.barrierCount += uploadBarrierStatistics.barrierCount;
+    barrierStatistics.batchCount += uploadBarrierStatistics.batchCount;
+    barrierStatistics.skippedCount += uploadBarrierStatistics.skippedCount;
+    frameTimer->EndFrame(std::chrono::duration<double, std::milli>(frameEnd - frameAcquired).count(),
+        std::chrono::duration<double, std::milli>(frameAcquired - frameStart).count(), barrierStatistics,
+        meshletRenderer ? meshletRenderer->GetDrawStatistics() : indirectRenderer ? indirectRenderer->GetDrawStatistics() : meshRenderer->GetDrawStatistics());
 }
 
 int CVulkanRenderer::SDL_EventFilterCallback(void* userdata, SDL_Event* event) {
@@ -5,6 +5,7 @@
 #include <SDL2/SDL.h>
 
 #include "system/window.hpp"
+#include "system/threadpool.hpp"
 #include "instance.hpp"
 #include "device.hpp"
 #include "queue.hpp"
@@ -13,37 +14,70 @@
 #include "buffer.hpp"
 #include "pipeline.hpp"
 #include "mesh.hpp"
+#include "transform.hpp"
+#include "descriptor.hpp"
+#include "bindless.hpp"
+#include "staging.hpp"
+#include "timer.hpp"
+#include "barrier.hpp"
+#include "graph.hpp"
+#include "indirect.hpp"
+#include "meshshading.hpp"
 #include "ui.hpp"
 #include "types.hpp"
 
+struct CVulkanRendererOptions {
+    bool benchmarkScene = false; // Replaces the triangle with a grid of BENCHMARK_INSTANCE_COUNT boxes from models/Box.gltf.
+    bool gpuDriven = false; // Culls and emits draws on the GPU through CVulkanIndirectRenderer when the device supports it.
+    bool meshShading = false; // Culls and draws meshlets on the GPU through CVulkanMeshletRenderer, ahead of gpuDriven.
+    bool lods = true; // Draws mesh instances at the LOD their screen-space error allows instead of at full detail.
+    uint32_t recordingThreads = 0; // Threads recording the secondary command buffers of the mesh renderer, 0 uses one per hardware thread.
+};
+
 class CVulkanRenderer {
     std::unique_ptr<CVulkanInstance> instance;
     std::unique_ptr<CVulkanDevice> device;
+    // Queues are declared early so that everything submitting to them is destroyed first.
+    std::unique_ptr<CVulkanQueue> graphicsQueue;
+    std::unique_ptr<CVulkanQueue> computeQueue;
+    std::unique_ptr<CVulkanQueue> transferQueue;
     std::unique_ptr<CVulkanSwapchain> swapchain;
+    // Sets of every renderer and the ui come from here, so it is declared before them and outlives them.
+    std::unique_ptr<CVulkanDescriptorAllocator> descriptorAllocator;
 
     std::unique_ptr<CVulkanGraphicsPipeline> pipeline;
 
-    std::unique_ptr<CVulkanCommandPool> graphicsCommandPool;
+    // One pool per frame in flight, reset once the fence of the frame that last used it signals.
+    std::vector<std::unique_ptr<CVulkanCommandPool>> graphicsCommandPools;
     std::unique_ptr<CVulkanCommandPool> computeCommandPool;
-    std::unique_ptr<CVulkanCommandPool> transferCommandPool;
 
     std::vector<std::shared_ptr<CVulkanCommandBuffer>> graphicsCommandBuffers;
     std::shared_ptr<CVulkanCommandBuffer> computeCommandBuffer;
-    std::shared_ptr<CVulkanCommandBuffer> transferCommandBuffer;
+
+    std::unique_ptr<CVulkanStagingRing> stagingRing;
+    std::unique_ptr<CVulkanFrameTimer> frameTimer;
+    std::unique_ptr<CVulkanBarrierTracker> barrierTracker; // Graphics queue resources, recorded in submission order.
+    std::unique_ptr<CVulkanRenderGraph> renderGraph; // Declared again every frame, transient images persist.
+    std::unique_ptr<CVulkanBindlessHeap> bindlessHeap; // Textures and materials by index, null when the device lacks descriptor indexing.
 
     std::unique_ptr<CVulkanUi> ui;
 
+    std::unique_ptr<CThreadPool> threadPool; // Records mesh draws, declared before the mesh renderer so it outlives it.
     std::unique_ptr<CVulkanMeshRenderer> meshRenderer;
     std::unique_ptr<CVulkanMeshLoader> meshLoader;
     std::vector<std::shared_ptr<CVulkanMesh>> meshes;
-
-    std::unique_ptr<CVulkanQueue> graphicsQueue;
-    std::unique_ptr<CVulkanQueue> computeQueue;
-    std::unique_ptr<CVulkanQueue> transferQueue;
+    std::vector<CVulkanMeshInstance> instances;
+    std::unique_ptr<CVulkanIndirectRenderer> indirectRenderer; // Draws the instances instead of meshRenderer when set.
+    std::unique_ptr<CVulkanMeshletRenderer> meshletRenderer; // Draws the instances instead of either when set.
 public:
-    CVulkanRenderer(CSDLWindow* window);
+    static constexpr uint32_t BENCHMARK_INSTANCE_COUNT = 100000;
+
+    CVulkanRenderer(CSDLWindow* window, CVulkanRendererOptions options = {});
+    ~CVulkanRenderer();
     void OnResize();
     void DrawFrame();
+    // Checks mip levels blitted on the graphics queue against the CPU box filter, see CVulkanImageLoader::RunBlitTest().
+    bool RunBlitTest();
     // Hook up events to the renderer.
     static int SDL_EventFilterCallback(void* userdata, SDL_Event* event);
 };
\ No newline at end of file
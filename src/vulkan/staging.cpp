@@ -0,0 +1,283 @@
+#include "staging.hpp"
+
+#include <cstdio>
+#include <stdexcept>
+#include "device.hpp"
+#include "queue.hpp"
+#include "cmd.hpp"
+#include "buffer.hpp"
+#include "image.hpp"
+#include "barrier.hpp"
+
+// Every way the owner queue may read an uploaded buffer.
+static const vk::AccessFlags2 UPLOADED_BUFFER_ACCESS = vk::AccessFlagBits2::eVertexAttributeRead | vk::AccessFlagBits2::eIndexRead
+    | vk::AccessFlagBits2::eUniformRead | vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eIndirectCommandRead;
+
+// What the copies leave behind in a resource, the state releases start from.
+static CVulkanResourceState GetCopiedState(vk::ImageLayout layout) {
+    CVulkanResourceState state;
+    state.layout = layout;
+    state.writeStages = vk::PipelineStageFlagBits2::eTransfer;
+    state.writeAccess = vk::AccessFlagBits2::eTransferWrite;
+    return state;
+}
+
+CVulkanStagingRing::CVulkanStagingRing(CVulkanDevice* device, CVulkanQueue* transferQueue, uint32_t ownerQueueFamilyIndex, vk::DeviceSize size)
+    : transferQueue(transferQueue), ownerQueueFamilyIndex(ownerQueueFamilyIndex), capacity(size), head(0), tail(0), batchDepth(0), submitCount(0) {
+    commandPool = std::make_unique<CVulkanCommandPool>(transferQueue->CreateCommandPool(vk::CommandPoolCreateFlagBits::eResetCommandBuffer));
+    barrierTracker = std::make_unique<CVulkanBarrierTracker>();
+    buffer = std::make_unique<CVulkanBuffer>(device->CreateBuffer(vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+        vk::BufferUsageFlagBits::eTransferSrc, nullptr, size));
+    mapped = static_cast<char*>(buffer->GetMappedData());
+}
+
+CVulkanStagingRing::~CVulkanStagingRing() {
+    Wait();
+}
+
+void CVulkanStagingRing::CopyToBuffer(const void* data, vk::DeviceSize dataSize, CVulkanBuffer* dstBuffer, vk::DeviceSize dstOffset) {
+    // Never take more than half of the ring at once so that a chunk can be staged while the previous one is in flight.
+    vk::DeviceSize maxChunkSize = capacity / 2;
+    vk::DeviceSize copied = 0;
+    while(copied < dataSize) {
+        vk::DeviceSize chunkSize = std::min(dataSize - copied, maxChunkSize);
+        vk::DeviceSize offset = Reserve(chunkSize, ALIGNMENT);
+        memcpy(mapped + offset, static_cast<const char*>(data) + copied, static_cast<size_t>(chunkSize));
+        GetCommandBuffer()->CopyBuffer(buffer.get(), dstBuffer, vk::BufferCopy(offset, dstOffset + copied, chunkSize));
+        copied += chunkSize;
+    }
+
+    if(IsOwnershipTransferRequired()) {
+        // Recorded with the other releases when the submission is made, after every copy.
+        barrierTracker->SetBufferState(dstBuffer->GetVkBuffer(), GetCopiedState(vk::ImageLayout::eUndefined));
+        barrierTracker->ReleaseBuffer(dstBuffer->GetVkBuffer(), dstOffset, dataSize, transferQueue->GetFamilyIndex(), ownerQueueFamilyIndex);
+
+        vk::BufferMemoryBarrier2 acquire;
+        acquire.setDstAccessMask(UPLOADED_BUFFER_ACCESS);
+        acquire.setSrcQueueFamilyIndex(transferQueue->GetFamilyIndex());
+        acquire.setDstQueueFamilyIndex(ownerQueueFamilyIndex);
+        acquire.setBuffer(dstBuffer->GetVkBuffer());
+        acquire.setOffset(dstOffset);
+        acquire.setSize(dataSize);
+        recordedAcquires.bufferBarriers.push_back(acquire);
+    }
+}
+
+void CVulkanStagingRing::CopyToImage(const void* data, vk::DeviceSize dataSize, CVulkanImage* dstImage, vk::BufferImageCopy region, vk::DeviceSize blockSize, uint32_t blockExtent) {
+    vk::DeviceSize alignment = std::max(ALIGNMENT, blockSize);
+    vk::DeviceSize maxChunkSize = capacity / 2;
+    if(dataSize <= maxChunkSize) {
+        vk::DeviceSize offset = Reserve(dataSize, alignment);
+        memcpy(mapped + offset, data, static_cast<size_t>(dataSize));
+        region.setBufferOffset(offset);
+        GetCommandBuffer()->CopyBufferToImage(buffer.get(), dstImage, vk::ImageLayout::eTransferDstOptimal, region);
+        return;
+    }
+
+    // Bands are made of whole rows of blocks, only the last one may end on a partial block.
+    uint32_t blockRows = (region.imageExtent.height + blockExtent - 1) / blockExtent;
+    vk::DeviceSize rowSize = dataSize / blockRows;
+    uint32_t rowsPerChunk = static_cast<uint32_t>(std::max<vk::DeviceSize>(maxChunkSize / rowSize, 1));
+    for(uint32_t row = 0; row < blockRows; row += rowsPerChunk) {
+        uint32_t rows = std::min(rowsPerChunk, blockRows - row);
+        vk::DeviceSize chunkSize = rowSize * rows;
+        vk::DeviceSize offset = Reserve(chunkSize, alignment);
+        memcpy(mapped + offset, static_cast<const char*>(data) + rowSize * row, static_cast<size_t>(chunkSize));
+
+        vk::BufferImageCopy band = region;
+        band.setBufferOffset(offset);
+        band.setBufferRowLength(0);
+        band.setBufferImageHeight(0);
+        band.imageOffset.y += static_cast<int32_t>(row * blockExtent);
+        band.imageExtent.height = std::min(rows * blockExtent, region.imageExtent.height - row * blockExtent);
+        GetCommandBuffer()->CopyBufferToImage(buffer.get(), dstImage, vk::ImageLayout::eTransferDstOptimal, band);
+    }
+}
+
+void CVulkanStagingRing::ReleaseImage(CVulkanImage* image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout) {
+    // Semaphore waits on the owner queue make the copies visible, the barrier here only has to order the layout transition.
+    ReleaseImage(image, oldLayout, newLayout, vk::AccessFlagBits2::eShaderSampledRead);
+}
+
+void CVulkanStagingRing::ReleaseImageForMipmapping(CVulkanImage* image) {
+    // Without an ownership transfer this records nothing, but still makes the tracker forget the image.
+    ReleaseImage(image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferDstOptimal,
+        vk::AccessFlagBits2::eTransferRead | vk::AccessFlagBits2::eTransferWrite);
+    recordedAcquires.mipmapRequests.push_back(CVulkanMipmapRequest { image->GetVkImage(), image->GetExtent(), image->GetMipLevels() });
+}
+
+void CVulkanStagingRing::ReleaseImage(CVulkanImage* image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::AccessFlags2 ownerAccess) {
+    // Every level was copied in oldLayout, whether or not the tracker saw its transition there. Recorded with the other
+    // releases when the submission is made, after every copy.
+    vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, image->GetMipLevels(), 0, 1);
+    barrierTracker->SetImageState(image->GetVkImage(), GetCopiedState(oldLayout), range);
+    barrierTracker->ReleaseImage(image->GetVkImage(), newLayout, transferQueue->GetFamilyIndex(),
+        IsOwnershipTransferRequired() ? ownerQueueFamilyIndex : transferQueue->GetFamilyIndex(), range);
+
+    if(IsOwnershipTransferRequired()) {
+        vk::ImageMemoryBarrier2 acquire;
+        acquire.setDstAccessMask(ownerAccess);
+        acquire.setOldLayout(oldLayout);
+        acquire.setNewLayout(newLayout);
+        acquire.setSrcQueueFamilyIndex(transferQueue->GetFamilyIndex());
+        acquire.setDstQueueFamilyIndex(ownerQueueFamilyIndex);
+        acquire.setImage(image->GetVkImage());
+        acquire.setSubresourceRange(range);
+        recordedAcquires.imageBarriers.push_back(acquire);
+    }
+}
+
+CVulkanBarrierTracker* CVulkanStagingRing::GetBarrierTracker() {
+    return barrierTracker.get();
+}
+
+CVulkanBarrierStatistics CVulkanStagingRing::TakeBarrierStatistics() {
+    return barrierTracker->TakeStatistics();
+}
+
+CVulkanOwnershipAcquire CVulkanStagingRing::TakeOwnershipAcquires() {
+    CVulkanOwnershipAcquire acquires = std::move(submittedAcquires);
+    submittedAcquires = {};
+    return acquires;
+}
+
+std::shared_ptr<CVulkanCommandBuffer> CVulkanStagingRing::GetCommandBuffer() {
+    if(recording == nullptr) {
+        if(!available.empty()) {
+            recording = std::move(available.back());
+            available.pop_back();
+        } else {
+            recording = std::make_unique<CVulkanStagingSubmission>();
+            recording->commandBuffer = std::make_shared<CVulkanCommandBuffer>(commandPool->CreateCommandBuffer());
+        }
+        recording->commandBuffer->Begin();
+    }
+    return recording->commandBuffer;
+}
+
+void CVulkanStagingRing::BeginBatch() {
+    batchDepth++;
+}
+
+CVulkanSubmitTicket CVulkanStagingRing::EndBatch() {
+    batchDepth--;
+    return Flush();
+}
+
+CVulkanSubmitTicket CVulkanStagingRing::Flush() {
+    if(batchDepth > 0) {
+        return GetLastTicket();
+    }
+    return Submit();
+}
+
+void CVulkanStagingRing::Wait() {
+    Submit();
+    while(!inFlight.empty()) {
+        RetireOldest();
+    }
+}
+
+CVulkanSubmitTicket CVulkanStagingRing::GetLastTicket() {
+    return transferQueue->GetLastTicket();
+}
+
+vk::DeviceSize CVulkanStagingRing::GetCapacity() {
+    return capacity;
+}
+
+uint64_t CVulkanStagingRing::GetSubmitCount() {
+    return submitCount;
+}
+
+CVulkanSubmitTicket CVulkanStagingRing::Submit() {
+    if(recording == nullptr) {
+        return GetLastTicket();
+    }
+    barrierTracker->Flush(recording->commandBuffer.get()); // Pending releases.
+    recording->commandBuffer->End();
+    recording->end = head;
+    recording->ticket = transferQueue->Submit(recording->commandBuffer);
+    submitCount++;
+    submittedAcquires.bufferBarriers.insert(submittedAcquires.bufferBarriers.end(), recordedAcquires.bufferBarriers.begin(), recordedAcquires.bufferBarriers.end());
+    submittedAcquires.imageBarriers.insert(submittedAcquires.imageBarriers.end(), recordedAcquires.imageBarriers.begin(), recordedAcquires.imageBarriers.end());
+    submittedAcquires.mipmapRequests.insert(submittedAcquires.mipmapRequests.end(), recordedAcquires.mipmapRequests.begin(), recordedAcquires.mipmapRequests.end());
+    recordedAcquires = {};
+    inFlight.push_back(std::move(recording));
+    return inFlight.back()->ticket;
+}
+
+bool CVulkanStagingRing::IsOwnershipTransferRequired() {
+    return ownerQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED && ownerQueueFamilyIndex != transferQueue->GetFamilyIndex();
+}
+
+bool CVulkanStagingRing::TryReserve(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset) {
+    if(size > capacity) {
+        return false;
+    }
+    RetireCompleted();
+    while(true) {
+        vk::DeviceSize physical = head % capacity;
+        vk::DeviceSize aligned = (physical + alignment - 1) / alignment * alignment;
+        // Ranges never straddle the end of the ring, skip to the start instead.
+        uint64_t start = aligned + size <= capacity ? head + (aligned - physical) : head + (capacity - physical);
+        if(start + size - tail <= capacity) {
+            head = start + size;
+            offset = start % capacity;
+            return true;
+        }
+
+        // Out of space, make room by waiting on the oldest submission. Our own copies may be all that is left in the way.
+        if(inFlight.empty()) {
+            return false;
+        }
+        RetireOldest();
+    }
+}
+
+vk::DeviceSize CVulkanStagingRing::Reserve(vk::DeviceSize size, vk::DeviceSize alignment) {
+    if(size > capacity) {
+        printf("CVulkanStagingRing::Reserve: %llu bytes do not fit a ring of %llu\n", static_cast<unsigned long long>(size), static_cast<unsigned long long>(capacity));
+        throw std::length_error("Staging range larger than the ring");
+    }
+    vk::DeviceSize offset;
+    while(!TryReserve(size, alignment, offset)) {
+        // Nothing left in flight, so only submitting the copies being recorded can free space. Without any, the space is
+        // held by ranges reserved and not yet copied from, and waiting would never end.
+        if(recording == nullptr) {
+            printf("CVulkanStagingRing::Reserve: %llu bytes are held by ranges without recorded copies\n", static_cast<unsigned long long>(head - tail));
+            throw std::runtime_error("Staging ring is full of ranges that were never copied from");
+        }
+        Submit();
+    }
+    return offset;
+}
+
+void* CVulkanStagingRing::GetMappedData(vk::DeviceSize offset) {
+    return mapped + offset;
+}
+
+void CVulkanStagingRing::CopyReservedToImage(vk::DeviceSize offset, CVulkanImage* dstImage, vk::BufferImageCopy region) {
+    region.setBufferOffset(offset);
+    GetCommandBuffer()->CopyBufferToImage(buffer.get(), dstImage, vk::ImageLayout::eTransferDstOptimal, region);
+}
+
+void CVulkanStagingRing::RetireOldest() {
+    auto& submission = inFlight.front();
+    transferQueue->Wait(submission->ticket);
+    submission->commandBuffer->Reset();
+    tail = submission->end;
+    available.push_back(std::move(submission));
+    inFlight.pop_front();
+
+    if(tail == head && recording == nullptr) { // Ring is idle, start over so the next range does not need to wrap.
+        head = 0;
+        tail = 0;
+    }
+}
+
+void CVulkanStagingRing::RetireCompleted() {
+    while(!inFlight.empty() && transferQueue->IsComplete(inFlight.front()->ticket)) {
+        RetireOldest();
+    }
+}
\ No newline at end of file
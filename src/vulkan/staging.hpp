@@ -0,0 +1,110 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include <deque>
+#include "queue.hpp"
+#include "barrier.hpp"
+
+class CVulkanDevice;
+class CVulkanBuffer;
+class CVulkanImage;
+class CVulkanCommandPool;
+class CVulkanCommandBuffer;
+
+// A command buffer recording copies out of the ring, and the ticket that tells us when its ring range can be reused.
+struct CVulkanStagingSubmission {
+    std::shared_ptr<CVulkanCommandBuffer> commandBuffer;
+    CVulkanSubmitTicket ticket;
+    uint64_t end = 0;
+};
+
+// Image whose level 0 was uploaded in eTransferDstOptimal and whose remaining levels are blitted on the owner queue.
+struct CVulkanMipmapRequest {
+    vk::Image image;
+    vk::Extent3D extent;
+    uint32_t mipLevels;
+};
+
+// Acquires the owning queue family has to record, through CVulkanBarrierTracker::AcquireBuffer() and AcquireImage(), before
+// using resources released to it by the ring. Stages are left to the owner, everything else matches the releases.
+struct CVulkanOwnershipAcquire {
+    std::vector<vk::BufferMemoryBarrier2> bufferBarriers;
+    std::vector<vk::ImageMemoryBarrier2> imageBarriers;
+    std::vector<CVulkanMipmapRequest> mipmapRequests; // Recorded after the barriers, transfer queues cannot blit.
+};
+
+// Persistently mapped host visible ring that all uploads to device local memory are staged through.
+// Ranges are handed out in submission order and reclaimed once the submission that used them completes.
+class CVulkanStagingRing {
+    CVulkanQueue* transferQueue;
+    uint32_t ownerQueueFamilyIndex;
+    std::unique_ptr<CVulkanCommandPool> commandPool;
+    std::unique_ptr<CVulkanBarrierTracker> barrierTracker; // For the transfer queue, releases are flushed on submission.
+    std::unique_ptr<CVulkanBuffer> buffer;
+    char* mapped;
+    vk::DeviceSize capacity;
+    uint64_t head; // Offsets grow monotonically, the physical offset is offset % capacity.
+    uint64_t tail;
+    uint32_t batchDepth;
+    uint64_t submitCount;
+    std::unique_ptr<CVulkanStagingSubmission> recording;
+    std::deque<std::unique_ptr<CVulkanStagingSubmission>> inFlight;
+    std::vector<std::unique_ptr<CVulkanStagingSubmission>> available;
+    CVulkanOwnershipAcquire recordedAcquires;
+    CVulkanOwnershipAcquire submittedAcquires;
+public:
+    static constexpr vk::DeviceSize DEFAULT_SIZE = 32ull * 1024 * 1024;
+    // Offsets handed out for copies, satisfies the texel size requirement of every format we upload.
+    static constexpr vk::DeviceSize ALIGNMENT = 16;
+
+    // Resources are released to ownerQueueFamilyIndex after upload when it differs from the transfer queue family.
+    CVulkanStagingRing(CVulkanDevice* device, CVulkanQueue* transferQueue, uint32_t ownerQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED, vk::DeviceSize size = DEFAULT_SIZE);
+    ~CVulkanStagingRing();
+    // Copies data into dstBuffer, splitting it into several copies when it is larger than the ring.
+    void CopyToBuffer(const void* data, vk::DeviceSize dataSize, CVulkanBuffer* dstBuffer, vk::DeviceSize dstOffset = 0);
+    // Copies tightly packed texels into a single layer of dstImage, which must already be in eTransferDstOptimal.
+    // Images larger than the ring are copied in bands of whole rows. Block compressed data passes the size in bytes
+    // and the width/height in texels of a block.
+    void CopyToImage(const void* data, vk::DeviceSize dataSize, CVulkanImage* dstImage, vk::BufferImageCopy region, vk::DeviceSize blockSize = 4, uint32_t blockExtent = 1);
+    // Records a copy of a range returned by Reserve() or TryReserve() into dstImage, which must already be in eTransferDstOptimal.
+    void CopyReservedToImage(vk::DeviceSize offset, CVulkanImage* dstImage, vk::BufferImageCopy region);
+    // Moves every mip level of image from oldLayout to newLayout once its copies are done, releasing it to the owner queue family.
+    void ReleaseImage(CVulkanImage* image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout);
+    // Releases image in eTransferDstOptimal and asks the owner queue to generate its mip chain from level 0.
+    void ReleaseImageForMipmapping(CVulkanImage* image);
+    // Acquire barriers for everything released by submissions made so far, to be recorded on the owner queue.
+    CVulkanOwnershipAcquire TakeOwnershipAcquires();
+    // Command buffer of the submission currently being recorded, for barriers around the copies.
+    std::shared_ptr<CVulkanCommandBuffer> GetCommandBuffer();
+    // Tracker of the transfer queue, barriers around the copies go through it and are flushed into GetCommandBuffer().
+    CVulkanBarrierTracker* GetBarrierTracker();
+    // Barriers recorded on the transfer queue since the last call.
+    CVulkanBarrierStatistics TakeBarrierStatistics();
+    // Opens an upload batch, until the matching EndBatch() every Flush() is deferred so that all loads in between
+    // are recorded into one command buffer and submitted once. The ring still submits early if it runs out of space.
+    void BeginBatch();
+    CVulkanSubmitTicket EndBatch();
+    // Submits everything recorded so far without waiting for it, the ticket of that submission is returned.
+    CVulkanSubmitTicket Flush();
+    // Submits everything recorded so far and waits until the ring is idle.
+    void Wait();
+    // Ticket of the last submitted upload, graphics work reading uploaded resources should wait on it.
+    CVulkanSubmitTicket GetLastTicket();
+    // Hands out size bytes of the ring for the caller to fill through GetMappedData(), submitting the copies recorded so far
+    // if they are what is in the way. Every range reserved before must have been written by then. Throws if size exceeds
+    // GetCapacity() or if the space is held by ranges no recorded copy reads from, as no submission would free it.
+    vk::DeviceSize Reserve(vk::DeviceSize size, vk::DeviceSize alignment);
+    // Same as Reserve() but never submits, returns false instead when only the copies being recorded are in the way.
+    // Lets ranges be filled from other threads until the caller is ready to submit.
+    bool TryReserve(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset);
+    void* GetMappedData(vk::DeviceSize offset);
+    vk::DeviceSize GetCapacity();
+    uint64_t GetSubmitCount();
+private:
+    // Releases image to the owner queue, which acquires it for ownerAccess.
+    void ReleaseImage(CVulkanImage* image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::AccessFlags2 ownerAccess);
+    CVulkanSubmitTicket Submit();
+    bool IsOwnershipTransferRequired();
+    void RetireOldest();
+    void RetireCompleted();
+};
\ No newline at end of file
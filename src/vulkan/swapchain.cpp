@@ -20,14 +20,12 @@
 CVulkanSwapchain::CVulkanSwapchain(CVulkanInstance* pInstance, CVulkanDevice* pDevice, CVulkanQueue* pQueue, SDL_Window* pWindow, uint32_t imageCount, bool vsync) 
         : device(pDevice->GetVkDevice()), physicalDevice(pDevice->GetVkPhysicalDevice()), queue(pQueue->GetVkQueue()), window(pWindow), imageCount(imageCount),
     vsync(vsync), currentFrame(0), currentImage(0) {
-    auto instance = pInstance->GetVkInstance();
-    VkSurfaceKHR tmpSurface;
-    if(!SDL_Vulkan_CreateSurface(window, **instance, &tmpSurface)) {
+    surface = pInstance->GetVkSurface();
+    if(!surface) {
         throw CVulkanSwapchainCreationException(EVulkanSwapchainCreationError::SURFACE_CREATION_FAILED);
     }
-    surface = std::make_unique<vk::raii::SurfaceKHR>(*instance, tmpSurface);
 
-    if(!physicalDevice.getSurfaceSupportKHR(0, **surface)) {
+    if(!physicalDevice.getSurfaceSupportKHR(pQueue->GetFamilyIndex(), surface)) {
         throw CVulkanSwapchainCreationException(EVulkanSwapchainCreationError::SURFACE_PRESENTATION_NOT_SUPPORTED);
     }
 
@@ -102,13 +100,13 @@ vk::Format CVulkanSwapchain::GetVkSurfaceFormat() {
 }
 
 void CVulkanSwapchain::createSwapchain() {
-    capabilities = physicalDevice.getSurfaceCapabilitiesKHR(**surface);
+    capabilities = physicalDevice.getSurfaceCapabilitiesKHR(surface);
     auto extent = GetSwapchainExtent(window, capabilities);
-    presentMode = SelectPresentMode(physicalDevice.getSurfacePresentModesKHR(**surface), vsync ? vk::PresentModeKHR::eImmediate : vk::PresentModeKHR::eMailbox);
-    surfaceFormat = SelectSurfaceFormat(physicalDevice.getSurfaceFormatsKHR(**surface), vk::Format::eB8G8R8A8Srgb, vk::ColorSpaceKHR::eSrgbNonlinear); // ImGui will use these settings, match them.
+    presentMode = SelectPresentMode(physicalDevice.getSurfacePresentModesKHR(surface), vsync ? vk::PresentModeKHR::eImmediate : vk::PresentModeKHR::eMailbox);
+    surfaceFormat = SelectSurfaceFormat(physicalDevice.getSurfaceFormatsKHR(surface), vk::Format::eB8G8R8A8Srgb, vk::ColorSpaceKHR::eSrgbNonlinear); // ImGui will use these settings, match them.
 
     vk::SwapchainCreateInfoKHR swapchainInfo;
-    swapchainInfo.setSurface(**surface);
+    swapchainInfo.setSurface(surface);
     swapchainInfo.setMinImageCount(imageCount);
     swapchainInfo.setImageFormat(surfaceFormat.format);
     swapchainInfo.setImageColorSpace(surfaceFormat.colorSpace);
@@ -33,7 +33,7 @@ class CVulkanSwapchain {
     vk::PhysicalDevice physicalDevice;
     std::shared_ptr<vk::raii::Queue> queue;
     SDL_Window* window;
-    std::unique_ptr<vk::raii::SurfaceKHR> surface;
+    vk::SurfaceKHR surface; // Owned by the instance.
     vk::SurfaceFormatKHR surfaceFormat;
     vk::SurfaceCapabilitiesKHR capabilities;
     vk::PresentModeKHR presentMode;
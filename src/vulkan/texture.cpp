@@ -0,0 +1,555 @@
+#include "texture.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include "image.hpp"
+
+static const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+static constexpr size_t KTX2_HEADER_SIZE = 80; // Identifier, header and index, the level index follows.
+static constexpr size_t DDS_HEADER_SIZE = 128; // Magic and DDS_HEADER.
+static constexpr size_t DDS_DX10_HEADER_SIZE = 20;
+static constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+static constexpr uint32_t DDPF_FOURCC = 0x4;
+static constexpr uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+// DXGI_FORMAT values of the BC formats we accept.
+enum DxgiFormat : uint32_t {
+    DXGI_FORMAT_BC1_UNORM = 71,
+    DXGI_FORMAT_BC1_UNORM_SRGB = 72,
+    DXGI_FORMAT_BC3_UNORM = 77,
+    DXGI_FORMAT_BC3_UNORM_SRGB = 78,
+    DXGI_FORMAT_BC4_UNORM = 80,
+    DXGI_FORMAT_BC5_UNORM = 83,
+    DXGI_FORMAT_BC7_UNORM = 98,
+    DXGI_FORMAT_BC7_UNORM_SRGB = 99
+};
+
+// Subset of each texel for the 64 two subset BC7 partitions, one bit per texel.
+static const uint16_t BC7_PARTITIONS_2[64] = {
+    0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80, 0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+    0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce, 0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+    0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a, 0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+    0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c, 0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22
+};
+
+// Same for the three subset partitions, two bits per texel.
+static const uint32_t BC7_PARTITIONS_3[64] = {
+    0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+    0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+    0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+    0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+    0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+    0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+    0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+    0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254
+};
+
+// Anchor texel of the second subset of each two subset partition, its index is stored with one bit less.
+static const uint8_t BC7_ANCHORS_2[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+    15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+    6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15
+};
+
+// Anchor texels of the second and third subsets of each three subset partition.
+static const uint8_t BC7_ANCHORS_3[2][64] = {
+    {
+        3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+        3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+        8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+        3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3
+    },
+    {
+        15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+        15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+        15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+        15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8
+    }
+};
+
+static const uint8_t BC7_WEIGHTS_2[4] = { 0, 21, 43, 64 };
+static const uint8_t BC7_WEIGHTS_3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const uint8_t BC7_WEIGHTS_4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct Bc7Mode {
+    uint8_t subsetCount;
+    uint8_t partitionBits;
+    uint8_t rotationBits;
+    uint8_t indexSelectionBits;
+    uint8_t colorBits;
+    uint8_t alphaBits;
+    uint8_t endpointPBits; // One P-bit per endpoint.
+    uint8_t sharedPBits; // One P-bit per subset.
+    uint8_t indexBits;
+    uint8_t secondaryIndexBits;
+};
+
+static const Bc7Mode BC7_MODES[8] = {
+    { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+    { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+    { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+    { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+    { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+    { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+    { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+    { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+};
+
+// Reads BC7 fields, which are packed starting from the least significant bit of the first byte.
+class Bc7BitReader {
+    const uint8_t* block;
+    uint32_t position;
+public:
+    Bc7BitReader(const uint8_t* block, uint32_t position) : block(block), position(position) {}
+
+    uint32_t Read(uint32_t count) {
+        uint32_t value = 0;
+        for(uint32_t i = 0; i < count; i++, position++) {
+            value |= ((block[position >> 3] >> (position & 7)) & 1u) << i;
+        }
+        return value;
+    }
+};
+
+static uint32_t ReadUint32(const uint8_t* data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+static uint64_t ReadUint64(const uint8_t* data) {
+    return ReadUint32(data) | (static_cast<uint64_t>(ReadUint32(data + 4)) << 32);
+}
+
+static uint32_t MakeFourCC(char a, char b, char c, char d) {
+    return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) | (static_cast<uint32_t>(c) << 16) | (static_cast<uint32_t>(d) << 24);
+}
+
+static uint8_t Expand565Channel(uint32_t value, uint32_t bits) {
+    return static_cast<uint8_t>((value << (8 - bits)) | (value >> (2 * bits - 8)));
+}
+
+// BC1 color block, also used by BC3 where the color block never has the 1-bit alpha mode.
+static void DecodeBc1Block(const uint8_t* block, uint8_t texels[16][4], bool allowPunchThrough, bool punchThroughAlpha) {
+    uint32_t colors[2] = { static_cast<uint32_t>(block[0] | (block[1] << 8)), static_cast<uint32_t>(block[2] | (block[3] << 8)) };
+    uint8_t palette[4][4];
+    for(int i = 0; i < 2; i++) {
+        palette[i][0] = Expand565Channel((colors[i] >> 11) & 0x1f, 5);
+        palette[i][1] = Expand565Channel((colors[i] >> 5) & 0x3f, 6);
+        palette[i][2] = Expand565Channel(colors[i] & 0x1f, 5);
+        palette[i][3] = 255;
+    }
+    for(int channel = 0; channel < 3; channel++) {
+        if(colors[0] > colors[1] || !allowPunchThrough) {
+            palette[2][channel] = static_cast<uint8_t>((2 * palette[0][channel] + palette[1][channel] + 1) / 3);
+            palette[3][channel] = static_cast<uint8_t>((palette[0][channel] + 2 * palette[1][channel] + 1) / 3);
+        } else {
+            palette[2][channel] = static_cast<uint8_t>((palette[0][channel] + palette[1][channel] + 1) / 2);
+            palette[3][channel] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = colors[0] > colors[1] || !allowPunchThrough || !punchThroughAlpha ? 255 : 0;
+
+    uint32_t indices = ReadUint32(block + 4);
+    for(int i = 0; i < 16; i++) {
+        memcpy(texels[i], palette[(indices >> (2 * i)) & 3], 4);
+    }
+}
+
+// BC4 block, the alpha block of BC3 and each channel of BC5.
+static void DecodeBc4Block(const uint8_t* block, uint8_t texels[16][4], int channel) {
+    uint32_t endpoints[2] = { block[0], block[1] };
+    uint8_t palette[8] = { block[0], block[1] };
+    if(endpoints[0] > endpoints[1]) {
+        for(uint32_t i = 2; i < 8; i++) {
+            palette[i] = static_cast<uint8_t>(((8 - i) * endpoints[0] + (i - 1) * endpoints[1] + 3) / 7);
+        }
+    } else {
+        for(uint32_t i = 2; i < 6; i++) {
+            palette[i] = static_cast<uint8_t>(((6 - i) * endpoints[0] + (i - 1) * endpoints[1] + 2) / 5);
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for(int i = 0; i < 6; i++) {
+        indices |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+    }
+    for(int i = 0; i < 16; i++) {
+        texels[i][channel] = palette[(indices >> (3 * i)) & 7];
+    }
+}
+
+static void DecodeBc7Block(const uint8_t* block, uint8_t texels[16][4]) {
+    uint32_t modeIndex = 0;
+    while(modeIndex < 8 && !(block[0] & (1 << modeIndex))) {
+        modeIndex++;
+    }
+    if(modeIndex == 8) { // Reserved mode, decodes to transparent black.
+        memset(texels, 0, 16 * 4);
+        return;
+    }
+
+    const Bc7Mode& mode = BC7_MODES[modeIndex];
+    Bc7BitReader reader(block, modeIndex + 1);
+    uint32_t partition = reader.Read(mode.partitionBits);
+    uint32_t rotation = reader.Read(mode.rotationBits);
+    uint32_t indexSelection = reader.Read(mode.indexSelectionBits);
+
+    uint32_t endpoints[3][2][4] = {};
+    for(int channel = 0; channel < 3; channel++) {
+        for(int subset = 0; subset < mode.subsetCount; subset++) {
+            endpoints[subset][0][channel] = reader.Read(mode.colorBits);
+            endpoints[subset][1][channel] = reader.Read(mode.colorBits);
+        }
+    }
+    for(int subset = 0; subset < mode.subsetCount && mode.alphaBits > 0; subset++) {
+        endpoints[subset][0][3] = reader.Read(mode.alphaBits);
+        endpoints[subset][1][3] = reader.Read(mode.alphaBits);
+    }
+
+    uint32_t colorBits = mode.colorBits;
+    uint32_t alphaBits = mode.alphaBits;
+    if(mode.endpointPBits || mode.sharedPBits) {
+        for(int subset = 0; subset < mode.subsetCount; subset++) {
+            uint32_t pBits[2];
+            pBits[0] = reader.Read(1);
+            pBits[1] = mode.endpointPBits ? reader.Read(1) : pBits[0];
+            for(int endpoint = 0; endpoint < 2; endpoint++) {
+                for(int channel = 0; channel < 4; channel++) {
+                    endpoints[subset][endpoint][channel] = (endpoints[subset][endpoint][channel] << 1) | pBits[endpoint];
+                }
+            }
+        }
+        colorBits++;
+        alphaBits += alphaBits > 0 ? 1 : 0;
+    }
+    for(int subset = 0; subset < mode.subsetCount; subset++) {
+        for(int endpoint = 0; endpoint < 2; endpoint++) {
+            for(int channel = 0; channel < 4; channel++) {
+                uint32_t bits = channel < 3 ? colorBits : alphaBits;
+                uint32_t& value = endpoints[subset][endpoint][channel];
+                if(bits == 0) {
+                    value = 255;
+                } else if(bits < 8) {
+                    value = (value << (8 - bits)) | (value >> (2 * bits - 8));
+                }
+            }
+        }
+    }
+
+    uint32_t subsets[16];
+    bool anchors[16] = { true };
+    for(int i = 0; i < 16; i++) {
+        if(mode.subsetCount == 2) {
+            subsets[i] = (BC7_PARTITIONS_2[partition] >> i) & 1;
+        } else if(mode.subsetCount == 3) {
+            subsets[i] = (BC7_PARTITIONS_3[partition] >> (2 * i)) & 3;
+        } else {
+            subsets[i] = 0;
+        }
+    }
+    if(mode.subsetCount == 2) {
+        anchors[BC7_ANCHORS_2[partition]] = true;
+    } else if(mode.subsetCount == 3) {
+        anchors[BC7_ANCHORS_3[0][partition]] = true;
+        anchors[BC7_ANCHORS_3[1][partition]] = true;
+    }
+
+    uint32_t indices[16];
+    uint32_t secondaryIndices[16];
+    for(int i = 0; i < 16; i++) {
+        indices[i] = reader.Read(mode.indexBits - (anchors[i] ? 1 : 0));
+    }
+    for(int i = 0; i < 16 && mode.secondaryIndexBits > 0; i++) {
+        secondaryIndices[i] = reader.Read(mode.secondaryIndexBits - (i == 0 ? 1 : 0));
+    }
+
+    auto getWeight = [](uint32_t bits, uint32_t index) -> uint32_t {
+        return bits == 2 ? BC7_WEIGHTS_2[index] : bits == 3 ? BC7_WEIGHTS_3[index] : BC7_WEIGHTS_4[index];
+    };
+    for(int i = 0; i < 16; i++) {
+        uint32_t colorWeight, alphaWeight;
+        if(mode.secondaryIndexBits == 0) {
+            colorWeight = alphaWeight = getWeight(mode.indexBits, indices[i]);
+        } else if(indexSelection == 0) {
+            colorWeight = getWeight(mode.indexBits, indices[i]);
+            alphaWeight = getWeight(mode.secondaryIndexBits, secondaryIndices[i]);
+        } else {
+            colorWeight = getWeight(mode.secondaryIndexBits, secondaryIndices[i]);
+            alphaWeight = getWeight(mode.indexBits, indices[i]);
+        }
+
+        const uint32_t (&subsetEndpoints)[2][4] = endpoints[subsets[i]];
+        for(int channel = 0; channel < 4; channel++) {
+            uint32_t weight = channel < 3 ? colorWeight : alphaWeight;
+            texels[i][channel] = static_cast<uint8_t>(((64 - weight) * subsetEndpoints[0][channel] + weight * subsetEndpoints[1][channel] + 32) >> 6);
+        }
+        if(rotation > 0) {
+            std::swap(texels[i][3], texels[i][rotation - 1]);
+        }
+    }
+}
+
+static bool IsSupportedFormat(vk::Format format) {
+    switch(format) {
+    case vk::Format::eBc1RgbUnormBlock:
+    case vk::Format::eBc1RgbSrgbBlock:
+    case vk::Format::eBc1RgbaUnormBlock:
+    case vk::Format::eBc1RgbaSrgbBlock:
+    case vk::Format::eBc3UnormBlock:
+    case vk::Format::eBc3SrgbBlock:
+    case vk::Format::eBc4UnormBlock:
+    case vk::Format::eBc5UnormBlock:
+    case vk::Format::eBc7UnormBlock:
+    case vk::Format::eBc7SrgbBlock:
+        return true;
+    default:
+        return false;
+    }
+}
+
+CVulkanCompressedTexture::CVulkanCompressedTexture(std::string path) : path(path), format(vk::Format::eUndefined) {
+    std::ifstream inputStream(path, std::ifstream::ate | std::ifstream::binary);
+    if(!inputStream.is_open()) {
+        throw CVulkanImageCreationException(CVulkanImageCreationError::IMAGE_LOAD_FAILED);
+    }
+    uint64_t fileSize = static_cast<uint64_t>(inputStream.tellg());
+
+    // Large enough for either header, KTX2 level indices are read separately.
+    std::vector<uint8_t> header(std::min<uint64_t>(fileSize, DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE));
+    inputStream.seekg(0);
+    inputStream.read(reinterpret_cast<char*>(header.data()), header.size());
+    if(header.size() >= KTX2_HEADER_SIZE && memcmp(header.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0) {
+        ParseKtx2(header, fileSize);
+    } else if(header.size() >= DDS_HEADER_SIZE && ReadUint32(header.data()) == MakeFourCC('D', 'D', 'S', ' ')) {
+        ParseDds(header, fileSize);
+    } else {
+        throw CVulkanImageCreationException(CVulkanImageCreationError::IMAGE_LOAD_FAILED);
+    }
+}
+
+bool CVulkanCompressedTexture::IsContainerPath(std::string path) {
+    size_t dot = path.find_last_of('.');
+    if(dot == std::string::npos) {
+        return false;
+    }
+    std::string extension = path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+    return extension == "ktx2" || extension == "dds";
+}
+
+vk::Format CVulkanCompressedTexture::GetFormat() {
+    return format;
+}
+
+vk::Format CVulkanCompressedTexture::GetDecodedFormat() {
+    switch(format) {
+    case vk::Format::eBc1RgbSrgbBlock:
+    case vk::Format::eBc1RgbaSrgbBlock:
+    case vk::Format::eBc3SrgbBlock:
+    case vk::Format::eBc7SrgbBlock:
+        return vk::Format::eR8G8B8A8Srgb;
+    default:
+        return vk::Format::eR8G8B8A8Unorm;
+    }
+}
+
+vk::Extent3D CVulkanCompressedTexture::GetExtent() {
+    return extent;
+}
+
+uint32_t CVulkanCompressedTexture::GetLevelCount() {
+    return static_cast<uint32_t>(levels.size());
+}
+
+vk::Extent3D CVulkanCompressedTexture::GetLevelExtent(uint32_t level) {
+    return levels[level].extent;
+}
+
+vk::DeviceSize CVulkanCompressedTexture::GetLevelSize(uint32_t level) {
+    return levels[level].size;
+}
+
+vk::DeviceSize CVulkanCompressedTexture::GetBlockSize() {
+    switch(format) {
+    case vk::Format::eBc1RgbUnormBlock:
+    case vk::Format::eBc1RgbSrgbBlock:
+    case vk::Format::eBc1RgbaUnormBlock:
+    case vk::Format::eBc1RgbaSrgbBlock:
+    case vk::Format::eBc4UnormBlock:
+        return 8;
+    default:
+        return 16;
+    }
+}
+
+void CVulkanCompressedTexture::ReadLevel(uint32_t level, void* dst) {
+    std::ifstream inputStream(path, std::ifstream::binary);
+    inputStream.seekg(static_cast<std::streamoff>(levels[level].fileOffset));
+    inputStream.read(static_cast<char*>(dst), static_cast<std::streamsize>(levels[level].size));
+    if(!inputStream) {
+        throw CVulkanImageCreationException(CVulkanImageCreationError::IMAGE_LOAD_FAILED);
+    }
+}
+
+std::vector<uint8_t> CVulkanCompressedTexture::DecodeLevel(uint32_t level) {
+    std::vector<uint8_t> blocks(static_cast<size_t>(levels[level].size));
+    ReadLevel(level, blocks.data());
+
+    uint32_t width = levels[level].extent.width;
+    uint32_t height = levels[level].extent.height;
+    uint32_t blocksWide = (width + 3) / 4;
+    uint32_t blocksHigh = (height + 3) / 4;
+    size_t blockSize = static_cast<size_t>(GetBlockSize());
+    bool punchThroughAlpha = format == vk::Format::eBc1RgbaUnormBlock || format == vk::Format::eBc1RgbaSrgbBlock;
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+    for(uint32_t blockY = 0; blockY < blocksHigh; blockY++) {
+        for(uint32_t blockX = 0; blockX < blocksWide; blockX++) {
+            const uint8_t* block = blocks.data() + (static_cast<size_t>(blockY) * blocksWide + blockX) * blockSize;
+            uint8_t texels[16][4];
+            switch(format) {
+            case vk::Format::eBc1RgbUnormBlock:
+            case vk::Format::eBc1RgbSrgbBlock:
+            case vk::Format::eBc1RgbaUnormBlock:
+            case vk::Format::eBc1RgbaSrgbBlock:
+                DecodeBc1Block(block, texels, true, punchThroughAlpha);
+                break;
+            case vk::Format::eBc3UnormBlock:
+            case vk::Format::eBc3SrgbBlock:
+                DecodeBc1Block(block + 8, texels, false, false);
+                DecodeBc4Block(block, texels, 3);
+                break;
+            case vk::Format::eBc4UnormBlock: // Sampling fills missing channels with 0 and alpha with 1, so does the decoded image.
+                memset(texels, 0, sizeof(texels));
+                DecodeBc4Block(block, texels, 0);
+                for(auto& texel : texels) {
+                    texel[3] = 255;
+                }
+                break;
+            case vk::Format::eBc5UnormBlock:
+                memset(texels, 0, sizeof(texels));
+                DecodeBc4Block(block, texels, 0);
+                DecodeBc4Block(block + 8, texels, 1);
+                for(auto& texel : texels) {
+                    texel[3] = 255;
+                }
+                break;
+            default:
+                DecodeBc7Block(block, texels);
+                break;
+            }
+
+            // Blocks on the right and bottom edges may hang over the image.
+            for(uint32_t y = 0; y < 4 && blockY * 4 + y < height; y++) {
+                for(uint32_t x = 0; x < 4 && blockX * 4 + x < width; x++) {
+                    memcpy(pixels.data() + ((static_cast<size_t>(blockY) * 4 + y) * width + blockX * 4 + x) * 4, texels[y * 4 + x], 4);
+                }
+            }
+        }
+    }
+    return pixels;
+}
+
+void CVulkanCompressedTexture::ParseKtx2(std::vector<uint8_t>& header, uint64_t fileSize) {
+    format = static_cast<vk::Format>(ReadUint32(header.data() + 12));
+    extent = vk::Extent3D(ReadUint32(header.data() + 20), ReadUint32(header.data() + 24), 1);
+    uint32_t pixelDepth = ReadUint32(header.data() + 28);
+    uint32_t layerCount = ReadUint32(header.data() + 32);
+    uint32_t faceCount = ReadUint32(header.data() + 36);
+    uint32_t levelCount = std::max(ReadUint32(header.data() + 40), 1u); // 0 asks the loader to generate mips, we upload what is there.
+    uint32_t supercompressionScheme = ReadUint32(header.data() + 44);
+    if(!IsSupportedFormat(format) || pixelDepth > 1 || layerCount > 1 || faceCount != 1 || supercompressionScheme != 0) {
+        throw CVulkanImageCreationException(CVulkanImageCreationError::IMAGE_UNSUPPORTED_FORMAT);
+    }
+
+    // Level index entries are byteOffset, byteLength and uncompressedByteLength, starting with level 0.
+    std::vector<uint8_t> levelIndex(static_cast<size_t>(levelCount) * 24);
+    std::ifstream inputStream(path, std::ifstream::binary);
+    inputStream.seekg(KTX2_HEADER_SIZE);
+    inputStream.read(reinterpret_cast<char*>(levelIndex.data()), levelIndex.size());
+    if(!inputStream) {
+        throw CVulkanImageCreationException(CVulkanImageCreationError::IMAGE_LOAD_FAILED);
+    }
+    std::vector<uint64_t> fileOffsets(levelCount);
+    for(uint32_t i = 0; i < levelCount; i++) {
+        fileOffsets[i] = ReadUint64(levelIndex.data() + i * 24);
+    }
+    SetLevels(levelCount, fileOffsets, fileSize);
+}
+
+void CVulkanCompressedTexture::ParseDds(std::vector<uint8_t>& header, uint64_t fileSize) {
+    uint32_t flags = ReadUint32(header.data() + 8);
+    extent = vk::Extent3D(ReadUint32(header.data() + 16), ReadUint32(header.data() + 12), 1);
+    uint32_t levelCount = flags & DDSD_MIPMAPCOUNT ? std::max(ReadUint32(header.data() + 28), 1u) : 1;
+    uint32_t pixelFormatFlags = ReadUint32(header.data() + 80);
+    uint32_t fourCC = ReadUint32(header.data() + 84);
+    uint32_t caps2 = ReadUint32(header.data() + 112);
+    if(!(pixelFormatFlags & DDPF_FOURCC) || caps2 != 0) { // Uncompressed, cube map or volume texture.
+        throw CVulkanImageCreationException(CVulkanImageCreationError::IMAGE_UNSUPPORTED_FORMAT);
+    }
+
+    uint64_t dataOffset = DDS_HEADER_SIZE;
+    if(fourCC == MakeFourCC('D', 'X', '1', '0')) {
+        if(header.size() < DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE || ReadUint32(header.data() + DDS_HEADER_SIZE + 8) & DDS_RESOURCE_MISC_TEXTURECUBE
+            || ReadUint32(header.data() + DDS_HEADER_SIZE + 12) > 1) {
+            throw CVulkanImageCreationException(CVulkanImageCreationError::IMAGE_UNSUPPORTED_FORMAT);
+        }
+        dataOffset += DDS_DX10_HEADER_SIZE;
+        switch(ReadUint32(header.data() + DDS_HEADER_SIZE)) {
+        case DXGI_FORMAT_BC1_UNORM: format = vk::Format::eBc1RgbaUnormBlock; break;
+        case DXGI_FORMAT_BC1_UNORM_SRGB: format = vk::Format::eBc1RgbaSrgbBlock; break;
+        case DXGI_FORMAT_BC3_UNORM: format = vk::Format::eBc3UnormBlock; break;
+        case DXGI_FORMAT_BC3_UNORM_SRGB: format = vk::Format::eBc3SrgbBlock; break;
+        case DXGI_FORMAT_BC4_UNORM: format = vk::Format::eBc4UnormBlock; break;
+        case DXGI_FORMAT_BC5_UNORM: format = vk::Format::eBc5UnormBlock; break;
+        case DXGI_FORMAT_BC7_UNORM: format = vk::Format::eBc7UnormBlock; break;
+        case DXGI_FORMAT_BC7_UNORM_SRGB: format = vk::Format::eBc7SrgbBlock; break;
+        }
+    } else if(fourCC == MakeFourCC('D', 'X', 'T', '1')) {
+        format = vk::Format::eBc1RgbaUnormBlock;
+    } else if(fourCC == MakeFourCC('D', 'X', 'T', '5')) {
+        format = vk::Format::eBc3UnormBlock;
+    } else if(fourCC == MakeFourCC('A', 'T', 'I', '1') || fourCC == MakeFourCC('B', 'C', '4', 'U')) {
+        format = vk::Format::eBc4UnormBlock;
+    } else if(fourCC == MakeFourCC('A', 'T', 'I', '2') || fourCC == MakeFourCC('B', 'C', '5', 'U')) {
+        format = vk::Format::eBc5UnormBlock;
+    }
+    if(!IsSupportedFormat(format)) {
+        throw CVulkanImageCreationException(CVulkanImageCreationError::IMAGE_UNSUPPORTED_FORMAT);
+    }
+
+    // Levels are stored back to back, largest first.
+    std::vector<uint64_t> fileOffsets(levelCount);
+    for(uint32_t i = 0; i < levelCount; i++) {
+        fileOffsets[i] = dataOffset;
+        uint64_t blocksWide = (std::max(extent.width >> i, 1u) + 3) / 4;
+        uint64_t blocksHigh = (std::max(extent.height >> i, 1u) + 3) / 4;
+        dataOffset += blocksWide * blocksHigh * GetBlockSize();
+    }
+    SetLevels(levelCount, fileOffsets, fileSize);
+}
+
+void CVulkanCompressedTexture::SetLevels(uint32_t levelCount, std::vector<uint64_t> fileOffsets, uint64_t fileSize) {
+    uint32_t fullChainLevels = 1;
+    while((std::max(extent.width, extent.height) >> fullChainLevels) > 0) {
+        fullChainLevels++;
+    }
+    if(extent.width == 0 || extent.height == 0 || levelCount > fullChainLevels) {
+        throw CVulkanImageCreationException(CVulkanImageCreationError::IMAGE_LOAD_FAILED);
+    }
+
+    levels.resize(levelCount);
+    for(uint32_t i = 0; i < levelCount; i++) {
+        CVulkanCompressedLevel& level = levels[i];
+        level.extent = vk::Extent3D(std::max(extent.width >> i, 1u), std::max(extent.height >> i, 1u), 1);
+        level.fileOffset = fileOffsets[i];
+        level.size = static_cast<vk::DeviceSize>((level.extent.width + 3) / 4) * ((level.extent.height + 3) / 4) * GetBlockSize();
+        if(level.fileOffset + level.size > fileSize) {
+            throw CVulkanImageCreationException(CVulkanImageCreationError::IMAGE_LOAD_FAILED);
+        }
+    }
+}
\ No newline at end of file
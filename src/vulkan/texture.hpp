@@ -0,0 +1,42 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include <string>
+#include <vector>
+
+// Where a mip level's blocks are stored in the container file.
+struct CVulkanCompressedLevel {
+    vk::Extent3D extent;
+    uint64_t fileOffset;
+    vk::DeviceSize size;
+};
+
+// KTX2 or DDS container holding a single 2D image with BC1/BC3/BC4/BC5/BC7 blocks. Only the header and level index are read
+// on construction, level data is read on demand so it can go straight to its destination.
+class CVulkanCompressedTexture {
+    std::string path;
+    vk::Format format;
+    vk::Extent3D extent;
+    std::vector<CVulkanCompressedLevel> levels;
+public:
+    // Throws IMAGE_LOAD_FAILED for unreadable or malformed files and IMAGE_UNSUPPORTED_FORMAT for anything other than the formats above.
+    CVulkanCompressedTexture(std::string path);
+    // True when path has a .ktx2 or .dds extension.
+    static bool IsContainerPath(std::string path);
+    vk::Format GetFormat();
+    // Uncompressed format DecodeLevel() produces, for devices that cannot sample GetFormat().
+    vk::Format GetDecodedFormat();
+    vk::Extent3D GetExtent();
+    uint32_t GetLevelCount();
+    vk::Extent3D GetLevelExtent(uint32_t level);
+    vk::DeviceSize GetLevelSize(uint32_t level);
+    vk::DeviceSize GetBlockSize();
+    // Reads the blocks of level unmodified into dst, which must hold GetLevelSize(level) bytes.
+    void ReadLevel(uint32_t level, void* dst);
+    // Reads level and transcodes it to tightly packed RGBA8.
+    std::vector<uint8_t> DecodeLevel(uint32_t level);
+private:
+    void ParseKtx2(std::vector<uint8_t>& header, uint64_t fileSize);
+    void ParseDds(std::vector<uint8_t>& header, uint64_t fileSize);
+    void SetLevels(uint32_t levelCount, std::vector<uint64_t> fileOffsets, uint64_t fileSize);
+};
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include "timer.hpp"
+
+#include <cstdio>
+#include "device.hpp"
+#include "queue.hpp"
+#include "cmd.hpp"
+
+CVulkanFrameTimer::CVulkanFrameTimer(CVulkanDevice* device, CVulkanQueue* queue, uint32_t framesInFlight, uint32_t reportInterval)
+    : device(device->GetVkDevice()), timestampPeriod(device->GetVkPhysicalDeviceProperties().limits.timestampPeriod), timestampMask(0),
+    queriesWritten(framesInFlight, false), reportInterval(reportInterval), gpuSampleCount(0) {
+    uint32_t validBits = device->GetVkQueueFamilyProperties(queue->GetFamilyIndex()).timestampValidBits;
+    if(validBits == 0) {
+        printf("CVulkanFrameTimer::CVulkanFrameTimer: Queue family has no timestamps, GPU times are not measured\n");
+        return;
+    }
+    timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+    queryPool = std::make_unique<vk::raii::QueryPool>(*this->device, vk::QueryPoolCreateInfo({}, vk::QueryType::eTimestamp, framesInFlight * 2));
+}
+
+void CVulkanFrameTimer::BeginFrame(uint32_t frameIndex) {
+    if(!queryPool || !queriesWritten[frameIndex]) {
+        return;
+    }
+    auto [result, timestamps] = queryPool->getResults<uint64_t>(frameIndex * 2, 2, 2 * sizeof(uint64_t), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+    if(result == vk::Result::eSuccess) {
+        uint64_t ticks = (timestamps[1] - timestamps[0]) & timestampMask;
+        totals.gpuMilliseconds += ticks * timestampPeriod / 1e6;
+        gpuSampleCount++;
+    }
+}
+
+void CVulkanFrameTimer::WriteBeginTimestamp(CVulkanCommandBuffer* commandBuffer, uint32_t frameIndex) {
+    if(!queryPool) {
+        return;
+    }
+    commandBuffer->ResetQueryPool(**queryPool, frameIndex * 2, 2);
+    commandBuffer->WriteTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, **queryPool, frameIndex * 2);
+}
+
+void CVulkanFrameTimer::WriteEndTimestamp(CVulkanCommandBuffer* commandBuffer, uint32_t frameIndex) {
+    if(!queryPool) {
+        return;
+    }
+    commandBuffer->WriteTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, **queryPool, frameIndex * 2 + 1);
+    queriesWritten[frameIndex] = true;
+}
+
+void CVulkanFrameTimer::EndFrame(double cpuMilliseconds, double waitMilliseconds, CVulkanBarrierStatistics barriers, CVulkanDrawStatistics draws) {
+    totals.frameCount++;
+    totals.cpuMilliseconds += cpuMilliseconds;
+    totals.waitMilliseconds += waitMilliseconds;
+    totals.barrierCount += barriers.barrierCount;
+    totals.barrierBatchCount += barriers.batchCount;
+    totals.skippedBarrierCount += barriers.skippedCount;
+    totals.drawCount += draws.drawCount;
+    totals.bindCount += draws.bindCount;
+    totals.skippedBindCount += draws.skippedBindCount;
+    totals.triangleCount += static_cast<double>(draws.triangleCount);
+    totals.recordingMilliseconds += draws.recordingMilliseconds;
+    if(reportInterval > 0 && totals.frameCount >= reportInterval) {
+        PrintStatistics();
+        totals = {};
+        gpuSampleCount = 0;
+    }
+}
+
+CVulkanFrameStatistics CVulkanFrameTimer::GetStatistics() {
+    CVulkanFrameStatistics averages;
+    averages.frameCount = totals.frameCount;
+    if(totals.frameCount > 0) {
+        averages.cpuMilliseconds = totals.cpuMilliseconds / totals.frameCount;
+        averages.waitMilliseconds = totals.waitMilliseconds / totals.frameCount;
+        averages.barrierCount = totals.barrierCount / totals.frameCount;
+        averages.barrierBatchCount = totals.barrierBatchCount / totals.frameCount;
+        averages.skippedBarrierCount = totals.skippedBarrierCount / totals.frameCount;
+        averages.drawCount = totals.drawCount / totals.frameCount;
+        averages.bindCount = totals.bindCount / totals.frameCount;
+        averages.skippedBindCount = totals.skippedBindCount / totals.frameCount;
+        averages.triangleCount = totals.triangleCount / totals.frameCount;
+        averages.recordingMilliseconds = totals.recordingMilliseconds / totals.frameCount;
+    }
+    if(gpuSampleCount > 0) {
+        averages.gpuMilliseconds = totals.gpuMilliseconds / gpuSampleCount;
+    }
+    return averages;
+}
+
+void CVulkanFrameTimer::PrintStatistics() {
+    CVulkanFrameStatistics averages = GetStatistics();
+    double frameMilliseconds = averages.cpuMilliseconds + averages.waitMilliseconds;
+    // Share of the frame the CPU spent doing work rather than waiting, 100% means the GPU never held it back.
+    double overlap = frameMilliseconds > 0.0 ? 100.0 * averages.cpuMilliseconds / frameMilliseconds : 0.0;
+    printf("CVulkanFrameTimer: %u frames, frame %.3f ms, cpu %.3f ms, wait %.3f ms, gpu %.3f ms, cpu busy %.1f%%\n", averages.frameCount,
+        frameMilliseconds, averages.cpuMilliseconds, averages.waitMilliseconds, averages.gpuMilliseconds, overlap);
+    printf("CVulkanFrameTimer: %.1f barriers in %.1f batches per frame, %.1f skipped\n", averages.barrierCount,
+        averages.barrierBatchCount, averages.skippedBarrierCount);
+    printf("CVulkanFrameTimer: %.1f draws, %.1f binds, %.1f skipped binds, %.0f triangles per frame, recorded in %.3f ms\n", averages.drawCount,
+        averages.bindCount, averages.skippedBindCount, averages.triangleCount, averages.recordingMilliseconds);
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include "barrier.hpp"
+#include "types.hpp"
+
+class CVulkanDevice;
+class CVulkanQueue;
+class CVulkanCommandBuffer;
+
+// Averages over the frames since the last report.
+struct CVulkanFrameStatistics {
+    uint32_t frameCount = 0;
+    double cpuMilliseconds = 0.0; // Recording and submitting, after the frame's fence signaled.
+    double waitMilliseconds = 0.0; // Blocked on the frame's fence and image acquisition.
+    double gpuMilliseconds = 0.0; // Between the timestamps around the frame's command buffer, 0 if the queue has no timestamps.
+    double barrierCount = 0.0; // Barrier structures and vkCmdPipelineBarrier2 calls recorded through the frame's barrier tracker.
+    double barrierBatchCount = 0.0;
+    double skippedBarrierCount = 0.0;
+    double drawCount = 0.0; // Draws and bind calls of the mesh renderer.
+    double bindCount = 0.0;
+    double skippedBindCount = 0.0;
+    double triangleCount = 0.0;
+    double recordingMilliseconds = 0.0; // Of the mesh renderer's draws, compare runs with --recording-threads.
+};
+
+// Measures how much of each frame the CPU spends waiting on the GPU. With frames pipelined the wait should be close
+// to zero whenever the GPU takes less time than the CPU.
+class CVulkanFrameTimer {
+    std::shared_ptr<vk::raii::Device> device;
+    std::unique_ptr<vk::raii::QueryPool> queryPool;
+    double timestampPeriod; // Nanoseconds per tick.
+    uint64_t timestampMask;
+    std::vector<bool> queriesWritten;
+    uint32_t reportInterval;
+    CVulkanFrameStatistics totals;
+    uint32_t gpuSampleCount;
+public:
+    // Prints the averages every reportInterval frames, 0 never prints.
+    CVulkanFrameTimer(CVulkanDevice* device, CVulkanQueue* queue, uint32_t framesInFlight, uint32_t reportInterval = 1000);
+    // Reads back the timestamps frameIndex wrote the last time it was used. Its fence must have signaled.
+    void BeginFrame(uint32_t frameIndex);
+    // Record these first and last in the frame's command buffer.
+    void WriteBeginTimestamp(CVulkanCommandBuffer* commandBuffer, uint32_t frameIndex);
+    void WriteEndTimestamp(CVulkanCommandBuffer* commandBuffer, uint32_t frameIndex);
+    void EndFrame(double cpuMilliseconds, double waitMilliseconds, CVulkanBarrierStatistics barriers = {}, CVulkanDrawStatistics draws = {});
+    CVulkanFrameStatistics GetStatistics();
+    void PrintStatistics();
+};
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "transform.hpp"
+
+#include <cstring>
+#include "device.hpp"
+#include "buffer.hpp"
+#include "descriptor.hpp"
+#include "types.hpp"
+
+CVulkanTransformBuffer::CVulkanTransformBuffer(CVulkanDevice* device, CVulkanDescriptorAllocator* descriptorAllocator, uint32_t framesInFlight)
+    : device(device), descriptorAllocator(descriptorAllocator), frames(framesInFlight) {
+    // The same layout the pipelines reading the set are created with.
+    descriptorLayout = device->GetDescriptorLayoutCache()->Get(GetDescriptorSetLayoutBindings(device));
+    vk::MemoryPropertyFlags hostVisible = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    for(auto& frame : frames) {
+        frame.camera = std::make_unique<CVulkanBuffer>(device->CreateBuffer(hostVisible, vk::BufferUsageFlagBits::eUniformBuffer, nullptr, sizeof(CVulkanCameraUniforms)));
+    }
+}
+
+CVulkanTransformBuffer::~CVulkanTransformBuffer() {}
+
+std::vector<vk::DescriptorSetLayoutBinding> CVulkanTransformBuffer::GetDescriptorSetLayoutBindings(CVulkanDevice* device) {
+    vk::ShaderStageFlags stages = vk::ShaderStageFlagBits::eVertex;
+    if(device->IsMeshShadingEnabled()) {
+        stages |= vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT;
+    }
+    return {
+        vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBuffer, 1, stages),
+        vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, stages),
+    };
+}
+
+uint32_t CVulkanTransformBuffer::Add(const glm::mat4& transform) {
+    uint32_t object = static_cast<uint32_t>(transforms.size());
+    transforms.push_back(transform);
+    for(auto& frame : frames) {
+        frame.dirtyObjects.push_back(object);
+    }
+    return object;
+}
+
+void CVulkanTransformBuffer::Set(uint32_t object, const glm::mat4& transform) {
+    transforms[object] = transform;
+    for(auto& frame : frames) {
+        frame.dirtyObjects.push_back(object);
+    }
+}
+
+const glm::mat4& CVulkanTransformBuffer::Get(uint32_t object) {
+    return transforms[object];
+}
+
+void CVulkanTransformBuffer::Resize(uint32_t count) {
+    uint32_t previousCount = GetCount();
+    transforms.resize(count, glm::mat4(1.0f));
+    for(auto& frame : frames) {
+        for(uint32_t object = previousCount; object < count; object++) {
+            frame.dirtyObjects.push_back(object);
+        }
+    }
+}
+
+void CVulkanTransformBuffer::Clear() {
+    transforms.clear();
+    for(auto& frame : frames) {
+        frame.dirtyObjects.clear();
+    }
+}
+
+uint32_t CVulkanTransformBuffer::GetCount() {
+    return static_cast<uint32_t>(transforms.size());
+}
+
+void CVulkanTransformBuffer::Upload(uint32_t frameIndex, const glm::mat4& viewProjection) {
+    FrameBuffers& frame = frames[frameIndex];
+    uint32_t objectCount = GetCount();
+    if(!frame.transforms || frame.capacity < objectCount) {
+        uint32_t capacity = MIN_OBJECT_CAPACITY;
+        while(capacity < objectCount) {
+            capacity *= 2;
+        }
+        frame.transforms = std::make_unique<CVulkanBuffer>(device->CreateBuffer(vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+            vk::BufferUsageFlagBits::eStorageBuffer, nullptr, sizeof(glm::mat4) * capacity));
+        frame.capacity = capacity;
+        frame.rewrite = true;
+    }
+    frame.descriptorSet = descriptorAllocator->Allocate(frameIndex, descriptorLayout);
+    descriptorAllocator->Write(frame.descriptorSet, descriptorLayout, {
+        vk::DescriptorBufferInfo(frame.camera->GetVkBuffer(), 0, VK_WHOLE_SIZE),
+        vk::DescriptorBufferInfo(frame.transforms->GetVkBuffer(), 0, VK_WHOLE_SIZE),
+    });
+
+    // The frame's fence has signaled, so the GPU is done with its copy.
+    CVulkanCameraUniforms camera = { viewProjection };
+    memcpy(frame.camera->GetMappedData(), &camera, sizeof(camera));
+    glm::mat4* mappedTransforms = static_cast<glm::mat4*>(frame.transforms->GetMappedData());
+    if(frame.rewrite || frame.dirtyObjects.size() >= objectCount) {
+        memcpy(mappedTransforms, transforms.data(), sizeof(glm::mat4) * objectCount);
+    } else {
+        for(auto object : frame.dirtyObjects) {
+            // Objects dropped by Resize() since they changed are skipped.
+            if(object < objectCount) {
+                mappedTransforms[object] = transforms[object];
+            }
+        }
+    }
+    frame.dirtyObjects.clear();
+    frame.rewrite = false;
+}
+
+vk::Buffer CVulkanTransformBuffer::GetVkBuffer(uint32_t frameIndex) {
+    return frames[frameIndex].transforms->GetVkBuffer();
+}
+
+vk::Buffer CVulkanTransformBuffer::GetVkCameraBuffer(uint32_t frameIndex) {
+    return frames[frameIndex].camera->GetVkBuffer();
+}
+
+vk::DescriptorSet CVulkanTransformBuffer::GetVkDescriptorSet(uint32_t frameIndex) {
+    return frames[frameIndex].descriptorSet;
+}
\ No newline at end of file
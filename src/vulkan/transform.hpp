@@ -0,0 +1,59 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+class CVulkanDevice;
+class CVulkanBuffer;
+class CVulkanDescriptorLayout;
+class CVulkanDescriptorAllocator;
+
+// World transforms of objects in a storage buffer indexed by object, next to the camera uniform block in one descriptor
+// set that shaders/vertex.vert reads as set 0. Every frame in flight has its own persistently mapped copy. Objects keep
+// their index and only the ones changed since a frame last wrote its copy are written again, so nothing is uploaded per
+// object or per draw and a frame costs as much as the objects that changed in it.
+class CVulkanTransformBuffer {
+    // Host visible and written by the CPU, so every frame in flight has its own copy.
+    struct FrameBuffers {
+        std::unique_ptr<CVulkanBuffer> camera; // CVulkanCameraUniforms.
+        std::unique_ptr<CVulkanBuffer> transforms;
+        vk::DescriptorSet descriptorSet; // Allocated again by every Upload().
+        uint32_t capacity = 0; // Objects the buffer holds, 0 until it is created.
+        std::vector<uint32_t> dirtyObjects; // Changed since the frame last wrote its copy.
+        bool rewrite = false; // Every object is written, the buffer is new.
+    };
+
+    CVulkanDevice* device;
+    CVulkanDescriptorAllocator* descriptorAllocator;
+    CVulkanDescriptorLayout* descriptorLayout;
+    std::vector<glm::mat4> transforms;
+    std::vector<FrameBuffers> frames;
+public:
+    static constexpr uint32_t MIN_OBJECT_CAPACITY = 1024;
+
+    // Descriptor sets are allocated from the frame's pools of descriptorAllocator.
+    CVulkanTransformBuffer(CVulkanDevice* device, CVulkanDescriptorAllocator* descriptorAllocator, uint32_t framesInFlight);
+    ~CVulkanTransformBuffer();
+    // The camera on binding 0 and the transforms on binding 1, for the vertex stage and the task and mesh stages when
+    // CVulkanDevice::IsMeshShadingEnabled(). Pipelines reading GetVkDescriptorSet() are created with these as set 0.
+    static std::vector<vk::DescriptorSetLayoutBinding> GetDescriptorSetLayoutBindings(CVulkanDevice* device);
+    // Returns the object index.
+    uint32_t Add(const glm::mat4& transform);
+    void Set(uint32_t object, const glm::mat4& transform);
+    const glm::mat4& Get(uint32_t object);
+    // Drops the objects from count on or adds identity transforms up to it.
+    void Resize(uint32_t count);
+    void Clear();
+    uint32_t GetCount();
+    // Writes viewProjection and the changed objects into the copy of frameIndex, whose fence must have signaled, and
+    // allocates its descriptor set after CVulkanDescriptorAllocator::BeginFrame(). The copy may be recreated to hold more
+    // objects, so sets referring to GetVkBuffer() are written every frame.
+    void Upload(uint32_t frameIndex, const glm::mat4& viewProjection);
+    // Valid after the first Upload() of frameIndex.
+    vk::Buffer GetVkBuffer(uint32_t frameIndex);
+    vk::Buffer GetVkCameraBuffer(uint32_t frameIndex);
+    // Valid from Upload() of frameIndex until the next CVulkanDescriptorAllocator::BeginFrame() of it.
+    vk::DescriptorSet GetVkDescriptorSet(uint32_t frameIndex);
+};
\ No newline at end of file
@@ -3,20 +3,29 @@
 #include <vulkan/vulkan_raii.hpp>
 #include <glm/glm.hpp>
 
-// Vertex Properties.
+// Vertex Properties, at full precision. Vertex buffers hold them encoded with a CVulkanVertexLayout.
 struct CVulkanVertex {
-    glm::vec2 position;
+    glm::vec3 position;
     glm::vec3 color;
+    glm::vec3 normal = glm::vec3(0.0f, 0.0f, 1.0f);
+    glm::vec2 uv = glm::vec2(0.0f);
+};
+
+// Per instance vertex data, read from binding 1 once per instance. Transforms live in CVulkanTransformBuffer and materials
+// in CVulkanBindlessHeap, instances only carry indices into them so that they stay small however many objects there are.
+struct CVulkanInstance {
+    uint32_t object;
+    uint32_t material = 0; // CVulkanMaterial::handle, 0 is the default material.
 
     static std::vector<vk::VertexInputAttributeDescription> GetVkVertexInputAttributeDescriptions() {
         return {
-            vk::VertexInputAttributeDescription(0, 0, vk::Format::eR32G32Sfloat, offsetof(CVulkanVertex, position)),
-            vk::VertexInputAttributeDescription(1, 0, vk::Format::eR32G32B32Sfloat, offsetof(CVulkanVertex, color)),
+            vk::VertexInputAttributeDescription(2, 1, vk::Format::eR32Uint, offsetof(CVulkanInstance, object)),
+            vk::VertexInputAttributeDescription(3, 1, vk::Format::eR32Uint, offsetof(CVulkanInstance, material)),
         };
     }
 
     static vk::VertexInputBindingDescription GetVkVertexInputBindingDecription() {
-        return vk::VertexInputBindingDescription(0, sizeof(CVulkanVertex), vk::VertexInputRate::eVertex);
+        return vk::VertexInputBindingDescription(1, sizeof(CVulkanInstance), vk::VertexInputRate::eInstance);
     }
 };
 
@@ -24,10 +33,24 @@ struct CVulkanVertex {
 struct CVulkanMaterial {
     float roughness;
     float metallic;
+    bool transparent = false; // Drawn after opaque geometry, back to front.
+    glm::vec4 baseColor = glm::vec4(1.0f);
+    uint32_t baseColorTexture = ~0u; // Bindless handle of the image from CVulkanImageLoader, ~0u for none.
+    uint32_t handle = ~0u; // Index in the material buffer set by CVulkanBindlessHeap::AddMaterial(), ~0u until it is added.
+};
+
+// A material as shaders/material.frag reads it from the material buffer.
+struct CVulkanMaterialData {
+    glm::vec4 baseColor;
+    uint32_t baseColorTexture;
+    float roughness;
+    float metallic;
+    uint32_t padding;
 };
 
-struct CVulkanPushConstants {
-    glm::mat4 modelViewProjection;
+// Camera uniform block on binding 0 of the CVulkanTransformBuffer set, shared by every object of a frame.
+struct CVulkanCameraUniforms {
+    glm::mat4 viewProjection;
 };
 
 // Data used every frame.
@@ -49,13 +72,51 @@ struct CVulkanRender {
     std::vector<vk::RenderingAttachmentInfo> stencilAttachments;
 };
 
-// Data passed in for draw settings.
+// Data passed in for draw settings. Bindings equal to the ones of the previous draw in the same command buffer are skipped.
 struct CVulkanDraw {
     vk::Pipeline pipeline;
+    vk::PipelineLayout pipelineLayout; // Only needed for descriptor sets and push constants.
+    std::vector<vk::DescriptorSet> descriptorSets; // Bound from set 0.
+    vk::ShaderStageFlags pushConstantStages;
+    std::vector<uint8_t> pushConstants; // Written from offset 0.
     uint32_t verticesCount;
     std::vector<vk::Buffer> vertexBuffers;
     std::vector<vk::DeviceSize> vertexBufferOffsets;
     uint32_t indicesCount;
+    uint32_t firstIndex = 0;
     vk::Buffer indexBuffer;
     vk::DeviceSize indexBufferOffset;
+    vk::IndexType indexType = vk::IndexType::eUint16;
+    uint32_t instanceCount = 1;
+    uint32_t firstInstance = 0;
+    // When set, draw parameters are read from VkDrawIndexedIndirectCommands in indirectBuffer instead, and up to maxDrawCount
+    // of them are drawn as given by the uint32_t in countBuffer. Needs indexBuffer.
+    vk::Buffer indirectBuffer;
+    vk::DeviceSize indirectBufferOffset = 0;
+    vk::Buffer countBuffer;
+    vk::DeviceSize countBufferOffset = 0;
+    uint32_t maxDrawCount = 0;
+    // When set, this many task shader workgroups are launched instead, vertex and index buffers are ignored.
+    uint32_t taskGroupCountX = 0;
+    uint32_t taskGroupCountY = 1;
+};
+
+// Data passed in for compute dispatches. Nothing is cached between dispatches.
+struct CVulkanDispatch {
+    vk::Pipeline pipeline;
+    vk::PipelineLayout pipelineLayout;
+    std::vector<vk::DescriptorSet> descriptorSets; // Bound from set 0.
+    std::vector<uint8_t> pushConstants; // Written from offset 0 for the compute stage.
+    uint32_t groupCountX = 1;
+    uint32_t groupCountY = 1;
+    uint32_t groupCountZ = 1;
+};
+
+// Bind calls a command buffer issued and skipped because the state was already bound.
+struct CVulkanDrawStatistics {
+    uint32_t drawCount = 0;
+    uint32_t bindCount = 0;
+    uint32_t skippedBindCount = 0;
+    uint64_t triangleCount = 0; // Of direct draws only, indirect ones are counted on the GPU.
+    double recordingMilliseconds = 0.0; // Wall clock of recording the draws of the mesh renderer, across all its threads.
 };
\ No newline at end of file
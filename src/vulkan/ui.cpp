@@ -11,11 +11,12 @@
 #include "queue.hpp"
 #include "cmd.hpp"
 #include "image.hpp"
+#include "descriptor.hpp"
 #include "types.hpp"
 
 CVulkanUi::CVulkanUi(SDL_Window* window, CVulkanInstance* instance, CVulkanDevice* device, 
     CVulkanQueue* queue, CVulkanCommandPool* commandPool, std::vector<std::shared_ptr<CVulkanCommandBuffer>> commandBuffers, 
-    uint32_t imageCount, vk::Format colorFormat)
+    uint32_t imageCount, vk::Format colorFormat, CVulkanDescriptorAllocator* descriptorAllocator)
     : window(window), instance(instance), device(device), queue(queue), commandPool(commandPool), commandBuffers(commandBuffers) {
     auto vkInstance = instance->GetVkInstance();
     auto vkPhysicalDevice = device->GetVkPhysicalDevice();
@@ -23,17 +24,6 @@ CVulkanUi::CVulkanUi(SDL_Window* window, CVulkanInstance* instance, CVulkanDevic
     auto vkQueue = queue->GetVkQueue();
     auto queueFamily = queue->GetFamilyIndex();
 
-    std::vector<vk::DescriptorPoolSize> descriptorPoolSizes = {
-        { vk::DescriptorType::eCombinedImageSampler, 1 },
-    };
-
-    vk::DescriptorPoolCreateInfo descriptorPoolInfo;
-    descriptorPoolInfo.setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet);
-    descriptorPoolInfo.setMaxSets(1);
-    descriptorPoolInfo.setPoolSizes(descriptorPoolSizes);
-
-    descriptorPool = std::make_unique<vk::raii::DescriptorPool>(vkDevice->createDescriptorPool(descriptorPoolInfo));
-
     ImGui::CreateContext();
     ImGui::StyleColorsDark();
 
@@ -55,7 +45,8 @@ CVulkanUi::CVulkanUi(SDL_Window* window, CVulkanInstance* instance, CVulkanDevic
     imguiVulkanInitInfo.Queue = **vkQueue;
     imguiVulkanInitInfo.QueueFamily = queueFamily;
     imguiVulkanInitInfo.PipelineCache = nullptr;
-    imguiVulkanInitInfo.DescriptorPool = **descriptorPool;
+    // ImGui frees its sets itself, so it gets the pool that allows that.
+    imguiVulkanInitInfo.DescriptorPool = descriptorAllocator->GetVkLibraryPool();
     imguiVulkanInitInfo.Subpass = 0;
     imguiVulkanInitInfo.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
     imguiVulkanInitInfo.MinImageCount = imageCount;
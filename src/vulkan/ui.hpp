@@ -9,6 +9,7 @@ class CVulkanQueue;
 class CVulkanCommandPool;
 class CVulkanCommandBuffer;
 class CVulkanImage;
+class CVulkanDescriptorAllocator;
 struct CVulkanFrame;
 
 class CVulkanUi {
@@ -20,11 +21,10 @@ class CVulkanUi {
     std::vector<std::shared_ptr<CVulkanCommandBuffer>> commandBuffers;
     vk::Viewport viewport;
     vk::Extent2D viewportExtent;
-    std::unique_ptr<vk::raii::DescriptorPool> descriptorPool = nullptr;
 public:
     CVulkanUi(SDL_Window* window, CVulkanInstance* instance, CVulkanDevice* device, CVulkanQueue* queue,
         CVulkanCommandPool* commandPool, std::vector<std::shared_ptr<CVulkanCommandBuffer>> commandBuffers,
-        uint32_t imageCount, vk::Format colorFormat);
+        uint32_t imageCount, vk::Format colorFormat, CVulkanDescriptorAllocator* descriptorAllocator);
     ~CVulkanUi();
     void Draw(CVulkanFrame* frame);
 };
\ No newline at end of file
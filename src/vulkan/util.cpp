@@ -9,5 +9,5 @@ uint32_t GetMemoryTypeIndex(vk::PhysicalDeviceMemoryProperties memoryProperties,
         }
         memoryTypeBits >>= 1;
     }
-    return -1;
+    return INVALID_MEMORY_TYPE_INDEX;
 }
@@ -1,4 +1,7 @@
 #pragma once
 #include <vulkan/vulkan.hpp>
 
+constexpr uint32_t INVALID_MEMORY_TYPE_INDEX = ~0u;
+
+// Returns INVALID_MEMORY_TYPE_INDEX when no allowed memory type has the desired properties.
 uint32_t GetMemoryTypeIndex(vk::PhysicalDeviceMemoryProperties memoryProperties, uint32_t memoryTypeBits, vk::MemoryPropertyFlags desiredPropertyFlags);
\ No newline at end of file
@@ -0,0 +1,259 @@
+#include "vertexformat.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+// Bytes an attribute of the given number of components takes with encoding.
+static uint32_t GetEncodedSize(CVulkanVertexEncoding encoding, uint32_t components) {
+    switch(encoding) {
+    case VERTEX_ENCODING_NONE:
+        return 0;
+    case VERTEX_ENCODING_FLOAT32:
+        return sizeof(float) * components;
+    case VERTEX_ENCODING_FLOAT16:
+        return components > 2 ? 8 : 4; // 3 components are padded to 4, there is no aligned 3 component half format.
+    default:
+        return 4; // Every other encoding packs into 32 bits.
+    }
+}
+
+static vk::Format GetVkFormat(CVulkanVertexEncoding encoding, uint32_t components) {
+    switch(encoding) {
+    case VERTEX_ENCODING_FLOAT16:
+        return components > 2 ? vk::Format::eR16G16B16A16Sfloat : vk::Format::eR16G16Sfloat;
+    case VERTEX_ENCODING_OCT_SNORM16:
+        return vk::Format::eR16G16Snorm;
+    case VERTEX_ENCODING_UNORM16:
+        return vk::Format::eR16G16Unorm;
+    case VERTEX_ENCODING_UNORM8:
+        return vk::Format::eR8G8B8A8Unorm;
+    default:
+        return components == 2 ? vk::Format::eR32G32Sfloat : vk::Format::eR32G32B32Sfloat;
+    }
+}
+
+CVulkanVertexLayout::CVulkanVertexLayout(CVulkanVertexEncoding position, CVulkanVertexEncoding normal, CVulkanVertexEncoding uv, CVulkanVertexEncoding color)
+    : position(position), normal(normal), uv(uv), color(color) {
+    if(position != VERTEX_ENCODING_FLOAT32 && position != VERTEX_ENCODING_FLOAT16) {
+        printf("CVulkanVertexLayout::CVulkanVertexLayout: Unsupported position encoding %d\n", position);
+        this->position = VERTEX_ENCODING_FLOAT32;
+    }
+    if(normal != VERTEX_ENCODING_NONE && normal != VERTEX_ENCODING_FLOAT32 && normal != VERTEX_ENCODING_OCT_SNORM16) {
+        printf("CVulkanVertexLayout::CVulkanVertexLayout: Unsupported normal encoding %d\n", normal);
+        this->normal = VERTEX_ENCODING_FLOAT32;
+    }
+    if(uv != VERTEX_ENCODING_NONE && uv != VERTEX_ENCODING_FLOAT32 && uv != VERTEX_ENCODING_FLOAT16 && uv != VERTEX_ENCODING_UNORM16) {
+        printf("CVulkanVertexLayout::CVulkanVertexLayout: Unsupported UV encoding %d\n", uv);
+        this->uv = VERTEX_ENCODING_FLOAT32;
+    }
+    if(color != VERTEX_ENCODING_FLOAT32 && color != VERTEX_ENCODING_UNORM8) {
+        printf("CVulkanVertexLayout::CVulkanVertexLayout: Unsupported color encoding %d\n", color);
+        this->color = VERTEX_ENCODING_FLOAT32;
+    }
+
+    // Every size is a multiple of 4, so attributes stay aligned.
+    positionOffset = 0;
+    colorOffset = positionOffset + GetEncodedSize(this->position, 3);
+    normalOffset = colorOffset + GetEncodedSize(this->color, 3);
+    uvOffset = normalOffset + GetEncodedSize(this->normal, 3);
+    stride = uvOffset + GetEncodedSize(this->uv, 2);
+}
+
+CVulkanVertexLayout CVulkanVertexLayout::Full() {
+    return CVulkanVertexLayout(VERTEX_ENCODING_FLOAT32, VERTEX_ENCODING_FLOAT32, VERTEX_ENCODING_FLOAT32, VERTEX_ENCODING_FLOAT32);
+}
+
+CVulkanVertexLayout CVulkanVertexLayout::Compact() {
+    return CVulkanVertexLayout(VERTEX_ENCODING_FLOAT16, VERTEX_ENCODING_OCT_SNORM16, VERTEX_ENCODING_FLOAT16, VERTEX_ENCODING_UNORM8);
+}
+
+uint32_t CVulkanVertexLayout::GetStride() const {
+    return stride;
+}
+
+std::vector<vk::VertexInputAttributeDescription> CVulkanVertexLayout::GetVkVertexInputAttributeDescriptions(uint32_t binding) const {
+    std::vector<vk::VertexInputAttributeDescription> descriptions = {
+        vk::VertexInputAttributeDescription(POSITION_LOCATION, binding, GetVkFormat(position, 3), positionOffset),
+        vk::VertexInputAttributeDescription(COLOR_LOCATION, binding, GetVkFormat(color, 3), colorOffset),
+    };
+    if(normal != VERTEX_ENCODING_NONE) {
+        descriptions.push_back(vk::VertexInputAttributeDescription(NORMAL_LOCATION, binding, GetVkFormat(normal, 3), normalOffset));
+    }
+    if(uv != VERTEX_ENCODING_NONE) {
+        descriptions.push_back(vk::VertexInputAttributeDescription(UV_LOCATION, binding, GetVkFormat(uv, 2), uvOffset));
+    }
+    return descriptions;
+}
+
+vk::VertexInputBindingDescription CVulkanVertexLayout::GetVkVertexInputBindingDescription(uint32_t binding) const {
+    return vk::VertexInputBindingDescription(binding, stride, vk::VertexInputRate::eVertex);
+}
+
+glm::vec4 CVulkanVertexLayout::GetPositionDequantization(const std::vector<CVulkanVertex>& vertices) const {
+    if(position != VERTEX_ENCODING_FLOAT16 || vertices.empty()) {
+        return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+    glm::vec3 minimum = vertices.front().position;
+    glm::vec3 maximum = vertices.front().position;
+    for(auto& vertex : vertices) {
+        minimum = glm::min(minimum, vertex.position);
+        maximum = glm::max(maximum, vertex.position);
+    }
+    glm::vec3 center = (minimum + maximum) * 0.5f;
+    glm::vec3 extent = (maximum - minimum) * 0.5f;
+    float scale = std::max(extent.x, std::max(extent.y, extent.z));
+    return glm::vec4(center, scale > 0.0f ? scale : 1.0f);
+}
+
+void CVulkanVertexLayout::Encode(const std::vector<CVulkanVertex>& vertices, glm::vec4 positionDequantization, std::vector<uint8_t>& buffer) const {
+    size_t start = buffer.size();
+    buffer.resize(start + static_cast<size_t>(stride) * vertices.size());
+    glm::vec3 positionOffset3 = glm::vec3(positionDequantization);
+    float inverseScale = 1.0f / positionDequantization.w;
+    for(size_t i = 0; i < vertices.size(); i++) {
+        const CVulkanVertex& vertex = vertices[i];
+        uint8_t* data = buffer.data() + start + i * stride;
+        if(position == VERTEX_ENCODING_FLOAT16) {
+            // The padding half is 1, so the position reads as a point when all 4 components are fetched.
+            glm::vec3 scaled = (vertex.position - positionOffset3) * inverseScale;
+            uint32_t packed[2] = { glm::packHalf2x16(glm::vec2(scaled.x, scaled.y)), glm::packHalf2x16(glm::vec2(scaled.z, 1.0f)) };
+            memcpy(data + positionOffset, packed, sizeof(packed));
+        } else {
+            memcpy(data + positionOffset, &vertex.position, sizeof(vertex.position));
+        }
+        if(color == VERTEX_ENCODING_UNORM8) {
+            uint32_t packed = glm::packUnorm4x8(glm::vec4(vertex.color, 1.0f));
+            memcpy(data + colorOffset, &packed, sizeof(packed));
+        } else {
+            memcpy(data + colorOffset, &vertex.color, sizeof(vertex.color));
+        }
+        if(normal == VERTEX_ENCODING_OCT_SNORM16) {
+            uint32_t packed = glm::packSnorm2x16(EncodeOctahedral(vertex.normal));
+            memcpy(data + normalOffset, &packed, sizeof(packed));
+        } else if(normal == VERTEX_ENCODING_FLOAT32) {
+            memcpy(data + normalOffset, &vertex.normal, sizeof(vertex.normal));
+        }
+        if(uv == VERTEX_ENCODING_FLOAT16) {
+            uint32_t packed = glm::packHalf2x16(vertex.uv);
+            memcpy(data + uvOffset, &packed, sizeof(packed));
+        } else if(uv == VERTEX_ENCODING_UNORM16) {
+            uint32_t packed = glm::packUnorm2x16(vertex.uv);
+            memcpy(data + uvOffset, &packed, sizeof(packed));
+        } else if(uv == VERTEX_ENCODING_FLOAT32) {
+            memcpy(data + uvOffset, &vertex.uv, sizeof(vertex.uv));
+        }
+    }
+}
+
+CVulkanVertex CVulkanVertexLayout::Decode(const uint8_t* data, size_t index, glm::vec4 positionDequantization) const {
+    data += index * stride;
+    CVulkanVertex vertex;
+    uint32_t packed;
+    if(position == VERTEX_ENCODING_FLOAT16) {
+        uint32_t packedPosition[2];
+        memcpy(packedPosition, data + positionOffset, sizeof(packedPosition));
+        glm::vec3 scaled(glm::unpackHalf2x16(packedPosition[0]), glm::unpackHalf2x16(packedPosition[1]).x);
+        vertex.position = glm::vec3(positionDequantization) + scaled * positionDequantization.w;
+    } else {
+        memcpy(&vertex.position, data + positionOffset, sizeof(vertex.position));
+    }
+    if(color == VERTEX_ENCODING_UNORM8) {
+        memcpy(&packed, data + colorOffset, sizeof(packed));
+        vertex.color = glm::vec3(glm::unpackUnorm4x8(packed));
+    } else {
+        memcpy(&vertex.color, data + colorOffset, sizeof(vertex.color));
+    }
+    if(normal == VERTEX_ENCODING_OCT_SNORM16) {
+        memcpy(&packed, data + normalOffset, sizeof(packed));
+        vertex.normal = DecodeOctahedral(glm::unpackSnorm2x16(packed));
+    } else if(normal == VERTEX_ENCODING_FLOAT32) {
+        memcpy(&vertex.normal, data + normalOffset, sizeof(vertex.normal));
+    }
+    if(uv == VERTEX_ENCODING_FLOAT16) {
+        memcpy(&packed, data + uvOffset, sizeof(packed));
+        vertex.uv = glm::unpackHalf2x16(packed);
+    } else if(uv == VERTEX_ENCODING_UNORM16) {
+        memcpy(&packed, data + uvOffset, sizeof(packed));
+        vertex.uv = glm::unpackUnorm2x16(packed);
+    } else if(uv == VERTEX_ENCODING_FLOAT32) {
+        memcpy(&vertex.uv, data + uvOffset, sizeof(vertex.uv));
+    }
+    return vertex;
+}
+
+glm::vec2 CVulkanVertexLayout::EncodeOctahedral(glm::vec3 normal) {
+    float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if(length == 0.0f) {
+        return glm::vec2(0.0f);
+    }
+    glm::vec2 encoded = glm::vec2(normal) / length;
+    if(normal.z < 0.0f) {
+        // The lower half is folded over the diagonals.
+        glm::vec2 folded = 1.0f - glm::abs(glm::vec2(encoded.y, encoded.x));
+        encoded = glm::vec2(encoded.x >= 0.0f ? folded.x : -folded.x, encoded.y >= 0.0f ? folded.y : -folded.y);
+    }
+    return encoded;
+}
+
+glm::vec3 CVulkanVertexLayout::DecodeOctahedral(glm::vec2 encoded) {
+    glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+    float fold = std::max(-normal.z, 0.0f);
+    normal.x += normal.x >= 0.0f ? -fold : fold;
+    normal.y += normal.y >= 0.0f ? -fold : fold;
+    return glm::normalize(normal);
+}
+
+bool CVulkanVertexLayout::RunErrorTest(size_t count) {
+    constexpr float UV_RANGE = 4.0f;
+    // Positions away from the origin, so the dequantization offset matters, and deepest along z, so z sets the scale.
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> coordinate(-50.0f, 150.0f);
+    std::uniform_real_distribution<float> depth(-300.0f, 500.0f);
+    std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::uniform_real_distribution<float> tiledUV(-UV_RANGE, UV_RANGE); // Tiling and mirrored UVs leave [0, 1].
+    std::vector<CVulkanVertex> vertices(count);
+    for(auto& vertex : vertices) {
+        vertex.position = glm::vec3(coordinate(random), coordinate(random), depth(random));
+        vertex.color = glm::vec3(unit(random), unit(random), unit(random));
+        do {
+            vertex.normal = glm::vec3(direction(random), direction(random), direction(random));
+        } while(glm::length(vertex.normal) < 0.01f);
+        vertex.normal = glm::normalize(vertex.normal);
+        vertex.uv = glm::vec2(tiledUV(random), tiledUV(random));
+    }
+
+    CVulkanVertexLayout layout = Compact();
+    glm::vec4 dequantization = layout.GetPositionDequantization(vertices);
+    std::vector<uint8_t> encoded;
+    layout.Encode(vertices, dequantization, encoded);
+
+    // Half of the last step of each encoding, positions and normals also allow for the float math around them.
+    float positionBound = dequantization.w / 4096.0f + 4.0f * FLT_EPSILON * (glm::length(glm::vec3(dequantization)) + dequantization.w);
+    float normalBound = 1e-4f;
+    float uvBound = UV_RANGE / 4096.0f; // Half of a half float step just below UV_RANGE, a power of 2.
+    float colorBound = 0.5f / 255.0f + FLT_EPSILON;
+    float positionError = 0.0f;
+    float normalError = 0.0f;
+    float uvError = 0.0f;
+    float colorError = 0.0f;
+    for(size_t i = 0; i < count; i++) {
+        CVulkanVertex decoded = layout.Decode(encoded.data(), i, dequantization);
+        glm::vec3 positionDifference = glm::abs(decoded.position - vertices[i].position);
+        glm::vec2 uvDifference = glm::abs(decoded.uv - vertices[i].uv);
+        glm::vec3 colorDifference = glm::abs(decoded.color - vertices[i].color);
+        positionError = std::max(positionError, std::max(positionDifference.x, std::max(positionDifference.y, positionDifference.z)));
+        normalError = std::max(normalError, glm::length(decoded.normal - vertices[i].normal)); // Chord length, close to the angle.
+        uvError = std::max(uvError, std::max(uvDifference.x, uvDifference.y));
+        colorError = std::max(colorError, std::max(colorDifference.x, std::max(colorDifference.y, colorDifference.z)));
+    }
+
+    bool passed = positionError <= positionBound && normalError <= normalBound && uvError <= uvBound && colorError <= colorBound;
+    printf("CVulkanVertexLayout::RunErrorTest: %zu vertices, %u instead of %u bytes each\n", count, layout.GetStride(), Full().GetStride());
+    printf("CVulkanVertexLayout::RunErrorTest: position %g (bound %g), normal %g (bound %g), UV %g (bound %g), color %g (bound %g), %s\n",
+        positionError, positionBound, normalError, normalBound, uvError, uvBound, colorError, colorBound, passed ? "passed" : "FAILED");
+    return passed;
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <glm/glm.hpp>
+#include <vector>
+#include "types.hpp"
+
+// How a vertex attribute is stored in vertex buffers.
+enum CVulkanVertexEncoding {
+    VERTEX_ENCODING_NONE, // Left out, only normals and UVs may be.
+    VERTEX_ENCODING_FLOAT32,
+    VERTEX_ENCODING_FLOAT16, // Positions, scaled into [-1, 1] by the mesh's position dequantization, and UVs as they are.
+    VERTEX_ENCODING_OCT_SNORM16, // Normals, mapped onto an octahedron and unfolded into 2 components.
+    VERTEX_ENCODING_UNORM16, // UVs, clamped to [0, 1] so only for meshes that do not tile their textures.
+    VERTEX_ENCODING_UNORM8 // Colors, clamped to [0, 1] with an alpha of 1.
+};
+
+// Encodings of the attributes of CVulkanVertex in a vertex buffer, and the vertex input state reading them.
+// Everything but oct encoded normals is expanded by the vertex input stage, those are decoded with DecodeOctahedral().
+class CVulkanVertexLayout {
+    CVulkanVertexEncoding position;
+    CVulkanVertexEncoding normal;
+    CVulkanVertexEncoding uv;
+    CVulkanVertexEncoding color;
+    uint32_t positionOffset;
+    uint32_t normalOffset;
+    uint32_t uvOffset;
+    uint32_t colorOffset;
+    uint32_t stride;
+public:
+    // Locations 2 and 3 are taken by CVulkanInstance, 4 and 5 are free.
+    static constexpr uint32_t POSITION_LOCATION = 0;
+    static constexpr uint32_t COLOR_LOCATION = 1;
+    static constexpr uint32_t NORMAL_LOCATION = 6;
+    static constexpr uint32_t UV_LOCATION = 7;
+
+    // Encodings an attribute does not support fall back to VERTEX_ENCODING_FLOAT32.
+    CVulkanVertexLayout(CVulkanVertexEncoding position, CVulkanVertexEncoding normal, CVulkanVertexEncoding uv, CVulkanVertexEncoding color);
+    // 32 bit floats throughout, 44 bytes per vertex.
+    static CVulkanVertexLayout Full();
+    // Half positions, oct encoded normals, half UVs and 8 bit colors, 20 bytes per vertex. Half UVs keep tiling and
+    // out of range UVs, with 11 bits of precision relative to their magnitude.
+    static CVulkanVertexLayout Compact();
+    uint32_t GetStride() const;
+    std::vector<vk::VertexInputAttributeDescription> GetVkVertexInputAttributeDescriptions(uint32_t binding) const;
+    vk::VertexInputBindingDescription GetVkVertexInputBindingDescription(uint32_t binding) const;
+    // Offset in xyz and uniform scale in w that take encoded positions back to model space, identity unless positions are
+    // VERTEX_ENCODING_FLOAT16. The scale is uniform so bounding spheres stay spheres.
+    glm::vec4 GetPositionDequantization(const std::vector<CVulkanVertex>& vertices) const;
+    // Appends vertices encoded with this layout to buffer.
+    void Encode(const std::vector<CVulkanVertex>& vertices, glm::vec4 positionDequantization, std::vector<uint8_t>& buffer) const;
+    // The vertex at index of an encoded buffer, as the vertex input stage would read it.
+    CVulkanVertex Decode(const uint8_t* data, size_t index, glm::vec4 positionDequantization) const;
+    static glm::vec2 EncodeOctahedral(glm::vec3 normal);
+    static glm::vec3 DecodeOctahedral(glm::vec2 encoded);
+    // Encodes count random vertices with Compact(), checks every decoded attribute against the error bound of its encoding
+    // and prints the largest errors. Returns false if one is exceeded.
+    static bool RunErrorTest(size_t count);
+};
\ No newline at end of file